@@ -52,7 +52,16 @@
 #ifdef HAVE_OPENSSL_RAND_H
 #include <openssl/rand.h>
 #endif
+#include <openssl/pem.h>
 #include <signal.h>
+#ifdef UB_ON_WINDOWS
+#include <io.h>
+#include <fcntl.h>
+#endif
+#ifndef USE_WINSOCK
+#include <sys/un.h>
+#include <fcntl.h>
+#endif
 #include "riggerd/log.h"
 #include "riggerd/cfg.h"
 #include "riggerd/net_help.h"
@@ -66,6 +75,10 @@ usage()
 	printf("Options:\n");
 	printf("  -c file	config file, default is %s\n", CONFIGFILE);
 	printf("  -s ip[@port]	server address, if omitted config is used.\n");
+#ifndef USE_WINSOCK
+	printf("  -u file	control socket, if omitted control-socket from\n");
+	printf("		config is used, and TLS if it cannot connect.\n");
+#endif
 	printf("  -h		show this usage help.\n");
 	printf("Commands:\n");
 	printf("  submit <ips>	submit a list of DHCP provided DNS servers,\n");
@@ -81,8 +94,15 @@ usage()
 	printf("  test_http	test option that pretends that http fails\n");
 	printf("  test_update	software update to the unstable test version\n");
 	printf("  results	continuous feed of probe results\n");
+	printf("  dump_trace	binary dump of the probe flight recorder,\n");
+	printf("		print it with dnssec-trigger-trace\n");
+	printf("  memstats	memory in use per subsystem, and the peaks\n");
+	printf("  profile [on|off|reset]  time per event loop callback,\n");
+	printf("		the loop iteration histogram and the stalls\n");
 	printf("  cmdtray	command channel for gui panel\n");
 	printf("  stoppanels	connected panels quit (for installers)\n");
+	printf("  session	read commands from stdin, one per line, and\n");
+	printf("		pipeline them on one connection\n");
 	printf("  stop		stop the daemon\n");
 	printf("Version %s\n", PACKAGE_VERSION);
 	printf("BSD licensed, see LICENSE in source package for details.\n");
@@ -106,19 +126,193 @@ static RETSIGTYPE sigh(int ATTR_UNUSED(sig))
 	}
 }
 
+/** the connection to the server, TLS, or plain on the control socket */
+struct conn {
+	/** the SSL, or NULL for the control socket */
+	SSL* ssl;
+	/** the file descriptor */
+	int fd;
+};
+
+/** write to the server, exit on failure */
+static void
+conn_write(struct conn* c, const char* s, size_t len)
+{
+#ifndef USE_WINSOCK
+	ssize_t r;
+	if(!c->ssl) {
+		while(len > 0) {
+			if((r = write(c->fd, s, len)) == -1) {
+				if(errno == EINTR)
+					continue;
+				fatal_exit("could not write: %s",
+					strerror(errno));
+			}
+			s += r;
+			len -= (size_t)r;
+		}
+		return;
+	}
+#endif
+	if(len > 0 && SSL_write(c->ssl, s, (int)len) <= 0)
+		ssl_err("could not SSL_write");
+}
+
+/** read from the server, returns 0 on EOF, exit on failure */
+static int
+conn_read(struct conn* c, char* buf, size_t len)
+{
+	int r;
+#ifndef USE_WINSOCK
+	if(!c->ssl) {
+		ssize_t n;
+		while((n = read(c->fd, buf, len)) == -1 && errno == EINTR)
+			;
+		if(n == -1)
+			fatal_exit("could not read: %s", strerror(errno));
+		return (int)n;
+	}
+#endif
+	ERR_clear_error();
+	if((r = SSL_read(c->ssl, buf, (int)len)) <= 0) {
+		if(SSL_get_error(c->ssl, r) == SSL_ERROR_ZERO_RETURN) {
+			/* EOF */
+			return 0;
+		}
+		ssl_err("could not SSL_read");
+	}
+	return r;
+}
+
+/** buffered input from the server, for the session replies */
+struct conn_in {
+	/** the connection */
+	struct conn* c;
+	/** read buffer */
+	char buf[4096];
+	/** position of the next byte and the number of bytes in buf */
+	size_t pos, len;
+};
+
+/** read more from the server if the buffer is empty, false on EOF */
+static int
+in_fill(struct conn_in* in)
+{
+	int r;
+	if(in->pos < in->len)
+		return 1;
+	if((r = conn_read(in->c, in->buf, sizeof(in->buf))) <= 0)
+		return 0;
+	in->pos = 0;
+	in->len = (size_t)r;
+	return 1;
+}
+
+/** read a line (without the newline) from the server, false on EOF */
+static int
+in_line(struct conn_in* in, char* line, size_t sz)
+{
+	size_t i = 0;
+	while(in_fill(in)) {
+		char ch = in->buf[in->pos++];
+		if(ch == '\n') {
+			line[i] = 0;
+			return 1;
+		}
+		if(i+1 < sz)
+			line[i++] = ch;
+	}
+	return 0;
+}
+
+/** copy n bytes from the server to stdout, false on EOF.  Sets error if
+ * they start with error */
+static int
+in_copy(struct conn_in* in, size_t n, int* was_error)
+{
+	int first = 1;
+	while(n > 0) {
+		size_t k;
+		if(!in_fill(in))
+			return 0;
+		k = in->len - in->pos;
+		if(k > n) k = n;
+		if(first && strncmp(in->buf+in->pos, "error", k<5?k:5) == 0)
+			*was_error = 1;
+		first = 0;
+		fwrite(in->buf+in->pos, 1, k, stdout);
+		in->pos += k;
+		n -= k;
+	}
+	return 1;
+}
+
+/** pipeline the commands from stdin, and print the replies in order */
+static int
+go_session(struct conn* c)
+{
+	struct conn_in in;
+	char line[1024];
+	int window = 0, outstanding = 0, was_error = 0, eof = 0;
+	unsigned len;
+	size_t n;
+	in.c = c;
+	in.pos = in.len = 0;
+	if(!in_line(&in, line, sizeof(line)) ||
+		sscanf(line, "ok session %d", &window) != 1 || window < 1) {
+		fprintf(stderr, "error: no session: %s\n", line);
+		return 1;
+	}
+	while(!eof || outstanding > 0) {
+		/* keep up to window commands on the way */
+		while(!eof && outstanding < window) {
+			if(!fgets(line, (int)sizeof(line), stdin)) {
+				eof = 1;
+				break;
+			}
+			n = strlen(line);
+			if(n == 0 || line[n-1] != '\n') {
+				/* last line, or too long and cut */
+				if(n+1 < sizeof(line)) n++;
+				line[n-1] = '\n';
+				line[n] = 0;
+			}
+			conn_write(c, line, n);
+			outstanding++;
+			/* the server closes after these, send no more */
+			if(strcmp(line, "quit\n") == 0 ||
+				strcmp(line, "stop\n") == 0)
+				eof = 1;
+		}
+		if(outstanding == 0)
+			break;
+		if(!in_line(&in, line, sizeof(line)) ||
+			sscanf(line, "reply %u", &len) != 1) {
+			/* the server closed, after quit or stop */
+			break;
+		}
+		if(!in_copy(&in, (size_t)len, &was_error))
+			break;
+		outstanding--;
+	}
+	/* the server waits for the next command, tell it we are done */
+	if(c->ssl)
+		SSL_shutdown(c->ssl);
+	return was_error;
+}
+
 /** send stdin to server */
 static void
-send_file(SSL* ssl, FILE* in, char* buf, size_t sz)
+send_file(struct conn* c, FILE* in, char* buf, size_t sz)
 {
 	while(fgets(buf, (int)sz, in)) {
-		if(SSL_write(ssl, buf, (int)strlen(buf)) <= 0)
-			ssl_err("could not SSL_write contents");
+		conn_write(c, buf, strlen(buf));
 	}
 }
 
 /** send command and display result */
 static int
-go_cmd(SSL* ssl, int argc, char* argv[])
+go_cmd(struct conn* c, int argc, char* argv[])
 {
 	char pre[10];
 	const char* space=" ";
@@ -127,38 +321,32 @@ go_cmd(SSL* ssl, int argc, char* argv[])
 	int r, i;
 	char buf[1024];
 	snprintf(pre, sizeof(pre), "DNSTRIG%d ", CONTROL_VERSION);
-	if(SSL_write(ssl, pre, (int)strlen(pre)) <= 0)
-		ssl_err("could not SSL_write");
+	conn_write(c, pre, strlen(pre));
 	for(i=0; i<argc; i++) {
-		if(SSL_write(ssl, space, (int)strlen(space)) <= 0)
-			ssl_err("could not SSL_write");
+		conn_write(c, space, strlen(space));
 		if(argv[i] && strlen(argv[i])>0)
-			if(SSL_write(ssl, argv[i], (int)strlen(argv[i])) <= 0)
-				ssl_err("could not SSL_write");
+			conn_write(c, argv[i], strlen(argv[i]));
 	}
-	if(SSL_write(ssl, newline, (int)strlen(newline)) <= 0)
-		ssl_err("could not SSL_write");
+	conn_write(c, newline, strlen(newline));
 
 	if(argc == 1 && strcmp(argv[0], "cmdtray") == 0) {
-		send_file(ssl, stdin, buf, sizeof(buf));
+		send_file(c, stdin, buf, sizeof(buf));
 	}
+	if(argc == 1 && strcmp(argv[0], "session") == 0)
+		return go_session(c);
 
 #ifndef UB_ON_WINDOWS
 	/* line buffering does not work on windows */
 	setvbuf(stdout, NULL, (int)_IOLBF, 0);
+#else
+	/* the trace dump is binary */
+	if(argc == 1 && strcmp(argv[0], "dump_trace") == 0)
+		_setmode(_fileno(stdout), _O_BINARY);
 #endif
 
-	while(1) {
-		ERR_clear_error();
-		if((r = SSL_read(ssl, buf, (int)sizeof(buf)-1)) <= 0) {
-			if(SSL_get_error(ssl, r) == SSL_ERROR_ZERO_RETURN) {
-				/* EOF */
-				break;
-			}
-			ssl_err("could not SSL_read");
-		}
+	while((r = conn_read(c, buf, sizeof(buf)-1)) > 0) {
 		buf[r] = 0;
-		printf("%s", buf);
+		fwrite(buf, 1, (size_t)r, stdout);
 		if(first_line && strncmp(buf, "error", 5) == 0)
 			was_error = 1;
 		first_line = 0;
@@ -166,19 +354,153 @@ go_cmd(SSL* ssl, int argc, char* argv[])
 	return was_error;
 }
 
+/** the file with the SSL session of the last command, in the state-dir,
+ * so the next command (of the hooks, as root) can resume it */
+static int
+session_file(struct cfg* cfg, char* buf, size_t len)
+{
+	if(!cfg->state_dir || cfg->state_dir[0] == 0)
+		return 0;
+	snprintf(buf, len, "%s/control-session", cfg->state_dir);
+	return 1;
+}
+
+/** read the session to resume, or NULL */
+static SSL_SESSION*
+session_read(struct cfg* cfg)
+{
+	char file[1024];
+	SSL_SESSION* sess;
+	FILE* in;
+	if(!session_file(cfg, file, sizeof(file)))
+		return NULL;
+	if(!(in = fopen(file, "r")))
+		return NULL;
+	sess = PEM_read_SSL_SESSION(in, NULL, NULL, NULL);
+	fclose(in);
+	if(!sess)
+		ERR_clear_error();
+	return sess;
+}
+
+/** store the session for the next command, if it was not resumed, the
+ * file is only readable by us */
+static void
+session_write(struct cfg* cfg, SSL* ssl)
+{
+	char file[1024], tmp[1100];
+	SSL_SESSION* sess;
+	FILE* out;
+	int r;
+#ifndef USE_WINSOCK
+	int fd;
+#endif
+	if(SSL_session_reused(ssl) || !session_file(cfg, file, sizeof(file)))
+		return;
+	if(!(sess = SSL_get1_session(ssl)))
+		return;
+	snprintf(tmp, sizeof(tmp), "%s.%d", file, (int)getpid());
+#ifndef USE_WINSOCK
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	out = (fd == -1)?NULL:fdopen(fd, "w");
+	if(!out && fd != -1)
+		close(fd);
+#else
+	out = fopen(tmp, "w");
+#endif
+	if(!out) {
+		/* not root, or no state-dir, no session kept */
+		SSL_SESSION_free(sess);
+		return;
+	}
+	r = PEM_write_SSL_SESSION(out, sess);
+	SSL_SESSION_free(sess);
+	if(fclose(out) != 0 || !r) {
+		unlink(tmp);
+		return;
+	}
+#ifdef USE_WINSOCK
+	/* rename does not overwrite on windows */
+	unlink(file);
+#endif
+	if(rename(tmp, file) != 0)
+		unlink(tmp);
+}
+
+#ifndef USE_WINSOCK
+/** connect to the control socket, or -1 and string in err */
+static int
+contact_unix(const char* path, char* err, size_t errlen)
+{
+	struct sockaddr_un addr;
+	int fd;
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		snprintf(err, errlen, "control socket path too long: %s",
+			path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memmove(addr.sun_path, path, strlen(path)+1);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1) {
+		snprintf(err, errlen, "socket: %s", strerror(errno));
+		return -1;
+	}
+	if(connect(fd, (struct sockaddr*)&addr, (socklen_t)sizeof(addr))
+		< 0) {
+		snprintf(err, errlen, "connect %s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/** perform the command on the control socket */
+static int
+go_unix(int fd, int argc, char* argv[])
+{
+	struct conn c;
+	int ret;
+	c.ssl = NULL;
+	c.fd = fd;
+	ret = go_cmd(&c, argc, argv);
+	close(fd);
+	return ret;
+}
+#endif /* USE_WINSOCK */
+
 /** go ahead and read config, contact server and perform command and display */
 static int
-go(const char* cfgfile, char* svr, int argc, char* argv[])
+go(const char* cfgfile, char* svr, char* sock, int argc, char* argv[])
 {
 	struct cfg* cfg;
 	int fd, ret;
 	SSL_CTX* ctx;
 	SSL* ssl;
+	SSL_SESSION* sess;
+	struct conn c;
 	char err[512];
 
 	/* read config */
 	if(!(cfg = cfg_create(cfgfile)))
 		fatal_exit("could not get config file");
+#ifndef USE_WINSOCK
+	/* the control socket saves the TLS handshake, for local hooks */
+	if(sock || (!svr && cfg->control_socket[0] != 0)) {
+		fd = contact_unix(sock?sock:cfg->control_socket, err,
+			sizeof(err));
+		if(fd != -1) {
+			cfg_delete(cfg);
+			return go_unix(fd, argc, argv);
+		}
+		if(sock)
+			fatal_exit("%s", err);
+		verbose(VERB_ALGO, "%s, using TLS", err);
+	}
+#else
+	(void)sock;
+#endif
 	ctx = cfg_setup_ctx_client(cfg, err, sizeof(err));
 	if(!ctx) fatal_exit("%s", err);
 
@@ -191,7 +513,9 @@ go(const char* cfgfile, char* svr, int argc, char* argv[])
 		printf("the daemon is stopped\n");
 		exit(3); /* statuscmd and server is down */
 	}
-	ssl = setup_ssl_client(ctx, fd, err, sizeof(err));
+	sess = session_read(cfg);
+	ssl = setup_ssl_client_resume(ctx, fd, sess, err, sizeof(err));
+	if(sess) SSL_SESSION_free(sess);
 	if(!ssl) fatal_exit("%s", err);
 	global_ssl = ssl;
 #ifdef SIGHUP
@@ -203,7 +527,11 @@ go(const char* cfgfile, char* svr, int argc, char* argv[])
 	(void)signal(SIGINT, sigh);
 	
 	/* send command */
-	ret = go_cmd(ssl, argc, argv);
+	c.ssl = ssl;
+	c.fd = fd;
+	ret = go_cmd(&c, argc, argv);
+	/* the tls1.3 session ticket has been read with the results */
+	session_write(cfg, ssl);
 
 	SSL_free(ssl);
 #ifndef USE_WINSOCK
@@ -227,6 +555,7 @@ int main(int argc, char* argv[])
 	int c, ret;
 	const char* cfgfile = CONFIGFILE;
 	char* svr = NULL;
+	char* sock = NULL;
 #ifdef USE_WINSOCK
 	int r;
 	WSADATA wsa_data;
@@ -261,7 +590,7 @@ int main(int argc, char* argv[])
 	}
 
 	/* parse the options */
-	while( (c=getopt(argc, argv, "c:s:h")) != -1) {
+	while( (c=getopt(argc, argv, "c:s:u:h")) != -1) {
 		switch(c) {
 		case 'c':
 			cfgfile = optarg;
@@ -269,6 +598,9 @@ int main(int argc, char* argv[])
 		case 's':
 			svr = optarg;
 			break;
+		case 'u':
+			sock = optarg;
+			break;
 		case '?':
 		case 'h':
 		default:
@@ -279,7 +611,7 @@ int main(int argc, char* argv[])
 	argv += optind;
 	if(argc == 0)
 		usage();
-	ret = go(cfgfile, svr, argc, argv);
+	ret = go(cfgfile, svr, sock, argc, argv);
 
 #ifdef USE_WINSOCK
         WSACleanup();
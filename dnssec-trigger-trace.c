@@ -0,0 +1,119 @@
+/*
+ * dnssec-trigger-trace.c - print the probe flight recorder of dnssec-trigger.
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * Prints the dump of the flight recorder, from dnssec-trigger-control
+ * dump_trace, as text.
+ */
+
+#include "config.h"
+#include <time.h>
+#ifdef UB_ON_WINDOWS
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include "riggerd/trace.h"
+
+/** Give dnssec-trigger-trace usage, and exit (1). */
+static void
+usage()
+{
+	printf("Usage:	dnssec-trigger-trace [file]\n");
+	printf("	Prints the probe flight recorder of dnssec-triggerd.\n");
+	printf("	The file is the output of dnssec-trigger-control\n");
+	printf("	dump_trace, without a file it is read from stdin.\n");
+	printf("Version %s\n", PACKAGE_VERSION);
+	printf("BSD licensed, see LICENSE in source package for details.\n");
+	printf("Report bugs to %s\n", PACKAGE_BUGREPORT);
+	exit(1);
+}
+
+/** read the dump and print the events, @return false on failure */
+static int
+print_trace(FILE* in, const char* name)
+{
+	static uint8_t buf[TRACE_DUMP_MAX];
+	struct trace_event e, first;
+	char line[256];
+	uint32_t num, total, i;
+	size_t len = fread(buf, 1, sizeof(buf), in);
+	if(ferror(in)) {
+		fprintf(stderr, "%s: read error: %s\n", name, strerror(errno));
+		return 0;
+	}
+	if(!trace_parse_header(buf, len, &num, &total) ||
+		len < TRACE_HEADER_LEN + num*TRACE_EVENT_LEN) {
+		fprintf(stderr, "%s: not a trace dump\n", name);
+		return 0;
+	}
+	printf("%u events of %u recorded\n", (unsigned)num, (unsigned)total);
+	for(i=0; i<num; i++) {
+		trace_parse_event(buf+TRACE_HEADER_LEN+i*TRACE_EVENT_LEN, &e);
+		if(i == 0) {
+			time_t t = (time_t)e.sec;
+			first = e;
+			printf("start at %s", ctime(&t));
+		}
+		trace_event_str(&e, &first, line, sizeof(line));
+		printf("%s\n", line);
+	}
+	return 1;
+}
+
+/** Main routine for dnssec-trigger-trace */
+int main(int argc, char* argv[])
+{
+	FILE* in = stdin;
+	const char* name = "stdin";
+	int ret;
+	if(argc > 2 || (argc == 2 && argv[1][0] == '-'))
+		usage();
+	if(argc == 2) {
+		name = argv[1];
+		if(!(in = fopen(name, "rb"))) {
+			fprintf(stderr, "%s: %s\n", name, strerror(errno));
+			return 1;
+		}
+	}
+#ifdef UB_ON_WINDOWS
+	else	_setmode(_fileno(stdin), _O_BINARY);
+#endif
+	ret = print_trace(in, name);
+	if(in != stdin)
+		fclose(in);
+	return ret?0:1;
+}
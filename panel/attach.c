@@ -64,6 +64,8 @@ void attach_create(void)
 
 void attach_delete(void)
 {
+	if(feed->session)
+		SSL_SESSION_free(feed->session);
 	free(feed);
 	feed = NULL;
 }
@@ -72,6 +74,15 @@ void attach_delete(void)
 static void
 stop_ssl(SSL* ssl, int fd)
 {
+	/* keep the session to resume it when we connect again */
+	if(ssl) {
+		SSL_SESSION* s = SSL_get1_session(ssl);
+		if(s) {
+			if(feed->session)
+				SSL_SESSION_free(feed->session);
+			feed->session = s;
+		}
+	}
 	if(ssl) SSL_shutdown(ssl);
 	SSL_free(ssl);
 #ifndef USE_WINSOCK
@@ -112,8 +123,8 @@ static SSL* try_contact_server()
 				feed->lock();
 			}
 		}
-		ssl = setup_ssl_client(feed->ctx, fd, feed->connect_reason,
-				sizeof(feed->connect_reason));
+		ssl = setup_ssl_client_resume(feed->ctx, fd, feed->session,
+			feed->connect_reason, sizeof(feed->connect_reason));
 		if(!ssl) {
 			stop_ssl(ssl, fd);
 			feed->unlock();
@@ -99,6 +99,8 @@ struct feed {
 	SSL* ssl_read;
 	/* ssl to write results to */
 	SSL* ssl_write;
+	/* session of the last connection, to resume, or NULL */
+	SSL_SESSION* session;
 };
 
 /** create the feed structure and inits it
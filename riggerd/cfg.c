@@ -348,6 +348,8 @@ keyword(struct cfg* cfg, char* p)
 		str_arg(&cfg->login_location, p+15);
 	} else if(strncmp(p, "noaction:", 9) == 0) {
 		bool_arg(&cfg->noaction, p+9);
+	} else if(strncmp(p, "state-dir:", 10) == 0) {
+		str_arg(&cfg->state_dir, p+10);
 	} else if(strncmp(p, "port:", 5) == 0) {
 		cfg->control_port = atoi(get_arg(p+5));
 	} else if(strncmp(p, "server-key-file:", 16) == 0) {
@@ -358,6 +360,12 @@ keyword(struct cfg* cfg, char* p)
 		str_arg(&cfg->control_key_file, p+17);
 	} else if(strncmp(p, "control-cert-file:", 18) == 0) {
 		str_arg(&cfg->control_cert_file, p+18);
+	} else if(strncmp(p, "control-socket:", 15) == 0) {
+		str_arg(&cfg->control_socket, p+15);
+	} else if(strncmp(p, "control-allow:", 14) == 0) {
+		strlist_append(&cfg->control_allow, &cfg->control_allow_last,
+			get_arg(p+14));
+		cfg->num_control_allow++;
 	} else if(strncmp(p, "tcp80:", 6) == 0) {
 		tcp_arg(&cfg->tcp80_ip4, &cfg->tcp80_ip4_last,
 			&cfg->num_tcp80_ip4, &cfg->tcp80_ip6,
@@ -373,6 +381,16 @@ keyword(struct cfg* cfg, char* p)
 	} else if(strncmp(p, "url:", 4) == 0) {
 		str2_arg(&cfg->http_urls, &cfg->http_urls_last, 
 			&cfg->num_http_urls, get_arg(p+4));
+	} else if(strncmp(p, "tcp-fastopen:", 13) == 0) {
+		bool_arg(&cfg->tcp_fastopen, p+13);
+	} else if(strncmp(p, "probe-inflight:", 15) == 0) {
+		cfg->probe_inflight = atoi(get_arg(p+15));
+	} else if(strncmp(p, "probe-rate:", 11) == 0) {
+		cfg->probe_rate = atoi(get_arg(p+11));
+	} else if(strncmp(p, "event-profile:", 14) == 0) {
+		bool_arg(&cfg->event_profile, p+14);
+	} else if(strncmp(p, "stall-threshold:", 16) == 0) {
+		cfg->stall_threshold = atoi(get_arg(p+16));
 	} else if(strncmp(p, "check-updates:", 14) == 0) {
 		bool_arg(&cfg->check_updates, p+14);
 	} else if(strncmp(p, "use-vpn-forwarders:", 19) == 0) {
@@ -424,6 +442,9 @@ struct cfg* cfg_create(const char* cfgfile)
 	if(!cfg) return NULL;
 	cfg->use_syslog = 1;
 	cfg->control_port = 8955;
+	cfg->probe_inflight = 32;
+	cfg->probe_rate = 100;
+	cfg->stall_threshold = 1000;
 	cfg->server_key_file=strdup(KEYDIR"/dnssec_trigger_server.key");
 	cfg->server_cert_file=strdup(KEYDIR"/dnssec_trigger_server.pem");
 	cfg->control_key_file=strdup(KEYDIR"/dnssec_trigger_control.key");
@@ -433,6 +454,12 @@ struct cfg* cfg_create(const char* cfgfile)
 	cfg->login_location = strdup(LOGIN_LOCATION);
 	cfg->pidfile = strdup(PIDFILE);
 	cfg->resolvconf = strdup("/etc/resolv.conf");
+	cfg->control_socket = strdup("");
+#ifdef USE_WINSOCK
+	cfg->state_dir = strdup("");
+#else
+	cfg->state_dir = strdup("/var/run/dnssec-trigger");
+#endif
 	cfg->check_updates = (strcmp(CHECK_UPDATES, "yes")==0);
 	/* Don't use it by default */
 	cfg->use_vpn_forwarders = 0;
@@ -442,7 +469,8 @@ struct cfg* cfg_create(const char* cfgfile)
 	if(!cfg->unbound_control || !cfg->pidfile || !cfg->server_key_file ||
 		!cfg->server_cert_file || !cfg->control_key_file ||
 		!cfg->control_cert_file || !cfg->resolvconf ||
-		!cfg->login_command || !cfg->login_location) {
+		!cfg->state_dir || !cfg->login_command || !cfg->login_location ||
+		!cfg->control_socket) {
 		cfg_delete(cfg);
 		return NULL;
 	}
@@ -464,6 +492,7 @@ void cfg_delete(struct cfg* cfg)
 	ssllist_delete(cfg->ssl443_ip4);
 	ssllist_delete(cfg->ssl443_ip6);
 	strlist2_delete(cfg->http_urls);
+	strlist_delete(cfg->control_allow);
 	free(cfg->login_command);
 	free(cfg->login_location);
 	free(cfg->pidfile);
@@ -473,10 +502,12 @@ void cfg_delete(struct cfg* cfg)
 	free(cfg->resolvconf);
 	free(cfg->rescf_domain);
 	free(cfg->rescf_search);
+	free(cfg->state_dir);
 	free(cfg->server_key_file);
 	free(cfg->server_cert_file);
 	free(cfg->control_key_file);
 	free(cfg->control_cert_file);
+	free(cfg->control_socket);
 	free(cfg);
 }
 
@@ -569,6 +600,12 @@ cfg_setup_ctx_client(struct cfg* cfg, char* err, size_t errlen)
 
 /** setup SSL on the connection, blocking, or NULL and string in err */
 SSL* setup_ssl_client(SSL_CTX* ctx, int fd, char* err, size_t errlen)
+{
+	return setup_ssl_client_resume(ctx, fd, NULL, err, errlen);
+}
+
+SSL* setup_ssl_client_resume(SSL_CTX* ctx, int fd, SSL_SESSION* sess,
+	char* err, size_t errlen)
 {
 	SSL* ssl;
 	X509* x;
@@ -577,6 +614,9 @@ SSL* setup_ssl_client(SSL_CTX* ctx, int fd, char* err, size_t errlen)
 	ssl = SSL_new(ctx);
 	if(!ssl)
 		return ssl_err_ret(ssl, err, errlen, "could not SSL_new");
+	/* if the server does not know it, this is a full handshake */
+	if(sess && !SSL_set_session(ssl, sess))
+		ERR_clear_error();
 	SSL_set_connect_state(ssl);
 	(void)SSL_set_mode(ssl, SSL_MODE_AUTO_RETRY);
 	if(!SSL_set_fd(ssl, fd))
@@ -601,6 +641,8 @@ SSL* setup_ssl_client(SSL_CTX* ctx, int fd, char* err, size_t errlen)
 		return ssl_err_ret(ssl, err, errlen,
 			"Server presented no peer certificate");
 	X509_free(x);
+	if(SSL_session_reused(ssl))
+		verbose(VERB_ALGO, "resumed SSL session");
 	return ssl;
 }
 
@@ -72,6 +72,8 @@ struct cfg {
 	char* rescf_search;
 	/** noaction option does no actions to resolv.conf or unbound */
 	int noaction;
+	/** directory for state kept across restarts ("" for none) */
+	char* state_dir;
 
 	/** web browser to open login windows */
 	char* login_command;
@@ -98,6 +100,17 @@ struct cfg {
 	struct strlist2* http_urls, *http_urls_last;
 	int num_http_urls;
 
+	/** use TCP Fast Open for the tcp, ssl and http probes */
+	int tcp_fastopen;
+	/** max probe queries in flight, 0 for no limit */
+	int probe_inflight;
+	/** probe queries per second, 0 for no pacing */
+	int probe_rate;
+	/** time the callbacks of the event loop, for the profile command */
+	int event_profile;
+	/** msec a callback can run before it is a stall, 0 for no watchdog */
+	int stall_threshold;
+
 	/** if we should perform version check (and ask user to update)
 	 * enabled on windows and osx. */
 	int check_updates;
@@ -112,6 +125,11 @@ struct cfg {
 	char* control_key_file;
 	/** certificate file for control */
 	char* control_cert_file;
+	/** unix socket path for local control without TLS ("" for none) */
+	char* control_socket;
+	/** users (uid or name) and @groups allowed on the control socket */
+	struct strlist* control_allow, *control_allow_last;
+	int num_control_allow;
 
 	/** use DNS forwarders provided by VPN connection instead of the forwarders
 	 * from the default connection. Use 0 or 1 to indicate the value. */
@@ -159,6 +177,10 @@ void cfg_delete(struct cfg* cfg);
 SSL_CTX* cfg_setup_ctx_client(struct cfg* cfg, char* err, size_t errlen);
 /** setup SSL on the connection, blocking, or NULL and string in err */
 SSL* setup_ssl_client(SSL_CTX* ctx, int fd, char* err, size_t errlen);
+/** setup SSL on the connection, like setup_ssl_client, resume the session
+ * if not NULL and the server accepts it */
+SSL* setup_ssl_client_resume(SSL_CTX* ctx, int fd, SSL_SESSION* sess,
+	char* err, size_t errlen);
 
 /** append to strlist, first=last=NULL to start empty. fatal if malloc fails */
 void strlist_append(struct strlist** first, struct strlist** last, char* str);
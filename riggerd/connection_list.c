@@ -5,6 +5,7 @@
 #ifdef FWD_ZONES_SUPPORT
 
 #include "log.h"
+#include "region.h"
 
 void nm_connection_init(struct nm_connection *conn)
 {
@@ -25,21 +26,48 @@ void nm_connection_list_init(struct nm_connection_list *list)
 {
     list->first = NULL;
     list->ownership = LIST_OWNING;
+    list->region = NULL;
 }
 
 void nm_connection_list_init_non_owning(struct nm_connection_list *list)
 {
     list->first = NULL;
     list->ownership = LIST_NON_OWNING;
+    list->region = NULL;
 }
 
-static void nm_connection_clean_up_node(struct nm_connection_node *current, enum list_ownership_type ownership) {
+void nm_connection_list_init_region(struct nm_connection_list *list, struct region *region)
+{
+    list->first = NULL;
+    list->ownership = LIST_OWNING;
+    list->region = region;
+}
+
+struct nm_connection *nm_connection_new(struct nm_connection_list *list)
+{
+    struct nm_connection *conn;
+    if (NULL != list->region) {
+        conn = (struct nm_connection *)region_alloc(list->region, sizeof(struct nm_connection));
+    } else {
+        conn = (struct nm_connection *)calloc_or_die(sizeof(struct nm_connection));
+    }
+    nm_connection_init(conn);
+    string_list_init_region(&conn->zones, list->region);
+    string_list_init_region(&conn->servers, list->region);
+    return conn;
+}
+
+static void nm_connection_clean_up_node(struct nm_connection_node *current, enum list_ownership_type ownership,
+        struct region *region) {
     if (LIST_OWNING == ownership){
             // We own the whole structure, clean up everything!
+            // (in a region, the string lists only free extensions)
             nm_connection_clear(current->self);
-            free(current->self);
-            free(current);
-        } else {
+            if (NULL == region) {
+                free(current->self);
+                free(current);
+            }
+        } else if (NULL == region) {
             // We own only nodes, not its content
             free(current);
         }
@@ -56,10 +84,11 @@ void nm_connection_list_clear(struct nm_connection_list *list)
     while (NULL != current){
         next = current->next;
 
-        nm_connection_clean_up_node(current, list->ownership);
+        nm_connection_clean_up_node(current, list->ownership, list->region);
 
         current = next;
     }
+    list->first = NULL;
 }
 
 void nm_connection_list_push_back(struct nm_connection_list *list, struct nm_connection *new_value)
@@ -73,7 +102,11 @@ void nm_connection_list_push_back(struct nm_connection_list *list, struct nm_con
     while (NULL != *node) {
         node = &(*node)->next;
     }
-    *node = (struct nm_connection_node *)calloc_or_die(sizeof(struct nm_connection_node));
+    if (NULL != list->region) {
+        *node = (struct nm_connection_node *)region_alloc(list->region, sizeof(struct nm_connection_node));
+    } else {
+        *node = (struct nm_connection_node *)calloc_or_die(sizeof(struct nm_connection_node));
+    }
     (*node)->next = NULL;
     (*node)->self = new_value;
     // new_value is now owned by connection list => it will be freed with the list
@@ -84,13 +117,12 @@ void nm_connection_list_copy_and_push_back(struct nm_connection_list *list, stru
     if (NULL == list || NULL == new_value) {
         return;
     }
-    conn = (struct nm_connection *)calloc_or_die(sizeof(struct nm_connection));
+    conn = nm_connection_new(list);
     conn->default_con = new_value->default_con;
-    string_list_init(&conn->zones);
     string_list_duplicate(&new_value->zones, &conn->zones);
     conn->type = new_value->type;
-    string_list_init(&conn->servers);
     string_list_duplicate(&new_value->servers, &conn->servers);
+    conn->security = new_value->security;
     nm_connection_list_push_back(list, conn);
 }
 
@@ -110,7 +142,7 @@ int nm_connection_list_remove(struct nm_connection_list *list, char *zone, size_
     for (iter = list->first; NULL != iter; prev = &(iter->next), iter = iter->next) {
         if (string_list_contains(&(iter->self->zones), zone, len)) {
             *prev = iter->next;
-            nm_connection_clean_up_node(iter, list->ownership);
+            nm_connection_clean_up_node(iter, list->ownership, list->region);
             return 0;
         }
     }
@@ -120,7 +152,7 @@ int nm_connection_list_remove(struct nm_connection_list *list, char *zone, size_
 struct string_list nm_connection_list_get_servers_list(struct nm_connection_list *list) {
     struct nm_connection_node *iter;
     struct string_list ret;
-    string_list_init(&ret);
+    string_list_init_region(&ret, list->region);
 
     for (iter = list->first; NULL != iter; iter = iter->next) {
         string_list_copy_and_append(&ret, &iter->self->servers);
@@ -141,6 +173,7 @@ struct nm_connection_list nm_connection_list_filter(struct nm_connection_list *l
     nm_connection_list_init_non_owning(&ret);
     if (NULL == list)
         return ret;
+    ret.region = list->region;
 
     va_start(args, count);
     // Load functions into a temporary array
@@ -7,6 +7,8 @@
 #include "string_list.h"
 #include "string_buffer.h"
 
+struct region;
+
 /**
  * All possible types of connections
  * in Network Manager.
@@ -70,6 +72,9 @@ struct nm_connection_list {
     struct nm_connection_node *first;
     /** Ownership status of this list */
     enum list_ownership_type ownership;
+    /** Region the nodes (and for owning lists the connections) are
+     * allocated from, or NULL for the heap */
+    struct region *region;
 };
 
 /**
@@ -102,6 +107,22 @@ void nm_connection_list_init(struct nm_connection_list *list);
  */
 void nm_connection_list_init_non_owning(struct nm_connection_list *list);
 
+/*
+ * Initialize an empty owning list of connections, that allocates from the
+ * region. The nodes, connections and their strings are freed with the region,
+ * nm_connection_list_clear does not free them.
+ * @param list: List to be initialized
+ * @param region: Region to allocate from, NULL is the heap
+ */
+void nm_connection_list_init_region(struct nm_connection_list *list, struct region *region);
+
+/**
+ * Allocate and initialize a new connection, from the region of the list
+ * (or the heap). It is not yet pushed into the list.
+ * @param list: The list the connection is going to be pushed into
+ */
+struct nm_connection *nm_connection_new(struct nm_connection_list *list);
+
 /**
  * Free the whole list and all its components (connection nodes and lists of strings)
  * Be careful though, use this only on owning lists. Usage on non-owning lists can cause
@@ -112,7 +133,8 @@ void nm_connection_list_clear(struct nm_connection_list *list);
 
 /**
  * Push a new connections into the list. The new connection is now owned by the list. You
- * should not use it elsewhere.
+ * should not use it elsewhere. For lists in a region it must be allocated with
+ * nm_connection_new.
  * @param list: List to push to
  * @param new_value: New connection
  */
@@ -143,14 +165,14 @@ bool nm_connection_list_contains_zone(const struct nm_connection_list *list, cha
 int nm_connection_list_remove(struct nm_connection_list *list, char *zone, size_t len);
 
 /**
- * 
+ * Get a list of all servers of all connections, in the region of the list (if any)
  * @param list: List to search through
  */
 struct string_list nm_connection_list_get_servers_list(struct nm_connection_list *list);
 
 /**
  * Filter connections list and return a new non-owning one, which contains only those connections
- * that satisfy **all** filters.
+ * that satisfy **all** filters. The new list uses the region of the original.
  * @param list: Original list (will be a superset to the new one)
  * @param count: Number of filters given to this function
  * @return: The new list
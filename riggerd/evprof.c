@@ -0,0 +1,243 @@
+/*
+ * evprof.c - dnssec-trigger profile of the event loop
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the profile of the event loop.
+ */
+#include "config.h"
+#include <sys/time.h>
+#include "evprof.h"
+#include "fptr_wlist.h"
+
+/** the counts of a function */
+struct evprof_entry {
+	/** the function, NULL for an empty entry */
+	evprof_func_type* func;
+	/** the kind of function */
+	enum evprof_kind kind;
+	/** number of calls */
+	uint64_t calls;
+	/** total run time, usec */
+	uint64_t total;
+	/** longest run time, usec */
+	uint64_t max;
+};
+
+int evprof_on = 0;
+
+/** the profile */
+static struct evprof {
+	/** the functions, a hash table with linear probing */
+	struct evprof_entry tab[EVPROF_MAX];
+	/** number of functions in the table */
+	int num;
+	/** calls that did not fit in the table */
+	uint64_t dropped;
+	/** the histogram of the loop iterations */
+	uint64_t loop[EVPROF_BUCKETS];
+	/** number of loop iterations */
+	uint64_t loops;
+	/** when the counts started */
+	struct timeval since;
+} evprof;
+
+void evprof_reset(void)
+{
+	memset(&evprof, 0, sizeof(evprof));
+	gettimeofday(&evprof.since, NULL);
+}
+
+void evprof_set(int on)
+{
+	if(on && !evprof_on)
+		evprof_reset();
+	evprof_on = on;
+}
+
+int evprof_begin(struct timeval* start)
+{
+	if(!evprof_on)
+		return 0;
+	gettimeofday(start, NULL);
+	return 1;
+}
+
+/** usec since the start, 0 if the clock went back */
+static uint64_t
+evprof_elapsed(struct timeval* start)
+{
+	struct timeval now;
+	int64_t d;
+	gettimeofday(&now, NULL);
+	d = ((int64_t)now.tv_sec - (int64_t)start->tv_sec)*1000000 +
+		((int64_t)now.tv_usec - (int64_t)start->tv_usec);
+	return d>0?(uint64_t)d:0;
+}
+
+/** find the entry of the function, or make it; NULL if the table is full */
+static struct evprof_entry*
+evprof_lookup(enum evprof_kind kind, evprof_func_type* func)
+{
+	size_t h = (((size_t)func)>>4) ^ (size_t)kind;
+	int i;
+	for(i=0; i<EVPROF_MAX; i++) {
+		struct evprof_entry* e = &evprof.tab[(h+i)%EVPROF_MAX];
+		if(e->func == func && e->kind == kind)
+			return e;
+		if(!e->func) {
+			/* keep a free entry, so the lookups end */
+			if(evprof.num >= EVPROF_MAX-1)
+				return NULL;
+			e->func = func;
+			e->kind = kind;
+			evprof.num++;
+			return e;
+		}
+	}
+	return NULL;
+}
+
+void evprof_end(struct timeval* start, enum evprof_kind kind,
+	evprof_func_type* func)
+{
+	uint64_t d = evprof_elapsed(start);
+	struct evprof_entry* e;
+	/* turned off by the callback itself */
+	if(!evprof_on)
+		return;
+	if(!(e = evprof_lookup(kind, func))) {
+		evprof.dropped++;
+		return;
+	}
+	e->calls++;
+	e->total += d;
+	if(d > e->max)
+		e->max = d;
+}
+
+void evprof_loop(struct timeval* start)
+{
+	uint64_t d = evprof_elapsed(start);
+	int b = 0;
+	if(!evprof_on)
+		return;
+	while(b < EVPROF_BUCKETS-1 && d >= ((uint64_t)1<<b))
+		b++;
+	evprof.loop[b]++;
+	evprof.loops++;
+}
+
+/** sort the entries on their total time, the most first */
+static int
+evprof_cmp(const void* x, const void* y)
+{
+	const struct evprof_entry* a = *(struct evprof_entry* const*)x;
+	const struct evprof_entry* b = *(struct evprof_entry* const*)y;
+	if(a->total != b->total)
+		return a->total > b->total ? -1 : 1;
+	if(a->calls != b->calls)
+		return a->calls > b->calls ? -1 : 1;
+	return 0;
+}
+
+/** the name of a kind */
+static const char*
+evprof_kind_name(enum evprof_kind kind)
+{
+	switch(kind) {
+	case evprof_event: return "event";
+	case evprof_callback: return "callback";
+	default: break;
+	}
+	return "?";
+}
+
+int evprof_print(ldns_buffer* buf)
+{
+	struct evprof_entry* list[EVPROF_MAX];
+	const char* name;
+	int i, n = 0;
+	if(!evprof_on) {
+		return ldns_buffer_printf(buf, "profile off\n") != -1;
+	}
+	for(i=0; i<EVPROF_MAX; i++)
+		if(evprof.tab[i].func)
+			list[n++] = &evprof.tab[i];
+	qsort(list, (size_t)n, sizeof(*list), &evprof_cmp);
+	if(ldns_buffer_printf(buf, "profile on for %u sec\n",
+		(unsigned)(evprof_elapsed(&evprof.since)/1000000)) == -1 ||
+	   ldns_buffer_printf(buf, "%-8s %10s %12s %10s %10s  %s\n", "kind",
+		"calls", "total_msec", "avg_usec", "max_usec", "function")
+		== -1)
+		return 0;
+	for(i=0; i<n; i++) {
+		name = fptr_whitelist_name(list[i]->func);
+		if(ldns_buffer_printf(buf, "%-8s %10llu %12.3f %10llu %10llu  ",
+			evprof_kind_name(list[i]->kind),
+			(unsigned long long)list[i]->calls,
+			(double)list[i]->total/1000.,
+			(unsigned long long)(list[i]->total/list[i]->calls),
+			(unsigned long long)list[i]->max) == -1)
+			return 0;
+		if(name) {
+			if(ldns_buffer_printf(buf, "%s\n", name) == -1)
+				return 0;
+		} else if(ldns_buffer_printf(buf, "%p\n",
+			(void*)(size_t)list[i]->func) == -1)
+			return 0;
+	}
+	if(evprof.dropped && ldns_buffer_printf(buf, "not counted: %llu "
+		"calls\n", (unsigned long long)evprof.dropped) == -1)
+		return 0;
+	if(ldns_buffer_printf(buf, "loop iterations: %llu\n",
+		(unsigned long long)evprof.loops) == -1)
+		return 0;
+	for(i=0; i<EVPROF_BUCKETS; i++) {
+		if(!evprof.loop[i])
+			continue;
+		if(i == EVPROF_BUCKETS-1) {
+			if(ldns_buffer_printf(buf, "loop >= %llu usec: %llu\n",
+				(unsigned long long)1<<(i-1),
+				(unsigned long long)evprof.loop[i]) == -1)
+				return 0;
+		} else if(ldns_buffer_printf(buf, "loop < %llu usec: %llu\n",
+			(unsigned long long)1<<i,
+			(unsigned long long)evprof.loop[i]) == -1)
+			return 0;
+	}
+	return 1;
+}
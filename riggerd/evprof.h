@@ -0,0 +1,119 @@
+/*
+ * evprof.h - dnssec-trigger profile of the event loop
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the profile of the event loop.  When it is on, the
+ * handlers that the event loop calls and the callbacks of the comm points
+ * and timers are timed, and per function the calls, the total and the
+ * longest run time are counted.  The functions are named from the
+ * function pointer whitelist.  The event loop iterations, the time from
+ * the wakeup of the loop until it waits again, go in a histogram; that is
+ * kept by the builtin event loop.
+ *
+ * It is used by the event loop thread only.  When it is off, the cost is
+ * a test of evprof_on per callback.
+ */
+
+#ifndef EVPROF_H
+#define EVPROF_H
+#include <ldns/buffer.h>
+struct timeval;
+
+/** number of functions that are counted */
+#define EVPROF_MAX 128
+/** buckets of the loop histogram, bucket i is under 2^i usec */
+#define EVPROF_BUCKETS 24
+
+/**
+ * The kinds of functions that are timed.
+ */
+enum evprof_kind {
+	/** the handlers that the event loop calls */
+	evprof_event = 0,
+	/** the callbacks of the comm points and timers */
+	evprof_callback,
+	/** number of kinds */
+	EVPROF_KINDS
+};
+
+/** a function pointer, the functions are counted by their address */
+typedef void evprof_func_type(void);
+
+/** if the profile is on */
+extern int evprof_on;
+
+/**
+ * Turn the profile on or off.  Turning it on when it is off clears the
+ * counts.
+ * @param on: true to turn it on.
+ */
+void evprof_set(int on);
+
+/** clear the counts */
+void evprof_reset(void);
+
+/**
+ * Start to time a function.
+ * @param start: the start time is stored here, if the profile is on.
+ * @return true if the profile is on, pass it to evprof_end then.
+ */
+int evprof_begin(struct timeval* start);
+
+/**
+ * The timed function has returned, count it.
+ * @param start: from evprof_begin.
+ * @param kind: the kind of function.
+ * @param func: the function, cast to evprof_func_type.
+ */
+void evprof_end(struct timeval* start, enum evprof_kind kind,
+	evprof_func_type* func);
+
+/**
+ * The event loop iteration is done, count it in the histogram.
+ * @param start: from evprof_begin, when the loop woke up.
+ */
+void evprof_loop(struct timeval* start);
+
+/**
+ * Print the profile, a line per function with the most time first, and
+ * the histogram of the loop iterations.
+ * @param buf: printed into, at the position.
+ * @return false if it did not fit.
+ */
+int evprof_print(ldns_buffer* buf);
+
+#endif /* EVPROF_H */
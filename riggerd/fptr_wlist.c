@@ -50,6 +50,8 @@
 #include "mini_event.h"
 #include "http.h"
 #include "update.h"
+#include "hookq.h"
+#include "sched.h"
 #ifdef USE_WINSOCK
 #include "winrc/netlist.h"
 #include "winrc/win_svc.h"
@@ -69,6 +71,10 @@ fptr_whitelist_comm_point_raw(comm_point_callback_t *fptr)
 	if(fptr == &handle_ssl_accept) return 1;
 	else if(fptr == &http_get_callback) return 1;
 	else if(fptr == &control_callback) return 1;
+#ifndef USE_WINSOCK
+	else if(fptr == &handle_unix_accept) return 1;
+#endif
+	else if(fptr == &hookq_wake_cb) return 1;
 	return 0;
 }
 
@@ -78,8 +84,13 @@ fptr_whitelist_comm_timer(void (*fptr)(void*))
 	if(fptr == &outq_timeout) return 1;
 	else if(fptr == &svr_retry_callback) return 1;
 	else if(fptr == &http_get_timeout_handler) return 1;
+	else if(fptr == &http_get_race_timeout) return 1;
 	else if(fptr == &selfupdate_timeout) return 1;
+	else if(fptr == &sched_timeout) return 1;
 	else if(fptr == &svr_tcp_callback) return 1;
+#ifdef FWD_ZONES_SUPPORT
+	else if(fptr == &svr_lock_callback) return 1;
+#endif
 #ifdef USE_WINSOCK
 	else if(fptr == &wsvc_cron_cb) return 1;
 #endif
@@ -118,6 +129,49 @@ fptr_whitelist_rbtree_cmp(int (*fptr) (const void *, const void *))
 	return 0;
 }
 
+/** return the name if the function is fptr */
+#define FPTR_NAME(f) if(fptr == (void (*)(void))&f) return #f;
+
+const char*
+fptr_whitelist_name(void (*fptr)(void))
+{
+	FPTR_NAME(outq_handle_udp)
+	FPTR_NAME(outq_handle_tcp)
+	FPTR_NAME(handle_ssl_accept)
+	FPTR_NAME(http_get_callback)
+	FPTR_NAME(control_callback)
+#ifndef USE_WINSOCK
+	FPTR_NAME(handle_unix_accept)
+#endif
+	FPTR_NAME(hookq_wake_cb)
+	FPTR_NAME(outq_timeout)
+	FPTR_NAME(svr_retry_callback)
+	FPTR_NAME(http_get_timeout_handler)
+	FPTR_NAME(http_get_race_timeout)
+	FPTR_NAME(selfupdate_timeout)
+	FPTR_NAME(sched_timeout)
+	FPTR_NAME(svr_tcp_callback)
+#ifdef FWD_ZONES_SUPPORT
+	FPTR_NAME(svr_lock_callback)
+#endif
+#ifdef USE_WINSOCK
+	FPTR_NAME(wsvc_cron_cb)
+#endif
+	FPTR_NAME(comm_point_udp_callback)
+	FPTR_NAME(comm_point_udp_ancil_callback)
+	FPTR_NAME(comm_point_tcp_accept_callback)
+	FPTR_NAME(comm_point_tcp_handle_callback)
+	FPTR_NAME(comm_timer_callback)
+	FPTR_NAME(comm_signal_callback)
+	FPTR_NAME(comm_point_local_handle_callback)
+	FPTR_NAME(comm_point_raw_handle_callback)
+#ifdef USE_WINSOCK
+	FPTR_NAME(netlist_change_cb)
+	FPTR_NAME(worker_win_stop_cb)
+#endif
+	return NULL;
+}
+
 #ifdef USE_WINSOCK
 int fptr_whitelist_enum_reg(void (*fptr) (HKEY, void *))
 {
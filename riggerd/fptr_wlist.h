@@ -113,6 +113,14 @@ int fptr_whitelist_event(void (*fptr)(int, short, void *));
  */
 int fptr_whitelist_rbtree_cmp(int (*fptr) (const void *, const void *));
 
+/**
+ * The name of a function in the whitelists, for the event loop profile.
+ *
+ * @param fptr: function pointer, cast to this type.
+ * @return the name, or NULL if not in a whitelist.
+ */
+const char* fptr_whitelist_name(void (*fptr)(void));
+
 #ifdef USE_WINSOCK
 /** whitelist for registry enumeration function */
 int fptr_whitelist_enum_reg(void (*fptr) (HKEY, void *));
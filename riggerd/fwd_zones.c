@@ -2,94 +2,400 @@
 #include <stdbool.h>
 
 #include "fwd_zones.h"
-#include "../vendor/ccan/json/json.h"
+#include "log.h"
 
 #ifdef FWD_ZONES_SUPPORT
 
-struct nm_connection_list yield_connections_from_json(char *json)
+/**
+ * Single pass decoder for the update_all input. It walks the text once and
+ * fills the connection list while it goes, values that are not used are
+ * skipped (but checked). Malformed input is rejected where it is found.
+ */
+struct json_stream {
+    /** start of the input, for error positions */
+    const char *start;
+    /** current position in the input */
+    const char *p;
+    /** scratch buffer for the decoded string */
+    char *buf;
+    /** length of the decoded string in buf */
+    size_t len;
+    /** allocated size of buf */
+    size_t max;
+    /** error description or NULL */
+    const char *err;
+};
+
+/** max nesting depth of skipped values */
+#define JSON_STREAM_MAX_DEPTH 64
+
+static bool json_stream_fail(struct json_stream *js, const char *err)
 {
-    struct nm_connection_list ret;
-    nm_connection_list_init(&ret);
-
-    if (json_validate(json) == true) {
-	//printf("I've got valid json and it looks like this:\n%s\n", json);
-	JsonNode *node;
-	JsonNode *connection;
-	JsonNode *parameter;
-
-	/* Decode the input string and check it again */
-	JsonNode *head = json_decode(json);
-	if (NULL == head || head->tag != JSON_OBJECT) {
-            json_delete(head);
-	    return ret;
-
-	}
-
-	/* We expect to get a list of connections. Anything else is not valid input,
-	 * even though it might be valid json. */
-	node = head->children.head; // now it should be the first dictionary value i.e. connections
-	if (NULL == node || strncmp(node->key, "connections", 11) != 0) { // and also must be an array
-            json_delete(head);
-	    return ret;
-	}
-
-        /* Now we finally have the array of connections and this is
-         * its head */
-        connection = node->children.head;
-        /* Go through all connections and put them into the connection list ret */
-        while (NULL != connection) {
-
-            struct nm_connection *new_conn = (struct nm_connection *)calloc_or_die(sizeof(struct nm_connection));
-            nm_connection_init(new_conn);
-
-            /* Read all key:value pairs in each node. Expected values
-             * are: default, servers, type, zones */
-            parameter = connection->children.head;
-            while (NULL != parameter) {
-
-                // Check JSON key
-                if (JSON_BOOL == parameter->tag && strncmp(parameter->key, "default", 7) == 0) {
-                    new_conn->default_con = parameter->bool_;
-                } else if (JSON_STRING == parameter->tag && strncmp(parameter->key, "type", 4) == 0) {
-                    if (strncmp(parameter->string_, "wifi", 4) == 0) {
-                        new_conn->type = NM_CON_WIFI;
-                    } else if (strncmp(parameter->string_, "vpn", 3) == 0) {
-                        new_conn->type = NM_CON_VPN;
-                    } else if (strncmp(parameter->string_, "other", 5) == 0) {
-                        new_conn->type = NM_CON_OTHER;
-                    } else {
-                        new_conn->type = NM_CON_IGNORE;
-                    }
-                } else if (JSON_ARRAY == parameter->tag && strncmp(parameter->key, "zones", 5) == 0) {
-                    JsonNode *zone = parameter->children.head;
-                    while (NULL != zone) {
-                        string_list_push_back(&new_conn->zones, zone->string_, strlen(zone->string_));
-                        zone = zone->next;
-                    }
-                } else if (JSON_ARRAY == parameter->tag && strncmp(parameter->key, "servers", 7) == 0) {
-                    JsonNode *server = parameter->children.head;
-                    while (NULL != server) {
-                        string_list_push_back(&new_conn->servers, server->string_, strlen(server->string_));
-                        server = server->next;
-                    }
-                } else {
-                    // TODO: debug output: invalid json key
-                }
-
-                parameter = parameter->next;
+    if (NULL == js->err)
+        js->err = err;
+    return false;
+}
+
+static void json_stream_skip_space(struct json_stream *js)
+{
+    while (*js->p == ' ' || *js->p == '\t' || *js->p == '\n' || *js->p == '\r')
+        js->p++;
+}
+
+/** Skip whitespace and consume the character c */
+static bool json_stream_expect(struct json_stream *js, char c)
+{
+    json_stream_skip_space(js);
+    if (*js->p != c)
+        return json_stream_fail(js, "unexpected character");
+    js->p++;
+    return true;
+}
+
+/** Skip whitespace and consume c if it is the next character */
+static bool json_stream_accept(struct json_stream *js, char c)
+{
+    json_stream_skip_space(js);
+    if (*js->p != c)
+        return false;
+    js->p++;
+    return true;
+}
+
+static void json_stream_putc(struct json_stream *js, char c)
+{
+    if (js->len + 1 >= js->max) {
+        size_t newmax = js->max ? js->max * 2 : 256;
+        char *n = (char *)realloc(js->buf, newmax);
+        if (NULL == n)
+            fatal_exit("out of memory");
+        js->buf = n;
+        js->max = newmax;
+    }
+    js->buf[js->len++] = c;
+    js->buf[js->len] = 0;
+}
+
+static bool json_stream_hex4(struct json_stream *js, unsigned *out)
+{
+    int i;
+    *out = 0;
+    for (i = 0; i < 4; i++) {
+        char c = *js->p++;
+        *out <<= 4;
+        if (c >= '0' && c <= '9')
+            *out |= (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            *out |= (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            *out |= (unsigned)(c - 'A' + 10);
+        else
+            return json_stream_fail(js, "bad \\u escape");
+    }
+    return true;
+}
+
+/** Append code point as UTF-8 to the scratch buffer */
+static void json_stream_put_utf8(struct json_stream *js, unsigned u)
+{
+    if (u < 0x80) {
+        json_stream_putc(js, (char)u);
+    } else if (u < 0x800) {
+        json_stream_putc(js, (char)(0xC0 | (u >> 6)));
+        json_stream_putc(js, (char)(0x80 | (u & 0x3F)));
+    } else if (u < 0x10000) {
+        json_stream_putc(js, (char)(0xE0 | (u >> 12)));
+        json_stream_putc(js, (char)(0x80 | ((u >> 6) & 0x3F)));
+        json_stream_putc(js, (char)(0x80 | (u & 0x3F)));
+    } else {
+        json_stream_putc(js, (char)(0xF0 | (u >> 18)));
+        json_stream_putc(js, (char)(0x80 | ((u >> 12) & 0x3F)));
+        json_stream_putc(js, (char)(0x80 | ((u >> 6) & 0x3F)));
+        json_stream_putc(js, (char)(0x80 | (u & 0x3F)));
+    }
+}
+
+/** Decode a string value into the scratch buffer (js->buf, js->len) */
+static bool json_stream_string(struct json_stream *js)
+{
+    if (!json_stream_expect(js, '"'))
+        return false;
+    /* buf is also a valid "" for the empty string */
+    js->len = 0;
+    json_stream_putc(js, 0);
+    js->len = 0;
+    while (*js->p != '"') {
+        unsigned char c = (unsigned char)*js->p++;
+        unsigned u, u2;
+        if (c == 0)
+            return json_stream_fail(js, "unterminated string");
+        if (c < 0x20)
+            return json_stream_fail(js, "control character in string");
+        if (c != '\\') {
+            json_stream_putc(js, (char)c);
+            continue;
+        }
+        switch (*js->p++) {
+        case '"': json_stream_putc(js, '"'); break;
+        case '\\': json_stream_putc(js, '\\'); break;
+        case '/': json_stream_putc(js, '/'); break;
+        case 'b': json_stream_putc(js, '\b'); break;
+        case 'f': json_stream_putc(js, '\f'); break;
+        case 'n': json_stream_putc(js, '\n'); break;
+        case 'r': json_stream_putc(js, '\r'); break;
+        case 't': json_stream_putc(js, '\t'); break;
+        case 'u':
+            if (!json_stream_hex4(js, &u))
+                return false;
+            if (u >= 0xD800 && u <= 0xDBFF) {
+                /* surrogate pair */
+                if (js->p[0] != '\\' || js->p[1] != 'u')
+                    return json_stream_fail(js, "bad surrogate pair");
+                js->p += 2;
+                if (!json_stream_hex4(js, &u2))
+                    return false;
+                if (u2 < 0xDC00 || u2 > 0xDFFF)
+                    return json_stream_fail(js, "bad surrogate pair");
+                u = 0x10000 + ((u - 0xD800) << 10) + (u2 - 0xDC00);
+            } else if (u >= 0xDC00 && u <= 0xDFFF) {
+                return json_stream_fail(js, "bad surrogate pair");
             }
+            if (u == 0)
+                return json_stream_fail(js, "null character in string");
+            json_stream_put_utf8(js, u);
+            break;
+        default:
+            return json_stream_fail(js, "bad escape in string");
+        }
+    }
+    js->p++;
+    return true;
+}
 
-            nm_connection_list_push_back(&ret, new_conn);
-            connection = connection->next;
+static bool json_stream_digits(struct json_stream *js)
+{
+    if (*js->p < '0' || *js->p > '9')
+        return json_stream_fail(js, "bad number");
+    while (*js->p >= '0' && *js->p <= '9')
+        js->p++;
+    return true;
+}
+
+static bool json_stream_skip_number(struct json_stream *js)
+{
+    if (*js->p == '-')
+        js->p++;
+    if (*js->p == '0')
+        js->p++;
+    else if (!json_stream_digits(js))
+        return false;
+    if (*js->p == '.') {
+        js->p++;
+        if (!json_stream_digits(js))
+            return false;
+    }
+    if (*js->p == 'e' || *js->p == 'E') {
+        js->p++;
+        if (*js->p == '+' || *js->p == '-')
+            js->p++;
+        if (!json_stream_digits(js))
+            return false;
+    }
+    return true;
+}
+
+static bool json_stream_literal(struct json_stream *js, const char *lit)
+{
+    size_t len = strlen(lit);
+    if (strncmp(js->p, lit, len) != 0)
+        return json_stream_fail(js, "bad literal");
+    js->p += len;
+    return true;
+}
+
+/** Decode a true or false value */
+static bool json_stream_bool(struct json_stream *js, bool *val)
+{
+    json_stream_skip_space(js);
+    if (*js->p == 't') {
+        *val = true;
+        return json_stream_literal(js, "true");
+    }
+    *val = false;
+    return json_stream_literal(js, "false");
+}
+
+/** Check and skip any value */
+static bool json_stream_skip_value(struct json_stream *js, int depth)
+{
+    if (depth > JSON_STREAM_MAX_DEPTH)
+        return json_stream_fail(js, "nested too deep");
+    json_stream_skip_space(js);
+    switch (*js->p) {
+    case '"':
+        return json_stream_string(js);
+    case '{':
+        js->p++;
+        if (json_stream_accept(js, '}'))
+            return true;
+        do {
+            if (!json_stream_string(js) || !json_stream_expect(js, ':') ||
+                !json_stream_skip_value(js, depth + 1))
+                return false;
+        } while (json_stream_accept(js, ','));
+        return json_stream_expect(js, '}');
+    case '[':
+        js->p++;
+        if (json_stream_accept(js, ']'))
+            return true;
+        do {
+            if (!json_stream_skip_value(js, depth + 1))
+                return false;
+        } while (json_stream_accept(js, ','));
+        return json_stream_expect(js, ']');
+    case 't':
+        return json_stream_literal(js, "true");
+    case 'f':
+        return json_stream_literal(js, "false");
+    case 'n':
+        return json_stream_literal(js, "null");
+    default:
+        return json_stream_skip_number(js);
+    }
+}
+
+/** Decode an array of strings into the list */
+static bool json_stream_string_array(struct json_stream *js, struct string_list *list)
+{
+    if (!json_stream_expect(js, '['))
+        return false;
+    if (json_stream_accept(js, ']'))
+        return true;
+    do {
+        if (!json_stream_string(js))
+            return false;
+        /* empty strings are skipped, as they would become the root zone */
+        if (js->len > 0)
+            string_list_push_back(list, js->buf, js->len + 1);
+    } while (json_stream_accept(js, ','));
+    return json_stream_expect(js, ']');
+}
+
+static enum nm_connection_type json_stream_con_type(const char *type)
+{
+    if (strcmp(type, "wifi") == 0)
+        return NM_CON_WIFI;
+    else if (strcmp(type, "vpn") == 0)
+        return NM_CON_VPN;
+    else if (strcmp(type, "other") == 0)
+        return NM_CON_OTHER;
+    return NM_CON_IGNORE;
+}
+
+/** Decode one connection object. Expected keys are: default, servers, type,
+ * zones. Other keys, or values of other types, are skipped. */
+static bool json_stream_connection(struct json_stream *js, struct nm_connection *conn)
+{
+    if (!json_stream_expect(js, '{'))
+        return false;
+    if (json_stream_accept(js, '}'))
+        return true;
+    do {
+        if (!json_stream_string(js) || !json_stream_expect(js, ':'))
+            return false;
+        json_stream_skip_space(js);
+        if (strcmp(js->buf, "default") == 0 && (*js->p == 't' || *js->p == 'f')) {
+            if (!json_stream_bool(js, &conn->default_con))
+                return false;
+        } else if (strcmp(js->buf, "type") == 0 && *js->p == '"') {
+            if (!json_stream_string(js))
+                return false;
+            conn->type = json_stream_con_type(js->buf);
+        } else if (strcmp(js->buf, "zones") == 0 && *js->p == '[') {
+            if (!json_stream_string_array(js, &conn->zones))
+                return false;
+        } else if (strcmp(js->buf, "servers") == 0 && *js->p == '[') {
+            if (!json_stream_string_array(js, &conn->servers))
+                return false;
+        } else {
+            verbose(VERB_ALGO, "update_all: skip json key %s", js->buf);
+            if (!json_stream_skip_value(js, 1))
+                return false;
         }
-        json_delete(head);
-    } else {
-	printf("Invalid json input\n");
-        // TODO: log error message into syslog
+    } while (json_stream_accept(js, ','));
+    return json_stream_expect(js, '}');
+}
+
+/** Decode the array of connections and push them on the list */
+static bool json_stream_connections(struct json_stream *js, struct nm_connection_list *list)
+{
+    if (!json_stream_expect(js, '['))
+        return false;
+    if (json_stream_accept(js, ']'))
+        return true;
+    do {
+        struct nm_connection *new_conn = nm_connection_new(list);
+        /* push first, so that it is freed with the list on error */
+        nm_connection_list_push_back(list, new_conn);
+        if (!json_stream_connection(js, new_conn))
+            return false;
+    } while (json_stream_accept(js, ','));
+    return json_stream_expect(js, ']');
+}
+
+/** Decode the top level object, it must contain the connections array */
+static bool json_stream_top(struct json_stream *js, struct nm_connection_list *list)
+{
+    bool seen = false;
+    if (!json_stream_expect(js, '{'))
+        return false;
+    if (!json_stream_accept(js, '}')) {
+        do {
+            if (!json_stream_string(js) || !json_stream_expect(js, ':'))
+                return false;
+            if (strcmp(js->buf, "connections") == 0 && !seen) {
+                if (!json_stream_connections(js, list))
+                    return false;
+                seen = true;
+            } else if (!json_stream_skip_value(js, 1)) {
+                return false;
+            }
+        } while (json_stream_accept(js, ','));
+        if (!json_stream_expect(js, '}'))
+            return false;
     }
+    json_stream_skip_space(js);
+    if (*js->p != 0)
+        return json_stream_fail(js, "trailing characters");
+    if (!seen)
+        return json_stream_fail(js, "no connections array");
+    return true;
+}
 
-    return ret;
+struct nm_connection_list yield_connections_from_json(char *json)
+{
+    return yield_connections_from_json_region(json, NULL);
+}
 
+struct nm_connection_list yield_connections_from_json_region(char *json, struct region *region)
+{
+    struct nm_connection_list ret;
+    struct json_stream js;
+    nm_connection_list_init_region(&ret, region);
+    if (NULL == json)
+        return ret;
+
+    memset(&js, 0, sizeof(js));
+    js.start = json;
+    js.p = json;
+    if (!json_stream_top(&js, &ret)) {
+        log_err("update_all: invalid json input at offset %d: %s",
+            (int)(js.p - js.start), js.err ? js.err : "parse error");
+        nm_connection_list_clear(&ret);
+        nm_connection_list_init_region(&ret, region);
+    }
+    free(js.buf);
+    return ret;
 }
 
 #endif
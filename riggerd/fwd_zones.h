@@ -11,4 +11,10 @@
  */
 struct nm_connection_list yield_connections_from_json(char *json);
 
+/**
+ * Like yield_connections_from_json, but the list is allocated from
+ * the region (or the heap if the region is NULL).
+ */
+struct nm_connection_list yield_connections_from_json_region(char *json, struct region *region);
+
 #endif /* FWD_ZONES_H */
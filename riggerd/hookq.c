@@ -0,0 +1,353 @@
+/*
+ * hookq.c - dnssec-trigger worker threads for the hooks
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the worker threads that perform the hooks.
+ */
+#include "config.h"
+#include "hookq.h"
+#include "log.h"
+#include "netevent.h"
+#include "net_help.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/** a job in a queue */
+struct hookq_job {
+	/** next in the queue of the target, or in the done list */
+	struct hookq_job* next;
+	/** performs the job in a worker, NULL for hookq_main calls */
+	hookq_func_type* run;
+	/** called on the event loop, or NULL */
+	hookq_func_type* done;
+	/** argument for run and done */
+	void* arg;
+};
+
+#ifdef HAVE_PTHREAD
+/**
+ * The queues of the jobs.  The lock protects the queues, the done list,
+ * the busy flags and stop; the rest is only used by the event loop.
+ */
+static struct hookq {
+	/** jobs to perform, per target, in order */
+	struct hookq_job* first[HOOKQ_TARGETS];
+	/** last job per target, to append to */
+	struct hookq_job* last[HOOKQ_TARGETS];
+	/** if a worker performs a job for the target */
+	int busy[HOOKQ_TARGETS];
+	/** performed jobs, to call done for on the event loop */
+	struct hookq_job* done_first;
+	/** last performed job */
+	struct hookq_job* done_last;
+	/** if the workers have to stop when the queues are empty */
+	int stop;
+	/** number of jobs submitted and not done */
+	int pending;
+	/** if the workers are running */
+	int running;
+	/** number of worker threads started */
+	int num_thr;
+	/** the worker threads */
+	pthread_t thr[HOOKQ_WORKERS];
+	/** the event loop thread */
+	pthread_t main;
+	/** lock for the queues */
+	pthread_mutex_t lock;
+	/** the workers wait on this for jobs */
+	pthread_cond_t cond;
+	/** hookq_wait waits on this for performed jobs */
+	pthread_cond_t done_cond;
+	/** the wake pipe, a byte is written when the done list fills */
+	int wake[2];
+	/** listens on the read end of the wake pipe */
+	struct comm_point* wake_c;
+} hookq;
+
+/** put a job on the done list and wake up the event loop, with lock */
+static void
+hookq_done_put(struct hookq_job* job)
+{
+	job->next = NULL;
+	if(hookq.done_last)
+		hookq.done_last->next = job;
+	else {
+		/* the event loop reads the pipe empty before it takes the
+		 * list, one byte per time it fills is enough */
+		if(write(hookq.wake[1], "", 1) == -1 && errno != EAGAIN &&
+			errno != EINTR)
+			log_err("hookq wake: %s", strerror(errno));
+		hookq.done_first = job;
+	}
+	hookq.done_last = job;
+	pthread_cond_broadcast(&hookq.done_cond);
+}
+
+/** the worker thread, performs jobs until stopped */
+static void*
+hookq_worker(void* ATTR_UNUSED(arg))
+{
+	struct hookq_job* job;
+	int t;
+	pthread_mutex_lock(&hookq.lock);
+	while(1) {
+		/* the first job of a target that no one works on */
+		job = NULL;
+		for(t=0; t<HOOKQ_TARGETS; t++) {
+			if(hookq.first[t] && !hookq.busy[t]) {
+				job = hookq.first[t];
+				hookq.first[t] = job->next;
+				if(!hookq.first[t])
+					hookq.last[t] = NULL;
+				hookq.busy[t] = 1;
+				break;
+			}
+		}
+		if(!job) {
+			/* the jobs of busy targets are done by their worker */
+			if(hookq.stop)
+				break;
+			pthread_cond_wait(&hookq.cond, &hookq.lock);
+			continue;
+		}
+		pthread_mutex_unlock(&hookq.lock);
+		(*job->run)(job->arg);
+		pthread_mutex_lock(&hookq.lock);
+		hookq.busy[t] = 0;
+		hookq_done_put(job);
+	}
+	pthread_mutex_unlock(&hookq.lock);
+	return NULL;
+}
+
+/** call the done functions of the performed jobs, on the event loop */
+static void
+hookq_run_done(void)
+{
+	struct hookq_job* job, *next;
+	pthread_mutex_lock(&hookq.lock);
+	job = hookq.done_first;
+	hookq.done_first = NULL;
+	hookq.done_last = NULL;
+	pthread_mutex_unlock(&hookq.lock);
+	while(job) {
+		next = job->next;
+		if(job->run)
+			hookq.pending--;
+		if(job->done)
+			(*job->done)(job->arg);
+		free(job);
+		job = next;
+	}
+}
+#endif /* HAVE_PTHREAD */
+
+int
+hookq_start(struct comm_base* base)
+{
+#ifdef HAVE_PTHREAD
+	int i, r;
+	if(hookq.running)
+		return 1;
+	memset(&hookq, 0, sizeof(hookq));
+	if(pipe(hookq.wake) == -1) {
+		log_err("hookq pipe: %s", strerror(errno));
+		return 0;
+	}
+	fd_set_nonblock(hookq.wake[0]);
+	fd_set_nonblock(hookq.wake[1]);
+	hookq.wake_c = comm_point_create_raw(base, hookq.wake[0], 0,
+		&hookq_wake_cb, NULL);
+	if(!hookq.wake_c) {
+		log_err("out of memory");
+		close(hookq.wake[0]);
+		close(hookq.wake[1]);
+		return 0;
+	}
+	hookq.wake_c->do_not_close = 0;
+	pthread_mutex_init(&hookq.lock, NULL);
+	pthread_cond_init(&hookq.cond, NULL);
+	pthread_cond_init(&hookq.done_cond, NULL);
+	hookq.main = pthread_self();
+	/* set before the threads, they read it for hookq_main */
+	hookq.running = 1;
+	for(i=0; i<HOOKQ_WORKERS; i++) {
+		if((r=pthread_create(&hookq.thr[i], NULL, hookq_worker, NULL))
+			!= 0) {
+			log_err("could not start hook thread: %s",
+				strerror(r));
+			break;
+		}
+		hookq.num_thr++;
+	}
+	if(hookq.num_thr == 0) {
+		hookq.running = 0;
+		pthread_cond_destroy(&hookq.done_cond);
+		pthread_cond_destroy(&hookq.cond);
+		pthread_mutex_destroy(&hookq.lock);
+		comm_point_delete(hookq.wake_c);
+		close(hookq.wake[1]);
+		return 0;
+	}
+	verbose(VERB_ALGO, "started %d hook threads", hookq.num_thr);
+	return 1;
+#else
+	(void)base;
+	return 0;
+#endif /* HAVE_PTHREAD */
+}
+
+void
+hookq_stop(void)
+{
+#ifdef HAVE_PTHREAD
+	int i;
+	if(!hookq.running)
+		return;
+	pthread_mutex_lock(&hookq.lock);
+	hookq.stop = 1;
+	pthread_cond_broadcast(&hookq.cond);
+	pthread_mutex_unlock(&hookq.lock);
+	for(i=0; i<hookq.num_thr; i++)
+		pthread_join(hookq.thr[i], NULL);
+	/* the done functions can submit jobs, they are performed now */
+	hookq.running = 0;
+	hookq_run_done();
+	pthread_cond_destroy(&hookq.done_cond);
+	pthread_cond_destroy(&hookq.cond);
+	pthread_mutex_destroy(&hookq.lock);
+	comm_point_delete(hookq.wake_c);
+	hookq.wake_c = NULL;
+	close(hookq.wake[1]);
+#endif /* HAVE_PTHREAD */
+}
+
+void
+hookq_wait(void)
+{
+#ifdef HAVE_PTHREAD
+	if(!hookq.running)
+		return;
+	while(hookq.pending > 0) {
+		pthread_mutex_lock(&hookq.lock);
+		while(!hookq.done_first)
+			pthread_cond_wait(&hookq.done_cond, &hookq.lock);
+		pthread_mutex_unlock(&hookq.lock);
+		hookq_run_done();
+	}
+#endif /* HAVE_PTHREAD */
+}
+
+void
+hookq_submit(enum hookq_target target, hookq_func_type* run,
+	hookq_func_type* done, void* arg)
+{
+#ifdef HAVE_PTHREAD
+	struct hookq_job* job;
+	if(hookq.running) {
+		job = (struct hookq_job*)calloc(1, sizeof(*job));
+		if(job) {
+			job->run = run;
+			job->done = done;
+			job->arg = arg;
+			pthread_mutex_lock(&hookq.lock);
+			if(hookq.last[target])
+				hookq.last[target]->next = job;
+			else	hookq.first[target] = job;
+			hookq.last[target] = job;
+			pthread_cond_signal(&hookq.cond);
+			pthread_mutex_unlock(&hookq.lock);
+			hookq.pending++;
+			return;
+		}
+		/* perform it now, after the jobs that are before it */
+		log_err("out of memory");
+		hookq_wait();
+	}
+#else
+	(void)target;
+#endif /* HAVE_PTHREAD */
+	(*run)(arg);
+	if(done)
+		(*done)(arg);
+}
+
+void
+hookq_main(hookq_func_type* func, void* arg)
+{
+#ifdef HAVE_PTHREAD
+	struct hookq_job* job;
+	if(hookq.running && !pthread_equal(pthread_self(), hookq.main)) {
+		job = (struct hookq_job*)calloc(1, sizeof(*job));
+		if(!job) {
+			log_err("out of memory");
+			return;
+		}
+		job->done = func;
+		job->arg = arg;
+		pthread_mutex_lock(&hookq.lock);
+		hookq_done_put(job);
+		pthread_mutex_unlock(&hookq.lock);
+		return;
+	}
+#endif /* HAVE_PTHREAD */
+	(*func)(arg);
+}
+
+int
+hookq_pending(void)
+{
+#ifdef HAVE_PTHREAD
+	return hookq.pending;
+#else
+	return 0;
+#endif
+}
+
+int
+hookq_wake_cb(struct comm_point* ATTR_UNUSED(c), void* ATTR_UNUSED(arg),
+	int ATTR_UNUSED(err), struct comm_reply* ATTR_UNUSED(reply_info))
+{
+#ifdef HAVE_PTHREAD
+	char buf[64];
+	while(read(hookq.wake[0], buf, sizeof(buf)) > 0)
+		;
+	hookq_run_done();
+#endif
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * hookq.h - dnssec-trigger worker threads for the hooks
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the worker threads that perform the hooks.  The
+ * unbound-control commands and the resolv.conf changes block, for as long
+ * as unbound or the file system take, and they are submitted as jobs
+ * instead of being run on the event loop.  The jobs for one target are
+ * performed in the order they were submitted, one at a time; jobs for
+ * different targets run at the same time.  When a job is done, its done
+ * function is called on the event loop, woken up by a pipe.
+ *
+ * Without threads, or when the workers are not started, a job is
+ * performed right away, when it is submitted.
+ */
+
+#ifndef HOOKQ_H
+#define HOOKQ_H
+struct comm_base;
+struct comm_point;
+struct comm_reply;
+
+/** number of worker threads */
+#define HOOKQ_WORKERS 2
+
+/**
+ * The targets of the hooks, the jobs for a target are performed in order.
+ */
+enum hookq_target {
+	/** unbound-control commands */
+	hookq_unbound = 0,
+	/** resolv.conf and the system resolver */
+	hookq_resolv,
+	/** number of targets */
+	HOOKQ_TARGETS
+};
+
+/** function of a job, it gets the argument of the job */
+typedef void hookq_func_type(void* arg);
+
+/**
+ * Start the worker threads, after the daemon has forked.
+ * @param base: the event base, its loop performs the done functions.
+ * @return false on failure, the jobs are then performed when submitted.
+ */
+int hookq_start(struct comm_base* base);
+
+/**
+ * Stop the worker threads.  The jobs that are submitted are performed
+ * first, and their done functions called, so the system is left in the
+ * state that was asked for.  Jobs submitted after this are performed
+ * right away.
+ */
+void hookq_stop(void);
+
+/**
+ * Wait until the submitted jobs are performed, and call their done
+ * functions.  Blocks, used when the config they use is replaced.
+ */
+void hookq_wait(void);
+
+/**
+ * Submit a job.
+ * @param target: the jobs of the target are performed in order.
+ * @param run: performs the job, in a worker thread.
+ * @param done: called on the event loop after run, with the same arg.
+ *	It frees the arg.  Can be NULL.
+ * @param arg: argument for run and done, owned by the job.
+ */
+void hookq_submit(enum hookq_target target, hookq_func_type* run,
+	hookq_func_type* done, void* arg);
+
+/**
+ * Call a function on the event loop.  From a worker thread it is queued
+ * with the done functions, on the event loop it is called right away.
+ * @param func: the function, it frees the arg.
+ * @param arg: argument for it.
+ */
+void hookq_main(hookq_func_type* func, void* arg);
+
+/** number of jobs that are submitted and not done */
+int hookq_pending(void);
+
+/** callback for the wake pipe, calls the done functions; on the event loop */
+int hookq_wake_cb(struct comm_point* c, void* arg, int err,
+	struct comm_reply* reply_info);
+
+#endif /* HOOKQ_H */
@@ -39,6 +39,7 @@
  * This file contains an implementation of HTTP fetch for a simple URL file.
  */
 #include "config.h"
+#include <ctype.h>
 #include <ldns/ldns.h>
 #include "riggerd/http.h"
 #include "riggerd/netevent.h"
@@ -48,6 +49,7 @@
 #include "riggerd/cfg.h"
 #include "riggerd/net_help.h"
 #include "riggerd/update.h"
+#include "riggerd/memstats.h"
 #ifdef USE_WINSOCK
 #include "winsock_event.h"
 #endif
@@ -103,6 +105,183 @@ http_probe_setup_url(struct http_general* hg, struct http_probe* hp, size_t i)
 	return 1;
 }
 
+struct http_addr_cache* http_addr_cache_create(void)
+{
+	return (struct http_addr_cache*)calloc(1, sizeof(struct
+		http_addr_cache));
+}
+
+/** delete an entry of the address cache */
+static void http_addr_entry_delete(struct http_addr_entry* e)
+{
+	if(!e) return;
+	free(e->hostname);
+	ldns_rr_list_deep_free(e->addr);
+	free(e);
+}
+
+/** remove all entries from the address cache */
+static void http_addr_cache_clear(struct http_addr_cache* c)
+{
+	struct http_addr_entry* e = c->list, *n;
+	while(e) {
+		n = e->next;
+		http_addr_entry_delete(e);
+		e = n;
+	}
+	c->list = NULL;
+	c->num = 0;
+}
+
+void http_addr_cache_delete(struct http_addr_cache* c)
+{
+	if(!c) return;
+	http_addr_cache_clear(c);
+	free(c->network);
+	free(c);
+}
+
+/** the current time, of the event loop, in seconds */
+static uint32_t http_now(void)
+{
+	uint32_t* secs;
+	struct timeval* tv;
+	comm_base_timept(global_svr->base, &secs, &tv);
+	return *secs;
+}
+
+/** compare strings for qsort */
+static int http_strcmp(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+void http_addr_cache_network(struct http_addr_cache* c,
+	struct probe_ip* probes)
+{
+	struct probe_ip* p;
+	char** names, *net;
+	size_t n = 0, i, len = 1;
+	for(p = probes; p; p=p->next)
+		if(probe_is_cache(p)) {
+			n++;
+			len += strlen(p->name)+1;
+		}
+	names = (char**)calloc(n+1, sizeof(char*));
+	net = (char*)malloc(len);
+	if(!names || !net) {
+		log_err("out of memory");
+		free(names);
+		free(net);
+		http_addr_cache_clear(c);
+		free(c->network);
+		c->network = NULL;
+		return;
+	}
+	n = 0;
+	for(p = probes; p; p=p->next)
+		if(probe_is_cache(p))
+			names[n++] = p->name;
+	qsort(names, n, sizeof(char*), &http_strcmp);
+	len = 0;
+	for(i=0; i<n; i++) {
+		if(i != 0)
+			net[len++] = ' ';
+		memmove(net+len, names[i], strlen(names[i]));
+		len += strlen(names[i]);
+	}
+	net[len] = 0;
+	free(names);
+	if(c->network && strcmp(c->network, net) == 0) {
+		free(net);
+		return;
+	}
+	if(c->list)
+		verbose(VERB_ALGO, "new network, drop cached http addresses");
+	http_addr_cache_clear(c);
+	free(c->network);
+	c->network = net;
+}
+
+/** find the entry for hostname, and drop expired entries on the way.
+ * @return NULL if not there, else the entry. */
+static struct http_addr_entry* http_addr_cache_find(struct http_addr_cache* c,
+	const char* hostname, int ip6, uint32_t now,
+	struct http_addr_entry*** prev)
+{
+	struct http_addr_entry* e = c->list, **pe = &c->list;
+	while(e) {
+		if(e->expire <= now) {
+			(*pe) = e->next;
+			http_addr_entry_delete(e);
+			c->num--;
+			e = (*pe);
+			continue;
+		}
+		if(e->ip6 == ip6 && strcmp(e->hostname, hostname) == 0) {
+			if(prev) *prev = pe;
+			return e;
+		}
+		pe = &e->next;
+		e = e->next;
+	}
+	return NULL;
+}
+
+ldns_rr_list* http_addr_cache_lookup(struct http_addr_cache* c,
+	const char* hostname, int ip6, uint32_t now)
+{
+	struct http_addr_entry* e = http_addr_cache_find(c, hostname, ip6,
+		now, NULL);
+	if(!e) return NULL;
+	return ldns_rr_list_clone(e->addr);
+}
+
+/** remove the addresses of the hostname from the cache */
+static void http_addr_cache_remove(struct http_addr_cache* c,
+	const char* hostname, int ip6, uint32_t now)
+{
+	struct http_addr_entry** pe = NULL;
+	struct http_addr_entry* e = http_addr_cache_find(c, hostname, ip6,
+		now, &pe);
+	if(!e) return;
+	*pe = e->next;
+	http_addr_entry_delete(e);
+	c->num--;
+}
+
+void http_addr_cache_store(struct http_addr_cache* c,
+	const char* hostname, int ip6, ldns_rr_list* addr, uint32_t now)
+{
+	struct http_addr_entry* e;
+	uint32_t ttl = 0;
+	size_t i;
+	for(i=0; i<ldns_rr_list_rr_count(addr); i++) {
+		if(i == 0 || ldns_rr_ttl(ldns_rr_list_rr(addr, i)) < ttl)
+			ttl = ldns_rr_ttl(ldns_rr_list_rr(addr, i));
+	}
+	http_addr_cache_remove(c, hostname, ip6, now);
+	if(ttl == 0 || c->num >= HTTP_ADDR_CACHE_MAX)
+		return;
+	e = (struct http_addr_entry*)calloc(1, sizeof(*e));
+	if(!e) {
+		log_err("out of memory");
+		return;
+	}
+	e->hostname = strdup(hostname);
+	e->addr = ldns_rr_list_clone(addr);
+	if(!e->hostname || !e->addr) {
+		log_err("out of memory");
+		http_addr_entry_delete(e);
+		return;
+	}
+	e->ip6 = ip6;
+	e->expire = now + ttl;
+	e->next = c->list;
+	c->list = e;
+	c->num++;
+}
+
 /** create probe for address */
 static void
 probe_create_addr(const char* ip, const char* domain, int rrtype)
@@ -137,6 +316,7 @@ probe_create_addr(const char* ip, const char* domain, int rrtype)
 	p->next = global_svr->probes;
 	global_svr->probes = p;
 	global_svr->num_probes++;
+	memstats_set(memstats_probes, &p->mem, sizeof(*p)+strlen(p->name)+1);
 }
 
 /** create address lookup queries for http probe */
@@ -160,6 +340,26 @@ http_probe_make_addr_queries(struct http_general* hg, struct http_probe* hp)
 	}
 }
 
+/** lookup the addresses of the hostname, in the cache or at the
+ * cache resolvers */
+static void
+http_probe_lookup_addr(struct http_general* hg, struct http_probe* hp)
+{
+	hp->addr = http_addr_cache_lookup(hg->svr->http_addrs, hp->hostname,
+		hp->ip6, http_now());
+	if(hp->addr) {
+		verbose(VERB_ALGO, "cached addr for %s%s", hp->hostname,
+			hp->ip6?" AAAA":"");
+		hp->addr_cached = 1;
+		hp->got_addrs = 1;
+		hp->do_addr = 0;
+		http_probe_start_http_get(hp);
+		return;
+	}
+	hp->addr_cached = 0;
+	http_probe_make_addr_queries(hg, hp);
+}
+
 /** see if hp ip6 fits with probe ip6 */
 static int
 right_ip6(struct http_probe* hp, struct probe_ip* p)
@@ -349,7 +549,8 @@ static void http_probe_done(struct http_general* hg,
 				http_general_done(reason);
 			}
 		} else {
-			if(!hg->v6 || hg->v6->finished) {
+			/* the v6 probe is started after this one */
+			if(hg->v6 && hg->v6->finished) {
 				http_general_done(reason);
 			}
 		}
@@ -368,6 +569,7 @@ static void http_probe_go_next_url(struct http_general* hg,
 	hp->filename = NULL;
 	ldns_rr_list_deep_free(hp->addr);
 	hp->addr = NULL;
+	hp->addr_cached = 0;
 	hp->num_addr_qs = 0;
 	hp->num_failed_addr_qs = 0;
 	hp->port = HTTP_PORT;
@@ -400,7 +602,7 @@ static void http_probe_go_next_url(struct http_general* hg,
 		http_probe_start_http_get(hp);
 		return;
 	}
-	http_probe_make_addr_queries(hg, hp);
+	http_probe_lookup_addr(hg, hp);
 }
 
 /** http probe is done with an address, check next addr */
@@ -450,6 +652,10 @@ static void http_probe_done_addr(struct http_general* hg,
 		http_probe_start_http_get(hp);
 		return;
 	}
+	/* the cached addresses do not work, look them up the next time */
+	if(hp->addr_cached)
+		http_addr_cache_remove(hg->svr->http_addrs, hp->hostname,
+			hp->ip6, http_now());
 	/* no more addresses? try the next url */
 	if(hp->url_idx+1 < global_svr->http->url_num) {
 		http_probe_go_next_url(hg, hp, NULL);
@@ -494,6 +700,24 @@ http_probe_create_get(struct http_probe* hp, ldns_rr* addr, char** reason)
 	/* put a cap on the max data size because we expect very short
 	 * responses for our probe */
 	p->http->data_limit = MAX_HTTP_LENGTH*10;
+	/* a hotspot page is not the expected content, and it is done
+	 * at the first character that differs */
+	p->http->expect = global_svr->http->codes[hp->url_idx];
+	/* race the connects to the other addresses, so that a broken
+	 * address does not cost the http timeout */
+	while(hp->addr && ldns_rr_list_rr_count(hp->addr) != 0 &&
+		p->http->race_num < HTTP_RACE_MAX) {
+		ldns_rr* rr = http_pick_random_addr(hp->addr);
+		char* s = NULL;
+		if(ldns_rr_rdf(rr, 0))
+			s = ldns_rdf2str(ldns_rr_rdf(rr, 0));
+		ldns_rr_free(rr);
+		if(!s || !http_get_add_dest(p->http, s)) {
+			free(s);
+			break;
+		}
+		free(s);
+	}
 	if(!http_get_fetch(p->http, p->name, hp->port, reason)) {
 		http_get_delete(p->http);
 		free(p->name); 
@@ -513,6 +737,7 @@ http_probe_create_get(struct http_probe* hp, ldns_rr* addr, char** reason)
 	p->next = global_svr->probes;
 	global_svr->probes = p;
 	global_svr->num_probes++;
+	memstats_set(memstats_probes, &p->mem, sizeof(*p)+strlen(p->name)+1);
 	return 1;
 }
 
@@ -588,7 +813,7 @@ http_probe_start(struct http_general* hg, int ip6)
 		http_probe_start_http_get(hp);
 		return hp;
 	}
-	http_probe_make_addr_queries(hg, hp);
+	http_probe_lookup_addr(hg, hp);
 	return hp;
 }
 
@@ -653,16 +878,22 @@ struct http_general* http_general_start(struct svr* svr)
 	}
 	/* randomly pick that number of urls from the config */
 	fill_urls(hg);
+	/* are the cached addresses for this network */
+	http_addr_cache_network(svr->http_addrs, svr->probes);
+	/* the probes can start the http get now, and that uses it */
+	svr->http = hg;
 	/* start v4 and v6 */
 	hg->v4 = http_probe_start(hg, 0);
 	if(!hg->v4) {
 		log_err("out of memory");
+		svr->http = NULL;
 		http_general_delete(hg);
 		return NULL;
 	}
 	hg->v6 = http_probe_start(hg, 1);
 	if(!hg->v6) {
 		log_err("out of memory");
+		svr->http = NULL;
 		http_general_delete(hg);
 		return NULL;
 	}
@@ -749,6 +980,7 @@ void http_host_outq_done(struct probe_ip* p, const char* reason)
 
 void http_host_outq_result(struct probe_ip* p, ldns_pkt* pkt)
 {
+	struct http_probe* hp;
 	/* not picked by name because of CNAMEs */
 	ldns_rr_list* addr = ldns_pkt_rr_list_by_type(pkt, p->http_ip6?
 		LDNS_RR_TYPE_AAAA:LDNS_RR_TYPE_A, LDNS_SECTION_ANSWER);
@@ -760,32 +992,32 @@ void http_host_outq_result(struct probe_ip* p, ldns_pkt* pkt)
 		return;
 	}
 	/* store the address results */
-	if(p->http_ip6)
-		global_svr->http->v6->addr = addr;
-	else 	global_svr->http->v4->addr = addr;
+	hp = p->http_ip6?global_svr->http->v6:global_svr->http->v4;
+	http_addr_cache_store(global_svr->http_addrs, hp->hostname,
+		p->http_ip6, addr, http_now());
+	hp->addr = addr;
 	http_host_outq_done(p, NULL);
 }
 
-/** check if the data is correct, ignore whitespace */
+/** check data against the expected content as it arrives, leading and
+ * trailing whitespace is ignored.  @return false if it is different. */
 static int
-hg_check_data(ldns_buffer* data, char* result)
+hg_match_data(struct http_get* hg, uint8_t* data, size_t len)
 {
-	char* s = (char*)ldns_buffer_begin(data);
-	size_t result_len = strlen(result);
-
-	while(isspace(*s))
-		s++;
-	if(strncmp(s, result, result_len) != 0)
-		return 0;
-	/*
-	 * check that there is nothing else
-	 * than whitespaces after the expected string
-	 */
-	s += result_len;
-	while(isspace(*s))
-		s++;
-	if(*s != 0)
-		return 0;
+	size_t i, n = strlen(hg->expect);
+	for(i=0; i<len; i++) {
+		int c = (int)data[i];
+		if(hg->expect_pos == 0 && isspace(c))
+			continue;
+		if(hg->expect_pos < n) {
+			if(c != (int)(unsigned char)hg->expect[hg->expect_pos])
+				return 0;
+			hg->expect_pos++;
+		} else if(!isspace(c)) {
+			/* there is something else after the expected string */
+			return 0;
+		}
+	}
 	return 1;
 }
 
@@ -814,9 +1046,8 @@ http_get_done(struct http_get* hg, char* reason, int connects, char* redirect)
 	if(!reason || connects)
 		hp->connects = 1;
 	if(!reason && !redirect) {
-		/* check the data */
-		if(!hg_check_data(hg->data,
-			global_svr->http->codes[hp->url_idx]))
+		/* the data is checked as it arrived, is all of it there */
+		if(!hg->expect || hg->expect_pos != strlen(hg->expect))
 			reason = "wrong page content";
 		else 	verbose(VERB_ALGO, "correct page content from %s",
 				p->name);
@@ -860,6 +1091,26 @@ http_get_timeout_handler(void* arg)
 	http_get_done(hg, "timeout", 0, NULL);
 }
 
+/** set the bytes of the http get in the memstats, after its buffers
+ * grow or its connections change */
+static void hg_account(struct http_get* hg)
+{
+	size_t s = sizeof(*hg) + strlen(hg->url) + 1;
+	int i;
+	if(hg->buf)
+		s += sizeof(*hg->buf) + ldns_buffer_capacity(hg->buf);
+	if(hg->data)
+		s += sizeof(*hg->data) + ldns_buffer_capacity(hg->data);
+	if(hg->timer)
+		s += comm_timer_get_mem(hg->timer);
+	if(hg->race_timer)
+		s += comm_timer_get_mem(hg->race_timer);
+	s += comm_point_get_mem(hg->cp);
+	for(i=0; i<hg->race_num; i++)
+		s += comm_point_get_mem(hg->race_cp[i]);
+	memstats_set(memstats_http, &hg->mem, s);
+}
+
 struct http_get* http_get_create(const char* url, struct comm_base* base,
 	struct probe_ip* probe)
 {
@@ -895,6 +1146,7 @@ struct http_get* http_get_create(const char* url, struct comm_base* base,
 		return NULL;
 	}
 	hg->base = base;
+	hg_account(hg);
 	return hg;
 }
 
@@ -919,9 +1171,12 @@ prep_get_cmd(struct http_get* hg)
 	return 1;
 }
 
-/** connect to destination IP (nonblocking), return fd (or -1). */
+/** connect to destination IP (nonblocking), return fd (or -1).  With
+ * fastopen the connect returns at once and the socket is writable before
+ * the handshake is done, so it is not used for connects that race. */
 static int
-http_get_connect(struct sockaddr_storage* addr, socklen_t addrlen, char** err)
+http_get_connect(struct sockaddr_storage* addr, socklen_t addrlen,
+	int fastopen, char** err)
 {
 	int fd;
 #ifdef INET6
@@ -947,6 +1202,8 @@ http_get_connect(struct sockaddr_storage* addr, socklen_t addrlen, char** err)
 		return -1;
 	}
 	fd_set_nonblock(fd);
+	if(fastopen)
+		(void)fd_set_tcp_fastopen(fd);
 	if(connect(fd, (struct sockaddr*)addr, addrlen) == -1) {
 #ifndef USE_WINSOCK
 #ifdef EINPROGRESS
@@ -973,52 +1230,70 @@ http_get_connect(struct sockaddr_storage* addr, socklen_t addrlen, char** err)
 	return fd;
 }
 
-/** write buffer to socket, returns true if done, false if notdone or error */
-static int hg_write_buf(struct http_get* hg, ldns_buffer* buf)
+/** check the nonblocking connect of the commpoint.
+ * @return 1 if connected, 0 if not yet, -1 on error, with str set. */
+static int hg_check_connect(struct comm_point* cp, char** str)
 {
-	ssize_t r;
-	char* str = NULL;
-	int fd = hg->cp->fd;
-	if(hg->cp->tcp_check_nb_connect) {
-		/* check for pending error from nonblocking connect */
-		/* from Stevens, unix network programming, vol1, 3rd ed, p450*/
-		int error = 0;
-		socklen_t len = (socklen_t)sizeof(error);
-		if(getsockopt(fd, SOL_SOCKET, SO_ERROR, (void*)&error,\
-			&len) < 0) {
+	/* check for pending error from nonblocking connect */
+	/* from Stevens, unix network programming, vol1, 3rd ed, p450*/
+	int error = 0;
+	socklen_t len = (socklen_t)sizeof(error);
+	if(getsockopt(cp->fd, SOL_SOCKET, SO_ERROR, (void*)&error,
+		&len) < 0) {
 #ifndef USE_WINSOCK
-			error = errno; /* on solaris errno is error */
+		error = errno; /* on solaris errno is error */
 #else /* USE_WINSOCK */
-			error = WSAGetLastError();
+		error = WSAGetLastError();
 #endif
-		}
+	}
 #ifndef USE_WINSOCK
 #if defined(EINPROGRESS) && defined(EWOULDBLOCK)
-		if(error == EINPROGRESS || error == EWOULDBLOCK)
-			return 0; /* try again later */
-		else
+	if(error == EINPROGRESS || error == EWOULDBLOCK)
+		return 0; /* try again later */
+	else
 #endif
-		if(error != 0) {
-			str = strerror(error);
+	if(error != 0) {
+		*str = strerror(error);
 #else /* USE_WINSOCK */
-		if(error == WSAEINPROGRESS)
-			return 0;
-		else if(error == WSAEWOULDBLOCK) {
-			winsock_tcp_wouldblock(comm_point_internal(hg->cp),
-				EV_WRITE);
-			return 0;
-		} else if(error != 0) {
-			str = wsa_strerror(error);
+	if(error == WSAEINPROGRESS)
+		return 0;
+	else if(error == WSAEWOULDBLOCK) {
+		winsock_tcp_wouldblock(comm_point_internal(cp), EV_WRITE);
+		return 0;
+	} else if(error != 0) {
+		*str = wsa_strerror(error);
 #endif /* USE_WINSOCK */
+		return -1;
+	}
+	/* no connect error */
+	cp->tcp_check_nb_connect = 0;
+	return 1;
+}
+
+/** the connection is made */
+static void hg_connected(struct http_get* hg)
+{
+	if(!hg->probe) {
+		selfupdate_http_connected(global_svr->update, hg);
+	}
+}
+
+/** write buffer to socket, returns true if done, false if notdone or error */
+static int hg_write_buf(struct http_get* hg, ldns_buffer* buf)
+{
+	ssize_t r;
+	char* str = NULL;
+	int fd = hg->cp->fd;
+	if(hg->cp->tcp_check_nb_connect) {
+		int c = hg_check_connect(hg->cp, &str);
+		if(c == 0)
+			return 0;
+		if(c == -1) {
 			log_err("http connect: %s", str);
 			http_get_done(hg, str, 0, NULL);
 			return 0;
 		}
-		/* no connect error */
-		hg->cp->tcp_check_nb_connect = 0;
-		if(!hg->probe) {
-			selfupdate_http_connected(global_svr->update, hg);
-		}
+		hg_connected(hg);
 	}
 
 	/* write data */
@@ -1255,11 +1530,14 @@ static int hg_handle_reply_header(struct http_get* hg)
 			http_get_done(hg, "http reply data too large", 1, NULL);
 			return 0;
 		}
-		if(!ldns_buffer_reserve(hg->buf,
+		/* a probe checks the data in buf as it arrives, and
+		 * does not need the room for all of it */
+		if(!hg->expect && !ldns_buffer_reserve(hg->buf,
 			datalen - ldns_buffer_position(hg->buf)+1)) {
 			http_get_done(hg, "out of memory", 1, NULL);
 			return 0;
 		}
+		hg_account(hg);
 		hg->state = http_state_reply_data;
 		hg->datalen = datalen;
 		verbose(VERB_ALGO, "http 1.0 data len %d", (int)datalen);
@@ -1269,19 +1547,64 @@ static int hg_handle_reply_header(struct http_get* hg)
 	return 1;
 }
 
+int
+http_get_check_data(struct http_get* hg)
+{
+	size_t end = ldns_buffer_position(hg->buf);
+	if(!hg->expect)
+		return 1;
+	if(end > hg->datalen)
+		end = hg->datalen;
+	if(end == 0)
+		return 1;
+	if(hg->data_limit && hg->expect_seen + end > hg->data_limit)
+		return -1;
+	if(!hg_match_data(hg, ldns_buffer_begin(hg->buf), end)) {
+		verbose(VERB_ALGO, "http data differs after %d bytes",
+			(int)(hg->expect_seen + end));
+		return 0;
+	}
+	hg->expect_seen += end;
+	hg->datalen -= end;
+	hg_buf_move(hg->buf, end);
+	return 1;
+}
+
+/** check the data that arrived in buf against the expected content.
+ * @return false if it is done, with the wrong page. */
+static int
+hg_check_buf(struct http_get* hg)
+{
+	int r = http_get_check_data(hg);
+	if(r == -1) {
+		http_get_done(hg, "http data too large", 1, NULL);
+		return 0;
+	} else if(r == 0) {
+		/* do not wait for the rest of a (big) hotspot page */
+		http_get_done(hg, "wrong page content", 1, NULL);
+		return 0;
+	}
+	return 1;
+}
+
 /** add data to output buffer */
 static int
 hg_add_data(struct http_get* hg, ldns_buffer* add, size_t len)
 {
-	if(hg->data_limit && ldns_buffer_position(hg->data) + len >
-		hg->data_limit) {
+	if(hg->data_limit && ldns_buffer_position(hg->data) +
+		hg->expect_seen + len > hg->data_limit) {
 		http_get_done(hg, "http data too large", 1, NULL);
 		return 0;
 	}
+	if(hg->expect) {
+		/* it is checked, and not kept */
+		return 1;
+	}
 	if(!ldns_buffer_reserve(hg->data, len+1)) {
 		http_get_done(hg, "out of memory", 1, NULL);
 		return 0;
 	}
+	hg_account(hg);
 	ldns_buffer_write(hg->data, ldns_buffer_begin(add), len);
 	/* zero terminate */
 	ldns_buffer_write_u8_at(hg->data, ldns_buffer_position(hg->data), 0);
@@ -1296,10 +1619,14 @@ static int hg_handle_reply_data(struct http_get* hg)
 	if(ldns_buffer_position(hg->buf) < hg->datalen) {
 		if(!hg_read_buf(hg, hg->buf))
 			return 0;
+		if(!hg_check_buf(hg))
+			return 0;
 		if(ldns_buffer_position(hg->buf) < hg->datalen)
 			return 0;
 	}
 	log_assert(ldns_buffer_position(hg->buf) >= hg->datalen);
+	if(!hg_check_buf(hg))
+		return 0;
 	if(!hg_add_data(hg, hg->buf, hg->datalen))
 		return 0;
 	/* done with success with data */
@@ -1366,11 +1693,12 @@ static int hg_handle_chunk_header(struct http_get* hg)
 		http_get_done(hg, "http reply chunk data too large", 1, NULL);
 		return 0;
 	}
-	if(!ldns_buffer_reserve(hg->buf,
+	if(!hg->expect && !ldns_buffer_reserve(hg->buf,
 		chunklen - ldns_buffer_position(hg->buf)+1)) {
 		http_get_done(hg, "out of memory", 1, NULL);
 		return 0;
 	}
+	hg_account(hg);
 	hg->state = http_state_chunk_data;
 	verbose(VERB_ALGO, "http chunk len %d", (int)chunklen);
 	hg->datalen = chunklen;
@@ -1386,9 +1714,13 @@ static int hg_handle_chunk_data(struct http_get* hg)
 	if(ldns_buffer_position(hg->buf) < hg->datalen+2) {
 		if(!hg_read_buf(hg, hg->buf))
 			return 0;
+		if(!hg_check_buf(hg))
+			return 0;
 		if(ldns_buffer_position(hg->buf) < hg->datalen+2)
 			return 0;
 	}
+	if(!hg_check_buf(hg))
+		return 0;
 	/* done reading put it together */
 	log_assert(ldns_buffer_position(hg->buf) >= hg->datalen);
 	verbose(VERB_ALGO, "datalen %d", (int)hg->datalen);
@@ -1434,9 +1766,145 @@ static int hg_handle_state(struct http_get* hg)
 	return 0;
 }
 
+int http_get_add_dest(struct http_get* hg, const char* dest)
+{
+	/* [0] is for the dest of the fetch */
+	int i = (hg->race_num == 0)?1:hg->race_num;
+	if(i >= HTTP_RACE_MAX)
+		return 0;
+	hg->race_dest[i] = strdup(dest);
+	if(!hg->race_dest[i]) {
+		log_err("out of memory");
+		return 0;
+	}
+	hg->race_num = i+1;
+	return 1;
+}
+
+/** number of connects of the race in progress */
+static int hg_race_pending(struct http_get* hg)
+{
+	int i, n = 0;
+	for(i=0; i<hg->race_num; i++)
+		if(hg->race_cp[i])
+			n++;
+	return n;
+}
+
+/** start the connect to the next address of the race.
+ * @return false if there is no address left to connect to, err is set. */
+static int hg_race_next(struct http_get* hg, char** err)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = 0;
+	struct timeval tv;
+	int fd, i;
+	while(hg->race_next < hg->race_num) {
+		i = hg->race_next++;
+		if(!ipstrtoaddr(hg->race_dest[i], hg->port, &addr, &addrlen)) {
+			log_err("error in syntax of IP address %s",
+				hg->race_dest[i]);
+			*err = "cannot parse IP address";
+			continue;
+		}
+		/* the first connect that is done wins the race */
+		if( (fd=http_get_connect(&addr, addrlen, 0, err)) == -1)
+			continue;
+		hg->race_cp[i] = comm_point_create_raw(hg->base, fd, 1,
+			http_get_callback, hg);
+		if(!hg->race_cp[i]) {
+#ifndef USE_WINSOCK
+			close(fd);
+#else
+			closesocket(fd);
+#endif
+			*err = "out of memory";
+			continue;
+		}
+		hg->race_cp[i]->do_not_close = 0;
+		hg->race_cp[i]->tcp_check_nb_connect = 1;
+		hg_account(hg);
+		verbose(VERB_ALGO, "http_get connect %s to %s", hg->url,
+			hg->race_dest[i]);
+		/* the next one if this does not connect soon enough */
+		if(hg->race_next < hg->race_num) {
+			tv.tv_sec = HTTP_RACE_DELAY/1000;
+			tv.tv_usec = (HTTP_RACE_DELAY%1000)*1000;
+			comm_timer_set(hg->race_timer, &tv);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+/** a connect of the race is done, with the connection or a failure.
+ * @return true if it won the race, and the get continues on it. */
+static int hg_race_event(struct http_get* hg, struct comm_point* cp)
+{
+	char* str = NULL;
+	int i, j, c;
+	for(i=0; i<hg->race_num; i++)
+		if(hg->race_cp[i] == cp)
+			break;
+	if(i == hg->race_num)
+		return 0;
+	c = hg_check_connect(cp, &str);
+	if(c == 0)
+		return 0;
+	if(c == -1) {
+		verbose(VERB_ALGO, "http connect to %s: %s", hg->race_dest[i],
+			str);
+		comm_point_delete(cp);
+		hg->race_cp[i] = NULL;
+		/* do not wait for the timer, try the next one now */
+		if(hg_race_next(hg, &str) || hg_race_pending(hg))
+			return 0;
+		comm_timer_disable(hg->race_timer);
+		log_err("http connect: %s", str);
+		http_get_done(hg, str, 0, NULL);
+		return 0;
+	}
+	/* the first to connect, close the others */
+	comm_timer_disable(hg->race_timer);
+	for(j=0; j<hg->race_num; j++) {
+		if(j != i && hg->race_cp[j]) {
+			comm_point_delete(hg->race_cp[j]);
+			hg->race_cp[j] = NULL;
+		}
+	}
+	hg->cp = cp;
+	hg->race_cp[i] = NULL;
+	hg_account(hg);
+	free(hg->dest);
+	hg->dest = hg->race_dest[i];
+	hg->race_dest[i] = NULL;
+	verbose(VERB_ALGO, "http_get connected to %s", hg->dest);
+	if(hg->probe) {
+		/* the probe is for the address that is used */
+		char* name = strdup(hg->dest);
+		if(name) {
+			free(hg->probe->name);
+			hg->probe->name = name;
+		}
+	}
+	hg_connected(hg);
+	return 1;
+}
+
+void
+http_get_race_timeout(void* arg)
+{
+	struct http_get* hg = (struct http_get*)arg;
+	char* err = "cannot connect";
+	if(hg_race_next(hg, &err) || hg_race_pending(hg))
+		return;
+	log_err("http connect: %s", err);
+	http_get_done(hg, err, 0, NULL);
+}
+
 /** handle events (read or write) on the http file descriptor */
 int
-http_get_callback(struct comm_point* ATTR_UNUSED(cp), void* arg, int err,
+http_get_callback(struct comm_point* cp, void* arg, int err,
 	struct comm_reply* ATTR_UNUSED(reply))
 {
 	struct http_get* hg = (struct http_get*)arg;
@@ -1445,6 +1913,10 @@ http_get_callback(struct comm_point* ATTR_UNUSED(cp), void* arg, int err,
 		log_err("internal error: http_get_callback got %d", err);
 		return 0;
 	}
+	if(!hg->cp && !hg_race_event(hg, cp)) {
+		/* a connect of the race, that is not done or did not win */
+		return 0;
+	}
 	/* is this read or write, and if so, what part of the protocol */
 	verbose(VERB_ALGO, "http_get: got event for %s from %s", hg->url, hg->dest);
 
@@ -1476,6 +1948,10 @@ int http_get_fetch(struct http_get* hg, const char* dest, int port, char** err)
 		return 0;
 	}
 	hg->port = port;
+	if(hg->race_num > 1 && !(hg->race_dest[0] = strdup(dest))) {
+		*err = "out of memory";
+		return 0;
+	}
 	if(!ipstrtoaddr(dest, port, &addr, &addrlen)) {
 		log_err("error in syntax of IP address %s", dest);
 		*err = "cannot parse IP address";
@@ -1496,8 +1972,24 @@ int http_get_fetch(struct http_get* hg, const char* dest, int port, char** err)
 	tv.tv_usec = HTTP_TIMEOUT%1000;
 	comm_timer_set(hg->timer, &tv);
 
+	if(hg->race_num > 1) {
+		/* connect to the addresses, the first connection is used */
+		hg->race_timer = comm_timer_create(hg->base,
+			http_get_race_timeout, hg);
+		if(!hg->race_timer) {
+			*err = "out of memory";
+			return 0;
+		}
+		hg->state = http_state_request;
+		if(!hg_race_next(hg, err))
+			return 0;
+		*err = NULL;
+		return 1;
+	}
+
 	/* create fd and connect nonblockingly */
-	if( (fd=http_get_connect(&addr, addrlen, err)) == -1) {
+	if( (fd=http_get_connect(&addr, addrlen,
+		global_svr->cfg->tcp_fastopen, err)) == -1) {
 		return 0;
 	}
 
@@ -1513,6 +2005,7 @@ int http_get_fetch(struct http_get* hg, const char* dest, int port, char** err)
 	hg->cp->do_not_close = 0;
 	hg->cp->tcp_check_nb_connect = 1;
 	hg->state = http_state_request;
+	hg_account(hg);
 
 	*err = NULL;
 	return 1;
@@ -1520,7 +2013,13 @@ int http_get_fetch(struct http_get* hg, const char* dest, int port, char** err)
 
 void http_get_delete(struct http_get* hg)
 {
+	int i;
 	if(!hg) return;
+	for(i=0; i<hg->race_num; i++) {
+		free(hg->race_dest[i]);
+		comm_point_delete(hg->race_cp[i]);
+	}
+	comm_timer_delete(hg->race_timer);
 	free(hg->url);
 	free(hg->hostname);
 	free(hg->filename);
@@ -1529,5 +2028,6 @@ void http_get_delete(struct http_get* hg)
 	ldns_buffer_free(hg->data);
 	comm_point_delete(hg->cp);
 	comm_timer_delete(hg->timer);
+	memstats_set(memstats_http, &hg->mem, 0);
 	free(hg);
 }
@@ -109,6 +109,39 @@ struct http_probe {
 	int works;
 	/* is the probe finished? */
 	int finished;
+	/* are the addresses from the address cache? */
+	int addr_cached;
+};
+
+/**
+ * Address of a hostname in the http address cache.
+ */
+struct http_addr_entry {
+	/* next in the list */
+	struct http_addr_entry* next;
+	/* the hostname */
+	char* hostname;
+	/* is this the AAAA lookup? */
+	int ip6;
+	/* the addresses (RR records) */
+	ldns_rr_list* addr;
+	/* time when it expires, from the smallest TTL */
+	uint32_t expire;
+};
+
+/**
+ * The addresses of the http probe hostnames, from earlier lookups at the
+ * cache resolvers, so that the next probes can start the http get at
+ * once.  The addresses are for one network, the set of cache resolvers,
+ * and are dropped when that changes.
+ */
+struct http_addr_cache {
+	/* the network, sorted cache resolver addresses, or NULL */
+	char* network;
+	/* the cached addresses */
+	struct http_addr_entry* list;
+	/* number of entries in the list */
+	int num;
 };
 
 /** the number of urls to try to probe; in case one fails. */
@@ -121,6 +154,56 @@ struct http_probe {
 /** max number of redirects in sequence */
 #define HTTP_MAX_REDIRECT 8
 
+/** max number of entries in the http address cache */
+#define HTTP_ADDR_CACHE_MAX 32
+
+/**
+ * Create the http address cache.
+ * @return the cache or NULL on malloc failure.
+ */
+struct http_addr_cache* http_addr_cache_create(void);
+
+/**
+ * Delete the http address cache.
+ * @param c: the cache.
+ */
+void http_addr_cache_delete(struct http_addr_cache* c);
+
+/**
+ * Set the network of the address cache, the sorted list of the cache
+ * resolvers.  If it is a different network, the addresses are dropped,
+ * they were looked up in the other network.
+ * @param c: the cache.
+ * @param probes: the list of probes, the cache resolvers are the ones
+ *	that are used for the network.
+ */
+void http_addr_cache_network(struct http_addr_cache* c,
+	struct probe_ip* probes);
+
+/**
+ * Lookup the addresses of the hostname in the cache.  Expired entries
+ * are dropped.
+ * @param c: the cache.
+ * @param hostname: the hostname.
+ * @param ip6: if the AAAA addresses are wanted, otherwise the A.
+ * @param now: the current time, in seconds.
+ * @return NULL if not in the cache, or a copy of the addresses.
+ */
+ldns_rr_list* http_addr_cache_lookup(struct http_addr_cache* c,
+	const char* hostname, int ip6, uint32_t now);
+
+/**
+ * Store the addresses of the hostname in the cache, for the smallest TTL
+ * of the records.  With TTL zero it is not stored.
+ * @param c: the cache.
+ * @param hostname: the hostname.
+ * @param ip6: if these are the AAAA addresses, otherwise the A.
+ * @param addr: the address records, they are copied.
+ * @param now: the current time, in seconds.
+ */
+void http_addr_cache_store(struct http_addr_cache* c,
+	const char* hostname, int ip6, ldns_rr_list* addr, uint32_t now);
+
 /**
  * create and randomise http general structure
  * @param svr: with config and create and register probes here.
@@ -145,6 +228,11 @@ void http_host_outq_done(struct probe_ip* p, const char* reason);
  * The pkt is freeed by this routine. */
 void http_host_outq_result(struct probe_ip* p, ldns_pkt* pkt);
 
+/* max number of addresses an http get races the connects to */
+#define HTTP_RACE_MAX 8
+/* msec to wait for a connect before the next address is tried as well */
+#define HTTP_RACE_DELAY 250
+
 /**
  * Structure that represents an open TCP activity for a HTTP (no -s) GET.
  */
@@ -183,6 +271,13 @@ struct http_get {
 	ldns_buffer* buf;
 	/* the buffer with the result data */
 	ldns_buffer* data;
+	/* the expected page content of the probe, the data is checked
+	 * against it as it arrives and not kept; NULL to keep the data */
+	char* expect;
+	/* number of characters of expect that are matched */
+	size_t expect_pos;
+	/* number of data bytes that are checked, and removed from buf */
+	size_t expect_seen;
 
 	/* my comm_base */
 	struct comm_base* base;
@@ -197,6 +292,19 @@ struct http_get {
 	int port;
 	/* the probe that this is part of */
 	struct probe_ip* probe;
+
+	/* the addresses to race the connects to, [0] is the dest of fetch */
+	char* race_dest[HTTP_RACE_MAX];
+	/* number of race addresses, 0 if no race */
+	int race_num;
+	/* index of the next address to connect to */
+	int race_next;
+	/* the connects in progress, per race address, or NULL */
+	struct comm_point* race_cp[HTTP_RACE_MAX];
+	/* timer to start the next connect of the race */
+	struct comm_timer* race_timer;
+	/* bytes accounted in the memstats */
+	size_t mem;
 };
 
 /* define max length that the buffer is created for */
@@ -223,6 +331,17 @@ struct http_get* http_get_create(const char* url, struct comm_base* base,
  */
 void http_get_delete(struct http_get* hg);
 
+/**
+ * Add an address to race the connect to, before the fetch.  The fetch
+ * connects to its dest, and to the added addresses one after the other,
+ * HTTP_RACE_DELAY apart, or sooner if a connect fails.  The first
+ * connection that is made is used and the others are closed.
+ * @param hg: http_get structure.
+ * @param dest: the IP address.
+ * @return false if the race is full or on malloc failure.
+ */
+int http_get_add_dest(struct http_get* hg, const char* dest);
+
 /**
  * Perform the fetch that was initialised.
  * Parses, connects, and so on.
@@ -234,11 +353,25 @@ void http_get_delete(struct http_get* hg);
  */
 int http_get_fetch(struct http_get* hg, const char* dest, int port, char** err);
 
+/**
+ * Check the page data that has arrived in the buffer, up to the data
+ * length, against the expected content.  Leading and trailing whitespace
+ * is ignored.  The checked data is removed from the buffer and from the
+ * data length; the page is all there when expect_pos is at the end of
+ * expect.
+ * @param hg: http_get structure.
+ * @return 1 if the data matches so far, 0 if it is different, and -1 if
+ *	it is larger than the data limit.
+ */
+int http_get_check_data(struct http_get* hg);
+
 /** handle socket events on http_get */
 int http_get_callback(struct comm_point* cp, void* arg, int err,
 	struct comm_reply* reply);
 /** handle timeout for the http_get operation */
 void http_get_timeout_handler(void* arg);
+/** handle timeout to start the next connect of the race */
+void http_get_race_timeout(void* arg);
 
 /** pick random RR from rr list, removes it from the list. list not empty*/
 ldns_rr* http_pick_random_addr(ldns_rr_list* list);
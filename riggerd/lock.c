@@ -1,18 +1,25 @@
 #include "config.h"
 #include "lock.h"
+#include "log.h"
 
 #include <stdbool.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 
 static const char *LF_PATH = __LOCK_FILE_PATH;
 static size_t LF_PATH_LEN = sizeof(__LOCK_FILE_PATH);
 
 static int check_dir = 1;
-static int fd = 0;
+static int fd = -1;
 
-void lock_acquire() {
+/* Take the lock on the lock file, with F_SETLKW (wait) or F_SETLK (fail
+ * when another process holds it).  Returns 1 when taken, 0 when busy and
+ * -1 on errors, then the file is closed again. */
+static int lock_take(int cmd) {
     const char* path;
     struct flock f = {
         .l_type=F_WRLCK,
@@ -21,20 +28,38 @@ void lock_acquire() {
         .l_len=0
     };
     int ret;
+    if (fd != -1) {
+        // we have it already
+        return 1;
+    }
     if (check_dir) {
         // TODO check & create dir
     }
     path = LF_PATH;
     fd = open(path, O_WRONLY|O_CREAT|O_CLOEXEC, 0600);
     if (fd == -1) {
-        // TODO error handling
-        return;
+        log_err("cannot open lock file %s: %s", path, strerror(errno));
+        return -1;
     }
-    ret = fcntl(fd, F_SETLKW, f);
+    ret = fcntl(fd, cmd, &f);
     if (ret == -1) {
-        // TODO error handling
-        return;
+        int busy = (errno == EACCES || errno == EAGAIN);
+        if (!busy) {
+            log_err("cannot lock %s: %s", path, strerror(errno));
+        }
+        close(fd);
+        fd = -1;
+        return busy ? 0 : -1;
     }
+    return 1;
+}
+
+void lock_acquire() {
+    (void)lock_take(F_SETLKW);
+}
+
+int lock_try_acquire() {
+    return lock_take(F_SETLK);
 }
 
 void lock_release() {
@@ -44,18 +69,14 @@ void lock_release() {
         .l_start=0,
         .l_len=0
     };
-    int ret;
-    if (fd == 0) {
+    if (fd == -1) {
         return;
     }
-    ret = fcntl(fd, F_SETLKW, f);
-    if (ret == -1) {
-        // TODO error handling
-        return;
+    if (fcntl(fd, F_SETLK, &f) == -1) {
+        log_err("cannot unlock %s: %s", LF_PATH, strerror(errno));
     }
-    
     close(fd);
-    fd = 0;
+    fd = -1;
 }
 
 void lock_override(const char *path, size_t len) {
@@ -16,6 +16,13 @@
  */
 void lock_acquire();
 
+/*
+ * Try to take the lock, without waiting for it.
+ * Returns 1 when taken, 0 when another process (the script) holds it,
+ * and -1 on failure to open or lock the file, that is logged.
+ */
+int lock_try_acquire();
+
 /** 
  * Release the lock.
  * TODO: possible errors
@@ -56,6 +56,9 @@
 #ifdef UB_ON_WINDOWS
 #  include "winrc/win_svc.h"
 #endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 /* default verbosity */
 enum verbosity_value verbosity = 0;
@@ -72,10 +75,91 @@ static uint32_t* log_now = NULL;
 /** print time in UTC or in secondsfrom1970 */
 static int log_time_asc = 1;
 
+#ifdef HAVE_PTHREAD
+/** number of messages in the log ring, a power of two */
+#define LOG_RING_SIZE 256
+/** length of a message in the log ring, longer messages are written
+ * directly, with the lock for the logfile */
+#define LOG_RING_MSG 1024
+
+/** a message in the log ring */
+struct log_slot {
+	/** sequence number, is the position when the slot can be filled,
+	 * and the position+1 when it is filled and can be written */
+	size_t seq;
+	/** time at the call site */
+	time_t now;
+	/** syslog priority */
+	int pri;
+	/** type of message, info, error */
+	char type[16];
+	/** the message text */
+	char msg[LOG_RING_MSG];
+};
+
+/**
+ * The log ring. Callers put messages in it without locks, the writer
+ * thread takes them out and writes them to the logfile or syslog.
+ * When it is full, messages are dropped and counted.
+ */
+static struct log_ring {
+	/** the messages */
+	struct log_slot slots[LOG_RING_SIZE];
+	/** position of the next slot to fill, for the callers */
+	size_t tail;
+	/** position of the next slot to write, for the writer thread */
+	size_t head;
+	/** number of messages dropped because the ring was full */
+	size_t dropped;
+	/** if the writer thread sleeps and has to be woken up */
+	int sleeping;
+	/** if the writer thread has to stop */
+	int stop;
+	/** if the writer thread is running, callers read it atomically */
+	int running;
+	/** the writer thread */
+	pthread_t thr;
+} log_ring;
+
+/** lock for the sleep and the stop of the writer thread, it is not
+ * destroyed, callers can signal it while the thread stops */
+static pthread_mutex_t log_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+/** the writer thread waits on this */
+static pthread_cond_t log_ring_cond = PTHREAD_COND_INITIALIZER;
+/** lock for the logfile and the syslog state, log_init swaps them while
+ * the writer thread, or another thread, writes */
+static pthread_mutex_t log_file_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif /* HAVE_PTHREAD */
+
+static void log_write(int pri, const char* type, time_t now,
+	const char* message);
+
+/** take the lock for the logfile, with the log thread */
+static void
+log_file_lock_take(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&log_file_lock);
+#endif
+}
+
+/** release the lock for the logfile */
+static void
+log_file_lock_give(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&log_file_lock);
+#endif
+}
+
 void
 log_init(const char* filename, int use_syslog, const char* chrootdir)
 {
-	FILE *f;
+	FILE *f = NULL;
+	int err = 0;
+#if !defined(HAVE_SYSLOG_H) && !defined(UB_ON_WINDOWS)
+	use_syslog = 0;
+#endif
 	if(logfile 
 #if defined(HAVE_SYSLOG_H) || defined(UB_ON_WINDOWS)
 	|| logging_to_syslog
@@ -83,8 +167,24 @@ log_init(const char* filename, int use_syslog, const char* chrootdir)
 	)
 	verbose(VERB_QUERY, "switching log to %s", 
 		use_syslog?"syslog":(filename&&filename[0]?filename:"stderr"));
+	/* open the new file first, the log thread keeps writing to the old
+	 * one, and it is swapped under the lock */
+	if(!use_syslog && filename && filename[0]) {
+		if(chrootdir && chrootdir[0] && strncmp(filename, chrootdir,
+			strlen(chrootdir)) == 0) 
+			filename += strlen(chrootdir);
+		f = fopen(filename, "a");
+		if(!f)
+			err = errno;
+#ifndef UB_ON_WINDOWS
+		/* line buffering does not work on windows */
+		else	setvbuf(f, NULL, (int)_IOLBF, 0);
+#endif
+	}
+	log_file_lock_take();
 	if(logfile && logfile != stderr)
 		fclose(logfile);
+	logfile = NULL;
 #ifdef HAVE_SYSLOG_H
 	if(logging_to_syslog) {
 		closelog();
@@ -95,7 +195,6 @@ log_init(const char* filename, int use_syslog, const char* chrootdir)
 		 * chroot and no longer be able to access dev/log and so on */
 		openlog(ident, LOG_NDELAY, LOG_DAEMON);
 		logging_to_syslog = 1;
-		return;
 	}
 #elif defined(UB_ON_WINDOWS)
 	if(logging_to_syslog) {
@@ -103,33 +202,23 @@ log_init(const char* filename, int use_syslog, const char* chrootdir)
 	}
 	if(use_syslog) {
 		logging_to_syslog = 1;
-		return;
 	}
 #endif /* HAVE_SYSLOG_H */
-	if(!filename || !filename[0]) {
-		logfile = stderr;
-		return;
+	if(!use_syslog) {
+		/* stderr when there is no file, or it cannot be opened */
+		logfile = f?f:stderr;
 	}
-	/* open the file for logging */
-	if(chrootdir && chrootdir[0] && strncmp(filename, chrootdir,
-		strlen(chrootdir)) == 0) 
-		filename += strlen(chrootdir);
-	f = fopen(filename, "a");
-	if(!f) {
+	log_file_lock_give();
+	if(err)
 		log_err("Could not open logfile %s: %s", filename, 
-			strerror(errno));
-		return;
-	}
-#ifndef UB_ON_WINDOWS
-	/* line buffering does not work on windows */
-	setvbuf(f, NULL, (int)_IOLBF, 0);
-#endif
-	logfile = f;
+			strerror(err));
 }
 
 void log_file(FILE *f)
 {
+	log_file_lock_take();
 	logfile = f;
+	log_file_lock_give();
 }
 
 void log_ident_set(const char* id)
@@ -147,18 +236,203 @@ void log_set_time_asc(int use_asc)
 	log_time_asc = use_asc;
 }
 
+#ifdef HAVE_PTHREAD
+/** put a message in the log ring.  @return false if it was full. */
+static int
+log_ring_put(int pri, const char* type, time_t now, const char* message)
+{
+	struct log_slot* slot;
+	size_t len, pos;
+	len = strlen(message);
+	if(len >= sizeof(slot->msg)) {
+		/* it does not fit, it is written now; before the messages
+		 * that wait in the ring, but not cut short */
+		log_write(pri, type, now, message);
+		return 1;
+	}
+	pos = __atomic_load_n(&log_ring.tail, __ATOMIC_RELAXED);
+	while(1) {
+		size_t seq;
+		slot = &log_ring.slots[pos & (LOG_RING_SIZE-1)];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if(seq == pos) {
+			if(__atomic_compare_exchange_n(&log_ring.tail, &pos,
+				pos+1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+			/* pos is updated with the current tail */
+		} else if((ssize_t)(seq - pos) < 0) {
+			/* the writer has not written this slot yet */
+			__atomic_add_fetch(&log_ring.dropped, 1,
+				__ATOMIC_RELAXED);
+			return 0;
+		} else {
+			pos = __atomic_load_n(&log_ring.tail, __ATOMIC_RELAXED);
+		}
+	}
+	slot->now = now;
+	slot->pri = pri;
+	snprintf(slot->type, sizeof(slot->type), "%s", type);
+	memmove(slot->msg, message, len);
+	slot->msg[len] = 0;
+	__atomic_store_n(&slot->seq, pos+1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&log_ring.sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&log_ring_lock);
+		pthread_cond_signal(&log_ring_cond);
+		pthread_mutex_unlock(&log_ring_lock);
+	}
+	return 1;
+}
+
+/** is there a message in the log ring for the writer */
+static int
+log_ring_filled(void)
+{
+	struct log_slot* slot = &log_ring.slots[log_ring.head &
+		(LOG_RING_SIZE-1)];
+	return __atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) ==
+		log_ring.head+1;
+}
+
+/** write the messages in the log ring. @return number written. */
+static size_t
+log_ring_drain(void)
+{
+	size_t n = 0, dropped;
+	while(log_ring_filled()) {
+		struct log_slot* slot = &log_ring.slots[log_ring.head &
+			(LOG_RING_SIZE-1)];
+		log_write(slot->pri, slot->type, slot->now, slot->msg);
+		/* the slot can be filled again at the next lap */
+		__atomic_store_n(&slot->seq, log_ring.head+LOG_RING_SIZE,
+			__ATOMIC_RELEASE);
+		log_ring.head++;
+		n++;
+	}
+	dropped = __atomic_exchange_n(&log_ring.dropped, 0, __ATOMIC_RELAXED);
+	if(dropped) {
+		char m[128];
+		snprintf(m, sizeof(m), "log ring full, %u messages dropped",
+			(unsigned)dropped);
+		log_write(LOG_WARNING, "warning", time(NULL), m);
+	}
+	if(n) {
+		log_file_lock_take();
+		if(logfile)
+			fflush(logfile);
+		log_file_lock_give();
+	}
+	return n;
+}
+
+/** the writer thread, writes the log ring until stopped */
+static void*
+log_ring_writer(void* ATTR_UNUSED(arg))
+{
+	while(1) {
+		if(log_ring_drain() != 0)
+			continue;
+		pthread_mutex_lock(&log_ring_lock);
+		if(log_ring.stop) {
+			pthread_mutex_unlock(&log_ring_lock);
+			break;
+		}
+		/* a caller that puts a message after this, wakes us up */
+		__atomic_store_n(&log_ring.sleeping, 1, __ATOMIC_SEQ_CST);
+		if(!log_ring_filled())
+			pthread_cond_wait(&log_ring_cond, &log_ring_lock);
+		__atomic_store_n(&log_ring.sleeping, 0, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&log_ring_lock);
+	}
+	/* messages put while stopping */
+	(void)log_ring_drain();
+	return NULL;
+}
+
+/** in a forked child there is no writer thread, log synchronously */
+static void
+log_ring_atfork_child(void)
+{
+	__atomic_store_n(&log_ring.running, 0, __ATOMIC_SEQ_CST);
+	/* a thread of the parent can have held it */
+	pthread_mutex_init(&log_file_lock, NULL);
+}
+#endif /* HAVE_PTHREAD */
+
+void
+log_async_start(void)
+{
+#ifdef HAVE_PTHREAD
+	static int atfork_done = 0;
+	size_t i;
+	int r;
+	if(__atomic_load_n(&log_ring.running, __ATOMIC_SEQ_CST))
+		return;
+	if(!atfork_done) {
+		(void)pthread_atfork(NULL, NULL, log_ring_atfork_child);
+		atfork_done = 1;
+	}
+	for(i=0; i<LOG_RING_SIZE; i++)
+		log_ring.slots[i].seq = i;
+	log_ring.head = 0;
+	log_ring.tail = 0;
+	log_ring.dropped = 0;
+	log_ring.sleeping = 0;
+	log_ring.stop = 0;
+	if((r=pthread_create(&log_ring.thr, NULL, log_ring_writer, NULL))
+		!= 0) {
+		log_err("could not start log thread: %s", strerror(r));
+		return;
+	}
+	__atomic_store_n(&log_ring.running, 1, __ATOMIC_SEQ_CST);
+#endif /* HAVE_PTHREAD */
+}
+
+void
+log_async_stop(void)
+{
+#ifdef HAVE_PTHREAD
+	if(!__atomic_load_n(&log_ring.running, __ATOMIC_SEQ_CST))
+		return;
+	pthread_mutex_lock(&log_ring_lock);
+	log_ring.stop = 1;
+	pthread_cond_signal(&log_ring_cond);
+	pthread_mutex_unlock(&log_ring_lock);
+	pthread_join(log_ring.thr, NULL);
+	__atomic_store_n(&log_ring.running, 0, __ATOMIC_SEQ_CST);
+	/* messages put while it stopped */
+	(void)log_ring_drain();
+#endif /* HAVE_PTHREAD */
+}
+
 void
 log_vmsg(int pri, const char* type,
 	const char *format, va_list args)
 {
 	char message[MAXSYSLOGMSGLEN];
 	time_t now;
+	/* the time of the call, the writer thread may write it later */
+	if(log_now)
+		now = (time_t)*log_now;
+	else	now = (time_t)time(NULL);
+	vsnprintf(message, sizeof(message), format, args);
+#ifdef HAVE_PTHREAD
+	if(__atomic_load_n(&log_ring.running, __ATOMIC_SEQ_CST)) {
+		(void)log_ring_put(pri, type, now, message);
+		return;
+	}
+#endif
+	log_write(pri, type, now, message);
+}
+
+/** write a log message to the logfile or syslog, with the lock */
+static void
+log_write_locked(int pri, const char* type, time_t now, const char* message)
+{
 #if defined(HAVE_STRFTIME) && defined(HAVE_LOCALTIME_R) 
 	char tmbuf[32];
 	struct tm tm;
 #endif
 	(void)pri;
-	vsnprintf(message, sizeof(message), format, args);
 #ifdef HAVE_SYSLOG_H
 	if(logging_to_syslog) {
 		syslog(pri, "[%d] %s: %s", 
@@ -193,9 +467,6 @@ log_vmsg(int pri, const char* type,
 	}
 #endif /* HAVE_SYSLOG_H */
 	if(!logfile) return;
-	if(log_now)
-		now = (time_t)*log_now;
-	else	now = (time_t)time(NULL);
 #if defined(HAVE_STRFTIME) && defined(HAVE_LOCALTIME_R) 
 	if(log_time_asc && strftime(tmbuf, sizeof(tmbuf), "%b %d %H:%M:%S",
 		localtime_r(&now, &tm))%(sizeof(tmbuf)) != 0) {
@@ -212,6 +483,15 @@ log_vmsg(int pri, const char* type,
 #endif
 }
 
+/** write a log message to the logfile or syslog */
+static void
+log_write(int pri, const char* type, time_t now, const char* message)
+{
+	log_file_lock_take();
+	log_write_locked(pri, type, now, message);
+	log_file_lock_give();
+}
+
 /**
  * implementation of log_info
  * @param format: format string printf-style.
@@ -262,6 +542,7 @@ fatal_exit(const char *format, ...)
 	va_start(args, format);
 	log_vmsg(LOG_CRIT, "fatal error", format, args);
 	va_end(args);
+	log_async_stop();
 	exit(1);
 }
 
@@ -109,6 +109,22 @@ void log_set_time(uint32_t* t);
  */
 void log_set_time_asc(int use_asc);
 
+/**
+ * Start writing the log from a thread of its own.  Log calls put the
+ * message, with the time of the call, in a ring buffer and return, the
+ * thread writes them to the logfile or syslog.  When the ring is full
+ * messages are dropped, and the number dropped is logged.  Start it after
+ * the fork to the background.  Without threads, logging stays synchronous.
+ */
+void log_async_start(void);
+
+/**
+ * Stop the log thread, after it has written the messages in the ring.
+ * fatal_exit stops it, logging is synchronous after.  log_init and
+ * log_file swap the logfile under a lock, the thread keeps running.
+ */
+void log_async_stop(void);
+
 /**
  * Log informational message.
  * Pass printf formatted arguments. No trailing newline is needed.
@@ -0,0 +1,159 @@
+/*
+ * memstats.c - dnssec-trigger memory accounting
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *
+ * This file contains the memory accounting per subsystem.
+ */
+#include "config.h"
+#include "memstats.h"
+#include <ldns/ldns.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/** the counts of a subsystem */
+struct memstats_count {
+	/** bytes now */
+	size_t bytes;
+	/** objects now */
+	size_t num;
+	/** highest bytes */
+	size_t max_bytes;
+	/** highest objects */
+	size_t max_num;
+};
+
+/** the counts, per subsystem */
+static struct memstats_count memstats[MEMSTATS_NUM];
+/** the bytes of all subsystems, the max_bytes is the highest total */
+static struct memstats_count memstats_total;
+#ifdef HAVE_PTHREAD
+/** lock for the counts */
+static pthread_mutex_t memstats_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/** the names of the subsystems, in the order of the enum */
+static const char* memstats_names[MEMSTATS_NUM] = {
+	"probes", "outq", "http", "sslconn", "store", "update"
+};
+
+void memstats_init(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&memstats_lock);
+#endif
+	memset(memstats, 0, sizeof(memstats));
+	memset(&memstats_total, 0, sizeof(memstats_total));
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&memstats_lock);
+#endif
+}
+
+void memstats_set(enum memstats_sub sub, size_t* mem, size_t bytes)
+{
+	struct memstats_count* m = &memstats[sub];
+	if(*mem == bytes)
+		return;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&memstats_lock);
+#endif
+	if(*mem == 0)
+		m->num++;
+	else if(bytes == 0)
+		m->num--;
+	/* the bytes of the object are in the count, this does not wrap */
+	m->bytes = m->bytes - *mem + bytes;
+	if(m->bytes > m->max_bytes)
+		m->max_bytes = m->bytes;
+	if(m->num > m->max_num)
+		m->max_num = m->num;
+	memstats_total.bytes = memstats_total.bytes - *mem + bytes;
+	if(memstats_total.bytes > memstats_total.max_bytes)
+		memstats_total.max_bytes = memstats_total.bytes;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&memstats_lock);
+#endif
+	*mem = bytes;
+}
+
+void memstats_get(enum memstats_sub sub, size_t* bytes, size_t* num,
+	size_t* max_bytes, size_t* max_num)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&memstats_lock);
+#endif
+	*bytes = memstats[sub].bytes;
+	*num = memstats[sub].num;
+	*max_bytes = memstats[sub].max_bytes;
+	*max_num = memstats[sub].max_num;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&memstats_lock);
+#endif
+}
+
+const char* memstats_name(enum memstats_sub sub)
+{
+	return memstats_names[sub];
+}
+
+int memstats_print(ldns_buffer* buf)
+{
+	size_t bytes, num, max_bytes, max_num;
+	struct memstats_count total;
+	int i;
+	for(i=0; i<MEMSTATS_NUM; i++) {
+		memstats_get((enum memstats_sub)i, &bytes, &num, &max_bytes,
+			&max_num);
+		if(ldns_buffer_printf(buf, "%s: bytes %u num %u max_bytes %u "
+			"max_num %u\n", memstats_names[i], (unsigned)bytes,
+			(unsigned)num, (unsigned)max_bytes, (unsigned)max_num)
+			== -1)
+			return 0;
+	}
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&memstats_lock);
+#endif
+	total = memstats_total;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&memstats_lock);
+#endif
+	if(ldns_buffer_printf(buf, "total: bytes %u max_bytes %u\n",
+		(unsigned)total.bytes, (unsigned)total.max_bytes) == -1)
+		return 0;
+	return 1;
+}
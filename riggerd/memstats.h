@@ -0,0 +1,104 @@
+/*
+ * memstats.h - dnssec-trigger memory accounting
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the memory accounting per subsystem.  Every accounted
+ * object has a size_t in it with the bytes that are accounted for it, the
+ * object is counted while that is nonzero.  memstats_set changes it to the
+ * new size of the object, and 0 when it is deleted.  The counts are kept
+ * under a lock, the zone store and the update regions are used by the hook
+ * workers.
+ */
+
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+#include <ldns/buffer.h>
+
+/**
+ * The subsystems that are accounted.
+ */
+enum memstats_sub {
+	/** the probes in the probe list */
+	memstats_probes = 0,
+	/** the DNS queries of the probes */
+	memstats_outq,
+	/** the http fetches and their buffers */
+	memstats_http,
+	/** the control connections and their buffers */
+	memstats_sslconn,
+	/** the zone stores */
+	memstats_store,
+	/** the regions of the zone updates */
+	memstats_update,
+	/** number of subsystems */
+	MEMSTATS_NUM
+};
+
+/** Initialise the accounting, at startup. */
+void memstats_init(void);
+
+/**
+ * Set the size of an object.
+ * @param sub: the subsystem it is in.
+ * @param mem: the accounted bytes in the object, set to bytes.  When it goes
+ *	from zero the object is counted, when it goes to zero it is no longer.
+ * @param bytes: the size of the object now, 0 when it is deleted.
+ */
+void memstats_set(enum memstats_sub sub, size_t* mem, size_t bytes);
+
+/**
+ * Get the counts for a subsystem.
+ * @param sub: the subsystem.
+ * @param bytes: the bytes now.
+ * @param num: the objects now.
+ * @param max_bytes: the highest bytes since startup.
+ * @param max_num: the highest objects since startup.
+ */
+void memstats_get(enum memstats_sub sub, size_t* bytes, size_t* num,
+	size_t* max_bytes, size_t* max_num);
+
+/** the name of a subsystem */
+const char* memstats_name(enum memstats_sub sub);
+
+/**
+ * Print the counts, a line per subsystem and a total line.
+ * @param buf: printed into, at the position.
+ * @return false if it did not fit.
+ */
+int memstats_print(ldns_buffer* buf);
+
+#endif /* MEMSTATS_H */
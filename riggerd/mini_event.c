@@ -51,6 +51,7 @@
 #include "mini_event.h"
 #include "log.h"
 #include "fptr_wlist.h"
+#include "evprof.h"
 
 /** compare events in tree, based on timevalue, ptr for uniqueness */
 int mini_ev_cmp(const void* a, const void* b)
@@ -144,6 +145,9 @@ static void handle_timeouts(struct event_base* base, struct timeval* now,
 	struct timeval* wait)
 {
 	struct event* p;
+	struct timeval start;
+	int prof;
+	void (*cb)(int, short, void*);
 #ifndef S_SPLINT_S
 	wait->tv_sec = (time_t)-1;
 #endif
@@ -170,16 +174,23 @@ static void handle_timeouts(struct event_base* base, struct timeval* now,
 		/* event times out, remove it */
 		(void)rbtree_delete(base->times, p);
 		p->ev_events &= ~EV_TIMEOUT;
-		fptr_ok(fptr_whitelist_event(p->ev_callback));
-		(*p->ev_callback)(p->ev_fd, EV_TIMEOUT, p->ev_arg);
+		cb = p->ev_callback;
+		fptr_ok(fptr_whitelist_event(cb));
+		prof = evprof_begin(&start);
+		(*cb)(p->ev_fd, EV_TIMEOUT, p->ev_arg);
+		if(prof)
+			evprof_end(&start, evprof_event, (evprof_func_type*)cb);
 	}
 }
 
-/** call select and callbacks for that */
-static int handle_select(struct event_base* base, struct timeval* wait)
+/** call select and callbacks for that, wake is set when the profile is on */
+static int handle_select(struct event_base* base, struct timeval* wait,
+	struct timeval* wake, int* prof)
 {
 	fd_set r, w;
-	int ret, i;
+	int ret, i, p;
+	struct timeval start;
+	void (*cb)(int, short, void*);
 
 #ifndef S_SPLINT_S
 	if(wait->tv_sec==(time_t)-1)
@@ -200,6 +211,7 @@ static int handle_select(struct event_base* base, struct timeval* wait)
 	}
 	if(settime(base) < 0)
 		return -1;
+	*prof = evprof_begin(wake);
 	
 	for(i=0; i<base->maxfd+1; i++) {
 		short bits = 0;
@@ -216,10 +228,13 @@ static int handle_select(struct event_base* base, struct timeval* wait)
 		}
 		bits &= base->fds[i]->ev_events;
 		if(bits) {
-			fptr_ok(fptr_whitelist_event(
-				base->fds[i]->ev_callback));
-			(*base->fds[i]->ev_callback)(base->fds[i]->ev_fd, 
-				bits, base->fds[i]->ev_arg);
+			cb = base->fds[i]->ev_callback;
+			fptr_ok(fptr_whitelist_event(cb));
+			p = evprof_begin(&start);
+			(*cb)(base->fds[i]->ev_fd, bits, base->fds[i]->ev_arg);
+			if(p)
+				evprof_end(&start, evprof_event,
+					(evprof_func_type*)cb);
 			if(ret==0)
 				break;
 		}
@@ -230,17 +245,22 @@ static int handle_select(struct event_base* base, struct timeval* wait)
 /** run select in a loop */
 int event_base_dispatch(struct event_base* base)
 {
-	struct timeval wait;
+	struct timeval wait, wake;
+	int prof = 0;
 	if(settime(base) < 0)
 		return -1;
 	while(!base->need_to_exit)
 	{
 		/* see if timeouts need handling */
 		handle_timeouts(base, base->time_tv, &wait);
+		/* the iteration, from the wakeup until select waits again */
+		if(prof)
+			evprof_loop(&wake);
+		prof = 0;
 		if(base->need_to_exit)
 			break;
 		/* do select */
-		if(handle_select(base, &wait) < 0) {
+		if(handle_select(base, &wait, &wake, &prof) < 0) {
 			if(base->need_to_exit)
 				break;
 			return -1;
@@ -41,6 +41,9 @@
 #include "net_help.h"
 #include "log.h"
 #include <fcntl.h>
+#ifndef USE_WINSOCK
+#include <netinet/tcp.h>
+#endif
 
 /** max length of an IP address (the address portion) that we allow */
 #define MAX_ADDR_STRLEN 128 /* characters */
@@ -80,6 +83,30 @@ fd_set_nonblock(int s)
 	return 1;
 }
 
+int
+fd_set_tcp_fastopen(int s)
+{
+#ifdef TCP_FASTOPEN_CONNECT
+	/* if the kernel does not have it, do not try again */
+	static int unsupported = 0;
+	int on = 1;
+	if(unsupported)
+		return 0;
+	if(setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, (void*)&on,
+		(socklen_t)sizeof(on)) < 0) {
+		verbose(VERB_OPS, "no tcp fastopen: setsockopt(TCP_FASTOPEN_"
+			"CONNECT): %s", strerror(errno));
+		if(errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+			unsupported = 1;
+		return 0;
+	}
+	return 1;
+#else
+	(void)s;
+	return 0;
+#endif
+}
+
 int 
 fd_set_block(int s) 
 {
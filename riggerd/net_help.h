@@ -107,6 +107,17 @@ int str_is_ip6(const char* str);
  */
 int fd_set_nonblock(int s); 
 
+/**
+ * Set TCP Fast Open on the fd, before the connect.  The connect returns
+ * at once and the first write sends the data with the SYN, if the kernel
+ * has a cookie from an earlier connection to the server.  The kernel
+ * keeps the cookies, and sends the data after the handshake if the
+ * server or the path does not allow it.
+ * @param s: file descriptor.
+ * @return: 0 if not supported, the connect is then as usual.
+ */
+int fd_set_tcp_fastopen(int s);
+
 /**
  * Set fd (back to) blocking.
  * @param s: file descriptor.
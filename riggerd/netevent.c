@@ -44,6 +44,8 @@
 #include "log.h"
 #include "net_help.h"
 #include "fptr_wlist.h"
+#include "evprof.h"
+#include "watchdog.h"
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
@@ -348,6 +350,12 @@ comm_point_send_udp_msg(struct comm_point *c, ldns_buffer* packet,
 	return 1;
 }
 
+int
+comm_point_connect_tcp_out(int fd, struct sockaddr* addr, socklen_t addrlen)
+{
+	return connect(fd, addr, addrlen);
+}
+
 #if defined(AF_INET6) && defined(IPV6_PKTINFO) && (defined(HAVE_RECVMSG) || defined(HAVE_SENDMSG))
 /** print debug ancillary info */
 static void p_ancil(const char* str, struct comm_reply* r)
@@ -493,6 +501,28 @@ comm_point_send_udp_msg_if(struct comm_point *c, ldns_buffer* packet,
 #endif /* AF_INET6 && IPV6_PKTINFO && HAVE_SENDMSG */
 }
 
+/** call the callback of the comm point, timed when the profile or the
+ * watchdog is on */
+static int
+comm_point_do_callback(struct comm_point* c, int err,
+	struct comm_reply* reply_info)
+{
+	comm_point_callback_t* cb;
+	struct timeval start;
+	int r, prof;
+	if(!evprof_on && !watchdog_on)
+		return (*c->callback)(c, c->cb_arg, err, reply_info);
+	/* the callback can delete the comm point */
+	cb = c->callback;
+	prof = evprof_begin(&start);
+	watchdog_enter((void (*)(void))cb);
+	r = (*cb)(c, c->cb_arg, err, reply_info);
+	watchdog_leave();
+	if(prof)
+		evprof_end(&start, evprof_callback, (evprof_func_type*)cb);
+	return r;
+}
+
 void 
 comm_point_udp_ancil_callback(int fd, short event, void* arg)
 {
@@ -571,7 +601,7 @@ comm_point_udp_ancil_callback(int fd, short event, void* arg)
 			p_ancil("receive_udp on interface", &rep);
 #endif /* S_SPLINT_S */
 		fptr_ok(fptr_whitelist_comm_point(rep.c->callback));
-		if((*rep.c->callback)(rep.c, rep.c->cb_arg, NETEVENT_NOERROR, &rep)) {
+		if(comm_point_do_callback(rep.c, NETEVENT_NOERROR, &rep)) {
 			/* send back immediate reply */
 			(void)comm_point_send_udp_msg_if(rep.c, rep.c->buffer,
 				(struct sockaddr*)&rep.addr, rep.addrlen, &rep);
@@ -630,7 +660,7 @@ comm_point_udp_callback(int fd, short event, void* arg)
 		ldns_buffer_flip(rep.c->buffer);
 		rep.srctype = 0;
 		fptr_ok(fptr_whitelist_comm_point(rep.c->callback));
-		if((*rep.c->callback)(rep.c, rep.c->cb_arg, NETEVENT_NOERROR, &rep)) {
+		if(comm_point_do_callback(rep.c, NETEVENT_NOERROR, &rep)) {
 			/* send back immediate reply */
 			(void)comm_point_send_udp_msg(rep.c, rep.c->buffer,
 				(struct sockaddr*)&rep.addr, rep.addrlen);
@@ -819,7 +849,7 @@ tcp_callback_reader(struct comm_point* c)
 	if(c->type == comm_tcp)
 		comm_point_stop_listening(c);
 	fptr_ok(fptr_whitelist_comm_point(c->callback));
-	if( (*c->callback)(c, c->cb_arg, NETEVENT_NOERROR, &c->repinfo) ) {
+	if( comm_point_do_callback(c, NETEVENT_NOERROR, &c->repinfo) ) {
 		comm_point_start_listening(c, -1, TCP_QUERY_TIMEOUT);
 	}
 }
@@ -1309,7 +1339,7 @@ comm_point_tcp_handle_callback(int fd, short event, void* arg)
 			if(!c->tcp_do_close) {
 				fptr_ok(fptr_whitelist_comm_point(
 					c->callback));
-				(void)(*c->callback)(c, c->cb_arg, 
+				(void)comm_point_do_callback(c,
 					NETEVENT_CLOSED, NULL);
 			}
 		}
@@ -1321,7 +1351,7 @@ comm_point_tcp_handle_callback(int fd, short event, void* arg)
 			if(!c->tcp_do_close) {
 				fptr_ok(fptr_whitelist_comm_point(
 					c->callback));
-				(void)(*c->callback)(c, c->cb_arg, 
+				(void)comm_point_do_callback(c,
 					NETEVENT_CLOSED, NULL);
 			}
 		}
@@ -1332,8 +1362,7 @@ comm_point_tcp_handle_callback(int fd, short event, void* arg)
 		reclaim_tcp_handler(c);
 		if(!c->tcp_do_close) {
 			fptr_ok(fptr_whitelist_comm_point(c->callback));
-			(void)(*c->callback)(c, c->cb_arg,
-				NETEVENT_TIMEOUT, NULL);
+			(void)comm_point_do_callback(c, NETEVENT_TIMEOUT, NULL);
 		}
 		return;
 	}
@@ -1349,7 +1378,7 @@ void comm_point_local_handle_callback(int fd, short event, void* arg)
 	if(event&EV_READ) {
 		if(!comm_point_tcp_handle_read(fd, c, 1)) {
 			fptr_ok(fptr_whitelist_comm_point(c->callback));
-			(void)(*c->callback)(c, c->cb_arg, NETEVENT_CLOSED, 
+			(void)comm_point_do_callback(c, NETEVENT_CLOSED, 
 				NULL);
 		}
 		return;
@@ -1368,7 +1397,7 @@ void comm_point_raw_handle_callback(int ATTR_UNUSED(fd),
 	if(event&EV_TIMEOUT)
 		err = NETEVENT_TIMEOUT;
 	fptr_ok(fptr_whitelist_comm_point_raw(c->callback));
-	(void)(*c->callback)(c, c->cb_arg, err, NULL);
+	(void)comm_point_do_callback(c, err, NULL);
 }
 
 struct comm_point* 
@@ -1976,12 +2005,25 @@ void
 comm_timer_callback(int ATTR_UNUSED(fd), short event, void* arg)
 {
 	struct comm_timer* tm = (struct comm_timer*)arg;
+	struct timeval start;
+	void (*cb)(void*);
+	int prof;
 	if(!(event&EV_TIMEOUT))
 		return;
 	comm_base_now(tm->ev_timer->base);
 	tm->ev_timer->enabled = 0;
 	fptr_ok(fptr_whitelist_comm_timer(tm->callback));
-	(*tm->callback)(tm->cb_arg);
+	if(!evprof_on && !watchdog_on) {
+		(*tm->callback)(tm->cb_arg);
+		return;
+	}
+	cb = tm->callback;
+	prof = evprof_begin(&start);
+	watchdog_enter((void (*)(void))cb);
+	(*cb)(tm->cb_arg);
+	watchdog_leave();
+	if(prof)
+		evprof_end(&start, evprof_callback, (evprof_func_type*)cb);
 }
 
 int 
@@ -443,6 +443,17 @@ void comm_point_drop_reply(struct comm_reply* repinfo);
 int comm_point_send_udp_msg(struct comm_point* c, ldns_buffer* packet,
 	struct sockaddr* addr, socklen_t addrlen);
 
+/**
+ * Start the connect of an outgoing tcp socket, that is then given to a
+ * tcp_out commpoint with comm_point_start_listening.
+ * @param fd: the nonblocking socket.
+ * @param addr: where to connect to.
+ * @param addrlen: length of addr.
+ * @return: 0 or -1 with errno set (EINPROGRESS), like connect(2).
+ */
+int comm_point_connect_tcp_out(int fd, struct sockaddr* addr,
+	socklen_t addrlen);
+
 /**
  * Stop listening for input on the commpoint. No callbacks will happen.
  * @param c: commpoint to disable. The fd is not closed.
@@ -49,6 +49,10 @@
 #include "reshook.h"
 #include "http.h"
 #include "update.h"
+#include "score.h"
+#include "trace.h"
+#include "memstats.h"
+#include "snapshot.h"
 #include <ldns/ldns.h>
 
 /* create probes for the ip addresses in the string */
@@ -114,7 +118,7 @@ void probe_start(char* ips)
 		if(!svr->http && svr->cfg->num_http_urls != 0) {
 			svr->http = http_general_start(svr);
 			if(!svr->http) log_err("out of memory");
-			svr->http->saw_http_work = 0;
+			else	svr->http->saw_http_work = 0;
 		}
 	}
 }
@@ -131,6 +135,7 @@ void probe_delete(struct probe_ip* p)
 	outq_delete(p->nsec3_c);
 	outq_delete(p->host_c);
 	http_get_delete(p->http);
+	memstats_set(memstats_probes, &p->mem, 0);
 	free(p);
 }
 
@@ -163,7 +168,7 @@ get_random_nsec3_dest(void)
 /** the NSEC3 qtype to elicit it (a nodata answer) */
 #define PROBE_NSEC3_QTYPE LDNS_RR_TYPE_NULL
 
-/** get random authority server */
+/** get authority server, by score */
 static const char*
 get_random_auth_ip4(void)
 {
@@ -183,10 +188,11 @@ get_random_auth_ip4(void)
 		"199.7.83.42", /* l */
 		"202.12.27.33" /* m */
 	};
-	return choices[ ldns_get_random() % 13 ];
+	return choices[ score_select(global_svr->scores, choices, 13,
+		DNS_PORT, 0) ];
 }
 
-/** get random authority server */
+/** get authority server, by score */
 static const char*
 get_random_auth_ip6(void)
 {
@@ -206,55 +212,72 @@ get_random_auth_ip6(void)
 		"2001:500:9f::42", /* l */
 		"2001:dc3::35" /* m */
 	};
-	return choices[ ldns_get_random() % 13 ];
+	return choices[ score_select(global_svr->scores, choices, 13,
+		DNS_PORT, 0) ];
 }
 
-static const char* get_random_tcp80_ip4(struct cfg* cfg)
+/** select one of the elements of the strlist (or ssllist), by score */
+static struct strlist* select_by_score(struct strlist* list, int num,
+	int port, int ssl)
 {
-	if(cfg->num_tcp80_ip4 == 0)
+	const char** names;
+	struct strlist* s;
+	int i = 0;
+	if(num == 0)
+		return NULL;
+	names = (const char**)calloc((size_t)num, sizeof(*names));
+	if(!names) {
+		log_err("out of memory");
 		return NULL;
-	return strlist_get_num(cfg->tcp80_ip4,
-		((unsigned)ldns_get_random())%((unsigned)cfg->num_tcp80_ip4));
+	}
+	for(s = list; s && i < num; s = s->next)
+		names[i++] = s->str;
+	i = score_select(global_svr->scores, names, i, port, ssl);
+	free(names);
+	for(s = list; s && i > 0; s = s->next)
+		i--;
+	return s;
+}
+
+static const char* get_random_tcp80_ip4(struct cfg* cfg)
+{
+	struct strlist* s = select_by_score(cfg->tcp80_ip4,
+		cfg->num_tcp80_ip4, 80, 0);
+	return s?s->str:NULL;
 }
 
 static const char* get_random_tcp80_ip6(struct cfg* cfg)
 {
-	if(cfg->num_tcp80_ip6 == 0)
-		return NULL;
-	return strlist_get_num(cfg->tcp80_ip6,
-		((unsigned)ldns_get_random())%((unsigned)cfg->num_tcp80_ip6));
+	struct strlist* s = select_by_score(cfg->tcp80_ip6,
+		cfg->num_tcp80_ip6, 80, 0);
+	return s?s->str:NULL;
 }
 
 static const char* get_random_tcp443_ip4(struct cfg* cfg)
 {
-	if(cfg->num_tcp443_ip4 == 0)
-		return NULL;
-	return strlist_get_num(cfg->tcp443_ip4,
-		((unsigned)ldns_get_random())%((unsigned)cfg->num_tcp443_ip4));
+	struct strlist* s = select_by_score(cfg->tcp443_ip4,
+		cfg->num_tcp443_ip4, 443, 0);
+	return s?s->str:NULL;
 }
 
 static const char* get_random_tcp443_ip6(struct cfg* cfg)
 {
-	if(cfg->num_tcp443_ip6 == 0)
-		return NULL;
-	return strlist_get_num(cfg->tcp443_ip6,
-		((unsigned)ldns_get_random())%((unsigned)cfg->num_tcp443_ip6));
+	struct strlist* s = select_by_score(cfg->tcp443_ip6,
+		cfg->num_tcp443_ip6, 443, 0);
+	return s?s->str:NULL;
 }
 
+/* the ssllist has the next and str members in the same place as strlist */
 static struct ssllist* get_random_ssl443_ip4(struct cfg* cfg)
 {
-	if(cfg->num_ssl443_ip4 == 0)
-		return NULL;
-	return ssllist_get_num(cfg->ssl443_ip4,
-		((unsigned)ldns_get_random())%((unsigned)cfg->num_ssl443_ip4));
+	return (struct ssllist*)select_by_score(
+		(struct strlist*)cfg->ssl443_ip4, cfg->num_ssl443_ip4, 443, 1);
 }
 
 static struct ssllist* get_random_ssl443_ip6(struct cfg* cfg)
 {
-	if(cfg->num_ssl443_ip6 == 0)
-		return NULL;
-	return ssllist_get_num(cfg->ssl443_ip6,
-		((unsigned)ldns_get_random())%((unsigned)cfg->num_ssl443_ip6));
+	return (struct ssllist*)select_by_score(
+		(struct strlist*)cfg->ssl443_ip6, cfg->num_ssl443_ip6, 443, 1);
 }
 
 int probe_is_cache(struct probe_ip* p)
@@ -336,12 +359,23 @@ check_ssl(struct outq* outq)
 	return NULL;
 }
 
+/** record an event for the outq in the flight recorder */
+static void
+outq_trace(struct outq* outq, enum trace_type type, int val)
+{
+	trace_outq(type, &outq->addr, (outq->on_tcp?TRACE_TCP:0) |
+		(outq->on_ssl?TRACE_SSL:0) | (outq->recurse?TRACE_RECURSE:0),
+		(int)outq->qtype, val);
+}
+
 /** outq is done, NULL reason for success */
 static void
 outq_done(struct outq* outq, const char* reason)
 {
 	struct probe_ip* p = outq->probe;
 	const char* in = NULL;
+	if(reason)
+		outq_trace(outq, trace_outq_fail, 0);
 	if(!p) {
 		selfupdate_outq_done(global_svr->update, outq, NULL, reason);
 		return;
@@ -468,6 +502,7 @@ outq_check_packet(struct outq* outq, uint8_t* wire, size_t len)
 		/* start TCP query and wait for it */
 		verbose(VERB_ALGO, "%s: TC flag, switching to TCP",
 			outq->probe?outq->probe->name:outq->qname);
+		outq_trace(outq, trace_outq_tc, 0);
 		if(!outq_send_tcp(outq)) {
 			outq_done(outq, "cannot send TCP query after TC flag");
 		}
@@ -619,6 +654,7 @@ int outq_handle_udp(struct comm_point* c, void* my_arg, int error,
 		return 0;
 	}
 	comm_timer_disable(outq->timer);
+	outq_trace(outq, trace_outq_recv, (int)len);
 	outq_check_packet(outq, wire, len);
 	return 0;
 }
@@ -660,6 +696,42 @@ create_probe_query(struct outq* outq, ldns_buffer* buffer)
 	return 1;
 }
 
+/** the class of the outq in the pacing of the queries */
+static enum sched_class outq_class(struct outq* outq)
+{
+	struct probe_ip* p = outq->probe;
+	if(!p)
+		return sched_update;
+	if(p->to_http)
+		return sched_http;
+	if(p->dnstcp || p->ssldns)
+		return sched_tcp;
+	if(p->to_auth)
+		return sched_auth;
+	return sched_cache;
+}
+
+/** start the outq after it waited for the pacing, udp has its comm point */
+static void outq_start(void* arg)
+{
+	struct outq* outq = (struct outq*)arg;
+	int r;
+	if(outq->c)
+		r = outq_settimeout_and_send(outq);
+	else	r = outq_send_tcp(outq);
+	if(!r)
+		outq_done(outq, "could not send query");
+}
+
+/** set the bytes of the outq in the memstats, after its comm point changes */
+static void outq_account(struct outq* outq)
+{
+	size_t s = sizeof(*outq) + comm_point_get_mem(outq->c);
+	if(outq->timer)
+		s += comm_timer_get_mem(outq->timer);
+	memstats_set(memstats_outq, &outq->mem, s);
+}
+
 struct outq*
 outq_create(const char* ip, int tp, const char* domain, int recurse,
 	struct probe_ip* p, int tcp, int onssl, int port, int edns, int cdflag)
@@ -697,7 +769,11 @@ outq_create(const char* ip, int tp, const char* domain, int recurse,
 		/* also sets timeout, timer */
 		/* we test if it works, because if it were to call outq_done
 		 * with an error reason the query counts go wrong and the
-		 * probe does not work correctly. */
+		 * probe does not work correctly.  If it waits, the probe is
+		 * set up when it starts, and outq_done can be called. */
+		if(!sched_submit(global_svr->sched, &outq->sched,
+			outq_class(outq), &outq_start, outq))
+			return outq;
 		if(!outq_send_tcp(outq)) {
 			outq_delete(outq);
 			return NULL;
@@ -739,8 +815,12 @@ outq_create(const char* ip, int tp, const char* domain, int recurse,
 		free(outq);
 		return NULL;
 	}
+	outq_account(outq);
 	/* set timeout on commpoint */
 	outq->timeout = QUERY_START_TIMEOUT; /* msec */
+	if(!sched_submit(global_svr->sched, &outq->sched, outq_class(outq),
+		&outq_start, outq))
+		return outq;
 	if(!outq_settimeout_and_send(outq)) {
 		outq_delete(outq);
 		return NULL;
@@ -753,6 +833,8 @@ void outq_delete(struct outq* outq)
 	if(!outq) return;
 	comm_timer_delete(outq->timer);
 	comm_point_delete(outq->c);
+	sched_release(global_svr->sched, &outq->sched);
+	memstats_set(memstats_outq, &outq->mem, 0);
 	free(outq);
 }
 
@@ -780,6 +862,7 @@ static int outq_settimeout_and_send(struct outq* outq)
 		log_err("could not UDP send to ip %s", outq->probe->name);
 		return 0;
 	}
+	outq_trace(outq, trace_outq_send, outq->timeout);
 	return 1;
 }
 
@@ -790,6 +873,7 @@ void outq_timeout(void* arg)
 	verbose(VERB_ALGO, "%s %s: UDP timeout after %d msec",
 		outq->probe?outq->probe->name:outq->qname, t, outq->timeout);
 	free(t);
+	outq_trace(outq, trace_outq_timeout, outq->timeout);
 	if(outq->timeout > QUERY_END_TIMEOUT) {
 		/* too many timeouts */
 		outq_done(outq, "timeout");
@@ -839,7 +923,10 @@ outq_tcp_take_into_use(struct outq* outq)
 	}
 
 	fd_set_nonblock(s);
-	if(connect(s, (struct sockaddr*)&outq->addr, outq->addrlen) == -1) {
+	if(global_svr->cfg->tcp_fastopen)
+		(void)fd_set_tcp_fastopen(s);
+	if(comm_point_connect_tcp_out(s, (struct sockaddr*)&outq->addr,
+		outq->addrlen) == -1) {
 #ifndef USE_WINSOCK
 #ifdef EINPROGRESS
 		if(errno != EINPROGRESS) {
@@ -891,11 +978,13 @@ static int outq_send_tcp(struct outq* outq)
 		log_err("cannot create tcp comm point, out of memory");
 		return 0;
 	}
+	outq_account(outq);
 	if(!create_probe_query(outq, outq->c->buffer))
 		return 0;
 	if(!outq_tcp_take_into_use(outq))
 		return 0;
 	outq_settimer(outq);
+	outq_trace(outq, trace_outq_send, outq->timeout);
 	return 1;
 }
 
@@ -921,10 +1010,20 @@ int outq_handle_tcp(struct comm_point* c, void* my_arg, int error,
 		return 0;
 	}
 	comm_timer_disable(outq->timer);
+	outq_trace(outq, trace_outq_recv, (int)len);
 	outq_check_packet(outq, wire, len);
 	return 0;
 }
 
+/** get the time from the event base, that keeps it up to date */
+static void probe_now(struct timeval* tv)
+{
+	uint32_t* secs;
+	struct timeval* now;
+	comm_base_timept(global_svr->base, &secs, &now);
+	*tv = *now;
+}
+
 static int addr_is_localhost(const char* ip)
 {
 	struct sockaddr_storage addr;
@@ -977,6 +1076,7 @@ static void probe_spawn(const char* ip, int recurse, int dnstcp,
 	p->ssldns = ssldns;
 	p->port = port;
 	p->got_packet = 0;
+	probe_now(&p->start);
 	p->name = strdup(ip);
 	if(!p->name) {
 		free(p);
@@ -1025,6 +1125,7 @@ static void probe_spawn(const char* ip, int recurse, int dnstcp,
 	p->next = global_svr->probes;
 	global_svr->probes = p;
 	global_svr->num_probes++;
+	memstats_set(memstats_probes, &p->mem, sizeof(*p)+strlen(p->name)+1);
 }
 
 /** start probes for direct DNS authority server connection */
@@ -1172,6 +1273,16 @@ int probe_has_work_tcp(struct svr* svr, int port, int ip6, int ssl)
 }
 
 
+/** msec since the probe was started */
+static int
+probe_elapsed(struct probe_ip* p)
+{
+	struct timeval now;
+	probe_now(&now);
+	return (int)((now.tv_sec - p->start.tv_sec)*1000 +
+		(now.tv_usec - p->start.tv_usec)/1000);
+}
+
 /** see if probe totally done or we have to wait more */
 static void
 probe_partial_done(struct probe_ip* p, const char* in, const char* reason)
@@ -1202,6 +1313,7 @@ probe_partial_done(struct probe_ip* p, const char* in, const char* reason)
 	}
 
 	p->finished = 1;
+	p->rtt = probe_elapsed(p);
 	global_svr->num_probes_done++;
 	probe_done(p);
 }
@@ -1312,6 +1424,29 @@ void probe_setup_dnstcp(struct svr* svr)
 	svr->http_insecure = 0;
 }
 
+void probe_setup_snapshot(struct svr* svr, struct snapshot* s)
+{
+	int old_state = (int)svr->res_state;
+	svr->insecure_state = 0;
+	svr->res_state = (enum res_state)s->res_state;
+	if(svr->res_state == res_cache)
+		hook_unbound_cache(svr->cfg, s->forward);
+	else if(svr->res_state == res_tcp)
+		hook_unbound_tcp_upstream(svr->cfg, s->tcp80_ip4,
+			s->tcp80_ip6, s->tcp443_ip4, s->tcp443_ip6);
+	else if(svr->res_state == res_ssl)
+		hook_unbound_ssl_upstream(svr->cfg, s->ssl443_ip4,
+			s->ssl443_ip6);
+	else	hook_unbound_auth(svr->cfg);
+	/* set resolv.conf to 127.0.0.1 */
+	hook_resolv_localhost(svr->cfg);
+	if(svr->res_state == res_tcp || svr->res_state == res_ssl)
+		svr_tcp_timer_enable();
+	svr->http_insecure = 0;
+	trace_state(old_state, (int)svr->res_state, 0);
+	svr_send_results(svr);
+}
+
 /** setup to be disconnected */
 void probe_setup_disconnected(struct svr* svr)
 {
@@ -1409,6 +1544,9 @@ probe_cache_done(void)
 		cfg_have_ssldns(svr->cfg))) {
 		int nump = global_svr->num_probes;
 		int done = 0;
+		/* the check is done by the hook workers, and this uses the
+		 * answer of the previous one, unbound does not change much */
+		hook_unbound_check_upstream(svr->cfg);
 		if(hook_unbound_supports_tcp_upstream(svr->cfg)) {
 			/* no working cache and authority-direct works.
 			 * probe dns-over-tcp on port 80 and 443.
@@ -1439,6 +1577,81 @@ probe_cache_done(void)
 	probe_all_done();
 }
 
+/** note the results of the fallback server probes in the scores */
+static void
+probe_note_scores(struct svr* svr)
+{
+	struct probe_ip* p;
+	for(p=svr->probes; p; p=p->next) {
+		/* unfinished ones were stopped because others worked */
+		if(!p->finished || p->scored || p->to_http)
+			continue;
+		if(!p->to_auth && !p->dnstcp)
+			continue; /* DHCP-provided cache, not a choice */
+		score_note(svr->scores, p->name, p->port, p->ssldns!=NULL,
+			p->works, p->rtt);
+		p->scored = 1;
+	}
+	svr_store_scores(svr);
+}
+
+/** append a name to a space separated list, false on alloc failure */
+static int
+probe_list_append(char** list, const char* name)
+{
+	size_t len = *list?strlen(*list):0;
+	char* s = (char*)realloc(*list, len + strlen(name) + 2);
+	if(!s)
+		return 0;
+	if(len)
+		s[len++] = ' ';
+	memmove(s+len, name, strlen(name)+1);
+	*list = s;
+	return 1;
+}
+
+/** keep the decision in the state dir, for the warm start at the next
+ * boot, or remove it if it should not be used again */
+static void
+probe_store_snapshot(struct svr* svr)
+{
+	struct snapshot* s;
+	struct probe_ip* p;
+	if(svr->forced_insecure || svr->res_state == res_disconn)
+		return; /* nothing is learned about the network */
+	if(svr->res_state == res_dark || svr->insecure_state) {
+		svr_store_snapshot(svr, NULL);
+		return;
+	}
+	if(!(s = snapshot_create())) {
+		log_err("out of memory");
+		return;
+	}
+	if(!snapshot_fingerprint(s->fingerprint, sizeof(s->fingerprint))) {
+		snapshot_delete(s);
+		return;
+	}
+	s->res_state = (int)svr->res_state;
+	for(p=svr->probes; p; p=p->next) {
+		if(!probe_is_cache(p))
+			continue;
+		if(!probe_list_append(&s->dhcp, p->name) ||
+			(p->works && p->finished &&
+			!probe_list_append(&s->forward, p->name))) {
+			log_err("out of memory");
+			snapshot_delete(s);
+			return;
+		}
+	}
+	s->tcp80_ip4 = probe_has_work_tcp(svr, 80, 0, 0);
+	s->tcp80_ip6 = probe_has_work_tcp(svr, 80, 1, 0);
+	s->tcp443_ip4 = probe_has_work_tcp(svr, 443, 0, 0);
+	s->tcp443_ip6 = probe_has_work_tcp(svr, 443, 1, 0);
+	s->ssl443_ip4 = probe_has_work_tcp(svr, 443, 0, 1);
+	s->ssl443_ip6 = probe_has_work_tcp(svr, 443, 1, 1);
+	svr_store_snapshot(svr, s);
+}
+
 /** true if no packets were received during the probe: network seems down */
 static int
 got_no_packets(struct svr* svr)
@@ -1455,6 +1668,8 @@ void
 probe_all_done(void)
 {
 	struct svr* svr = global_svr;
+	struct timeval now;
+	int old_state = (int)svr->res_state;
 	if(verbosity >= VERB_DETAIL) {
 		struct probe_ip* p;
 		for(p=svr->probes; p; p=p->next) {
@@ -1472,6 +1687,10 @@ probe_all_done(void)
 				p->works?"OK":"error", p->reason?p->reason:"");
 		}
 	}
+	/* without any packets the network is down, and that is not
+	 * the fault of the servers */
+	if(!got_no_packets(svr))
+		probe_note_scores(svr);
 	/* reset skip http once it works */
 	if(svr->skip_http && svr->http && svr->http->saw_http_work)
 		svr->skip_http = 0;
@@ -1511,7 +1730,13 @@ probe_all_done(void)
 		verbose(VERB_OPS, "probe done: DNSSEC to cache");
 		probe_setup_cache(svr, NULL);
 	}
-	svr->probetime = time(0);
+	trace_state(old_state, (int)svr->res_state,
+		(svr->insecure_state?TRACE_INSECURE:0) |
+		(svr->forced_insecure?TRACE_FORCED:0) |
+		(svr->http_insecure?TRACE_HTTP_INSECURE:0));
+	probe_store_snapshot(svr);
+	probe_now(&now);
+	svr->probetime = (time_t)now.tv_sec;
 	svr_send_results(svr);
 	svr_check_update(svr);
 }
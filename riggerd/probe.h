@@ -41,12 +41,14 @@
 
 #ifndef PROBE_H
 #define PROBE_H
+#include "sched.h"
 struct comm_point;
 struct comm_reply;
 struct http_get;
 struct http_fetch;
 struct outq;
 struct svr;
+struct snapshot;
 
 /**
  * probe structure that contains the probe details for one IP address.
@@ -93,6 +95,14 @@ struct probe_ip {
 	char* reason;
 	/* if a packet has been received by a query (i.e. network is up) */
 	int got_packet;
+	/* time the probe was started */
+	struct timeval start;
+	/* msec it took for the probe to finish */
+	int rtt;
+	/* if the result has been noted in the server scores */
+	int scored;
+	/* bytes accounted in the memstats, while in the probe list */
+	size_t mem;
 };
 
 /** outstanding query */
@@ -112,6 +122,8 @@ struct outq {
 	struct comm_point* c;
 	struct comm_timer* timer;
 	struct probe_ip* probe; /* reference only to owner */
+	size_t mem; /* bytes accounted in the memstats */
+	struct sched_item sched; /* slot in the pacing of the queries */
 };
 
 #define QUERY_START_TIMEOUT 100 /* msec */
@@ -147,6 +159,8 @@ void probe_ssl_test(void);
 void probe_setup_cache(struct svr* svr, struct probe_ip* p);
 void probe_setup_hotspot_signon(struct svr* svr);
 void probe_setup_dnstcp(struct svr* svr);
+/** setup from the warm start snapshot, before the first probe */
+void probe_setup_snapshot(struct svr* svr, struct snapshot* s);
 
 /** true if probe is a cache IP, a DNS server from the DHCP hook */
 int probe_is_cache(struct probe_ip* p);
@@ -0,0 +1,94 @@
+#include "config.h"
+#include "region.h"
+
+#ifdef FWD_ZONES_SUPPORT
+
+#include "log.h"
+#include "memstats.h"
+#include <string.h>
+
+/** Alignment of the allocations */
+#define REGION_ALIGN (2*sizeof(void*))
+#define REGION_ALIGN_UP(x) (((x) + REGION_ALIGN - 1) & ~(REGION_ALIGN - 1))
+/** Size of the chunk header, so that the data that follows is aligned */
+#define REGION_HEADER REGION_ALIGN_UP(sizeof(struct region_chunk))
+
+/** Get a new chunk from the system and put it in the list */
+static char* region_new_chunk(struct region *region, size_t size)
+{
+    struct region_chunk *chunk = (struct region_chunk *)malloc(REGION_HEADER + size);
+    if (NULL == chunk)
+        fatal_exit("out of memory");
+    region->total += REGION_HEADER + size;
+    memstats_set(memstats_update, &region->mem, sizeof(*region) + region->total);
+    chunk->next = region->chunks;
+    region->chunks = chunk;
+    return (char *)chunk + REGION_HEADER;
+}
+
+struct region* region_create(void)
+{
+    struct region *region = (struct region *)calloc(1, sizeof(struct region));
+    if (NULL == region)
+        fatal_exit("out of memory");
+    memstats_set(memstats_update, &region->mem, sizeof(*region));
+    return region;
+}
+
+void* region_alloc(struct region *region, size_t size)
+{
+    void *ret;
+    size = REGION_ALIGN_UP(size ? size : 1);
+    region->count++;
+    if (size > REGION_LARGE_OBJECT) {
+        /* does not touch cur, the free space there is still used */
+        ret = region_new_chunk(region, size);
+        memset(ret, 0, size);
+        return ret;
+    }
+    if (size > region->left) {
+        region->cur = region_new_chunk(region, REGION_CHUNK_SIZE);
+        region->left = REGION_CHUNK_SIZE;
+    }
+    ret = region->cur;
+    region->cur += size;
+    region->left -= size;
+    memset(ret, 0, size);
+    return ret;
+}
+
+char* region_strndup(struct region *region, const char *string, size_t len)
+{
+    char *ret = (char *)region_alloc(region, len + 1);
+    memmove(ret, string, len);
+    ret[len] = 0;
+    return ret;
+}
+
+void region_free_all(struct region *region)
+{
+    struct region_chunk *chunk, *next;
+    if (NULL == region)
+        return;
+    for (chunk = region->chunks; NULL != chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    region->chunks = NULL;
+    region->cur = NULL;
+    region->left = 0;
+    region->total = 0;
+    region->count = 0;
+    memstats_set(memstats_update, &region->mem, sizeof(*region));
+}
+
+void region_destroy(struct region *region)
+{
+    if (NULL == region)
+        return;
+    region_free_all(region);
+    memstats_set(memstats_update, &region->mem, 0);
+    free(region);
+}
+
+#endif /* FWD_ZONES_SUPPORT */
@@ -0,0 +1,75 @@
+#include "config.h"
+
+#if !defined REGION_H && defined FWD_ZONES_SUPPORT
+#define REGION_H
+
+#include <stdlib.h>
+
+/**
+ * Region (arena) allocator. Memory is handed out from large chunks and
+ * is only given back all at once, when the region is freed. It is used
+ * for the lists of connections, zones and servers that are built for one
+ * update_all command, so that these do not take a malloc and free each.
+ */
+struct region {
+    /** List of all chunks */
+    struct region_chunk *chunks;
+    /** Next free byte in the current chunk */
+    char *cur;
+    /** Number of free bytes at cur */
+    size_t left;
+    /** Number of bytes allocated from the system */
+    size_t total;
+    /** Number of allocations done from this region */
+    size_t count;
+    /** Number of bytes accounted in the memstats */
+    size_t mem;
+};
+
+/**
+ * Header of a chunk of memory, the data follows it.
+ */
+struct region_chunk {
+    /** Next chunk in the list */
+    struct region_chunk *next;
+};
+
+/** Size of the chunks allocated from the system */
+#define REGION_CHUNK_SIZE 8192
+/** Allocations larger than this get a chunk of their own */
+#define REGION_LARGE_OBJECT (REGION_CHUNK_SIZE/4)
+
+/**
+ * Create a new empty region. Exits the process when out of memory.
+ */
+struct region* region_create(void);
+
+/**
+ * Allocate zeroed memory from the region. Exits the process when out of
+ * memory, like calloc_or_die.
+ * @param region: Region to allocate from
+ * @param size: Number of bytes
+ */
+void* region_alloc(struct region *region, size_t size);
+
+/**
+ * Copy a string into the region.
+ * @param region: Region to allocate from
+ * @param string: String to copy
+ * @param len: Length of the string, without the terminating zero
+ */
+char* region_strndup(struct region *region, const char *string, size_t len);
+
+/**
+ * Free all memory of the region, but keep the region itself for reuse.
+ * @param region: Region to clear
+ */
+void region_free_all(struct region *region);
+
+/**
+ * Free the region and all memory allocated from it.
+ * @param region: Region to free, can be NULL
+ */
+void region_destroy(struct region *region);
+
+#endif /* REGION_H */
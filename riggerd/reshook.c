@@ -45,14 +45,26 @@
 #include "log.h"
 #include "cfg.h"
 #include "probe.h"
+#include "hookq.h"
+#include "watchdog.h"
 #ifdef USE_WINSOCK
 #include "winrc/win_svc.h"
 #endif
 #ifdef HAVE_CHFLAGS
 #include <sys/stat.h>
 #endif
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+#include <fcntl.h>
 static int set_to_localhost = 0;
 
+/** max length of the resolv.conf that we write */
+#define RESCF_MAX 10240
+
 #ifdef HOOKS_OSX
 /** set the DNS the OSX way */
 static void
@@ -83,16 +95,6 @@ void restore_resolv_osx(struct cfg* cfg)
 #endif /* HOOKS_OSX */
 
 #ifndef USE_WINSOCK
-static void prline(FILE* out, const char* line)
-{
-	int r = fprintf(out, "%s", line);
-	if(r < 0) {
-		log_err("cannot write resolvconf: %s", strerror(errno));
-	} else if(r != (int)strlen(line)) {
-		log_err("short write resolvconf: filesystem full?");
-	}
-}
-
 #if defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
 static void r_mutable_bsd(const char* f)
 {
@@ -107,6 +109,41 @@ static void r_immutable_bsd(const char* f)
 		log_err("chflags(%s, uchg) failed: %s", f, strerror(errno));
 	}
 }
+#elif !defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX) && defined(FS_IOC_GETFLAGS)
+/** set or clear the immutable flag, what chattr does, without the fork */
+static void r_immutable_ioctl(const char* f, int on)
+{
+	int fd, flags = 0;
+	fd = open(f, O_RDONLY|O_NONBLOCK);
+	if(fd == -1) {
+		if(errno != ENOENT)
+			log_err("open(%s) failed: %s", f, strerror(errno));
+		return;
+	}
+	/* the immutable flag only works on extX like file systems */
+	if(ioctl(fd, FS_IOC_GETFLAGS, &flags) < 0) {
+		verbose(VERB_ALGO, "ioctl(%s, FS_IOC_GETFLAGS) failed: %s",
+			f, strerror(errno));
+		close(fd);
+		return;
+	}
+	if(!(flags&FS_IMMUTABLE_FL) != !on) {
+		if(on) flags |= FS_IMMUTABLE_FL;
+		else flags &= ~FS_IMMUTABLE_FL;
+		if(ioctl(fd, FS_IOC_SETFLAGS, &flags) < 0)
+			log_err("ioctl(%s, FS_IOC_SETFLAGS) failed: %s",
+				f, strerror(errno));
+	}
+	close(fd);
+}
+static void r_mutable_efs(const char* f)
+{
+	r_immutable_ioctl(f, 0);
+}
+static void r_immutable_efs(const char* f)
+{
+	r_immutable_ioctl(f, 1);
+}
 #elif !defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
 static void r_mutable_efs(const char* f)
 {
@@ -125,50 +162,154 @@ static void r_immutable_efs(const char* f)
 }
 #endif /* mutable/immutable on BSD and Linux */
 
-static FILE* open_rescf(struct cfg* cfg)
+/** make the file mutable */
+static void r_mutable(const char* f)
 {
-	FILE* out;
-	char line[1024];
-#  if defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
-	r_mutable_bsd(cfg->resolvconf);
-#  elif !defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
-	r_mutable_efs(cfg->resolvconf);
-#  endif
-	if(chmod(cfg->resolvconf, 0644)<0) {
-		log_err("chmod(%s) failed: %s", cfg->resolvconf,
-			strerror(errno));
-	}
-	/* make resolv.conf writable */
-	out = fopen(cfg->resolvconf, "w");
-	if(!out) {
-		log_err("cannot open %s: %s", cfg->resolvconf, strerror(errno));
-		return NULL;
+#if defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
+	r_mutable_bsd(f);
+#elif !defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
+	r_mutable_efs(f);
+#else
+	(void)f;
+#endif
+}
+
+/** make the file immutable */
+static void r_immutable(const char* f)
+{
+#if defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
+	r_immutable_bsd(f);
+#elif !defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
+	r_immutable_efs(f);
+#else
+	(void)f;
+#endif
+}
+
+/** append a line to the resolv.conf contents */
+static void rescf_line(char* buf, size_t len, const char* line)
+{
+	size_t l = strlen(buf), add = strlen(line);
+	if(l + add >= len) {
+		log_err("resolv.conf too long, skipped %s", line);
+		return;
 	}
-	prline(out, "# Generated by " PACKAGE_STRING "\n");
+	memmove(buf+l, line, add+1);
+}
+
+/** start the resolv.conf contents, with domain and search */
+static void rescf_start(struct cfg* cfg, char* buf, size_t len)
+{
+	char line[1024];
+	buf[0] = 0;
+	rescf_line(buf, len, "# Generated by " PACKAGE_STRING "\n");
 	if(cfg->rescf_domain) {
 		snprintf(line, sizeof(line), "domain %s\n", cfg->rescf_domain);
-		prline(out, line);
+		rescf_line(buf, len, line);
 	}
 	if(cfg->rescf_search) {
 		snprintf(line, sizeof(line), "search %s\n", cfg->rescf_search);
-		prline(out, line);
+		rescf_line(buf, len, line);
 	}
-	return out;
 }
 
-static void close_rescf(struct cfg* cfg, FILE* out)
+/** see if the file has this content already */
+static int rescf_same(const char* file, const char* content, size_t len)
+{
+	char cur[RESCF_MAX+1];
+	size_t r;
+	FILE* in = fopen(file, "r");
+	if(!in)
+		return 0;
+	/* read one more, so that a longer file is different */
+	r = fread(cur, 1, sizeof(cur), in);
+	fclose(in);
+	return r == len && memcmp(cur, content, len) == 0;
+}
+
+/** write the file in place, when it cannot be replaced, such as a
+ * bind-mounted resolv.conf.  @return false on failure */
+static int rescf_write_inplace(const char* file, const char* content,
+	size_t len)
+{
+	FILE* out;
+	/* make resolv.conf writable */
+	if(chmod(file, 0644)<0) {
+		log_err("chmod(%s) failed: %s", file, strerror(errno));
+	}
+	out = fopen(file, "w");
+	if(!out) {
+		log_err("cannot open %s: %s", file, strerror(errno));
+		return 0;
+	}
+	if(fwrite(content, 1, len, out) != len || fflush(out) != 0) {
+		log_err("cannot write %s: %s", file, strerror(errno));
+		fclose(out);
+		return 0;
+	}
+	fclose(out);
+	if(chmod(file, 0444)<0) {
+		log_err("chmod(%s) failed: %s", file, strerror(errno));
+	}
+	return 1;
+}
+
+int hook_resolv_write(const char* file, const char* content, int immutable)
 {
+	char tmp[1024];
+	char* real;
+	size_t len = strlen(content);
+	int r = 1;
+	FILE* out;
+	if(rescf_same(file, content, len)) {
+		verbose(VERB_ALGO, "%s unchanged", file);
+		return 1;
+	}
+	/* if it is a symlink, replace the file it points to */
+	real = realpath(file, NULL);
+	if(real)
+		file = real;
+	snprintf(tmp, sizeof(tmp), "%s.dnssec-trigger", file);
+	out = fopen(tmp, "w");
+	if(!out) {
+		log_err("cannot open %s: %s", tmp, strerror(errno));
+		free(real);
+		return 0;
+	}
+	if(fwrite(content, 1, len, out) != len || fflush(out) != 0 ||
+		fsync(fileno(out)) != 0) {
+		log_err("cannot write %s: %s", tmp, strerror(errno));
+		fclose(out);
+		unlink(tmp);
+		free(real);
+		return 0;
+	}
 	fclose(out);
 	/* make resolv.conf readonly */
-	if(chmod(cfg->resolvconf, 0444)<0) {
-		log_err("chmod(%s) failed: %s", cfg->resolvconf,
-			strerror(errno));
+	if(chmod(tmp, 0444)<0) {
+		log_err("chmod(%s) failed: %s", tmp, strerror(errno));
 	}
-#if defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
-	r_immutable_bsd(cfg->resolvconf);
-#elif !defined(HAVE_CHFLAGS) && !defined(HOOKS_OSX)
-	r_immutable_efs(cfg->resolvconf);
-#endif
+	/* an immutable file cannot be replaced */
+	if(immutable)
+		r_mutable(file);
+	if(rename(tmp, file) < 0) {
+		int e = errno;
+		unlink(tmp);
+		if(e == EBUSY || e == EXDEV) {
+			/* a mount point cannot be replaced, overwrite it */
+			verbose(VERB_ALGO, "rename(%s, %s) failed: %s, "
+				"write in place", tmp, file, strerror(e));
+			r = rescf_write_inplace(file, content, len);
+		} else {
+			log_err("rename(%s, %s) failed: %s", tmp, file,
+				strerror(e));
+			r = 0;
+		}
+	}
+	if(immutable)
+		r_immutable(file);
+	free(real);
+	return r;
 }
 #endif /* !USE_WINSOCK */
 
@@ -240,23 +381,28 @@ really_set_to_localhost(struct cfg* cfg) {
 }
 #endif /* no USE_WINSOCK, no OSX */
 
-void hook_resolv_localhost(struct cfg* cfg)
+/** set resolv.conf to 127.0.0.1, in a hook worker */
+static void resolv_localhost_run(void* arg)
 {
+	struct cfg* cfg = (struct cfg*)arg;
 #ifndef USE_WINSOCK
-	FILE* out;
+	char buf[RESCF_MAX];
+#endif
+#if !defined(HOOKS_OSX) && !defined(USE_WINSOCK)
+	int r;
 #endif
-	set_to_localhost = 1;
-	if(cfg->noaction) {
-		return;
-	}
 #ifdef HOOKS_OSX
 	set_dns_osx(cfg, "127.0.0.1");
 #endif
 #ifdef USE_WINSOCK
+	(void)cfg;
 	win_set_resolv("127.0.0.1");
 #else /* not on windows */
 #  ifndef HOOKS_OSX /* on Linux/BSD */
-	if (system("/usr/libexec/dnssec-trigger-script --setup") == 0)
+	watchdog_hook_begin("dnssec-trigger-script --setup");
+	r = system("/usr/libexec/dnssec-trigger-script --setup");
+	watchdog_hook_end();
+	if (r == 0)
 		return;
 
 	if(really_set_to_localhost(cfg)) {
@@ -267,35 +413,85 @@ void hook_resolv_localhost(struct cfg* cfg)
 	}
 	verbose(VERB_ALGO, "resolv.conf localhost write");
 #  endif
-	out = open_rescf(cfg);
-	if(!out) return;
-	/* write the options and nameserver records */
-	prline(out, "nameserver 127.0.0.1\n");
-	prline(out, "options edns0\n");
-	prline(out, "options trust-ad\n");
-	close_rescf(cfg, out);
+	rescf_start(cfg, buf, sizeof(buf));
+	/* the options and nameserver records */
+	rescf_line(buf, sizeof(buf), "nameserver 127.0.0.1\n");
+	rescf_line(buf, sizeof(buf), "options edns0\n");
+	rescf_line(buf, sizeof(buf), "options trust-ad\n");
+	(void)hook_resolv_write(cfg->resolvconf, buf, 1);
 #endif /* not on windows */
 }
 
-void hook_resolv_iplist(struct cfg* cfg, struct probe_ip* list)
+void hook_resolv_localhost(struct cfg* cfg)
 {
+	set_to_localhost = 1;
+	if(cfg->noaction) {
+		return;
+	}
+	hookq_submit(hookq_resolv, &resolv_localhost_run, NULL, cfg);
+}
+
+/** resolv.conf with the DHCP servers, made on the event loop because
+ * the probe list changes, and written by a hook worker */
+struct resolv_iplist_job {
+	/** the config */
+	struct cfg* cfg;
 #ifndef USE_WINSOCK
-	char line[1024];
-	FILE* out;
+	/** contents of resolv.conf */
+	char buf[RESCF_MAX];
 #endif
 #if defined(HOOKS_OSX) || defined(USE_WINSOCK)
+	/** the servers, space separated */
 	char iplist[10240];
-	iplist[0] = 0;
-#else
-	if (system("/usr/libexec/dnssec-trigger-script --restore") == 0)
+#endif
+};
+
+/** set resolv.conf to the DHCP servers, in a hook worker */
+static void resolv_iplist_run(void* arg)
+{
+	struct resolv_iplist_job* j = (struct resolv_iplist_job*)arg;
+#if !defined(HOOKS_OSX) && !defined(USE_WINSOCK)
+	int r;
+	watchdog_hook_begin("dnssec-trigger-script --restore");
+	r = system("/usr/libexec/dnssec-trigger-script --restore");
+	watchdog_hook_end();
+	if (r == 0)
 		return;
+#endif
+	if(j->cfg->noaction)
+		return;
+#ifndef USE_WINSOCK
+	(void)hook_resolv_write(j->cfg->resolvconf, j->buf, 1);
+#endif
+#ifdef HOOKS_OSX
+	set_dns_osx(j->cfg, j->iplist);
+#endif
+#ifdef USE_WINSOCK
+	win_set_resolv(j->iplist);
+#endif
+}
+
+/** free the iplist job */
+static void resolv_iplist_done(void* arg)
+{
+	free(arg);
+}
+
+void hook_resolv_iplist(struct cfg* cfg, struct probe_ip* list)
+{
+	struct resolv_iplist_job* j;
+#ifndef USE_WINSOCK
+	char line[1024];
 #endif
 	set_to_localhost = 0;
-	if(cfg->noaction)
+	j = (struct resolv_iplist_job*)calloc(1, sizeof(*j));
+	if(!j) {
+		log_err("out of memory");
 		return;
+	}
+	j->cfg = cfg;
 #ifndef USE_WINSOCK
-	out = open_rescf(cfg);
-	if(!out) return;
+	rescf_start(cfg, j->buf, sizeof(j->buf));
 #endif
 	/* write the nameserver records */
 	while(list) {
@@ -303,32 +499,22 @@ void hook_resolv_iplist(struct cfg* cfg, struct probe_ip* list)
 #ifndef USE_WINSOCK
 			snprintf(line, sizeof(line), "nameserver %s\n",
 				list->name);
-			prline(out, line);
+			rescf_line(j->buf, sizeof(j->buf), line);
 #endif
 #if defined(HOOKS_OSX) || defined(USE_WINSOCK)
-			snprintf(iplist+strlen(iplist),
-				sizeof(iplist)-strlen(iplist), "%s%s",
-				((iplist[0]==0)?"":" "), list->name);
+			snprintf(j->iplist+strlen(j->iplist),
+				sizeof(j->iplist)-strlen(j->iplist), "%s%s",
+				((j->iplist[0]==0)?"":" "), list->name);
 #endif
 		}
 		list = list->next;
 	}
-#ifndef USE_WINSOCK
-	close_rescf(cfg, out);
-#endif
-#ifdef HOOKS_OSX
-	set_dns_osx(cfg, iplist);
-#endif
-#ifdef USE_WINSOCK
-	win_set_resolv(iplist);
-#endif
+	hookq_submit(hookq_resolv, &resolv_iplist_run, &resolv_iplist_done, j);
 }
 
-void hook_resolv_flush(struct cfg* cfg)
+/** flush the caches of the system, in a hook worker */
+static void resolv_flush_run(void* ATTR_UNUSED(arg))
 {
-	/* attempt to flush OS specific caches, because we go from
-	 * insecure to secure mode */
-	(void)cfg;
 #ifdef HOOKS_OSX
 	/* dscacheutil on 10.5 an later, lookupd before that */
 	system("dscacheutil -flushcache || lookupd -flushcache || discoveryutil udnsflushcaches");
@@ -340,6 +526,13 @@ void hook_resolv_flush(struct cfg* cfg)
 #endif
 }
 
+void hook_resolv_flush(struct cfg* ATTR_UNUSED(cfg))
+{
+	/* attempt to flush OS specific caches, because we go from
+	 * insecure to secure mode */
+	hookq_submit(hookq_resolv, &resolv_flush_run, NULL, NULL);
+}
+
 #ifdef HOOKS_OSX
 static void osx_uninit(void)
 {
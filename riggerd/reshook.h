@@ -58,6 +58,22 @@ void hook_resolv_localhost(struct cfg* cfg);
  */
 void hook_resolv_iplist(struct cfg* cfg, struct probe_ip* list);
 
+#ifndef USE_WINSOCK
+/**
+ * Write resolv.conf, if the content is different from what is in it.
+ * It is written to a temp file that is renamed over it, so readers
+ * see the old or the new file, and never a partial one.  A file that
+ * cannot be replaced, such as a bind mount, is written in place.
+ * @param file: the resolv.conf file, if a symlink, the file it points to
+ *	is replaced.
+ * @param content: the new content.
+ * @param immutable: if true, the file is made immutable (on Linux
+ *	with the ext2 attribute, on BSD with chflags).
+ * @return false on failure, logged.
+ */
+int hook_resolv_write(const char* file, const char* content, int immutable);
+#endif /* !USE_WINSOCK */
+
 /**
  * Flush the DNS caches on the system, if somehow possible
  * @param cfg: with config options.
@@ -42,7 +42,12 @@
 #include "cfg.h"
 #include "svr.h"
 #include "reshook.h"
+#include "ubhook.h"
+#include "hookq.h"
 #include "netevent.h"
+#include "sched.h"
+#include "evprof.h"
+#include "watchdog.h"
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #endif
@@ -268,6 +273,12 @@ do_main_work(const char* cfgfile, int nodaemonize, int verb)
 	log_init(cfg->logfile, cfg->use_syslog, cfg->chroot);
 	if(!nodaemonize)
 		detach();
+	/* log from a thread, so that debug output does not slow the probes */
+	log_async_start();
+	/* unbound-control and resolv.conf changes do not block the probes */
+	(void)hookq_start(svr->base);
+	/* a thread that reports callbacks that stall the event loop */
+	(void)watchdog_start(cfg->stall_threshold);
 	store_pid(cfg->pidfile);
 	log_info("%s start", PACKAGE_STRING);
 	/* start 127.0.0.1 service (assumes not left in insecure mode),
@@ -275,6 +286,10 @@ do_main_work(const char* cfgfile, int nodaemonize, int verb)
 	/* TODO: check if already localhost and if so do not provide a small
 	 * window of opportunity here */
 	hook_resolv_localhost(cfg);
+	if(cfg_have_dnstcp(cfg) || cfg_have_ssldns(cfg))
+		hook_unbound_check_upstream(cfg);
+	/* set up unbound like it was on this network, and probe it */
+	svr_warm_start(svr);
 #ifdef USE_WINSOCK
 	netlist_start(svr);
 #endif
@@ -290,9 +305,15 @@ do_main_work(const char* cfgfile, int nodaemonize, int verb)
 			if(!(c2 = cfg_create(cfgfile)))
 				log_err("could not reload config");
 			else {
+				/* the hooks that run use the old config */
+				hookq_wait();
 				cfg_delete(cfg);
 				cfg = c2;
 				svr->cfg = cfg;
+				sched_set_limits(svr->sched, cfg->probe_inflight,
+					cfg->probe_rate);
+				evprof_set(cfg->event_profile);
+				(void)watchdog_start(cfg->stall_threshold);
 			}
 			/* reopen log after HUP to facilitate log rotation */
 			if(!cfg->use_syslog)
@@ -306,6 +327,9 @@ do_main_work(const char* cfgfile, int nodaemonize, int verb)
 	   so that during the reboot there is no window of opportunity */ 
 	if(svr->insecure_state)
 		hook_resolv_localhost(cfg);
+	watchdog_stop();
+	/* performs the hooks that are submitted */
+	hookq_stop();
 	unlink_pid(cfg->pidfile);
 	log_info("%s stop", PACKAGE_STRING);
 	svr_delete(svr);
@@ -414,6 +438,7 @@ int main(int argc, char *argv[])
 			wsa_strerror(WSAGetLastError()));
 	}
 #endif
+	log_async_stop();
 	log_init(NULL, 0, NULL); /* close logfile */
 	return 0;
 }
@@ -0,0 +1,220 @@
+/*
+ * sched.c - dnssec-trigger pacing of the probe queries
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *
+ * This file contains the scheduler of the probe queries.
+ */
+#include "config.h"
+#include <sys/time.h>
+#include "sched.h"
+#include "log.h"
+#include "netevent.h"
+
+struct sched* sched_create(struct comm_base* base)
+{
+	uint32_t* secs;
+	struct sched* s = (struct sched*)calloc(1, sizeof(*s));
+	if(!s)
+		return NULL;
+	s->timer = comm_timer_create(base, &sched_timeout, s);
+	if(!s->timer) {
+		free(s);
+		return NULL;
+	}
+	comm_base_timept(base, &secs, &s->now);
+	return s;
+}
+
+void sched_delete(struct sched* s)
+{
+	if(!s)
+		return;
+	comm_timer_delete(s->timer);
+	free(s);
+}
+
+/** the size of the bucket, in thousandths of a query */
+static long sched_burst(struct sched* s)
+{
+	if(s->max_inflight > 0)
+		return (long)s->max_inflight*1000;
+	return (long)s->rate*1000;
+}
+
+/** fill the bucket for the time since it was filled */
+static void sched_fill(struct sched* s)
+{
+	long usec;
+	if(s->rate == 0)
+		return;
+	usec = (long)(s->now->tv_sec - s->filled.tv_sec)*1000000 +
+		(long)(s->now->tv_usec - s->filled.tv_usec);
+	if(usec < 0 || usec > 1000000)
+		/* a clock jump, or more than a second, fills it */
+		s->tokens = sched_burst(s);
+	else	s->tokens += usec*(long)s->rate/1000;
+	if(s->tokens > sched_burst(s))
+		s->tokens = sched_burst(s);
+	s->filled = *s->now;
+}
+
+void sched_set_limits(struct sched* s, int max_inflight, int rate)
+{
+	s->max_inflight = max_inflight;
+	s->rate = rate;
+	s->filled = *s->now;
+	s->tokens = sched_burst(s);
+}
+
+/** if a query can take a slot and a token now */
+static int sched_can_start(struct sched* s)
+{
+	if(s->max_inflight > 0 && s->inflight >= s->max_inflight)
+		return 0;
+	if(s->rate > 0 && s->tokens < 1000)
+		return 0;
+	return 1;
+}
+
+/** take a slot and a token for the item */
+static void sched_take(struct sched* s, struct sched_item* item)
+{
+	item->inflight = 1;
+	s->inflight++;
+	if(s->rate > 0)
+		s->tokens -= 1000;
+}
+
+/** set the timer for the waiting queries, if they can start sometime */
+static void sched_arm(struct sched* s)
+{
+	struct timeval tv;
+	long usec = 0;
+	if(s->num_queued == 0 || comm_timer_is_set(s->timer))
+		return;
+	if(s->max_inflight > 0 && s->inflight >= s->max_inflight)
+		return; /* a release arms it */
+	if(s->rate > 0 && s->tokens < 1000)
+		/* time until the next token, rounded up */
+		usec = ((1000 - s->tokens)*1000 + s->rate - 1)/s->rate;
+	tv.tv_sec = usec/1000000;
+	tv.tv_usec = usec%1000000;
+	comm_timer_set(s->timer, &tv);
+}
+
+int sched_submit(struct sched* s, struct sched_item* item,
+	enum sched_class cls, sched_start_func* start, void* arg)
+{
+	if(!s)
+		return 1; /* no pacing */
+	item->start = start;
+	item->arg = arg;
+	item->cls = cls;
+	item->next = NULL;
+	sched_fill(s);
+	/* the waiting queries go first */
+	if(s->num_queued == 0 && sched_can_start(s)) {
+		sched_take(s, item);
+		return 1;
+	}
+	item->queued = 1;
+	if(s->last[cls])
+		s->last[cls]->next = item;
+	else	s->first[cls] = item;
+	s->last[cls] = item;
+	s->num_queued++;
+	verbose(VERB_ALGO, "query waits for pacing, %d in flight, %d waiting",
+		s->inflight, s->num_queued);
+	sched_arm(s);
+	return 0;
+}
+
+void sched_release(struct sched* s, struct sched_item* item)
+{
+	struct sched_item** pp;
+	if(!s)
+		return;
+	if(item->inflight) {
+		item->inflight = 0;
+		s->inflight--;
+		sched_arm(s);
+	}
+	if(item->queued) {
+		for(pp = &s->first[item->cls]; *pp; pp = &(*pp)->next) {
+			if(*pp == item) {
+				*pp = item->next;
+				break;
+			}
+		}
+		if(s->last[item->cls] == item) {
+			/* the one before it, or none */
+			struct sched_item* p = s->first[item->cls];
+			while(p && p->next)
+				p = p->next;
+			s->last[item->cls] = p;
+		}
+		item->queued = 0;
+		item->next = NULL;
+		s->num_queued--;
+	}
+}
+
+void sched_timeout(void* arg)
+{
+	struct sched* s = (struct sched*)arg;
+	struct sched_item* item;
+	int c;
+	sched_fill(s);
+	while(s->num_queued > 0 && sched_can_start(s)) {
+		for(c=0; c<SCHED_CLASSES; c++)
+			if(s->first[c])
+				break;
+		item = s->first[c];
+		s->first[c] = item->next;
+		if(!s->first[c])
+			s->last[c] = NULL;
+		item->queued = 0;
+		item->next = NULL;
+		s->num_queued--;
+		sched_take(s, item);
+		/* this can delete queries and submit new ones, the queues
+		 * are looked at again */
+		(*item->start)(item->arg);
+	}
+	sched_arm(s);
+}
@@ -0,0 +1,166 @@
+/*
+ * sched.h - dnssec-trigger pacing of the probe queries
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *
+ * This file contains the scheduler of the probe queries.  The probes for
+ * all the servers start their queries at the same time, and on a network
+ * with many resolvers that is a burst that trips the rate limits of the
+ * resolvers.  The scheduler keeps the number of queries in flight under a
+ * limit, and paces them with a token bucket.  The queries that have to
+ * wait are started in the order of their class, the cache probes first,
+ * and in the order they were submitted within a class.
+ *
+ * A query takes a slot when it is started and gives it back when it is
+ * deleted.  Waiting queries are started from a timer on the event loop,
+ * never from within the release of another query.
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+struct comm_base;
+struct comm_timer;
+
+/**
+ * The classes of queries, the lower ones are started first.
+ */
+enum sched_class {
+	/** probes of the DHCP supplied resolvers */
+	sched_cache = 0,
+	/** probes of the authority servers */
+	sched_auth,
+	/** probes of the tcp80, tcp443 and ssl443 resolvers */
+	sched_tcp,
+	/** address lookups of the http probes */
+	sched_http,
+	/** lookups of the software update */
+	sched_update,
+	/** number of classes */
+	SCHED_CLASSES
+};
+
+/** starts a query that waited, it handles its own failure */
+typedef void sched_start_func(void* arg);
+
+/**
+ * The part of a query that the scheduler uses, in the query struct.
+ */
+struct sched_item {
+	/** next in the queue of its class */
+	struct sched_item* next;
+	/** starts the query */
+	sched_start_func* start;
+	/** argument for start */
+	void* arg;
+	/** the class */
+	enum sched_class cls;
+	/** if it waits in a queue */
+	int queued;
+	/** if it has a slot */
+	int inflight;
+};
+
+/**
+ * The scheduler.
+ */
+struct sched {
+	/** the waiting queries, per class */
+	struct sched_item* first[SCHED_CLASSES];
+	/** the last waiting query, per class */
+	struct sched_item* last[SCHED_CLASSES];
+	/** number of waiting queries */
+	int num_queued;
+	/** number of queries that have a slot */
+	int inflight;
+	/** max queries in flight, 0 for no limit */
+	int max_inflight;
+	/** queries per second, 0 for no pacing */
+	int rate;
+	/** tokens in the bucket, in thousandths of a query */
+	long tokens;
+	/** time the bucket was filled */
+	struct timeval filled;
+	/** time of the event base */
+	struct timeval* now;
+	/** starts the waiting queries */
+	struct comm_timer* timer;
+};
+
+/**
+ * Create the scheduler.
+ * @param base: the event base, for the timer.
+ * @return NULL on alloc failure.
+ */
+struct sched* sched_create(struct comm_base* base);
+
+/** delete the scheduler, the queries are deleted before it */
+void sched_delete(struct sched* s);
+
+/**
+ * Set the limits, from the config.
+ * @param s: the scheduler.
+ * @param max_inflight: max queries in flight, 0 for no limit.
+ * @param rate: queries per second, 0 for no pacing.  The bucket holds
+ *	max_inflight queries, or a second of queries without that limit.
+ */
+void sched_set_limits(struct sched* s, int max_inflight, int rate);
+
+/**
+ * Submit a query.
+ * @param s: the scheduler, or NULL, then the query starts now.
+ * @param item: the item of the query.
+ * @param cls: the class of the query.
+ * @param start: called to start the query, when it waited.
+ * @param arg: argument for start, the query.
+ * @return true if the query has a slot and the caller starts it now,
+ *	false if it waits, and start is called later.
+ */
+int sched_submit(struct sched* s, struct sched_item* item,
+	enum sched_class cls, sched_start_func* start, void* arg);
+
+/**
+ * Release a query, when it is deleted.  It gives back its slot or is
+ * taken from its queue.  Can be called for an item that is not submitted.
+ * @param s: the scheduler, or NULL.
+ * @param item: the item of the query.
+ */
+void sched_release(struct sched* s, struct sched_item* item);
+
+/** timer callback, starts the waiting queries */
+void sched_timeout(void* arg);
+
+#endif /* SCHED_H */
@@ -0,0 +1,242 @@
+/*
+ * score.c - dnssec-trigger fallback server scoring
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the scoring of fallback servers for the probes.
+ */
+#include "config.h"
+#include "score.h"
+#include "log.h"
+#include <ldns/ldns.h>
+
+struct score_tab* score_tab_create(void)
+{
+	struct score_tab* tab = (struct score_tab*)calloc(1, sizeof(*tab));
+	return tab;
+}
+
+void score_tab_delete(struct score_tab* tab)
+{
+	struct score_entry* e, *n;
+	if(!tab) return;
+	e = tab->list;
+	while(e) {
+		n = e->next;
+		free(e->name);
+		free(e);
+		e = n;
+	}
+	free(tab);
+}
+
+struct score_entry* score_lookup(struct score_tab* tab, const char* name,
+	int port, int ssl, int create)
+{
+	struct score_entry* e;
+	for(e = tab->list; e; e = e->next) {
+		if(e->port == port && e->ssl == ssl &&
+			strcmp(e->name, name) == 0)
+			return e;
+	}
+	if(!create)
+		return NULL;
+	e = (struct score_entry*)calloc(1, sizeof(*e));
+	if(!e) {
+		log_err("out of memory");
+		return NULL;
+	}
+	e->name = strdup(name);
+	if(!e->name) {
+		log_err("out of memory");
+		free(e);
+		return NULL;
+	}
+	e->port = port;
+	e->ssl = ssl;
+	e->next = tab->list;
+	tab->list = e;
+	return e;
+}
+
+void score_note(struct score_tab* tab, const char* name, int port, int ssl,
+	int works, int rtt)
+{
+	struct score_entry* e;
+	if(!tab) return;
+	e = score_lookup(tab, name, port, ssl, 1);
+	if(!e) return;
+	if(e->tries >= SCORE_MAX_TRIES) {
+		/* age the old results, so recent ones count more */
+		e->tries /= 2;
+		e->success /= 2;
+	}
+	e->tries++;
+	if(works) {
+		e->success++;
+		if(rtt < 1) rtt = 1;
+		/* smoothed like the tcp srtt, 1/8 of the new sample */
+		if(e->rtt == 0)
+			e->rtt = rtt;
+		else	e->rtt = (7*e->rtt + rtt)/8;
+	}
+	tab->dirty = 1;
+	verbose(VERB_ALGO, "score %s port %d%s: %d/%d rtt %d", name, port,
+		ssl?" ssl":"", e->success, e->tries, e->rtt);
+}
+
+/** weight of a server for selection */
+static double
+score_weight(struct score_tab* tab, const char* name, int port, int ssl)
+{
+	struct score_entry* e = score_lookup(tab, name, port, ssl, 0);
+	double s;
+	int rtt;
+	if(!e) {
+		/* not probed yet, expect average */
+		s = 0.5;
+		rtt = SCORE_RTT_UNKNOWN;
+	} else {
+		/* the +1,+2 make sure untried or always failing servers
+		 * keep a (small) chance to be picked */
+		s = ((double)e->success + 1.) / ((double)e->tries + 2.);
+		rtt = e->rtt?e->rtt:SCORE_RTT_UNKNOWN;
+	}
+	/* failures weigh heavier than slowness, a failure costs a
+	 * full probe timeout */
+	return s*s*1000. / ((double)rtt + 100.);
+}
+
+/** get random number in range [0, 1> */
+static double
+score_random(void)
+{
+	unsigned r = ((unsigned)ldns_get_random()<<16) |
+		(unsigned)ldns_get_random();
+	return (double)r / 4294967296.;
+}
+
+int score_select(struct score_tab* tab, const char** names, int num,
+	int port, int ssl)
+{
+	double total = 0., r;
+	int i;
+	if(num <= 1)
+		return 0;
+	if(!tab || ((unsigned)ldns_get_random())%100 < SCORE_EXPLORE_PCT)
+		return (int)(((unsigned)ldns_get_random())%((unsigned)num));
+	for(i=0; i<num; i++)
+		total += score_weight(tab, names[i], port, ssl);
+	r = score_random() * total;
+	for(i=0; i<num; i++) {
+		r -= score_weight(tab, names[i], port, ssl);
+		if(r < 0.)
+			return i;
+	}
+	return num-1;
+}
+
+int score_tab_read(struct score_tab* tab, const char* file)
+{
+	char buf[1024];
+	char name[256];
+	int port, ssl, tries, success, rtt, line = 0;
+	struct score_entry* e;
+	FILE* in = fopen(file, "r");
+	if(!in) {
+		if(errno == ENOENT) {
+			verbose(VERB_ALGO, "no score file %s", file);
+			return 1;
+		}
+		log_err("cannot open %s: %s", file, strerror(errno));
+		return 0;
+	}
+	while(fgets(buf, (int)sizeof(buf), in)) {
+		line++;
+		if(buf[0] == '#' || buf[0] == '\n' || buf[0] == 0)
+			continue;
+		if(sscanf(buf, "%255s %d %d %d %d %d", name, &port, &ssl,
+			&tries, &success, &rtt) != 6 || tries < 0 ||
+			success < 0 || success > tries || rtt < 0) {
+			log_err("%s:%d: bad score line, ignored", file, line);
+			continue;
+		}
+		if(!(e = score_lookup(tab, name, port, ssl, 1)))
+			break;
+		e->tries = tries;
+		e->success = success;
+		e->rtt = rtt;
+	}
+	fclose(in);
+	tab->dirty = 0;
+	return 1;
+}
+
+int score_tab_write(struct score_tab* tab, const char* file)
+{
+	char tmp[1024];
+	struct score_entry* e;
+	FILE* out;
+	snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+	out = fopen(tmp, "w");
+	if(!out) {
+		log_err("cannot open %s for write: %s", tmp, strerror(errno));
+		return 0;
+	}
+	fprintf(out, "# dnssec-trigger probe scores\n");
+	fprintf(out, "# ip port ssl tries success rtt(msec)\n");
+	for(e = tab->list; e; e = e->next) {
+		fprintf(out, "%s %d %d %d %d %d\n", e->name, e->port, e->ssl,
+			e->tries, e->success, e->rtt);
+	}
+	if(fclose(out) != 0) {
+		log_err("cannot write %s: %s", tmp, strerror(errno));
+		unlink(tmp);
+		return 0;
+	}
+#ifdef USE_WINSOCK
+	/* rename does not overwrite on windows */
+	unlink(file);
+#endif
+	if(rename(tmp, file) != 0) {
+		log_err("cannot rename %s to %s: %s", tmp, file,
+			strerror(errno));
+		unlink(tmp);
+		return 0;
+	}
+	tab->dirty = 0;
+	return 1;
+}
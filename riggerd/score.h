@@ -0,0 +1,148 @@
+/*
+ * score.h - dnssec-trigger fallback server scoring
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the scoring table for the fallback servers (the root
+ * servers and the tcp80, tcp443 and ssl443 open resolvers).  Per server
+ * it keeps the success rate and the round trip time of earlier probes,
+ * and the probe picks a server by weighted random selection on that,
+ * with a fraction of uniform choices so that every server is retried.
+ */
+
+#ifndef SCORE_H
+#define SCORE_H
+
+/** percentage of selections that are uniform random (exploration) */
+#define SCORE_EXPLORE_PCT 10
+/** rtt (msec) assumed for servers that have not been probed yet */
+#define SCORE_RTT_UNKNOWN 500
+/** when tries reaches this, tries and successes are halved (aging) */
+#define SCORE_MAX_TRIES 32
+/** filename of the score table in the state directory */
+#define SCORE_FILE_NAME "probe-scores"
+
+/**
+ * Score for one server.
+ */
+struct score_entry {
+	struct score_entry* next;
+	/** IP address of the server */
+	char* name;
+	/** port number probed */
+	int port;
+	/** true if probed over ssl */
+	int ssl;
+	/** number of probes that finished */
+	int tries;
+	/** number of those probes that worked */
+	int success;
+	/** smoothed round trip time in msec, of the working probes,
+	 * 0 if not known */
+	int rtt;
+};
+
+/**
+ * The table with server scores.
+ */
+struct score_tab {
+	/** list of entries */
+	struct score_entry* list;
+	/** if changed since read from or written to file */
+	int dirty;
+};
+
+/** create empty score table, or NULL on malloc failure */
+struct score_tab* score_tab_create(void);
+
+/** delete score table */
+void score_tab_delete(struct score_tab* tab);
+
+/**
+ * Read score table entries from file, nonexistent file is not an error.
+ * @param tab: table to add entries to.
+ * @param file: filename.
+ * @return false on failure.
+ */
+int score_tab_read(struct score_tab* tab, const char* file);
+
+/**
+ * Write score table to file (via a temp file and rename).
+ * @param tab: table to write.
+ * @param file: filename.
+ * @return false on failure.
+ */
+int score_tab_write(struct score_tab* tab, const char* file);
+
+/**
+ * Lookup a server in the score table.
+ * @param tab: table.
+ * @param name: IP address of the server.
+ * @param port: port number.
+ * @param ssl: if ssl is used.
+ * @param create: if true, an entry is created when not found.
+ * @return entry or NULL if not found (or malloc failure).
+ */
+struct score_entry* score_lookup(struct score_tab* tab, const char* name,
+	int port, int ssl, int create);
+
+/**
+ * Note the result of a finished probe to a server.
+ * @param tab: table.
+ * @param name: IP address.
+ * @param port: port number.
+ * @param ssl: if ssl is used.
+ * @param works: if the probe worked.
+ * @param rtt: time taken by the probe in msec.
+ */
+void score_note(struct score_tab* tab, const char* name, int port, int ssl,
+	int works, int rtt);
+
+/**
+ * Select one server from a list.  Mostly a weighted random choice, that
+ * prefers servers that worked and have short round trip times, and
+ * sometimes a uniform random choice.
+ * @param tab: table, if NULL uniform random selection.
+ * @param names: array of IP addresses.
+ * @param num: number of elements in the array, must be >0.
+ * @param port: port number.
+ * @param ssl: if ssl is used.
+ * @return index into the array.
+ */
+int score_select(struct score_tab* tab, const char** names, int num,
+	int port, int ssl);
+
+#endif /* SCORE_H */
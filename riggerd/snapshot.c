@@ -0,0 +1,374 @@
+/*
+ * snapshot.c - dnssec-trigger warm start state
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *
+ * This file contains the snapshot of the last decision of the probes.
+ */
+#include "config.h"
+#include "snapshot.h"
+#include "svr.h"
+#include "log.h"
+#include "net_help.h"
+#ifndef USE_WINSOCK
+#include <ifaddrs.h>
+#include <net/if.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+/** max length of a line in the snapshot file */
+#define SNAPSHOT_LINE_MAX 10240
+
+struct snapshot* snapshot_create(void)
+{
+	return (struct snapshot*)calloc(1, sizeof(struct snapshot));
+}
+
+/** clear the contents of the snapshot */
+static void snapshot_clear(struct snapshot* s)
+{
+	free(s->dhcp);
+	free(s->forward);
+	memset(s, 0, sizeof(*s));
+}
+
+void snapshot_delete(struct snapshot* s)
+{
+	if(!s)
+		return;
+	snapshot_clear(s);
+	free(s);
+}
+
+/** the name of a state in the file, or NULL if it is not kept */
+static const char* snapshot_state_str(int res_state)
+{
+	switch(res_state) {
+	case res_cache: return "cache";
+	case res_auth: return "auth";
+	case res_tcp: return "tcp";
+	case res_ssl: return "ssl";
+	default: break;
+	}
+	return NULL;
+}
+
+/** the state for a name in the file, -1 if not known */
+static int snapshot_str_state(const char* str)
+{
+	if(strcmp(str, "cache") == 0) return res_cache;
+	if(strcmp(str, "auth") == 0) return res_auth;
+	if(strcmp(str, "tcp") == 0) return res_tcp;
+	if(strcmp(str, "ssl") == 0) return res_ssl;
+	return -1;
+}
+
+/** the upstream flags, with their names in the file */
+static int* snapshot_upstream(struct snapshot* s, const char* str)
+{
+	if(strcmp(str, "tcp80_ip4") == 0) return &s->tcp80_ip4;
+	if(strcmp(str, "tcp80_ip6") == 0) return &s->tcp80_ip6;
+	if(strcmp(str, "tcp443_ip4") == 0) return &s->tcp443_ip4;
+	if(strcmp(str, "tcp443_ip6") == 0) return &s->tcp443_ip6;
+	if(strcmp(str, "ssl443_ip4") == 0) return &s->ssl443_ip4;
+	if(strcmp(str, "ssl443_ip6") == 0) return &s->ssl443_ip6;
+	return NULL;
+}
+
+/** true if the list has only IP addresses, separated by spaces.  The
+ * addresses go on the unbound-control command line and to the probes. */
+static int snapshot_iplist_ok(const char* list)
+{
+	struct sockaddr_storage addr;
+	socklen_t len;
+	char ip[64];
+	size_t n;
+	if(!list)
+		return 1;
+	while(*list) {
+		if(*list == ' ') {
+			list++;
+			continue;
+		}
+		n = strcspn(list, " ");
+		if(n >= sizeof(ip))
+			return 0;
+		memmove(ip, list, n);
+		ip[n] = 0;
+		if(!ipstrtoaddr(ip, DNS_PORT, &addr, &len))
+			return 0;
+		list += n;
+	}
+	return 1;
+}
+
+/** true if the contents can be applied */
+static int snapshot_usable(struct snapshot* s)
+{
+	if(s->fingerprint[0] == 0)
+		return 0;
+	if(!snapshot_iplist_ok(s->dhcp) || !snapshot_iplist_ok(s->forward))
+		return 0;
+	switch(s->res_state) {
+	case res_cache:
+		return s->forward && s->forward[0] != 0;
+	case res_auth:
+		return 1;
+	case res_tcp:
+		return s->tcp80_ip4 || s->tcp80_ip6 || s->tcp443_ip4 ||
+			s->tcp443_ip6;
+	case res_ssl:
+		return s->ssl443_ip4 || s->ssl443_ip6;
+	default:
+		break;
+	}
+	return 0;
+}
+
+int snapshot_read(struct snapshot* s, const char* file)
+{
+	char* buf, *arg, *w;
+	int line = 0, ok = 1;
+	FILE* in = fopen(file, "r");
+	snapshot_clear(s);
+	s->res_state = -1;
+	if(!in) {
+		if(errno == ENOENT) {
+			verbose(VERB_ALGO, "no snapshot file %s", file);
+			return 0;
+		}
+		log_err("cannot open %s: %s", file, strerror(errno));
+		return 0;
+	}
+	buf = (char*)malloc(SNAPSHOT_LINE_MAX);
+	if(!buf) {
+		log_err("out of memory");
+		fclose(in);
+		return 0;
+	}
+	while(ok && fgets(buf, SNAPSHOT_LINE_MAX, in)) {
+		line++;
+		buf[strcspn(buf, "\r\n")] = 0;
+		if(buf[0] == '#' || buf[0] == 0)
+			continue;
+		/* keyword, space, the rest of the line */
+		arg = strchr(buf, ' ');
+		if(arg)
+			*arg++ = 0;
+		else	arg = "";
+		if(strcmp(buf, "fingerprint") == 0) {
+			if(strlen(arg) >= sizeof(s->fingerprint))
+				ok = 0;
+			else	memmove(s->fingerprint, arg, strlen(arg)+1);
+		} else if(strcmp(buf, "state") == 0) {
+			s->res_state = snapshot_str_state(arg);
+		} else if(strcmp(buf, "dhcp") == 0) {
+			free(s->dhcp);
+			if(!(s->dhcp = strdup(arg)))
+				ok = 0;
+		} else if(strcmp(buf, "forward") == 0) {
+			free(s->forward);
+			if(!(s->forward = strdup(arg)))
+				ok = 0;
+		} else if(strcmp(buf, "upstream") == 0) {
+			for(w = strtok(arg, " "); w; w = strtok(NULL, " ")) {
+				int* f = snapshot_upstream(s, w);
+				if(f) *f = 1;
+			}
+		} else {
+			log_err("%s:%d: unknown snapshot line, ignored", file,
+				line);
+		}
+	}
+	free(buf);
+	fclose(in);
+	if(!ok || !snapshot_usable(s)) {
+		log_err("%s: bad snapshot, ignored", file);
+		snapshot_clear(s);
+		return 0;
+	}
+	return 1;
+}
+
+int snapshot_write(struct snapshot* s, const char* file)
+{
+	char tmp[1024];
+	FILE* out;
+	const char* st = snapshot_state_str(s->res_state);
+	if(!st)
+		return 0;
+	snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+	out = fopen(tmp, "w");
+	if(!out) {
+		log_err("cannot open %s for write: %s", tmp, strerror(errno));
+		return 0;
+	}
+	fprintf(out, "# dnssec-trigger warm start snapshot\n");
+	fprintf(out, "fingerprint %s\n", s->fingerprint);
+	fprintf(out, "state %s\n", st);
+	fprintf(out, "dhcp %s\n", s->dhcp?s->dhcp:"");
+	fprintf(out, "forward %s\n", s->forward?s->forward:"");
+	fprintf(out, "upstream%s%s%s%s%s%s\n",
+		s->tcp80_ip4?" tcp80_ip4":"", s->tcp80_ip6?" tcp80_ip6":"",
+		s->tcp443_ip4?" tcp443_ip4":"", s->tcp443_ip6?" tcp443_ip6":"",
+		s->ssl443_ip4?" ssl443_ip4":"", s->ssl443_ip6?" ssl443_ip6":"");
+	/* on disk before the rename, so a crash leaves the old or new file */
+	if(fflush(out) != 0
+#ifndef USE_WINSOCK
+		|| fsync(fileno(out)) != 0
+#endif
+		) {
+		log_err("cannot write %s: %s", tmp, strerror(errno));
+		fclose(out);
+		unlink(tmp);
+		return 0;
+	}
+	if(fclose(out) != 0) {
+		log_err("cannot write %s: %s", tmp, strerror(errno));
+		unlink(tmp);
+		return 0;
+	}
+#ifdef USE_WINSOCK
+	/* rename does not overwrite on windows */
+	unlink(file);
+#endif
+	if(rename(tmp, file) != 0) {
+		log_err("cannot rename %s to %s: %s", tmp, file,
+			strerror(errno));
+		unlink(tmp);
+		return 0;
+	}
+	return 1;
+}
+
+/** compare strings that can be NULL, NULL is the empty string */
+static int snapshot_str_equal(const char* a, const char* b)
+{
+	return strcmp(a?a:"", b?b:"") == 0;
+}
+
+int snapshot_equal(struct snapshot* a, struct snapshot* b)
+{
+	return a->res_state == b->res_state &&
+		strcmp(a->fingerprint, b->fingerprint) == 0 &&
+		snapshot_str_equal(a->dhcp, b->dhcp) &&
+		snapshot_str_equal(a->forward, b->forward) &&
+		a->tcp80_ip4 == b->tcp80_ip4 && a->tcp80_ip6 == b->tcp80_ip6 &&
+		a->tcp443_ip4 == b->tcp443_ip4 &&
+		a->tcp443_ip6 == b->tcp443_ip6 &&
+		a->ssl443_ip4 == b->ssl443_ip4 &&
+		a->ssl443_ip6 == b->ssl443_ip6;
+}
+
+#ifndef USE_WINSOCK
+/** add bytes to an FNV-1a hash */
+static uint64_t snapshot_hash(uint64_t h, const uint8_t* d, size_t len)
+{
+	size_t i;
+	for(i=0; i<len; i++) {
+		h ^= d[i];
+		h *= (uint64_t)1099511628211ULL;
+	}
+	return h;
+}
+
+/** the hash of the network of an interface address, or 0 to skip it */
+static uint64_t snapshot_hash_ifa(struct ifaddrs* ifa)
+{
+	uint8_t net[16];
+	const uint8_t* a, *m;
+	size_t i, len;
+	uint64_t h = (uint64_t)14695981039346656037ULL;
+	if(!ifa->ifa_addr || !ifa->ifa_netmask || !(ifa->ifa_flags&IFF_UP)
+		|| (ifa->ifa_flags&IFF_LOOPBACK))
+		return 0;
+	if(ifa->ifa_addr->sa_family == AF_INET) {
+		a = (uint8_t*)&((struct sockaddr_in*)ifa->ifa_addr)->sin_addr;
+		m = (uint8_t*)&((struct sockaddr_in*)ifa->ifa_netmask)->
+			sin_addr;
+		len = 4;
+	} else if(ifa->ifa_addr->sa_family == AF_INET6) {
+		a = (uint8_t*)&((struct sockaddr_in6*)ifa->ifa_addr)->
+			sin6_addr;
+		m = (uint8_t*)&((struct sockaddr_in6*)ifa->ifa_netmask)->
+			sin6_addr;
+		len = 16;
+		/* the link local addresses are there without a network */
+		if(a[0] == 0xfe && (a[1]&0xc0) == 0x80)
+			return 0;
+	} else	return 0;
+	for(i=0; i<len; i++)
+		net[i] = a[i]&m[i];
+	h = snapshot_hash(h, (uint8_t*)ifa->ifa_name, strlen(ifa->ifa_name));
+	/* the mask has the prefix length */
+	h = snapshot_hash(h, m, len);
+	h = snapshot_hash(h, net, len);
+	return h;
+}
+#endif /* USE_WINSOCK */
+
+int snapshot_fingerprint(char* buf, size_t len)
+{
+#ifndef USE_WINSOCK
+	struct ifaddrs* list, *ifa;
+	uint64_t h, sum = 0;
+	int num = 0;
+	if(getifaddrs(&list) == -1) {
+		log_err("getifaddrs: %s", strerror(errno));
+		return 0;
+	}
+	/* the sum does not depend on the order of the interfaces */
+	for(ifa = list; ifa; ifa = ifa->ifa_next) {
+		if((h = snapshot_hash_ifa(ifa)) != 0) {
+			sum += h;
+			num++;
+		}
+	}
+	freeifaddrs(list);
+	if(num == 0)
+		return 0;
+	snprintf(buf, len, "%d-%08x%08x", num, (unsigned)(sum>>32),
+		(unsigned)(sum&0xffffffff));
+	return 1;
+#else
+	(void)buf;
+	(void)len;
+	return 0;
+#endif /* USE_WINSOCK */
+}
@@ -0,0 +1,112 @@
+/*
+ * snapshot.h - dnssec-trigger warm start state
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *
+ * This file contains the snapshot of the last decision of the probes, so
+ * that at the next start of the daemon, after a boot or a resume, unbound
+ * can be set up right away instead of after the first probes.  It has the
+ * state, the resolvers that unbound forwards to, the tcp and ssl upstreams,
+ * and a fingerprint of the networks of the interfaces.  It is used only
+ * when the interfaces are on the same networks, and a probe confirms it.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/** filename of the snapshot in the state directory */
+#define SNAPSHOT_FILE_NAME "warm-start"
+/** length of the fingerprint string, with the zero */
+#define SNAPSHOT_FP_LEN 32
+
+/**
+ * The snapshot of a decision.
+ */
+struct snapshot {
+	/** the state, res_cache, res_auth, res_tcp or res_ssl */
+	int res_state;
+	/** fingerprint of the networks of the interfaces */
+	char fingerprint[SNAPSHOT_FP_LEN];
+	/** the DHCP supplied resolvers, space separated, probed again to
+	 * confirm the snapshot */
+	char* dhcp;
+	/** the resolvers that unbound forwards to in the cache state,
+	 * space separated */
+	char* forward;
+	/** the tcp upstreams that work, in the tcp state */
+	int tcp80_ip4, tcp80_ip6, tcp443_ip4, tcp443_ip6;
+	/** the ssl upstreams that work, in the ssl state */
+	int ssl443_ip4, ssl443_ip6;
+};
+
+/** create an empty snapshot, NULL on alloc failure */
+struct snapshot* snapshot_create(void);
+
+/** delete a snapshot */
+void snapshot_delete(struct snapshot* s);
+
+/**
+ * Read the snapshot from file.
+ * @param s: filled with the contents.
+ * @param file: the filename.
+ * @return false if there is no snapshot, or it cannot be used.
+ */
+int snapshot_read(struct snapshot* s, const char* file);
+
+/**
+ * Write the snapshot to file, via a temporary file.
+ * @param s: the snapshot.
+ * @param file: the filename.
+ * @return false on failure, it is logged.
+ */
+int snapshot_write(struct snapshot* s, const char* file);
+
+/** true if the snapshots are the same decision on the same network */
+int snapshot_equal(struct snapshot* a, struct snapshot* b);
+
+/**
+ * Compute the fingerprint of the networks the interfaces are on: their
+ * up, not loopback, addresses with the netmask applied.  The addresses
+ * themselves can change with a new DHCP lease.
+ * @param buf: the fingerprint is returned in here.
+ * @param len: length of buf, SNAPSHOT_FP_LEN.
+ * @return false if there are no networks (or it is not supported), and
+ *	there is no fingerprint.
+ */
+int snapshot_fingerprint(char* buf, size_t len);
+
+#endif /* SNAPSHOT_H */
@@ -1,10 +1,16 @@
 #include "config.h"
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "store.h"
 #include "string_list.h"
 #include "log.h"
+#include "memstats.h"
+
+/** bytes of an entry of the cache in the memstats */
+#define STORE_ENTRY_MEM(len) (sizeof(struct string_entry) + (len) + 1)
 
 struct store store_init(const char *dir, const char *full_path, const char *full_path_tmp) {
     struct string_list cache;
@@ -18,10 +24,17 @@ struct store store_init(const char *dir, const char *full_path, const char *full
     s.path = full_path,
     s.path_tmp = full_path_tmp,
     s.cache = cache;
+    s.mem = 0;
+    s.dirty = 0;
+    memstats_set(memstats_store, &s.mem, sizeof(s));
     // Read cache into the string list
     fp = fopen(full_path, "r");
     if (fp == NULL) {
-	log_err("cannot open %s: %s", full_path, strerror(errno));
+        /* there is no file before the first update */
+        if (errno == ENOENT)
+            verbose(VERB_ALGO, "no store file %s", full_path);
+        else
+            log_err("cannot open %s: %s", full_path, strerror(errno));
         return s;
     }
     line = (char *)calloc_or_die(line_len);
@@ -30,44 +43,101 @@ struct store store_init(const char *dir, const char *full_path, const char *full
 	if(read_len > 0 && line[read_len-1]=='\n')
 		line[--read_len] = 0; /* remove \n */
         string_list_push_back(&s.cache, line, read_len);
+        if (read_len > 0)
+            memstats_set(memstats_store, &s.mem, s.mem +
+                STORE_ENTRY_MEM(strnlen(line, read_len)));
         memset(line, 0, line_len);
     }
-    if(ferror(fp)) {
-	    log_err("error reading %s: %s", full_path, strerror(errno));
+    if (ferror(fp)) {
+        log_err("error reading %s: %s", full_path, strerror(errno));
     }
     free(line);
     fclose(fp);
     return s;
 }
 
-int store_commit(const struct store *self) {
+int store_commit(struct store *self) {
     struct string_entry* iter;
-    // Open the tmp file
-    FILE *fp = fopen(self->path_tmp, "w");
-    if (fp == NULL) {
-	log_err("cannot open %s for write: %s", self->path_tmp, strerror(errno));
+    size_t len = 0, pos = 0;
+    ssize_t r;
+    char* buf;
+    int fd;
+    // Put the content in one buffer
+    FOR_EACH_STRING_IN_LIST(iter, &self->cache) {
+        len += strlen(iter->string) + 1;
+    }
+    buf = (char *)malloc(len + 1);
+    if (buf == NULL) {
+        log_err("out of memory");
         return -1;
     }
-    // Write its content
     FOR_EACH_STRING_IN_LIST(iter, &self->cache) {
-        fprintf(fp, "%s\n", iter->string);
+        size_t l = strlen(iter->string);
+        memmove(buf + pos, iter->string, l);
+        pos += l;
+        buf[pos++] = '\n';
     }
-    // Close it
-    fclose(fp);
-    return rename(self->path_tmp, self->path);
+    // Write it to the tmp file
+    fd = open(self->path_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        log_err("cannot open %s for write: %s", self->path_tmp,
+            strerror(errno));
+        free(buf);
+        return -1;
+    }
+    for (pos = 0; pos < len; pos += (size_t)r) {
+        r = write(fd, buf + pos, len - pos);
+        if (r == -1 && errno == EINTR) {
+            r = 0;
+            continue;
+        }
+        if (r <= 0) {
+            log_err("cannot write %s: %s", self->path_tmp, strerror(errno));
+            close(fd);
+            free(buf);
+            return -1;
+        }
+    }
+    free(buf);
+    // Sync it before it replaces the file
+    if (fsync(fd) == -1)
+        log_err("cannot fsync %s: %s", self->path_tmp, strerror(errno));
+    close(fd);
+    if (rename(self->path_tmp, self->path) == -1) {
+        log_err("cannot rename %s: %s", self->path_tmp, strerror(errno));
+        return -1;
+    }
+    self->dirty = 0;
+    return 0;
+}
+
+int store_flush(struct store *self) {
+    if (!self->dirty)
+        return 0;
+    verbose(VERB_ALGO, "write store %s", self->path);
+    return store_commit(self);
 }
 
 void store_destroy(struct store *self) {
     string_list_clear(&self->cache);
+    memstats_set(memstats_store, &self->mem, 0);
 }
 
 void store_remove(struct store *self, char *string, size_t len) {
-    string_list_remove(&self->cache, string, len);
+    if (string_list_contains(&self->cache, string, len)) {
+        string_list_remove(&self->cache, string, len);
+        self->dirty = 1;
+        memstats_set(memstats_store, &self->mem, self->mem -
+            STORE_ENTRY_MEM(strnlen(string, len)));
+    }
 }
 
 void store_add(struct store *self, char *string, size_t len) {
     if (!string_list_contains(&self->cache, string, len)) {
         string_list_push_back(&self->cache, string, len);
+        self->dirty = 1;
+        memstats_set(memstats_store, &self->mem, self->mem +
+            STORE_ENTRY_MEM(strnlen(string, len)));
     }
 }
 
@@ -22,6 +22,9 @@ struct store {
     const char *path;
     const char *path_tmp;
     struct string_list cache;
+    size_t mem;
+    /* the cache differs from the file, set by store_add and store_remove */
+    int dirty;
 };
 
 /**
@@ -31,9 +34,17 @@ struct store {
 struct store store_init(const char *dir, const char *full_path, const char *full_path_tmp);
 
 /**
- * Write the cache back to disk into file specified in the 'path' member
+ * Write the cache back to disk into file specified in the 'path' member.
+ * It is written with one write to the tmp file, synced and renamed over the
+ * file, and the store is no longer dirty.  Returns 0 on success.
  */
-int store_commit(const struct store *self);
+int store_commit(struct store *self);
+
+/**
+ * Write the cache back to disk if it has changed since it was read or
+ * written, several changes are written together.  Returns 0 on success.
+ */
+int store_flush(struct store *self);
 
 /**
  * Destroy cache
@@ -4,6 +4,7 @@
 #ifdef FWD_ZONES_SUPPORT
 
 #include "log.h"
+#include "region.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -14,6 +15,28 @@ void string_list_init(struct string_list* list)
 		return;
 
 	list->first = NULL;
+	list->region = NULL;
+}
+
+void string_list_init_region(struct string_list* list, struct region* region)
+{
+	if (NULL == list)
+		return;
+
+	list->first = NULL;
+	list->region = region;
+}
+
+/** Free one entry, in a region only the extension is freed */
+static void string_entry_free(struct string_list* list, struct string_entry* node)
+{
+	if (NULL != node->extension) {
+		free(node->extension);
+	}
+	if (NULL == list->region) {
+		free(node->string);
+		free(node);
+	}
 }
 
 void string_list_clear(struct string_list* list)
@@ -26,11 +49,7 @@ void string_list_clear(struct string_list* list)
 	while (NULL != iter) {
 		struct string_entry* node = iter;
 		iter = node->next;
-		free(node->string);
-		if (NULL != node->extension) {
-			free(node->extension);
-		}
-		free(node);
+		string_entry_free(list, node);
 	}
 	list->first = NULL;
 }
@@ -61,12 +80,17 @@ void string_list_push_back(struct string_list* list, const char* new_value, cons
 		node = &(*node)->next;
 	}
 
-	*node = (struct string_entry*) calloc_or_die(sizeof(struct string_entry));
+	if (NULL != list->region) {
+		*node = (struct string_entry*) region_alloc(list->region, sizeof(struct string_entry));
+		(*node)->string = region_strndup(list->region, new_value, len);
+	} else {
+		*node = (struct string_entry*) calloc_or_die(sizeof(struct string_entry));
+		(*node)->string = (char*) calloc_or_die(len + 1);
+		memmove((*node)->string, new_value, len);
+	}
 	(*node)->extension = NULL;
 	(*node)->next = NULL;
 	(*node)->length = len;
-	(*node)->string = strdup(new_value);
-	if(!(*node)->string) fatal_exit("malloc failure");
 }
 
 int string_list_contains(const struct string_list* list, const char* value, const size_t buffer_size)
@@ -101,7 +125,6 @@ void string_list_duplicate(const struct string_list* original, struct string_lis
 	}
 
 	string_list_clear(copy);
-	string_list_init(copy);
 
 	FOR_EACH_STRING_IN_LIST(iter, original) {
 		string_list_push_back(copy, iter->string, iter->length);
@@ -146,11 +169,7 @@ void string_list_remove(struct string_list* list, const char* value, const size_
 			} else {
 				prev->next = iter->next;
 			}
-			free(iter->string);
-			if (NULL != iter->extension) {
-				free(iter->extension);
-			}
-			free(iter);
+			string_entry_free(list, iter);
 			return;
 		}
 		first = 0;
@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+struct region;
+
 #define FOR_EACH_STRING_IN_LIST(ITER, LIST) for ((ITER) = (LIST)->first; (ITER) != NULL; (ITER) = (ITER)->next)
 
 /**
@@ -14,6 +16,8 @@
 struct string_list {
 	/** A linked list of strings */
 	struct string_entry *first;
+	/** Region the entries are allocated from, or NULL for the heap */
+	struct region *region;
 };
 
 /**
@@ -29,7 +33,7 @@ struct string_entry {
 	/** Length of the string buffer */
 	size_t length;
 	/** Heap allocated extension of this entry. It can be of any type and if not NULL
-	 * it will be freed during the cleanup.
+	 * it will be freed during the cleanup (also for lists in a region).
 	 */
 	void* extension;
 };
@@ -47,6 +51,14 @@ void* calloc_or_die(size_t size);
  */
 void string_list_init(struct string_list* list);
 
+/**
+ * Initialize a new list of strings, the entries are allocated from the
+ * region and are freed with the region.
+ * @param list: New list
+ * @param region: Region to allocate from, NULL is the heap
+ */
+void string_list_init_region(struct string_list* list, struct region* region);
+
 /**
  * Clear the list and free all contained buffers
  * @param list: List to be cleared. To free the structure itself is caller responsibility.
@@ -73,7 +85,7 @@ int string_list_contains(const struct string_list* list, const char* value, cons
 /**
  * Duplicate the list
  * @param original: List to copy
- * @param copy: New list
+ * @param copy: New list, it keeps its region (if any)
  */
 void string_list_duplicate(const struct string_list* original, struct string_list *copy);
 
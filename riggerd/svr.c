@@ -48,36 +48,68 @@
 #include "net_help.h"
 #include "reshook.h"
 #include "update.h"
+#include "score.h"
+#include "trace.h"
+#include "hookq.h"
+#include "memstats.h"
+#include "evprof.h"
+#include "watchdog.h"
+#include "sched.h"
+#include "snapshot.h"
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#ifdef HAVE_SSL_CTX_SET_TLSEXT_TICKET_KEY_EVP_CB
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
 #ifdef USE_WINSOCK
 #include "winsock_event.h"
+#else
+#include <sys/un.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <grp.h>
 #endif
 #ifdef FWD_ZONES_SUPPORT
 #include "fwd_zones.h"
+#include "region.h"
 #include "lock.h"
 #include "store.h"
 #include "ubhook.h"
+#include "zonetree.h"
 #endif
 
 struct svr* global_svr = NULL;
 
 static int setup_ssl_ctx(struct svr* svr);
 static int setup_listen(struct svr* svr);
+#ifndef USE_WINSOCK
+static int setup_unix_listen(struct svr* svr);
+#endif
 static void sslconn_delete(struct sslconn* sc);
 static int sslconn_readline(struct sslconn* sc);
-static int sslconn_write(struct sslconn* sc);
+static int sslconn_write(struct sslconn* sc, ldns_buffer* buf);
 static int sslconn_checkclose(struct sslconn* sc);
 static void sslconn_shutdown(struct sslconn* sc);
 static void sslconn_command(struct sslconn* sc);
 static void sslconn_persist_command(struct sslconn* sc);
+static void session_service(struct sslconn* sc);
+static void session_eof(struct sslconn* sc);
 static void send_results_to_con(struct svr* svr, struct sslconn* s);
+static int svr_state_file(const char* name, char* buf, size_t len);
 #ifdef FWD_ZONES_SUPPORT
 static void update_global_forwarders(struct nm_connection_list *original);
+static void probe_locked(char* ips);
 static void update_connection_zones(struct nm_connection_list *original);
+static struct zonetree* reverse_zones_create(void);
 #endif
 
 struct svr* svr_create(struct cfg* cfg)
 {
 	struct svr* svr = (struct svr*)calloc(1, sizeof(*svr));
+	uint32_t* secs;
+	struct timeval* now;
 	if(!svr) return NULL;
 	global_svr = svr;
 	svr->max_active = 32;
@@ -89,6 +121,10 @@ struct svr* svr_create(struct cfg* cfg)
 		svr_delete(svr);
 		return NULL;
 	}
+	/* the flight recorder uses the time of the event base */
+	comm_base_timept(svr->base, &secs, &now);
+	trace_set_time(now);
+	memstats_init();
 	svr->udp_buffer = ldns_buffer_new(65553);
 	if(!svr->udp_buffer) {
 		log_err("out of memory");
@@ -103,6 +139,43 @@ struct svr* svr_create(struct cfg* cfg)
 		svr_delete(svr);
 		return NULL;
 	}
+#ifdef FWD_ZONES_SUPPORT
+	svr->lock_timer = comm_timer_create(svr->base, &svr_lock_callback,
+		svr);
+	svr->zones = (struct store*)calloc(1, sizeof(*svr->zones));
+	svr->reverse_zones = reverse_zones_create();
+	if(!svr->lock_timer || !svr->zones || !svr->reverse_zones) {
+		log_err("out of memory");
+		svr_delete(svr);
+		return NULL;
+	}
+	/* read once, it is kept and written when it changes */
+	*svr->zones = STORE_INIT("zones");
+#endif
+	svr->scores = score_tab_create();
+	if(!svr->scores) {
+		log_err("out of memory");
+		svr_delete(svr);
+		return NULL;
+	} else {
+		char file[1024];
+		if(svr_state_file(SCORE_FILE_NAME, file, sizeof(file)))
+			(void)score_tab_read(svr->scores, file);
+	}
+	svr->http_addrs = http_addr_cache_create();
+	if(!svr->http_addrs) {
+		log_err("out of memory");
+		svr_delete(svr);
+		return NULL;
+	}
+	svr->sched = sched_create(svr->base);
+	if(!svr->sched) {
+		log_err("out of memory");
+		svr_delete(svr);
+		return NULL;
+	}
+	sched_set_limits(svr->sched, cfg->probe_inflight, cfg->probe_rate);
+	evprof_set(cfg->event_profile);
 	if(cfg->check_updates) {
 		svr->update = selfupdate_create(svr, cfg);
 		if(!svr->update) {
@@ -124,6 +197,13 @@ struct svr* svr_create(struct cfg* cfg)
 		svr_delete(svr);
 		return NULL;
 	}
+#ifndef USE_WINSOCK
+	if(!setup_unix_listen(svr)) {
+		log_err("cannot setup control socket");
+		svr_delete(svr);
+		return NULL;
+	}
+#endif
 
 	return svr;
 }
@@ -132,9 +212,11 @@ void svr_delete(struct svr* svr)
 {
 	struct listen_list* ll, *nll;
 	if(!svr) return;
+	trace_set_time(NULL);
 	/* delete busy */
 	while(svr->busy_list) {
-		(void)SSL_shutdown(svr->busy_list->ssl);
+		if(svr->busy_list->ssl)
+			(void)SSL_shutdown(svr->busy_list->ssl);
 		sslconn_delete(svr->busy_list);
 	}
 
@@ -146,6 +228,13 @@ void svr_delete(struct svr* svr)
 		free(ll);
 		ll=nll;
 	}
+#ifndef USE_WINSOCK
+	if(svr->listen_unix)
+		(void)unlink(svr->listen_unix);
+	free(svr->listen_unix);
+	free(svr->allow_uid);
+	free(svr->allow_gid);
+#endif
 
 	/* delete probes */
 	probe_list_delete(svr->probes);
@@ -153,15 +242,228 @@ void svr_delete(struct svr* svr)
 	if(svr->ctx) {
 		SSL_CTX_free(svr->ctx);
 	}
+	/* the keys are in the ticket-keys file, if it is kept */
+	memset(svr->ticket_keys, 0, sizeof(svr->ticket_keys));
 	selfupdate_delete(svr->update);
 	ldns_buffer_free(svr->udp_buffer);
 	comm_timer_delete(svr->retry_timer);
 	comm_timer_delete(svr->tcp_timer);
+#ifdef FWD_ZONES_SUPPORT
+	comm_timer_delete(svr->lock_timer);
+	free(svr->lock_pending);
+	if(svr->zones) {
+		/* the hook workers are stopped, and wrote the changes */
+		if(svr->zones->path)
+			store_destroy(svr->zones);
+		free(svr->zones);
+	}
+	zonetree_delete(svr->reverse_zones);
+	hook_unbound_mirror_clear();
+#endif
 	http_general_delete(svr->http);
+	http_addr_cache_delete(svr->http_addrs);
+	/* after the probes and the update, their queries release it */
+	sched_delete(svr->sched);
+	snapshot_delete(svr->snapshot);
+	score_tab_delete(svr->scores);
 	comm_base_delete(svr->base);
 	free(svr);
 }
 
+/** get the filename of a file in the state-dir, and create the directory,
+ * it could be on a tmpfs and gone after a reboot.  false if no state is
+ * kept, or the directory cannot be created */
+static int svr_state_file(const char* name, char* buf, size_t len)
+{
+	struct cfg* cfg = global_svr->cfg;
+	if(!cfg->state_dir || cfg->state_dir[0] == 0)
+		return 0;
+#ifdef USE_WINSOCK
+	if(mkdir(cfg->state_dir) == -1 && errno != EEXIST) {
+#else
+	if(mkdir(cfg->state_dir, 0755) == -1 && errno != EEXIST) {
+#endif
+		log_err("cannot create %s: %s", cfg->state_dir,
+			strerror(errno));
+		return 0;
+	}
+	snprintf(buf, len, "%s/%s", cfg->state_dir, name);
+	return 1;
+}
+
+void svr_store_scores(struct svr* svr)
+{
+	char file[1024];
+	if(!svr->scores || !svr->scores->dirty)
+		return;
+	if(!svr_state_file(SCORE_FILE_NAME, file, sizeof(file)))
+		return;
+	(void)score_tab_write(svr->scores, file);
+}
+
+void svr_store_snapshot(struct svr* svr, struct snapshot* s)
+{
+	char file[1024];
+	if(!svr_state_file(SNAPSHOT_FILE_NAME, file, sizeof(file))) {
+		snapshot_delete(s);
+		return;
+	}
+	if(!s) {
+		/* the next start probes before it sets up unbound */
+		snapshot_delete(svr->snapshot);
+		svr->snapshot = NULL;
+		if(unlink(file) == -1 && errno != ENOENT)
+			log_err("cannot remove %s: %s", file, strerror(errno));
+		return;
+	}
+	if(svr->snapshot && snapshot_equal(svr->snapshot, s)) {
+		snapshot_delete(s);
+		return;
+	}
+	if(!snapshot_write(s, file)) {
+		snapshot_delete(s);
+		return;
+	}
+	snapshot_delete(svr->snapshot);
+	svr->snapshot = s;
+}
+
+void svr_warm_start(struct svr* svr)
+{
+	char file[1024], fp[SNAPSHOT_FP_LEN];
+	struct snapshot* s;
+	char* ips;
+	if(!svr_state_file(SNAPSHOT_FILE_NAME, file, sizeof(file)))
+		return;
+	if(!(s = snapshot_create())) {
+		log_err("out of memory");
+		return;
+	}
+	if(!snapshot_read(s, file)) {
+		snapshot_delete(s);
+		return;
+	}
+	if(!snapshot_fingerprint(fp, sizeof(fp)) ||
+		strcmp(fp, s->fingerprint) != 0) {
+		verbose(VERB_OPS, "warm start: the networks changed, the "
+			"snapshot is not used");
+		snapshot_delete(s);
+		return;
+	}
+	verbose(VERB_OPS, "warm start: set up from the snapshot");
+	probe_setup_snapshot(svr, s);
+	snapshot_delete(svr->snapshot);
+	svr->snapshot = s;
+	/* and confirm it with a probe, of the resolvers of that network */
+	if(!(ips = strdup(s->dhcp?s->dhcp:""))) {
+		log_err("out of memory");
+		return;
+	}
+	probe_start(ips);
+	free(ips);
+}
+
+/** read the ticket keys of an earlier run, so that the panels can resume
+ * their sessions after a restart */
+static void svr_ticket_keys_read(struct svr* svr)
+{
+	char file[1024];
+	if(!svr_state_file(TICKET_FILE_NAME, file, sizeof(file)))
+		return;
+	(void)ticket_keys_read(svr->ticket_keys, file);
+}
+
+/** make a new current ticket key when it is old, and store it */
+static int svr_ticket_keys_rotate(struct svr* svr)
+{
+	char file[1024];
+	int r = ticket_keys_rotate(svr->ticket_keys, time(NULL));
+	if(r == 1 && svr_state_file(TICKET_FILE_NAME, file, sizeof(file)))
+		(void)ticket_keys_write(svr->ticket_keys, file);
+	return r != -1;
+}
+
+#ifdef HAVE_SSL_CTX_SET_TLSEXT_TICKET_KEY_EVP_CB
+/** set the HMAC key of the ticket */
+static int ticket_hmac_init(EVP_MAC_CTX* hctx, struct ticket_key* k)
+{
+	OSSL_PARAM params[2];
+	params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+		"SHA256", 0);
+	params[1] = OSSL_PARAM_construct_end();
+	return EVP_MAC_init(hctx, k->hmac, sizeof(k->hmac), params);
+}
+#else
+/** set the HMAC key of the ticket */
+static int ticket_hmac_init(HMAC_CTX* hctx, struct ticket_key* k)
+{
+	return HMAC_Init_ex(hctx, k->hmac, (int)sizeof(k->hmac), EVP_sha256(),
+		NULL);
+}
+#endif
+
+/** encrypt or decrypt session tickets with our keys.  returns -1 on
+ * failure, 0 for an unknown key (full handshake), 1 if ok, and 2 if ok
+ * but the client has to get a new ticket with the current key */
+static int ticket_key_cb(SSL* ATTR_UNUSED(ssl), unsigned char* name,
+	unsigned char* iv, EVP_CIPHER_CTX* ectx,
+#ifdef HAVE_SSL_CTX_SET_TLSEXT_TICKET_KEY_EVP_CB
+	EVP_MAC_CTX* hctx,
+#else
+	HMAC_CTX* hctx,
+#endif
+	int enc)
+{
+	struct svr* svr = global_svr;
+	struct ticket_key* k;
+	int renew = 0;
+	if(enc) {
+		if(!svr_ticket_keys_rotate(svr))
+			return -1;
+		k = &svr->ticket_keys[0];
+		if(RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+			return -1;
+		memmove(name, k->name, sizeof(k->name));
+		if(!EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, k->aes,
+			iv) || !ticket_hmac_init(hctx, k))
+			return -1;
+		return 1;
+	}
+	if(!(k = ticket_key_find(svr->ticket_keys, name, time(NULL), &renew)))
+		return 0;
+	if(!ticket_hmac_init(hctx, k) || !EVP_DecryptInit_ex(ectx,
+		EVP_aes_256_cbc(), NULL, k->aes, iv))
+		return -1;
+	return renew?2:1;
+}
+
+/** setup the session cache and the session tickets, so that reconnecting
+ * panels can resume their session without the full handshake */
+static void setup_ssl_sessions(struct svr* s)
+{
+	const char* sid = "dnssec-trigger";
+	/* needed for resumption when client certificates are verified */
+	if(!SSL_CTX_set_session_id_context(s->ctx, (const unsigned char*)sid,
+		(unsigned int)strlen(sid))) {
+		log_crypto_err("could not SSL_CTX_set_session_id_context");
+		return;
+	}
+	(void)SSL_CTX_set_session_cache_mode(s->ctx, SSL_SESS_CACHE_SERVER);
+	(void)SSL_CTX_sess_set_cache_size(s->ctx, SESSION_CACHE_SIZE);
+	(void)SSL_CTX_set_timeout(s->ctx, TICKET_KEY_ROTATE);
+	svr_ticket_keys_read(s);
+	if(!svr_ticket_keys_rotate(s)) {
+		/* openssl makes ticket keys of its own */
+		return;
+	}
+#ifdef HAVE_SSL_CTX_SET_TLSEXT_TICKET_KEY_EVP_CB
+	if(!SSL_CTX_set_tlsext_ticket_key_evp_cb(s->ctx, ticket_key_cb))
+#else
+	if(!SSL_CTX_set_tlsext_ticket_key_cb(s->ctx, ticket_key_cb))
+#endif
+		log_crypto_err("could not set the session ticket key callback");
+}
+
 static int setup_ssl_ctx(struct svr* s)
 {
 	char* s_cert;
@@ -201,6 +503,7 @@ static int setup_ssl_ctx(struct svr* s)
 	}
 	SSL_CTX_set_client_CA_list(s->ctx, SSL_load_client_CA_file(s_cert));
 	SSL_CTX_set_verify(s->ctx, SSL_VERIFY_PEER, NULL);
+	setup_ssl_sessions(s);
 	return 1;
 }
 
@@ -261,11 +564,179 @@ static int setup_listen(struct svr* svr)
 	return 1;
 }
 
+#ifndef USE_WINSOCK
+/** get the uid or gid of a control-allow entry, numeric or a name */
+static int allow_id(const char* str, int group, unsigned* id)
+{
+	char* end;
+	unsigned long v = strtoul(str, &end, 10);
+	if(str[0] != 0 && *end == 0) {
+		*id = (unsigned)v;
+		return 1;
+	}
+	if(group) {
+		struct group* gr = getgrnam(str);
+		if(!gr) return 0;
+		*id = (unsigned)gr->gr_gid;
+	} else {
+		struct passwd* pw = getpwnam(str);
+		if(!pw) return 0;
+		*id = (unsigned)pw->pw_uid;
+	}
+	return 1;
+}
+
+/** look up the control-allow users and groups, once at the start */
+static int setup_unix_allow(struct svr* svr)
+{
+	struct strlist* p;
+	unsigned id;
+	if(svr->cfg->num_control_allow == 0)
+		return 1;
+	svr->allow_uid = (uid_t*)calloc((size_t)svr->cfg->num_control_allow,
+		sizeof(uid_t));
+	svr->allow_gid = (gid_t*)calloc((size_t)svr->cfg->num_control_allow,
+		sizeof(gid_t));
+	if(!svr->allow_uid || !svr->allow_gid) {
+		log_err("out of memory");
+		return 0;
+	}
+	for(p = svr->cfg->control_allow; p; p = p->next) {
+		int group = (p->str[0] == '@');
+		if(!allow_id(group?p->str+1:p->str, group, &id)) {
+			log_err("control-allow: no such %s: %s",
+				group?"group":"user", group?p->str+1:p->str);
+			continue;
+		}
+		if(group)
+			svr->allow_gid[svr->num_allow_gid++] = (gid_t)id;
+		else	svr->allow_uid[svr->num_allow_uid++] = (uid_t)id;
+	}
+	return 1;
+}
+
+/** listen on the control-socket, if configured */
+static int setup_unix_listen(struct svr* svr)
+{
+	const char* path = svr->cfg->control_socket;
+	struct sockaddr_un addr;
+	struct listen_list* e;
+	struct stat st;
+	int s;
+	if(!path || path[0] == 0)
+		return 1;
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		log_err("control-socket path too long: %s", path);
+		return 0;
+	}
+	if(!setup_unix_allow(svr))
+		return 0;
+	/* the tcp port is ours, so a socket there is a stale one of an
+	 * earlier run; anything else is not removed */
+	if(lstat(path, &st) == 0) {
+		if(!S_ISSOCK(st.st_mode)) {
+			log_err("control-socket %s exists and is not a socket",
+				path);
+			return 0;
+		}
+		if(unlink(path) != 0) {
+			log_err("unlink %s: %s", path, strerror(errno));
+			return 0;
+		}
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memmove(addr.sun_path, path, strlen(path)+1);
+	s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(s == -1) {
+		log_err("socket %s: %s", path, strerror(errno));
+		return 0;
+	}
+	if(bind(s, (struct sockaddr*)&addr, (socklen_t)sizeof(addr)) != 0) {
+		fatal_exit("can't bind unix socket %s: %s", path,
+			strerror(errno));
+	}
+	svr->listen_unix = strdup(path);
+	if(!svr->listen_unix) {
+		(void)unlink(path);
+		fatal_exit("out of memory");
+	}
+	/* anyone can connect, the peer credentials are checked on accept */
+	if(chmod(path, 0666) != 0) {
+		log_err("chmod %s: %s", path, strerror(errno));
+	}
+	fd_set_nonblock(s);
+	if(listen(s, 15) == -1) {
+		log_err("can't listen: %s", strerror(errno));
+	}
+	e = (struct listen_list*)calloc(1, sizeof(*e));
+	if(!e) {
+		fatal_exit("out of memory");
+	}
+	e->c = comm_point_create_raw(svr->base, s, 0, handle_unix_accept, NULL);
+	e->c->do_not_close = 0;
+	e->next = svr->listen;
+	svr->listen = e;
+	return 1;
+}
+
+/** check the peer credentials of a control-socket connection */
+static int unix_peer_allowed(struct svr* svr, int s)
+{
+	uid_t uid;
+	gid_t gid;
+	int i;
+#if defined(SO_PEERCRED)
+	struct ucred cred;
+	socklen_t len = (socklen_t)sizeof(cred);
+	if(getsockopt(s, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1) {
+		log_err("getsockopt(.. SO_PEERCRED ..) failed: %s",
+			strerror(errno));
+		return 0;
+	}
+	uid = cred.uid;
+	gid = cred.gid;
+#elif defined(HAVE_GETPEEREID)
+	if(getpeereid(s, &uid, &gid) == -1) {
+		log_err("getpeereid failed: %s", strerror(errno));
+		return 0;
+	}
+#else
+	(void)s;
+	log_err("no peer credentials on this system, control-socket refused");
+	return 0;
+#endif
+	if(uid == 0 || uid == geteuid())
+		return 1;
+	for(i=0; i<svr->num_allow_uid; i++)
+		if(uid == svr->allow_uid[i])
+			return 1;
+	for(i=0; i<svr->num_allow_gid; i++)
+		if(gid == svr->allow_gid[i])
+			return 1;
+	verbose(VERB_DETAIL, "control-socket connection refused for uid %u "
+		"gid %u", (unsigned)uid, (unsigned)gid);
+	return 0;
+}
+#endif /* USE_WINSOCK */
+
 void svr_service(struct svr* svr)
 {
 	comm_base_dispatch(svr->base);
 }
 
+/** set the bytes of the connection in the memstats, the buffers grow
+ * when the replies are printed, and this is called when they are written */
+static void sslconn_account(struct sslconn* sc)
+{
+	size_t s = sizeof(*sc) + comm_point_get_mem(sc->c);
+	if(sc->buffer)
+		s += sizeof(*sc->buffer) + ldns_buffer_capacity(sc->buffer);
+	if(sc->out)
+		s += sizeof(*sc->out) + ldns_buffer_capacity(sc->out);
+	memstats_set(memstats_sslconn, &sc->mem, s);
+}
+
 static void sslconn_delete(struct sslconn* sc)
 {
 	struct sslconn** pp;
@@ -280,9 +751,12 @@ static void sslconn_delete(struct sslconn* sc)
 	global_svr->active--;
 	if(sc->buffer)
 		ldns_buffer_free(sc->buffer);
+	if(sc->out)
+		ldns_buffer_free(sc->out);
 	comm_point_delete(sc->c);
 	if(sc->ssl)
 		SSL_free(sc->ssl);
+	memstats_set(memstats_sslconn, &sc->mem, 0);
 	free(sc);
 }
 
@@ -365,6 +839,7 @@ int handle_ssl_accept(struct comm_point* c, void* ATTR_UNUSED(arg), int err,
         sc->next = svr->busy_list;
         svr->busy_list = sc;
         svr->active ++;
+	sslconn_account(sc);
 
         /* perform the first nonblocking read already, for windows, 
          * so it can return wouldblock. could be faster too. */
@@ -372,6 +847,65 @@ int handle_ssl_accept(struct comm_point* c, void* ATTR_UNUSED(arg), int err,
 	return 0;
 }
 
+#ifndef USE_WINSOCK
+int handle_unix_accept(struct comm_point* c, void* ATTR_UNUSED(arg), int err,
+	struct comm_reply* ATTR_UNUSED(reply_info))
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	int s;
+	struct svr* svr = global_svr;
+	struct sslconn* sc;
+	if(err != NETEVENT_NOERROR) {
+		log_err("error %d on unix_accept_callback", err);
+		return 0;
+	}
+	s = comm_point_perform_accept(c, &addr, &addrlen);
+	if(s == -1)
+		return 0;
+	if(svr->active >= svr->max_active) {
+		log_warn("drop incoming control socket: too many connections");
+		close(s);
+		return 0;
+	}
+	if(!unix_peer_allowed(svr, s)) {
+		close(s);
+		return 0;
+	}
+	/* the same commands as the TLS channel, without handshake */
+	sc = (struct sslconn*)calloc(1, sizeof(*sc));
+	if(!sc) {
+		log_err("out of memory");
+		close(s);
+		return 0;
+	}
+	sc->c = comm_point_create_raw(svr->base, s, 0, &control_callback, sc);
+	if(!sc->c) {
+		log_err("out of memory");
+		free(sc);
+		close(s);
+		return 0;
+	}
+	verbose(VERB_QUERY, "new control-socket connection");
+	sc->c->do_not_close = 0;
+	sc->shake_state = rc_hs_none;
+	sc->line_state = command_read;
+	sc->buffer = ldns_buffer_new(65536);
+	if(!sc->buffer) {
+		log_err("out of memory");
+		comm_point_delete(sc->c);
+		free(sc);
+		return 0;
+	}
+	sc->next = svr->busy_list;
+	svr->busy_list = sc;
+	svr->active ++;
+	sslconn_account(sc);
+	(void)control_callback(sc->c, sc, NETEVENT_NOERROR, NULL);
+	return 0;
+}
+#endif /* USE_WINSOCK */
+
 int control_callback(struct comm_point* c, void* arg, int err,
 	struct comm_reply* ATTR_UNUSED(reply_info))
 {
@@ -484,12 +1018,13 @@ int control_callback(struct comm_point* c, void* arg, int err,
 				return 0;
 			/* we are done handle it */
 			sslconn_persist_command(s);
-			/* there may be more to read in the same SSL packet */
-		} while(SSL_pending(s->ssl) != 0);
+			/* there may be more to read in the same SSL packet,
+			 * plain connections read until it would block */
+		} while(!s->ssl || SSL_pending(s->ssl) != 0);
 	} else if(s->line_state == persist_write) {
 		if(sslconn_checkclose(s))
 			return 0;
-		if(!sslconn_write(s))
+		if(!sslconn_write(s, s->buffer))
 			return 0;
 		if(s->fetch_another_update) {
 			s->fetch_another_update = 0;
@@ -505,20 +1040,124 @@ int control_callback(struct comm_point* c, void* arg, int err,
 		s->line_state = persist_write_checkclose;
 	} else if(s->line_state == persist_write_checkclose) {
 		(void)sslconn_checkclose(s);
+	} else if(s->line_state == session_cmds) {
+		session_service(s);
+	}
+	return 0;
+}
+
+#ifndef USE_WINSOCK
+/** if the errno of the plain connection means try again later */
+static int plain_wouldblock(void)
+{
+	return errno == EAGAIN || errno == EINTR
+#ifdef EWOULDBLOCK
+		|| errno == EWOULDBLOCK
+#endif
+		;
+}
+
+/** readline for the plain control-socket connection.  It peeks for the
+ * newline, so that the lines after the command stay in the socket. */
+static int plainconn_readline(struct sslconn* sc)
+{
+	ssize_t r;
+	uint8_t* nl;
+	while(ldns_buffer_available(sc->buffer, 1)) {
+		r = recv(sc->c->fd, (void*)ldns_buffer_current(sc->buffer),
+			ldns_buffer_remaining(sc->buffer), MSG_PEEK);
+		if(r == -1 && plain_wouldblock())
+			return 0;
+		if(r == 0 && sc->line_state == session_cmds) {
+			session_eof(sc);
+			return 0;
+		}
+		if(r <= 0) {
+			if(r == -1)
+				log_err("control-socket read: %s",
+					strerror(errno));
+			sslconn_delete(sc);
+			return 0;
+		}
+		nl = (uint8_t*)memchr(ldns_buffer_current(sc->buffer), '\n',
+			(size_t)r);
+		if(nl)
+			r = nl - ldns_buffer_current(sc->buffer) + 1;
+		r = recv(sc->c->fd, (void*)ldns_buffer_current(sc->buffer),
+			(size_t)r, 0);
+		if(r <= 0) {
+			log_err("control-socket read: %s", strerror(errno));
+			sslconn_delete(sc);
+			return 0;
+		}
+		if(nl) {
+			/* return string without \n */
+			ldns_buffer_skip(sc->buffer, r-1);
+			ldns_buffer_write_u8(sc->buffer, 0);
+			ldns_buffer_flip(sc->buffer);
+			return 1;
+		}
+		ldns_buffer_skip(sc->buffer, r);
+	}
+	log_err("control-socket readline too long");
+	sslconn_delete(sc);
+	return 0;
+}
+
+/** write the buffer to the plain control-socket connection */
+static int plainconn_write(struct sslconn* sc, ldns_buffer* buf)
+{
+	ssize_t r;
+	while(ldns_buffer_remaining(buf)>0) {
+		r = send(sc->c->fd, (void*)ldns_buffer_current(buf),
+			ldns_buffer_remaining(buf), 0);
+		if(r == -1 && plain_wouldblock())
+			return 0;
+		if(r == -1) {
+			/* the other side has closed the channel */
+			verbose(VERB_ALGO, "result write closed: %s",
+				strerror(errno));
+			sslconn_delete(sc);
+			return 0;
+		}
+		ldns_buffer_skip(buf, r);
+	}
+	return 1;
+}
+
+/** see if the plain control-socket connection is closed, input is
+ * ignored */
+static int plainconn_checkclose(struct sslconn* sc)
+{
+	char buf[256];
+	ssize_t r = recv(sc->c->fd, buf, sizeof(buf), 0);
+	if(r == -1 && plain_wouldblock())
+		return 0;
+	if(r <= 0) {
+		verbose(VERB_ALGO, "checked channel closed otherside");
+		sslconn_delete(sc);
+		return 1;
 	}
 	return 0;
 }
+#endif /* USE_WINSOCK */
 
 static int sslconn_readline(struct sslconn* sc)
 {
         int r;
+#ifndef USE_WINSOCK
+	if(!sc->ssl)
+		return plainconn_readline(sc);
+#endif
 	while(ldns_buffer_available(sc->buffer, 1)) {
 		ERR_clear_error();
 		if((r=SSL_read(sc->ssl, ldns_buffer_current(sc->buffer), 1))
 			<= 0) {
 			int want = SSL_get_error(sc->ssl, r);
 			if(want == SSL_ERROR_ZERO_RETURN) {
-				sslconn_shutdown(sc);
+				if(sc->line_state == session_cmds)
+					session_eof(sc);
+				else	sslconn_shutdown(sc);
 				return 0;
 			} else if(want == SSL_ERROR_WANT_READ) {
 				return 0;
@@ -570,15 +1209,20 @@ static int sslconn_readline(struct sslconn* sc)
 	return 0;
 }
 
-static int sslconn_write(struct sslconn* sc)
+static int sslconn_write(struct sslconn* sc, ldns_buffer* buf)
 {
         int r;
+	sslconn_account(sc);
+#ifndef USE_WINSOCK
+	if(!sc->ssl)
+		return plainconn_write(sc, buf);
+#endif
 	/* ignore return, if fails we may simply block */
 	(void)SSL_set_mode(sc->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE);
-	while(ldns_buffer_remaining(sc->buffer)>0) {
+	while(ldns_buffer_remaining(buf)>0) {
 		ERR_clear_error();
-		if((r=SSL_write(sc->ssl, ldns_buffer_current(sc->buffer), 
-			(int)ldns_buffer_remaining(sc->buffer)))
+		if((r=SSL_write(sc->ssl, ldns_buffer_current(buf), 
+			(int)ldns_buffer_remaining(buf)))
 			<= 0) {
 			int want = SSL_get_error(sc->ssl, r);
 			if(want == SSL_ERROR_ZERO_RETURN) {
@@ -618,7 +1262,7 @@ static int sslconn_write(struct sslconn* sc)
 			sslconn_delete(sc);
 			return 0;
 		}
-		ldns_buffer_skip(sc->buffer, (ssize_t)r);
+		ldns_buffer_skip(buf, (ssize_t)r);
 	}
 	/* done writing the buffer. */
 	return 1;
@@ -626,7 +1270,13 @@ static int sslconn_write(struct sslconn* sc)
 
 static void sslconn_shutdown(struct sslconn* sc)
 {
-	int r = SSL_shutdown(sc->ssl);
+	int r;
+	if(!sc->ssl) {
+		/* plain connection, closing the fd is the shutdown */
+		sslconn_delete(sc);
+		return;
+	}
+	r = SSL_shutdown(sc->ssl);
 	if(r > 0) {
 		sslconn_delete(sc);
 	} else if(r == 0) {
@@ -653,6 +1303,10 @@ static void sslconn_shutdown(struct sslconn* sc)
 static int sslconn_checkclose(struct sslconn* sc)
 {
 	int r;
+#ifndef USE_WINSOCK
+	if(!sc->ssl)
+		return plainconn_checkclose(sc);
+#endif
 	ERR_clear_error();
 	if((r=SSL_read(sc->ssl, NULL, 0)) <= 0) {
 		int want = SSL_get_error(sc->ssl, r);
@@ -805,17 +1459,65 @@ static void handle_submit(char* ips)
 #ifdef FWD_ZONES_SUPPORT
 #define VERB_DEBUG VERB_QUERY
 
+/** The update of the connection zones.  It lists and changes the zones
+ * of unbound, and is performed by a hook worker, after the unbound-control
+ * commands that are submitted before it. */
+struct update_zones_job {
+	/** the region with the lists */
+	struct region* region;
+	/** the connections from the update */
+	struct nm_connection_list connections;
+};
+
+/** update the connection zones, in a hook worker */
+static void update_zones_run(void* arg) {
+	struct update_zones_job* job = (struct update_zones_job*)arg;
+	verbose(VERB_QUERY, "running update connection zones");
+	update_connection_zones(&job->connections);
+}
+
+/** write the zone store if it changed, in the hook worker after the
+ * updates that are submitted before it */
+static void store_zones_run(void* arg) {
+	(void)store_flush((struct store*)arg);
+}
+
+/** the update is done, free it, on the event loop */
+static void update_zones_done(void* arg) {
+	struct update_zones_job* job = (struct update_zones_job*)arg;
+	nm_connection_list_clear(&job->connections);
+	verbose(VERB_ALGO, "update_all used %u allocations in %u bytes",
+		(unsigned)job->region->count, (unsigned)job->region->total);
+	region_destroy(job->region);
+	free(job);
+	/* the changes of a burst of updates are written once, after the
+	 * last of them */
+	if(--global_svr->zones_updates == 0)
+		hookq_submit(hookq_unbound, &store_zones_run, NULL,
+			global_svr->zones);
+}
+
 static void handle_update_all(char *json) {
 	/* Parse the JSON string received from the script and create a list of active connections.
 	 * e.g. Ethernet with some IP address, forward zones and DNS servers, Wi-Fi connection or
 	 * corporate VPN. */
-	struct nm_connection_list original =  yield_connections_from_json(json);
+	/* All lists made for this command are allocated from one region,
+	 * and freed with it when the update is done. */
+	struct update_zones_job* job = (struct update_zones_job*)calloc(1,
+		sizeof(*job));
+	if(!job) {
+		log_err("out of memory");
+		return;
+	}
+	job->region = region_create();
+	job->connections = yield_connections_from_json_region(json,
+		job->region);
 	verbose(VERB_QUERY, "Query: %s", json);
 	verbose(VERB_QUERY, "running update global forwarders");
-	update_global_forwarders(&original);
-	verbose(VERB_QUERY, "running update connection zones");
-	update_connection_zones(&original);
-	nm_connection_list_clear(&original);
+	update_global_forwarders(&job->connections);
+	global_svr->zones_updates++;
+	hookq_submit(hookq_unbound, &update_zones_run, &update_zones_done,
+		job);
 }
 
 static void update_global_forwarders(struct nm_connection_list *original) {
@@ -837,15 +1539,60 @@ static void update_global_forwarders(struct nm_connection_list *original) {
 	verbose(VERB_DEBUG, "Global forward candidates: %s", global_forward_candidates.string);
 	verbose(VERB_DEBUG, "Starting probe");
 
-	lock_acquire();
-	probe_start(global_forward_candidates.string);
+	probe_locked(global_forward_candidates.string);
 
 	// Cleanup:
-	lock_release();
 	free(global_forward_candidates.string);
 	nm_connection_list_clear(&defaults);
 }
 
+/** Probe the servers while holding the update lock.  The script can hold
+ * the lock for a while, and we do not block the event loop on it; if it
+ * is busy, the servers are kept (the newest list replaces an older one)
+ * and the lock timer tries again, with exponential backoff. */
+static void probe_locked(char* ips) {
+	struct svr* svr = global_svr;
+	struct timeval tv;
+	if (lock_try_acquire() != 0) {
+		/* taken, or the lock file fails and we go on without it */
+		char* pending = svr->lock_pending;
+		comm_timer_disable(svr->lock_timer);
+		svr->lock_pending = NULL;
+		svr->lock_backoff = 0;
+		probe_start(ips);
+		lock_release();
+		free(pending);
+		return;
+	}
+	if (svr->lock_pending != ips) {
+		char* dup = strdup(ips);
+		if (!dup) {
+			log_err("out of memory");
+			return;
+		}
+		free(svr->lock_pending);
+		svr->lock_pending = dup;
+	}
+	if (svr->lock_backoff == 0) {
+		svr->lock_backoff = LOCK_RETRY_START;
+	} else if (svr->lock_backoff < LOCK_RETRY_MAX) {
+		svr->lock_backoff *= 2;
+		if (svr->lock_backoff > LOCK_RETRY_MAX)
+			svr->lock_backoff = LOCK_RETRY_MAX;
+	}
+	verbose(VERB_ALGO, "update lock busy, retry in %d msec", svr->lock_backoff);
+	tv.tv_sec = svr->lock_backoff / 1000;
+	tv.tv_usec = (svr->lock_backoff % 1000) * 1000;
+	comm_timer_set(svr->lock_timer, &tv);
+}
+
+void svr_lock_callback(void* arg) {
+	struct svr* svr = (struct svr*)arg;
+	if (!svr->lock_pending)
+		return;
+	probe_locked(svr->lock_pending);
+}
+
 static const struct string_buffer rfc1918_reverse_zones[] = {
 	{.string = "c.f.ip6.arpa", .length = 12},
 	{.string = "d.f.ip6.arpa", .length = 12},
@@ -871,17 +1618,65 @@ static const struct string_buffer rfc1918_reverse_zones[] = {
 
 static const size_t reverse_zones_len = 20;
 
-static int zone_in_reverse_zones(char *zone, size_t len) {
+/** make the tree of the reverse zones of the private address ranges */
+static struct zonetree* reverse_zones_create(void) {
+	struct zonetree* tree = zonetree_create();
 	size_t i;
+	if (!tree)
+		return NULL;
 	for (i = 0; i < reverse_zones_len; ++i) {
-		if (len == rfc1918_reverse_zones[i].length) {
-			if (strncmp(rfc1918_reverse_zones[i].string, zone, len) == 0) {
-				return 1;
-			}
+		if (!zonetree_insert(tree, rfc1918_reverse_zones[i].string,
+			rfc1918_reverse_zones[i].length, NULL)) {
+			zonetree_delete(tree);
+			return NULL;
 		}
+	}
+	return tree;
+}
 
+/** if the zone is one of the reverse zones of the private address ranges,
+ * the zone itself; the zones below it are configured as any other zone */
+static int zone_in_reverse_zones(char *zone, size_t len) {
+	return zonetree_lookup(global_svr->reverse_zones, zone, len) != NULL;
+}
+
+/** remove a forward zone from the list, and from the tree of the list */
+static void fwd_zone_remove(struct nm_connection_list *list, struct zonetree *tree,
+	char *zone, size_t len) {
+	struct nm_connection *c = (struct nm_connection *)zonetree_remove(tree, zone, len);
+	if (c && c->zones.first)
+		(void)nm_connection_list_remove(list, c->zones.first->string,
+			c->zones.first->length);
+}
+
+/** add a forward zone to the list and the tree of the list, it replaces
+ * the entry for the same zone */
+static void fwd_zone_add(struct nm_connection_list *list, struct zonetree *tree,
+	struct nm_connection *c) {
+	fwd_zone_remove(list, tree, c->zones.first->string, c->zones.first->length);
+	nm_connection_list_push_back(list, c);
+	if (!zonetree_insert(tree, c->zones.first->string, c->zones.first->length, c))
+		log_err("out of memory");
+}
+
+/** if unbound forwards the zone to the servers, as insecure, already.  By
+ * the zone itself, or by a parent zone that is set by this update; the
+ * other parents can still change in it. */
+static int fwd_zone_covered(struct zonetree *tree, struct zonetree *added,
+	char *zone, size_t len, struct string_list *servers) {
+	struct zonetree_node *n = zonetree_lookup(tree, zone, len);
+	struct nm_connection *c;
+	if (!n) {
+		n = zonetree_cover(tree, zone, len, 1);
+		if (!n)
+			return 0;
+		c = (struct nm_connection *)n->data;
+		if (!zonetree_lookup(added, c->zones.first->string, c->zones.first->length))
+			return 0;
 	}
-	return 0;
+	c = (struct nm_connection *)n->data;
+	return c->security == NM_CON_INSECURE &&
+		string_list_is_equal(&c->servers, servers);
 }
 
 static void update_connection_zones(struct nm_connection_list *connections) {
@@ -893,12 +1688,29 @@ static void update_connection_zones(struct nm_connection_list *connections) {
 	 */
 
 	struct string_buffer static_label = string_builder("static");
-	struct store stored_zones = STORE_INIT("zones");
-	struct nm_connection_list forward_zones =  hook_unbound_list_forwards(NULL);
+	struct store* stored_zones = global_svr->zones;
+	struct nm_connection_list forward_zones =  hook_unbound_list_forwards(NULL, connections->region);
+	/* the forward zones by their canonical name, and the zones that are
+	 * set by this update */
+	struct zonetree* fwd_tree = zonetree_create();
+	struct zonetree* added = zonetree_create();
 	struct string_entry* iter;
 	struct nm_connection_node *conniter;
 	struct string_entry* string_iter;
 
+	if (!fwd_tree || !added) {
+		log_err("out of memory");
+		zonetree_delete(fwd_tree);
+		zonetree_delete(added);
+		nm_connection_list_clear(&forward_zones);
+		return;
+	}
+	for (conniter = forward_zones.first; NULL != conniter; conniter = conniter->next) {
+		if (conniter->self->zones.first)
+			(void)zonetree_insert(fwd_tree, conniter->self->zones.first->string,
+				conniter->self->zones.first->length, conniter->self);
+	}
+
 	/*
 	 * Step 1:
 	 * 		Remove zones from unbound, that were previously configured by dnssec-trigger, but are no longer
@@ -906,7 +1718,7 @@ static void update_connection_zones(struct nm_connection_list *connections) {
 	 * 		dnssec-trigger, as these were probably configured by the user and it would be nice from us
 	 * 		to keep them there.
 	 */
-	iter = stored_zones.cache.first;
+	iter = stored_zones->cache.first;
 	while(iter) {
 		struct string_buffer zone = {
 			.string = iter->string,
@@ -929,13 +1741,13 @@ static void update_connection_zones(struct nm_connection_list *connections) {
 				hook_unbound_add_local_zone(zone, static_label);
 			}
 		}
-		if (nm_connection_list_contains_zone(&forward_zones, zone.string, zone.length)) {
+		if (zonetree_lookup(fwd_tree, zone.string, zone.length)) {
 			verbose(VERB_DEBUG, "Iter over stored zones: %s removing from forward zones", zone.string);
-			nm_connection_list_remove(&forward_zones, zone.string, zone.length);
+			fwd_zone_remove(&forward_zones, fwd_tree, zone.string, zone.length);
 			hook_unbound_remove_forward_zone(zone);
 		}
 		verbose(VERB_DEBUG, "Iter over stored zones: %s removing from store", zone.string);
-		store_remove(&stored_zones, zone.string, zone.length);
+		store_remove(stored_zones, zone.string, zone.length);
 	}
 
 	/*
@@ -956,22 +1768,27 @@ static void update_connection_zones(struct nm_connection_list *connections) {
 				.string = string_iter->string,
 				.length = string_iter->length,
 			};
-			int in_store = store_contains(&stored_zones, zone.string, zone.length);
-			int in_fwd_zones = nm_connection_list_contains_zone(&forward_zones, zone.string, zone.length);
+			int in_store = store_contains(stored_zones, zone.string, zone.length);
+			int in_fwd_zones = zonetree_lookup(fwd_tree, zone.string, zone.length) != NULL;
 			verbose(VERB_DEBUG, "Iter over connections: %s (%s, %s)",
 				zone.string,
 				in_store ? "in store" : "not in store",
 				in_fwd_zones ? "in fwd zones" : "not in fwd zones");
 			if ( (in_store) || !(in_fwd_zones) ) {
 				struct nm_connection* new_fwd_zone;
+				(void)zonetree_insert(added, zone.string, zone.length, NULL);
+				store_add(stored_zones, zone.string, zone.length);
+				if (fwd_zone_covered(fwd_tree, added, zone.string, zone.length, &c->servers)) {
+					verbose(VERB_DEBUG, "Iter over connections: %s is forwarded to these servers already, add to store", zone.string);
+					continue;
+				}
 				verbose(VERB_DEBUG, "Iter over connections: %s append to forward zones and add to store", zone.string);
-				new_fwd_zone = (struct nm_connection *)calloc_or_die(sizeof(struct nm_connection));
-				nm_connection_init(new_fwd_zone);
+				new_fwd_zone = nm_connection_new(&forward_zones);
 				string_list_duplicate(&c->servers, &new_fwd_zone->servers);
 				string_list_push_back(&new_fwd_zone->zones, zone.string, zone.length);
-				nm_connection_list_push_back(&forward_zones, new_fwd_zone);
+				new_fwd_zone->security = NM_CON_INSECURE;
+				fwd_zone_add(&forward_zones, fwd_tree, new_fwd_zone);
 				hook_unbound_add_forward_zone_from_connection(new_fwd_zone);
-				store_add(&stored_zones, zone.string, zone.length);
 			}
 		}
 	}
@@ -1003,37 +1820,41 @@ static void update_connection_zones(struct nm_connection_list *connections) {
                          * Ignore a connection provided zone as it's been already
                          * processed.
                          */
-			if (nm_connection_list_contains_zone(&forward_zones, zone->string, zone->length)) {
+			if (zonetree_lookup(added, zone->string, zone->length)) {
 				continue;
 			}
-			if (store_contains(&stored_zones, zone->string, zone->length) || 
-					!nm_connection_list_contains_zone(&forward_zones, zone->string, zone->length)) {
-				struct nm_connection *new_zone = (struct nm_connection *) calloc_or_die(sizeof(struct nm_connection));
-				nm_connection_init(new_zone);
-				string_list_push_back(&new_zone->zones, zone->string, zone->length);
-				new_zone->servers = nm_connection_list_get_servers_list(&global_forwarders);
-				new_zone->security = NM_CON_INSECURE;
-				verbose(VERB_DEBUG, "Iter over reverse zones: %s append to forward zones as insecure, add to store and remove from unbound local zones", zone->string);
-				hook_unbound_add_forward_zone_from_connection(new_zone);
-				nm_connection_list_push_back(&forward_zones, new_zone);
-				store_add(&stored_zones, zone->string, zone->length);
+			if (store_contains(stored_zones, zone->string, zone->length) || 
+					!zonetree_lookup(fwd_tree, zone->string, zone->length)) {
+				struct nm_connection *new_zone;
+				struct string_list servers = nm_connection_list_get_servers_list(&global_forwarders);
+				(void)zonetree_insert(added, zone->string, zone->length, NULL);
+				store_add(stored_zones, zone->string, zone->length);
+				if (fwd_zone_covered(fwd_tree, added, zone->string, zone->length, &servers)) {
+					verbose(VERB_DEBUG, "Iter over reverse zones: %s is forwarded to these servers already, add to store and remove from unbound local zones", zone->string);
+					string_list_clear(&servers);
+				} else {
+					new_zone = nm_connection_new(&forward_zones);
+					string_list_push_back(&new_zone->zones, zone->string, zone->length);
+					new_zone->servers = servers;
+					new_zone->security = NM_CON_INSECURE;
+					verbose(VERB_DEBUG, "Iter over reverse zones: %s append to forward zones as insecure, add to store and remove from unbound local zones", zone->string);
+					hook_unbound_add_forward_zone_from_connection(new_zone);
+					fwd_zone_add(&forward_zones, fwd_tree, new_zone);
+				}
 				hook_unbound_remove_local_zone(*zone);
 			} else {
-				if (nm_connection_list_contains_zone(&forward_zones, zone->string, zone->length)) {
-					verbose(VERB_DEBUG, "Iter over reverse zones: %s remove from unbound local zones", zone->string);
-					hook_unbound_remove_local_zone(*zone);
-				}
-				if (store_contains(&stored_zones, zone->string, zone->length)) {
-					verbose(VERB_DEBUG, "Iter over reverse zones: %s remove from store", zone->string);
-					store_remove(&stored_zones, zone->string, zone->length);
-				}
-				hook_unbound_add_local_zone(*zone, static_label);
-				verbose(VERB_DEBUG, "Iter over reverse zones: %s add to unbound local zones", zone->string);
+				/* forwarded by other means, a local zone would
+				 * hide the forward */
+				verbose(VERB_DEBUG, "Iter over reverse zones: %s remove from unbound local zones", zone->string);
+				hook_unbound_remove_local_zone(*zone);
 			}
 		}
+		nm_connection_list_clear(&global_forwarders);
 	}
 
-	store_commit(&stored_zones);
+	zonetree_delete(fwd_tree);
+	zonetree_delete(added);
+	nm_connection_list_clear(&forward_zones);
 
 	return;
 }
@@ -1044,24 +1865,24 @@ static void update_connection_zones(struct nm_connection_list *connections) {
 
 /** append update signal to buffer to send */
 static void
-append_update_to_con(struct sslconn* s, char* version_available)
+append_update(ldns_buffer* buf, char* version_available)
 {
-	ldns_buffer_printf(s->buffer, "update %s\n%s\n\n", PACKAGE_VERSION,
+	ldns_buffer_printf(buf, "update %s\n%s\n\n", PACKAGE_VERSION,
 		version_available);
 }
 
+/** print the probe results, the state and update (if any) to the buffer */
 static void
-send_results_to_con(struct svr* svr, struct sslconn* s)
+print_results(struct svr* svr, ldns_buffer* buf)
 {
 	struct probe_ip* p;
 	char at[32];
 	int numcache = 0, unfinished = 0;
-	ldns_buffer_clear(s->buffer);
 	if(svr->probetime == 0)
-		ldns_buffer_printf(s->buffer, "at (no probe performed)\n");
+		ldns_buffer_printf(buf, "at (no probe performed)\n");
 	else if(strftime(at, sizeof(at), "%Y-%m-%d %H:%M:%S",
 		localtime(&svr->probetime)))
-		ldns_buffer_printf(s->buffer, "at %s\n", at);
+		ldns_buffer_printf(buf, "at %s\n", at);
 	for(p=svr->probes; p; p=p->next) {
 		if(probe_is_cache(p))
 			numcache++;
@@ -1071,29 +1892,29 @@ send_results_to_con(struct svr* svr, struct sslconn* s)
 		}
 		if(p->to_http) {
 			if(p->host_c) {
-		    	ldns_buffer_printf(s->buffer, "%s %s %s from %s: %s %s\n",
+		    	ldns_buffer_printf(buf, "%s %s %s from %s: %s %s\n",
 		    		"addr", p->host_c->qname,
 				p->http_ip6?"AAAA":"A", p->name,
 				p->works?"OK":"error", p->reason?p->reason:"");
 			} else
-		    	    ldns_buffer_printf(s->buffer, "%s %s (%s): %s %s\n",
+		    	    ldns_buffer_printf(buf, "%s %s (%s): %s %s\n",
 		    		"http", p->http_desc, p->name,
 				p->works?"OK":"error", p->reason?p->reason:"");
 		} else if(p->dnstcp)
-		    ldns_buffer_printf(s->buffer, "%s%d %s: %s %s\n",
+		    ldns_buffer_printf(buf, "%s%d %s: %s %s\n",
 		        p->ssldns?"ssl":"tcp", p->port, p->name,
 			p->works?"OK":"error", p->reason?p->reason:"");
 		else
-		    ldns_buffer_printf(s->buffer, "%s %s: %s %s\n",
+		    ldns_buffer_printf(buf, "%s %s: %s %s\n",
 			p->to_auth?"authority":"cache", p->name,
 			p->works?"OK":"error", p->reason?p->reason:"");
 	}
 	if(unfinished)
-		ldns_buffer_printf(s->buffer, "probe is in progress\n");
+		ldns_buffer_printf(buf, "probe is in progress\n");
 	else if(!numcache)
-		ldns_buffer_printf(s->buffer, "no cache: no DNS servers have been supplied via DHCP\n");
+		ldns_buffer_printf(buf, "no cache: no DNS servers have been supplied via DHCP\n");
 
-	ldns_buffer_printf(s->buffer, "state: %s %s%s%s\n",
+	ldns_buffer_printf(buf, "state: %s %s%s%s\n",
 		svr->res_state==res_cache?"cache":(
 		svr->res_state==res_tcp?"tcp":(
 		svr->res_state==res_ssl?"ssl":(
@@ -1103,12 +1924,19 @@ send_results_to_con(struct svr* svr, struct sslconn* s)
 		svr->forced_insecure?" forced_insecure":"",
 		svr->http_insecure?" http_insecure":""
 		);
-	ldns_buffer_printf(s->buffer, "\n");
+	ldns_buffer_printf(buf, "\n");
 	if(svr->update && svr->update->update_available &&
 		!svr->update->user_replied) {
 		log_info("append_update signal");
-		append_update_to_con(s, svr->update->version_available);
+		append_update(buf, svr->update->version_available);
 	}
+}
+
+static void
+send_results_to_con(struct svr* svr, struct sslconn* s)
+{
+	ldns_buffer_clear(s->buffer);
+	print_results(svr, s->buffer);
 	ldns_buffer_flip(s->buffer);
 	comm_point_listen_for_rw(s->c, 1, 1);
 	s->line_state = persist_write;
@@ -1125,7 +1953,7 @@ void svr_signal_update(struct svr* svr, char* version_available)
 		}
 		if(s->line_state == persist_write_checkclose) {
 			ldns_buffer_clear(s->buffer);
-			append_update_to_con(s, version_available);
+			append_update(s->buffer, version_available);
 			ldns_buffer_flip(s->buffer);
 			comm_point_listen_for_rw(s->c, 1, 1);
 			s->line_state = persist_write;
@@ -1163,52 +1991,125 @@ static void handle_printclose(struct sslconn* sc, char* str)
 	ldns_buffer_flip(sc->buffer);
 }
 
-static void handle_cmdtray_cmd(struct sslconn* sc)
+static void handle_dump_trace_cmd(struct sslconn* sc)
 {
-#ifdef HOOKS_OSX
-	/* OSX has messed up resolv.conf after relogin */
-	restore_resolv_osx(global_svr->cfg);
-#endif
-	/* turn into persist read */
+	/* write the flight recorder and then close */
+	sc->close_me = 1;
+	comm_point_listen_for_rw(sc->c, 1, 1);
+	sc->line_state = persist_write;
 	ldns_buffer_clear(sc->buffer);
-	comm_point_listen_for_rw(sc->c, 1, 0);
-	sc->line_state = persist_read;
+	if(!ldns_buffer_reserve(sc->buffer, TRACE_DUMP_MAX)) {
+		ldns_buffer_printf(sc->buffer, "error out of memory\n");
+		ldns_buffer_flip(sc->buffer);
+		return;
+	}
+	ldns_buffer_skip(sc->buffer, (ssize_t)trace_dump(
+		ldns_buffer_begin(sc->buffer)));
+	ldns_buffer_flip(sc->buffer);
 }
 
-static void handle_unsafe_cmd(struct sslconn* sc)
+static void handle_memstats_cmd(struct sslconn* sc)
 {
-	probe_unsafe_test();
-	sslconn_shutdown(sc);
+	/* write the memory counts and then close */
+	sc->close_me = 1;
+	comm_point_listen_for_rw(sc->c, 1, 1);
+	sc->line_state = persist_write;
+	ldns_buffer_clear(sc->buffer);
+	if(!memstats_print(sc->buffer)) {
+		ldns_buffer_clear(sc->buffer);
+		ldns_buffer_printf(sc->buffer, "error out of memory\n");
+	}
+	ldns_buffer_flip(sc->buffer);
 }
 
-static void handle_test_tcp_cmd(struct sslconn* sc)
+/** perform the profile command, turn it on or off and print it, and
+ * the stalls of the watchdog.
+ * @return false if it did not fit in the buffer */
+static int profile_cmd(char* arg, ldns_buffer* buf)
 {
-	probe_tcp_test();
-	sslconn_shutdown(sc);
+	while(*arg == ' ')
+		arg++;
+	if(strncmp(arg, "on", 2) == 0)
+		evprof_set(1);
+	else if(strncmp(arg, "off", 3) == 0)
+		evprof_set(0);
+	else if(strncmp(arg, "reset", 5) == 0)
+		evprof_reset();
+	return evprof_print(buf) && watchdog_print(buf);
 }
 
-static void handle_test_ssl_cmd(struct sslconn* sc)
+static void handle_profile_cmd(struct sslconn* sc, char* arg)
 {
-	probe_ssl_test();
-	sslconn_shutdown(sc);
+	/* write the profile and then close */
+	sc->close_me = 1;
+	comm_point_listen_for_rw(sc->c, 1, 1);
+	sc->line_state = persist_write;
+	ldns_buffer_clear(sc->buffer);
+	if(!profile_cmd(arg, sc->buffer)) {
+		ldns_buffer_clear(sc->buffer);
+		ldns_buffer_printf(sc->buffer, "error out of memory\n");
+	}
+	ldns_buffer_flip(sc->buffer);
 }
 
-static void handle_test_http_cmd(struct sslconn* sc)
+static void handle_cmdtray_cmd(struct sslconn* sc)
 {
-	probe_http_test();
-	sslconn_shutdown(sc);
+#ifdef HOOKS_OSX
+	/* OSX has messed up resolv.conf after relogin */
+	restore_resolv_osx(global_svr->cfg);
+#endif
+	/* turn into persist read */
+	ldns_buffer_clear(sc->buffer);
+	comm_point_listen_for_rw(sc->c, 1, 0);
+	sc->line_state = persist_read;
 }
 
-static void handle_test_update_cmd(struct sslconn* sc)
+static void handle_test_update_cmd(void)
 {
+	if(!global_svr->update)
+		return;
 	global_svr->update->test_flag = 1;
 	global_svr->update_desired = 1;
-	sslconn_shutdown(sc);
 }
 
-static void handle_stoppanels_cmd(struct sslconn* sc)
+/** perform the commands that only do something, without output.
+ * @return false if not such a command */
+static int run_action(char* str)
+{
+	if(strncmp(str, "submit", 6) == 0) {
+		handle_submit(str+6);
+	} else if(strncmp(str, "reprobe", 7) == 0) {
+		global_svr->forced_insecure = 0;
+		global_svr->http_insecure = 0;
+		cmd_reprobe();
+	} else if(strncmp(str, "skip_http", 9) == 0) {
+		handle_skip_http_cmd();
+	} else if(strncmp(str, "hotspot_signon", 14) == 0) {
+		handle_hotspot_signon_cmd(global_svr);
+	} else if(strncmp(str, "unsafe", 6) == 0) {
+		probe_unsafe_test();
+	} else if(strncmp(str, "test_tcp", 8) == 0) {
+		probe_tcp_test();
+	} else if(strncmp(str, "test_ssl", 8) == 0) {
+		probe_ssl_test();
+	} else if(strncmp(str, "test_http", 8) == 0) {
+		probe_http_test();
+	} else if(strncmp(str, "test_update", 11) == 0) {
+		handle_test_update_cmd();
+#ifdef FWD_ZONES_SUPPORT
+	} else if(strncmp(str, "update_all", 10) == 0) {
+		/* moves pointer above the command name upto args */
+		handle_update_all(str+10);
+#endif
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+/** write stop to all connected panels */
+static void stop_panels(void)
 {
-	/* write stop to all connected panels */
 	const char* stopcmd = "stop\n";
 	struct sslconn* s;
 	for(s=global_svr->busy_list; s; s=s->next) {
@@ -1216,6 +2117,26 @@ static void handle_stoppanels_cmd(struct sslconn* sc)
 		if(s->line_state != persist_write_checkclose &&
 			s->line_state != persist_write)
 			continue;
+#ifndef USE_WINSOCK
+		if(!s->ssl) {
+			/* plain control-socket connection */
+			fd_set_block(s->c->fd);
+			if(s->line_state == persist_write) {
+				if(send(s->c->fd, (void*)ldns_buffer_current(
+					s->buffer), ldns_buffer_remaining(
+					s->buffer), 0) == -1)
+					log_err("cannot write remainder: %s",
+						strerror(errno));
+			}
+			if(send(s->c->fd, stopcmd, strlen(stopcmd), 0) == -1)
+				log_err("cannot write panel stop: %s",
+					strerror(errno));
+			fd_set_nonblock(s->c->fd);
+			comm_point_listen_for_rw(s->c, 1, 0);
+			s->line_state = persist_write_checkclose;
+			continue;
+		}
+#endif
 		(void)SSL_set_mode(s->ssl, SSL_MODE_AUTO_RETRY);
 		if(SSL_get_fd(s->ssl) != -1) {
 #ifdef USE_WINSOCK
@@ -1248,10 +2169,148 @@ static void handle_stoppanels_cmd(struct sslconn* sc)
 		comm_point_listen_for_rw(s->c, 1, 0);
 		s->line_state = persist_write_checkclose;
 	}
+}
+
+static void handle_stoppanels_cmd(struct sslconn* sc)
+{
+	stop_panels();
 	/* wait until they all stopped, then stop commanding connection */
 	sslconn_shutdown(sc);
 }
 
+/** start a reply on the session; the out buffer is flipped, with the
+ * replies that are not written yet, and is opened for more at the end.
+ * @return the start position of the reply */
+static size_t session_reply_start(struct sslconn* sc)
+{
+	size_t start = ldns_buffer_limit(sc->out);
+	ldns_buffer_set_limit(sc->out, ldns_buffer_capacity(sc->out));
+	ldns_buffer_set_position(sc->out, start);
+	return start;
+}
+
+/** finish the reply, put "reply <length>" before it and flip the out
+ * buffer again.  @return false on malloc failure */
+static int session_reply_end(struct sslconn* sc, size_t start)
+{
+	char hdr[32];
+	size_t len = ldns_buffer_position(sc->out) - start;
+	size_t hl = (size_t)snprintf(hdr, sizeof(hdr), "reply %u\n",
+		(unsigned)len);
+	if(!ldns_buffer_reserve(sc->out, hl))
+		return 0;
+	memmove(ldns_buffer_at(sc->out, start+hl),
+		ldns_buffer_at(sc->out, start), len);
+	memmove(ldns_buffer_at(sc->out, start), hdr, hl);
+	ldns_buffer_skip(sc->out, (ssize_t)hl);
+	/* nothing has been written yet, the replies are written when the
+	 * queue is full or no more commands can be read */
+	ldns_buffer_flip(sc->out);
+	return 1;
+}
+
+/** perform a command in session mode, the reply is queued.
+ * @return false on failure, the connection has to be closed */
+static int session_command(struct sslconn* sc, char* str)
+{
+	size_t start = session_reply_start(sc);
+	while(*str == ' ')
+		str++;
+	verbose(VERB_ALGO, "session command: %s", str);
+	if(run_action(str)) {
+		/* empty reply */
+	} else if(strncmp(str, "status", 7) == 0) {
+		print_results(global_svr, sc->out);
+	} else if(strncmp(str, "dump_trace", 10) == 0) {
+		if(!ldns_buffer_reserve(sc->out, TRACE_DUMP_MAX))
+			return 0;
+		ldns_buffer_skip(sc->out, (ssize_t)trace_dump(
+			ldns_buffer_current(sc->out)));
+	} else if(strncmp(str, "memstats", 8) == 0) {
+		if(!memstats_print(sc->out))
+			return 0;
+	} else if(strncmp(str, "profile", 7) == 0) {
+		if(!profile_cmd(str+7, sc->out))
+			return 0;
+	} else if(strncmp(str, "stoppanels", 10) == 0) {
+		stop_panels();
+	} else if(strncmp(str, "stop", 4) == 0) {
+		comm_base_exit(global_svr->base);
+		sc->close_me = 1;
+	} else if(strncmp(str, "quit", 4) == 0) {
+		sc->close_me = 1;
+	} else {
+		/* and the persistent ones, results and cmdtray */
+		verbose(VERB_DETAIL, "unknown session command: %s", str);
+		ldns_buffer_printf(sc->out, "error unknown command\n");
+	}
+	return session_reply_end(sc, start);
+}
+
+/** write the replies, then read and perform up to SESSION_QUEUE_MAX
+ * commands.  Their replies are written on the next write event, and the
+ * next commands are read after that, so that a client that streams
+ * commands does not hold the event loop */
+static void session_service(struct sslconn* sc)
+{
+	int n;
+	if(ldns_buffer_remaining(sc->out) > 0) {
+		/* returns false when it has to wait for the socket,
+		 * or when it has closed the connection */
+		if(!sslconn_write(sc, sc->out))
+			return;
+		ldns_buffer_clear(sc->out);
+		ldns_buffer_flip(sc->out);
+	}
+	if(sc->close_me) {
+		sslconn_shutdown(sc);
+		return;
+	}
+	comm_point_listen_for_rw(sc->c, 1, 0);
+	for(n=0; n<SESSION_QUEUE_MAX && !sc->close_me; n++) {
+		if(!sslconn_readline(sc))
+			return; /* wait for more, or it is closed */
+		if(!session_command(sc,
+			(char*)ldns_buffer_begin(sc->buffer))) {
+			log_err("out of memory");
+			sslconn_delete(sc);
+			return;
+		}
+		ldns_buffer_clear(sc->buffer);
+		/* write the replies when it can */
+		comm_point_listen_for_rw(sc->c, 1, 1);
+	}
+}
+
+/** the client has closed its side of the session; the replies to the
+ * commands it sent are written, then the connection is closed.  A last
+ * line without newline is not a command, it is dropped */
+static void session_eof(struct sslconn* sc)
+{
+	verbose(VERB_ALGO, "session closed by client");
+	sc->close_me = 1;
+	comm_point_listen_for_rw(sc->c, 0, 1);
+}
+
+static void handle_session_cmd(struct sslconn* sc)
+{
+	sc->out = ldns_buffer_new(65536);
+	if(!sc->out) {
+		log_err("out of memory");
+		sslconn_delete(sc);
+		return;
+	}
+	/* the client has to keep no more than this many commands without
+	 * a reply, or it may block on the write while we write to it */
+	ldns_buffer_printf(sc->out, "ok session %d\n", SESSION_QUEUE_MAX);
+	ldns_buffer_flip(sc->out);
+	ldns_buffer_clear(sc->buffer);
+	sc->line_state = session_cmds;
+	comm_point_listen_for_rw(sc->c, 1, 1);
+	/* the commands can be in the same SSL packet as the header */
+	session_service(sc);
+}
+
 static void sslconn_command(struct sslconn* sc)
 {
 	char header[10];
@@ -1266,46 +2325,27 @@ static void sslconn_command(struct sslconn* sc)
 	while(*str == ' ')
 		str++;
 	verbose(VERB_ALGO, "command: %s", str);
-	if(strncmp(str, "submit", 6) == 0) {
-		handle_submit(str+6);
-		sslconn_shutdown(sc);
-	} else if(strncmp(str, "reprobe", 7) == 0) {
-		global_svr->forced_insecure = 0;
-		global_svr->http_insecure = 0;
-		cmd_reprobe();
-		sslconn_shutdown(sc);
-	} else if(strncmp(str, "skip_http", 9) == 0) {
-		handle_skip_http_cmd();
-		sslconn_shutdown(sc);
-	} else if(strncmp(str, "hotspot_signon", 14) == 0) {
-		handle_hotspot_signon_cmd(global_svr);
+	if(run_action(str)) {
 		sslconn_shutdown(sc);
+	} else if(strncmp(str, "session", 7) == 0) {
+		handle_session_cmd(sc);
 	} else if(strncmp(str, "results", 7) == 0) {
 		handle_results_cmd(sc);
 	} else if(strncmp(str, "status", 7) == 0) {
 		handle_status_cmd(sc);
+	} else if(strncmp(str, "dump_trace", 10) == 0) {
+		handle_dump_trace_cmd(sc);
+	} else if(strncmp(str, "memstats", 8) == 0) {
+		handle_memstats_cmd(sc);
+	} else if(strncmp(str, "profile", 7) == 0) {
+		handle_profile_cmd(sc, str+7);
 	} else if(strncmp(str, "cmdtray", 7) == 0) {
 		handle_cmdtray_cmd(sc);
-	} else if(strncmp(str, "unsafe", 6) == 0) {
-		handle_unsafe_cmd(sc);
-	} else if(strncmp(str, "test_tcp", 8) == 0) {
-		handle_test_tcp_cmd(sc);
-	} else if(strncmp(str, "test_ssl", 8) == 0) {
-		handle_test_ssl_cmd(sc);
-	} else if(strncmp(str, "test_http", 8) == 0) {
-		handle_test_http_cmd(sc);
-	} else if(strncmp(str, "test_update", 11) == 0) {
-		handle_test_update_cmd(sc);
 	} else if(strncmp(str, "stoppanels", 10) == 0) {
 		handle_stoppanels_cmd(sc);
 	} else if(strncmp(str, "stop", 4) == 0) {
 		comm_base_exit(global_svr->base);
 		sslconn_shutdown(sc);
-#ifdef FWD_ZONES_SUPPORT
-       } else if(strncmp(str, "update_all", 10) == 0) {
-                handle_update_all(str+10);  // moves pointer above the command name upto args
-                sslconn_shutdown(sc);
-#endif
 	} else {
 		verbose(VERB_DETAIL, "unknown command: %s", str);
 		handle_printclose(sc, "error unknown command");
@@ -41,6 +41,7 @@
 
 #ifndef SVR_H
 #define SVR_H
+#include "ticket.h"
 struct cfg;
 struct comm_base;
 struct comm_reply;
@@ -51,6 +52,11 @@ struct comm_point;
 struct ldns_struct_buffer;
 struct probe_ip;
 struct http_general;
+struct http_addr_cache;
+struct sched;
+struct store;
+struct zonetree;
+struct snapshot;
 struct selfupdate;
 
 /**
@@ -62,6 +68,8 @@ struct svr {
 
 	/** SSL context with keys */
 	SSL_CTX* ctx;
+	/** session ticket keys, the current one and the previous one */
+	struct ticket_key ticket_keys[2];
 	/** number of active commpoints that are handling remote control */
 	int active;
 	/** max active commpoints */
@@ -70,6 +78,16 @@ struct svr {
 	struct listen_list* listen;
 	/** busy commpoints */
 	struct sslconn* busy_list;
+#ifndef USE_WINSOCK
+	/** path of the control-socket that was created, it is removed on
+	 * exit; a reload can change the path in the config */
+	char* listen_unix;
+	/** uids and gids allowed on the control socket, from control-allow */
+	uid_t* allow_uid;
+	int num_allow_uid;
+	gid_t* allow_gid;
+	int num_allow_gid;
+#endif
 
 	/** udp buffer */
 	struct ldns_struct_buffer* udp_buffer;
@@ -94,6 +112,10 @@ struct svr {
 	int probe_dnstcp;
 	/** time of probe */
 	time_t probetime;
+	/** scores of the fallback servers, or NULL if out of memory */
+	struct score_tab* scores;
+	/** the warm start snapshot that is in the state dir, or NULL */
+	struct snapshot* snapshot;
 
 	/** probe retry timer */
 	struct comm_timer* retry_timer;
@@ -109,8 +131,29 @@ struct svr {
 	/** tcp timer was used last time? */
 	int tcp_timer_used;
 
+#ifdef FWD_ZONES_SUPPORT
+	/** timer to retry taking the update lock from the script */
+	struct comm_timer* lock_timer;
+	/** forward candidates to probe once the lock is free, or NULL */
+	char* lock_pending;
+	/** current lock retry wait, msec */
+	int lock_backoff;
+	/** the zones that are configured by us, read at start, used by
+	 * the update jobs on the unbound hook worker */
+	struct store* zones;
+	/** number of update jobs that are not done, the zones are written
+	 * when it drops to zero */
+	int zones_updates;
+	/** the reverse zones of the private address ranges */
+	struct zonetree* reverse_zones;
+#endif
+
 	/** http lookup structure; or NULL if no urlprobe configured or done */
 	struct http_general* http;
+	/** addresses of the http probe hostnames, kept across probes */
+	struct http_addr_cache* http_addrs;
+	/** pacing of the probe queries */
+	struct sched* sched;
 
 	/** self update structure; or NULL if no selfupdate */
 	struct selfupdate* update;
@@ -149,6 +192,15 @@ struct svr {
 #define RETRY_TIMER_COUNT_MAX 30
 /** timer for tcp state to try again once (sec.) */
 #define SVR_TCP_RETRY 20
+/** first wait before trying the update lock again (msec.) */
+#define LOCK_RETRY_START 10
+/** max wait between tries of the update lock (msec.) */
+#define LOCK_RETRY_MAX 1000
+
+/** number of TLS sessions in the server session cache */
+#define SESSION_CACHE_SIZE 256
+/** commands read ahead on a control session before replies are written */
+#define SESSION_QUEUE_MAX 16
 
 /** list of commpoints */
 struct listen_list {
@@ -165,17 +217,21 @@ struct sslconn {
 	/** in the handshake part */
 	enum { rc_hs_none, rc_hs_read, rc_hs_write, rc_hs_want_write,
 		rc_hs_want_read, rc_hs_shutdown } shake_state;
-	/** the ssl state */
+	/** the ssl state, NULL for the plain control-socket connections */
 	SSL* ssl;
 	/** line state: read or write */
 	enum { command_read, persist_read, persist_write,
-		persist_write_checkclose } line_state;
+		persist_write_checkclose, session_cmds } line_state;
 	/** buffer with info to send or receive */
 	struct ldns_struct_buffer* buffer;
 	/** have to fetch another status update right away */
 	int fetch_another_update;
 	/** close after writing one set of results */
 	int close_me;
+	/** the replies to write in session mode, flipped, or NULL */
+	struct ldns_struct_buffer* out;
+	/** bytes accounted in the memstats */
+	size_t mem;
 };
 
 extern struct svr* global_svr;
@@ -192,6 +248,10 @@ void svr_send_results(struct svr* svr);
 void svr_retry_callback(void* arg);
 /** timeouts of tcp timer */
 void svr_tcp_callback(void* arg);
+#ifdef FWD_ZONES_SUPPORT
+/** timeouts of the update lock retry timer */
+void svr_lock_callback(void* arg);
+#endif
 
 /** start or enable next timeout on the retry timer */
 void svr_retry_timer_next(int http_mode);
@@ -208,10 +268,28 @@ void cmd_reprobe(void);
 void svr_check_update(struct svr* svr);
 /** signal update to panels over commandchannel */
 void svr_signal_update(struct svr* svr, char* version_available);
+/** write the fallback server scores to the state dir, if changed */
+void svr_store_scores(struct svr* svr);
+/**
+ * Write the warm start snapshot to the state dir, if changed.
+ * @param svr: the server.
+ * @param s: the snapshot, it is taken over.  NULL removes the snapshot,
+ *	the decision is not to be used at the next start.
+ */
+void svr_store_snapshot(struct svr* svr, struct snapshot* s);
+/**
+ * At start, set up unbound from the snapshot in the state dir, if the
+ * interfaces are on the same networks, and probe to confirm it.
+ */
+void svr_warm_start(struct svr* svr);
 
 int handle_ssl_accept(struct comm_point* c, void* arg, int error,
         struct comm_reply* reply_info);
 int control_callback(struct comm_point* c, void* arg, int error,
         struct comm_reply* reply_info);
+#ifndef USE_WINSOCK
+int handle_unix_accept(struct comm_point* c, void* arg, int error,
+        struct comm_reply* reply_info);
+#endif
 
 #endif /* SVR_H */
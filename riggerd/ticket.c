@@ -0,0 +1,167 @@
+/*
+ * ticket.c - dnssec-trigger TLS session ticket keys
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the TLS session ticket keys of the control port.
+ */
+#include "config.h"
+#include "ticket.h"
+#include "log.h"
+#include "net_help.h"
+#include <ldns/ldns.h>
+#include <openssl/rand.h>
+#ifndef USE_WINSOCK
+#include <fcntl.h>
+#endif
+
+/** the ticket key file is a magic string and the two keys */
+#define TICKET_MAGIC "DNSTKEY1"
+/** bytes per key in the ticket key file */
+#define TICKET_KEY_LEN (16+32+32+4)
+
+int ticket_keys_read(struct ticket_key* keys, const char* file)
+{
+	uint8_t buf[8+2*TICKET_KEY_LEN], *p;
+	FILE* in;
+	int i;
+	if(!(in = fopen(file, "rb")))
+		return 0;
+	if(fread(buf, 1, sizeof(buf), in) != sizeof(buf) ||
+		memcmp(buf, TICKET_MAGIC, 8) != 0) {
+		verbose(VERB_OPS, "%s: bad format, ignored", file);
+		fclose(in);
+		return 0;
+	}
+	fclose(in);
+	p = buf+8;
+	for(i=0; i<2; i++) {
+		struct ticket_key* k = &keys[i];
+		memmove(k->name, p, 16);
+		memmove(k->aes, p+16, 32);
+		memmove(k->hmac, p+48, 32);
+		k->created = (time_t)ldns_read_uint32(p+80);
+		p += TICKET_KEY_LEN;
+	}
+	return 1;
+}
+
+int ticket_keys_write(struct ticket_key* keys, const char* file)
+{
+	char tmp[1100];
+	uint8_t buf[8+2*TICKET_KEY_LEN], *p;
+	FILE* out;
+	int i;
+#ifndef USE_WINSOCK
+	int fd;
+#endif
+	memmove(buf, TICKET_MAGIC, 8);
+	p = buf+8;
+	for(i=0; i<2; i++) {
+		struct ticket_key* k = &keys[i];
+		memmove(p, k->name, 16);
+		memmove(p+16, k->aes, 32);
+		memmove(p+48, k->hmac, 32);
+		ldns_write_uint32(p+80, (uint32_t)k->created);
+		p += TICKET_KEY_LEN;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+#ifndef USE_WINSOCK
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	out = (fd == -1)?NULL:fdopen(fd, "wb");
+	if(!out && fd != -1)
+		close(fd);
+#else
+	out = fopen(tmp, "wb");
+#endif
+	if(!out) {
+		log_err("cannot open %s for write: %s", tmp, strerror(errno));
+		return 0;
+	}
+	if(fwrite(buf, 1, sizeof(buf), out) != sizeof(buf) ||
+		fclose(out) != 0) {
+		log_err("cannot write %s: %s", tmp, strerror(errno));
+		unlink(tmp);
+		return 0;
+	}
+#ifdef USE_WINSOCK
+	/* rename does not overwrite on windows */
+	unlink(file);
+#endif
+	if(rename(tmp, file) != 0) {
+		log_err("cannot rename %s to %s: %s", tmp, file,
+			strerror(errno));
+		unlink(tmp);
+		return 0;
+	}
+	return 1;
+}
+
+int ticket_keys_rotate(struct ticket_key* keys, time_t now)
+{
+	struct ticket_key* k = &keys[0];
+	if(k->created != 0 && now >= k->created &&
+		now - k->created < TICKET_KEY_ROTATE)
+		return 0;
+	keys[1] = *k;
+	if(RAND_bytes(k->name, (int)sizeof(k->name)) != 1 ||
+		RAND_bytes(k->aes, (int)sizeof(k->aes)) != 1 ||
+		RAND_bytes(k->hmac, (int)sizeof(k->hmac)) != 1) {
+		log_crypto_err("could not RAND_bytes for ticket key");
+		memset(k, 0, sizeof(*k));
+		return -1;
+	}
+	k->created = now;
+	verbose(VERB_ALGO, "new session ticket key");
+	return 1;
+}
+
+struct ticket_key* ticket_key_find(struct ticket_key* keys,
+	const unsigned char* name, time_t now, int* renew)
+{
+	int i;
+	for(i=0; i<2; i++) {
+		struct ticket_key* k = &keys[i];
+		if(k->created == 0 || memcmp(name, k->name, sizeof(k->name))
+			!= 0)
+			continue;
+		if(now - k->created >= 2*TICKET_KEY_ROTATE)
+			return NULL;
+		*renew = (i != 0);
+		return k;
+	}
+	return NULL;
+}
@@ -0,0 +1,105 @@
+/*
+ * ticket.h - dnssec-trigger TLS session ticket keys
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the TLS session ticket keys of the control port.
+ * There is a current key, that encrypts new tickets, and the previous key,
+ * that still decrypts the tickets it made, so that they are renewed.  The
+ * keys are kept in the state-dir, so the tickets stay valid across a
+ * restart of the daemon.
+ */
+
+#ifndef TICKET_H
+#define TICKET_H
+
+/** session ticket key rotation, and the ticket lifetime (sec.) */
+#define TICKET_KEY_ROTATE 43200
+/** file in the state-dir with the session ticket keys */
+#define TICKET_FILE_NAME "ticket-keys"
+
+/** a TLS session ticket key */
+struct ticket_key {
+	/** key name, sent in the ticket */
+	unsigned char name[16];
+	/** AES-256 key */
+	unsigned char aes[32];
+	/** HMAC-SHA256 key */
+	unsigned char hmac[32];
+	/** time the key was made, 0 if not in use */
+	time_t created;
+};
+
+/**
+ * Read the ticket keys of an earlier run.
+ * @param keys: the current and the previous key, set if the file is ok.
+ * @param file: the file name.
+ * @return false if there is no file, or it has the wrong format, and the
+ *	keys are not changed.
+ */
+int ticket_keys_read(struct ticket_key* keys, const char* file);
+
+/**
+ * Write the ticket keys, the file is only readable by us.
+ * @param keys: the current and the previous key.
+ * @param file: the file name, a temp file is renamed to it.
+ * @return false on failure, it is logged.
+ */
+int ticket_keys_write(struct ticket_key* keys, const char* file);
+
+/**
+ * Make a new current key when it is old, or not there.  The current key
+ * becomes the previous key.
+ * @param keys: the current and the previous key.
+ * @param now: the time.
+ * @return -1 on failure, 0 if the current key is kept, 1 if there is a
+ *	new key, and the keys have to be written.
+ */
+int ticket_keys_rotate(struct ticket_key* keys, time_t now);
+
+/**
+ * Find the key of a ticket, to decrypt it.
+ * @param keys: the current and the previous key.
+ * @param name: the key name in the ticket, 16 bytes.
+ * @param now: the time, keys older than twice the rotation are not used.
+ * @param renew: set true if it is the previous key, and the client has to
+ *	get a new ticket with the current key.
+ * @return the key, or NULL if it is not known (a full handshake).
+ */
+struct ticket_key* ticket_key_find(struct ticket_key* keys,
+	const unsigned char* name, time_t now, int* renew);
+
+#endif /* TICKET_H */
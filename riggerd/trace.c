@@ -0,0 +1,239 @@
+/*
+ * trace.c - dnssec-trigger probe flight recorder
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the flight recorder of the probe events.
+ */
+#include "config.h"
+#include "trace.h"
+#include <sys/time.h>
+#include <ldns/ldns.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+/** the ring with the events */
+static struct trace_event trace_ring[TRACE_SIZE];
+/** number of events recorded since start, the next goes in
+ * trace_ring[trace_total%TRACE_SIZE] */
+static uint32_t trace_total = 0;
+/** time of the event base, or NULL */
+static struct timeval* trace_now = NULL;
+
+void trace_set_time(struct timeval* now)
+{
+	trace_now = now;
+}
+
+void trace_clear(void)
+{
+	trace_total = 0;
+}
+
+/** get the next event in the ring, with the time filled in */
+static struct trace_event* trace_next(enum trace_type type)
+{
+	struct trace_event* e = &trace_ring[(trace_total++)%TRACE_SIZE];
+	struct timeval tv;
+	if(trace_now)
+		tv = *trace_now;
+	else	gettimeofday(&tv, NULL);
+	e->sec = (uint32_t)tv.tv_sec;
+	e->usec = (uint32_t)tv.tv_usec;
+	e->type = (uint8_t)type;
+	return e;
+}
+
+void trace_outq(enum trace_type type, struct sockaddr_storage* addr,
+	int flags, int qtype, int val)
+{
+	struct trace_event* e = trace_next(type);
+	e->arg = (uint16_t)qtype;
+	e->val = (uint16_t)(val>0xffff?0xffff:val);
+	if(addr->ss_family == AF_INET6) {
+		struct sockaddr_in6* sa = (struct sockaddr_in6*)addr;
+		memmove(e->data, &sa->sin6_addr, 16);
+		e->port = ntohs(sa->sin6_port);
+		flags |= TRACE_IP6;
+	} else {
+		struct sockaddr_in* sa = (struct sockaddr_in*)addr;
+		memmove(e->data, &sa->sin_addr, 4);
+		e->port = ntohs(sa->sin_port);
+	}
+	e->flags = (uint8_t)flags;
+}
+
+void trace_state(int old, int state, int flags)
+{
+	struct trace_event* e = trace_next(trace_probe_state);
+	e->flags = (uint8_t)flags;
+	e->arg = (uint16_t)state;
+	e->port = (uint16_t)old;
+	e->val = 0;
+}
+
+void trace_ubctrl(const char* cmd, int status, int msec)
+{
+	struct trace_event* e = trace_next(trace_unbound_control);
+	size_t len = strcspn(cmd, " ");
+	e->flags = 0;
+	e->arg = (uint16_t)status;
+	e->port = 0;
+	e->val = (uint16_t)(msec>0xffff?0xffff:(msec<0?0:msec));
+	if(len > sizeof(e->data))
+		len = sizeof(e->data);
+	memset(e->data, 0, sizeof(e->data));
+	memmove(e->data, cmd, len);
+}
+
+size_t trace_dump(uint8_t* buf)
+{
+	uint32_t i, num = trace_total<TRACE_SIZE?trace_total:TRACE_SIZE;
+	uint8_t* p = buf;
+	memmove(p, TRACE_MAGIC, 8);
+	ldns_write_uint32(p+8, num);
+	ldns_write_uint32(p+12, trace_total);
+	p += TRACE_HEADER_LEN;
+	for(i=trace_total-num; i!=trace_total; i++) {
+		struct trace_event* e = &trace_ring[i%TRACE_SIZE];
+		ldns_write_uint32(p, e->sec);
+		ldns_write_uint32(p+4, e->usec);
+		p[8] = e->type;
+		p[9] = e->flags;
+		ldns_write_uint16(p+10, e->arg);
+		ldns_write_uint16(p+12, e->port);
+		ldns_write_uint16(p+14, e->val);
+		memmove(p+16, e->data, 16);
+		p += TRACE_EVENT_LEN;
+	}
+	return (size_t)(p-buf);
+}
+
+int trace_parse_header(uint8_t* buf, size_t len, uint32_t* num,
+	uint32_t* total)
+{
+	if(len < TRACE_HEADER_LEN || memcmp(buf, TRACE_MAGIC, 8) != 0)
+		return 0;
+	*num = ldns_read_uint32(buf+8);
+	*total = ldns_read_uint32(buf+12);
+	return *num <= TRACE_SIZE;
+}
+
+void trace_parse_event(uint8_t* buf, struct trace_event* e)
+{
+	e->sec = ldns_read_uint32(buf);
+	e->usec = ldns_read_uint32(buf+4);
+	e->type = buf[8];
+	e->flags = buf[9];
+	e->arg = ldns_read_uint16(buf+10);
+	e->port = ldns_read_uint16(buf+12);
+	e->val = ldns_read_uint16(buf+14);
+	memmove(e->data, buf+16, 16);
+}
+
+/** name of a res_state, in the order of enum res_state in svr.h */
+static const char* trace_state_str(int s)
+{
+	const char* names[] = {"auth", "cache", "tcp", "ssl", "nodnssec",
+		"disconnected"};
+	if(s < 0 || s >= (int)(sizeof(names)/sizeof(names[0])))
+		return "unknown";
+	return names[s];
+}
+
+/** name of a query type */
+static const char* trace_qtype_str(int t)
+{
+	switch(t) {
+	case LDNS_RR_TYPE_A: return "A";
+	case LDNS_RR_TYPE_AAAA: return "AAAA";
+	case LDNS_RR_TYPE_TXT: return "TXT";
+	case LDNS_RR_TYPE_DS: return "DS";
+	case LDNS_RR_TYPE_DNSKEY: return "DNSKEY";
+	case LDNS_RR_TYPE_SOA: return "SOA";
+	default: break;
+	}
+	return "other";
+}
+
+void trace_event_str(struct trace_event* e, struct trace_event* start,
+	char* s, size_t len)
+{
+	char ip[64];
+	long msec = ((long)e->sec - (long)start->sec)*1000 +
+		((long)e->usec - (long)start->usec)/1000;
+	const char* what;
+	int n = snprintf(s, len, "%+8.3f ", (double)msec/1000.);
+	if(n < 0 || (size_t)n >= len)
+		return;
+	s += n;
+	len -= n;
+	switch(e->type) {
+	case trace_probe_state:
+		snprintf(s, len, "state %s -> %s%s%s%s",
+			trace_state_str(e->port), trace_state_str(e->arg),
+			(e->flags&TRACE_INSECURE)?" insecure_mode":"",
+			(e->flags&TRACE_FORCED)?" forced_insecure":"",
+			(e->flags&TRACE_HTTP_INSECURE)?" http_insecure":"");
+		return;
+	case trace_unbound_control:
+		snprintf(s, len, "unbound-control %.16s: status %d, %d msec",
+			(char*)e->data, (int)e->arg, (int)e->val);
+		return;
+	case trace_outq_send: what = "send"; break;
+	case trace_outq_recv: what = "recv"; break;
+	case trace_outq_timeout: what = "timeout"; break;
+	case trace_outq_tc: what = "truncated"; break;
+	case trace_outq_fail: what = "fail"; break;
+	default:
+		snprintf(s, len, "unknown event %d", (int)e->type);
+		return;
+	}
+	if(!inet_ntop((e->flags&TRACE_IP6)?AF_INET6:AF_INET, e->data, ip,
+		(socklen_t)sizeof(ip)))
+		snprintf(ip, sizeof(ip), "(inet_ntop error)");
+	snprintf(s, len, "%-9s %s %s%s port %d %s", what,
+		(e->flags&TRACE_SSL)?"ssl":((e->flags&TRACE_TCP)?"tcp":"udp"),
+		ip, (e->flags&TRACE_RECURSE)?" recursive":"", (int)e->port,
+		trace_qtype_str(e->arg));
+	if(e->type == trace_outq_recv || e->type == trace_outq_send ||
+		e->type == trace_outq_timeout) {
+		size_t l = strlen(s);
+		snprintf(s+l, len-l, e->type==trace_outq_recv?", %d bytes":
+			", %d msec", (int)e->val);
+	}
+}
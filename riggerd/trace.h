@@ -0,0 +1,191 @@
+/*
+ * trace.h - dnssec-trigger probe flight recorder
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the flight recorder.  It keeps the last events of the
+ * probes in a fixed size ring, in binary: queries sent and received,
+ * timeouts, fallback to TCP, the state chosen by probe_all_done and the
+ * unbound-control commands with their latency.  It is always on, recording
+ * an event is a copy into the ring.  The dump_trace control command sends
+ * the ring, and dnssec-trigger-trace prints it.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+struct sockaddr_storage;
+
+/** number of events in the ring */
+#define TRACE_SIZE 1024
+/** magic string at the start of a dump, with the format version */
+#define TRACE_MAGIC "DNSTRAC1"
+/** length of the dump header: magic, number of events, total recorded */
+#define TRACE_HEADER_LEN 16
+/** length of an event in the dump */
+#define TRACE_EVENT_LEN 32
+/** max length of a dump */
+#define TRACE_DUMP_MAX (TRACE_HEADER_LEN + TRACE_SIZE*TRACE_EVENT_LEN)
+
+/** event types */
+enum trace_type {
+	/** query sent, val is the timeout in msec */
+	trace_outq_send = 1,
+	/** reply received, val is its length */
+	trace_outq_recv,
+	/** UDP timeout, val is the timeout in msec */
+	trace_outq_timeout,
+	/** truncated reply, the query is sent again over TCP */
+	trace_outq_tc,
+	/** query failed: TCP error or a bad reply */
+	trace_outq_fail,
+	/** probe_all_done picked a state, arg is the new res_state,
+	 * port is the old res_state */
+	trace_probe_state,
+	/** unbound-control ran, arg is its exit status, val the latency in
+	 * msec, data the command name */
+	trace_unbound_control
+};
+
+/** event flags: over TCP */
+#define TRACE_TCP 0x01
+/** event flags: over SSL */
+#define TRACE_SSL 0x02
+/** event flags: the address in data is IPv6 */
+#define TRACE_IP6 0x04
+/** event flags: recursive query, to a cache or open resolver */
+#define TRACE_RECURSE 0x08
+/** state flags: insecure_state */
+#define TRACE_INSECURE 0x10
+/** state flags: forced insecure, by hotspot signon */
+#define TRACE_FORCED 0x20
+/** state flags: http insecure */
+#define TRACE_HTTP_INSECURE 0x40
+
+/**
+ * An event in the flight recorder.
+ */
+struct trace_event {
+	/** time of the event */
+	uint32_t sec;
+	/** microseconds of the time */
+	uint32_t usec;
+	/** the enum trace_type */
+	uint8_t type;
+	/** TRACE_ flags */
+	uint8_t flags;
+	/** query type, state or exit status */
+	uint16_t arg;
+	/** port number, or old state */
+	uint16_t port;
+	/** timeout, length or latency */
+	uint16_t val;
+	/** IP address, 4 or 16 bytes, or command name (not terminated) */
+	uint8_t data[16];
+};
+
+/**
+ * Set the time to record for the events.
+ * @param now: the time is read from here, the event base keeps it up to
+ *	date.  If NULL, gettimeofday(2) is used.
+ */
+void trace_set_time(struct timeval* now);
+
+/**
+ * Record a query event.
+ * @param type: trace_outq_ type.
+ * @param addr: address of the server.
+ * @param flags: TRACE_TCP, TRACE_SSL, TRACE_RECURSE.
+ * @param qtype: query type.
+ * @param val: timeout or length.
+ */
+void trace_outq(enum trace_type type, struct sockaddr_storage* addr,
+	int flags, int qtype, int val);
+
+/**
+ * Record the state chosen by probe_all_done.
+ * @param old: the previous res_state.
+ * @param state: the new res_state.
+ * @param flags: TRACE_INSECURE, TRACE_FORCED, TRACE_HTTP_INSECURE.
+ */
+void trace_state(int old, int state, int flags);
+
+/**
+ * Record an unbound-control command.
+ * @param cmd: command name, up to the first space is recorded.
+ * @param status: exit status.
+ * @param msec: how long it took.
+ */
+void trace_ubctrl(const char* cmd, int status, int msec);
+
+/**
+ * Write the ring, the oldest event first, in network order.
+ * @param buf: buffer of at least TRACE_DUMP_MAX bytes.
+ * @return length written.
+ */
+size_t trace_dump(uint8_t* buf);
+
+/**
+ * Parse the header of a dump.
+ * @param buf: the dump.
+ * @param len: its length.
+ * @param num: number of events in the dump is returned.
+ * @param total: number of events recorded since start is returned.
+ * @return false if it is not a dump.
+ */
+int trace_parse_header(uint8_t* buf, size_t len, uint32_t* num,
+	uint32_t* total);
+
+/**
+ * Parse an event from a dump.
+ * @param buf: TRACE_EVENT_LEN bytes.
+ * @param e: the event is returned here.
+ */
+void trace_parse_event(uint8_t* buf, struct trace_event* e);
+
+/**
+ * Print an event as a line of text.
+ * @param e: the event.
+ * @param start: time of the first event, times are printed relative to it.
+ * @param s: string buffer.
+ * @param len: length of the buffer.
+ */
+void trace_event_str(struct trace_event* e, struct trace_event* start,
+	char* s, size_t len);
+
+/** clear the ring, for tests */
+void trace_clear(void);
+
+#endif /* TRACE_H */
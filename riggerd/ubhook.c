@@ -44,14 +44,33 @@
 #include "cfg.h"
 #include "log.h"
 #include "probe.h"
+#include "trace.h"
+#include "hookq.h"
+#include "watchdog.h"
 #ifdef USE_WINSOCK
 #include "winrc/win_svc.h"
 #endif
 #include <ctype.h>
+#include <sys/time.h>
+#include <time.h>
 
 /* the state configured for unbound */
 static int ub_has_tcp_upstream = 0;
 static int ub_has_ssl_upstream = 0;
+/* if unbound supports the options, from the last check; assumed until
+ * the first check is done */
+static int ub_supports_tcp_upstream = 1;
+static int ub_supports_ssl_upstream = 1;
+
+/** msec elapsed since start */
+static int
+elapsed_msec(struct timeval* start)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (int)((now.tv_sec - start->tv_sec)*1000 +
+		(now.tv_usec - start->tv_usec)/1000);
+}
 
 /** check if commandline argument is only a-zA-Z0-9, and ' :._-+' 
  * also not starting with a '-' (i.e. like a commandline option) */
@@ -90,8 +109,388 @@ allowed_arg(const char* arg)
 	return 1;
 }
 
+#ifdef FWD_ZONES_SUPPORT
+/** seconds between the checks of the mirror against the zones of unbound */
+#define UB_MIRROR_CHECK_SECS 300
+
+/**
+ * The mirror of the forward and local zones of unbound.  The commands that
+ * we perform change it when they succeed, so that the zones are not listed
+ * from unbound for every update.  It is read from unbound when it is used
+ * first, after a command has failed, and when the periodic check finds that
+ * the checksum of the zones unbound lists differs.  The unbound hook worker
+ * uses it, it performs the commands for unbound in order.
+ */
+static struct ub_mirror {
+	/** if the lists are read from unbound and kept up to date */
+	int valid;
+	/** when the zones were last listed from unbound */
+	time_t checked;
+	/** the forward zones, with their servers */
+	struct nm_connection_list forwards;
+	/** the local zones, of any type */
+	struct string_list locals;
+	/** the local zones of type static */
+	struct string_list statics;
+} ub_mirror;
+
+/** the zone name as unbound lists it, with the trailing dot */
+static void
+ub_zone_name(const char* zone, char* buf, size_t len)
+{
+	size_t l = strlen(zone);
+	snprintf(buf, len, "%s%s", zone, (l == 0 || zone[l-1] == '.')?"":".");
+}
+
+/** free the lists of the mirror, it is read again when it is used */
+static void
+ub_mirror_clear(void)
+{
+	if(ub_mirror.valid) {
+		nm_connection_list_clear(&ub_mirror.forwards);
+		string_list_clear(&ub_mirror.locals);
+		string_list_clear(&ub_mirror.statics);
+	}
+	ub_mirror.valid = 0;
+}
+
+/** a command failed, the zones of unbound are not known */
+static void
+ub_mirror_failed(const char* cmd)
+{
+	if(ub_mirror.valid)
+		verbose(VERB_ALGO, "unbound-control %s failed, read the zones "
+			"of unbound again", cmd);
+	ub_mirror_clear();
+}
+
+/** add a zone name to the order independent checksum */
+static uint32_t
+ub_mirror_sum(uint32_t sum, const char* kind, const char* zone)
+{
+	uint32_t h = 2166136261U;
+	const char* s;
+	/* FNV-1a of the kind and the name */
+	for(s = kind; *s; s++) {
+		h ^= (uint8_t)*s;
+		h *= 16777619U;
+	}
+	for(s = zone; *s; s++) {
+		h ^= (uint8_t)*s;
+		h *= 16777619U;
+	}
+	return sum + h;
+}
+
+/** the checksum of the zone names in the lists */
+static uint32_t
+ub_mirror_checksum(struct nm_connection_list* forwards,
+	struct string_list* locals, struct string_list* statics)
+{
+	struct nm_connection_node* n;
+	struct string_entry* e;
+	uint32_t sum = 0;
+	for(n = forwards->first; n; n = n->next) {
+		FOR_EACH_STRING_IN_LIST(e, &n->self->zones)
+			sum = ub_mirror_sum(sum, "forward", e->string);
+	}
+	FOR_EACH_STRING_IN_LIST(e, locals)
+		sum = ub_mirror_sum(sum, "local", e->string);
+	FOR_EACH_STRING_IN_LIST(e, statics)
+		sum = ub_mirror_sum(sum, "static", e->string);
+	return sum;
+}
+
+/** list the zones of unbound with unbound-control, false on failure */
+static int
+ub_mirror_list(const char* exe, struct nm_connection_list* forwards,
+	struct string_list* locals, struct string_list* statics)
+{
+	char cmd[1024], zone[1024], type[1024];
+	FILE* fp;
+	snprintf(cmd, sizeof(cmd), "%s list_forwards", exe);
+	if(!(fp = popen(cmd, "r"))) {
+		log_err("popen(%s) failed: %s", cmd, strerror(errno));
+		return 0;
+	}
+	*forwards = hook_unbound_list_forwards_inner(NULL, fp, NULL);
+	if(pclose(fp) != 0) {
+		log_err("%s failed", cmd);
+		nm_connection_list_clear(forwards);
+		return 0;
+	}
+	snprintf(cmd, sizeof(cmd), "%s list_local_zones", exe);
+	if(!(fp = popen(cmd, "r"))) {
+		log_err("popen(%s) failed: %s", cmd, strerror(errno));
+		nm_connection_list_clear(forwards);
+		return 0;
+	}
+	string_list_init(locals);
+	string_list_init(statics);
+	while(fscanf(fp, "%1023s %1023s\n", zone, type) == 2) {
+		string_list_push_back(locals, zone, sizeof(zone));
+		if(strcmp(type, "static") == 0)
+			string_list_push_back(statics, zone, sizeof(zone));
+	}
+	if(pclose(fp) != 0) {
+		log_err("%s failed", cmd);
+		nm_connection_list_clear(forwards);
+		string_list_clear(locals);
+		string_list_clear(statics);
+		return 0;
+	}
+	return 1;
+}
+
+/** read the mirror from unbound if it is not valid, and check it against
+ * the zones of unbound every UB_MIRROR_CHECK_SECS */
+static void
+ub_mirror_sync(const char* exe)
+{
+	struct nm_connection_list forwards;
+	struct string_list locals, statics;
+	time_t now = time(NULL);
+	if(ub_mirror.valid && now >= ub_mirror.checked &&
+		now - ub_mirror.checked < UB_MIRROR_CHECK_SECS)
+		return;
+	watchdog_hook_begin("list_forwards and list_local_zones");
+	if(!ub_mirror_list(exe, &forwards, &locals, &statics)) {
+		watchdog_hook_end();
+		ub_mirror_clear();
+		return;
+	}
+	watchdog_hook_end();
+	if(ub_mirror.valid) {
+		if(ub_mirror_checksum(&forwards, &locals, &statics) ==
+			ub_mirror_checksum(&ub_mirror.forwards,
+			&ub_mirror.locals, &ub_mirror.statics)) {
+			nm_connection_list_clear(&forwards);
+			string_list_clear(&locals);
+			string_list_clear(&statics);
+			ub_mirror.checked = now;
+			return;
+		}
+		verbose(VERB_OPS, "the zones of unbound have changed, "
+			"read them again");
+		ub_mirror_clear();
+	} else {
+		verbose(VERB_ALGO, "read the zones of unbound");
+	}
+	ub_mirror.forwards = forwards;
+	ub_mirror.locals = locals;
+	ub_mirror.statics = statics;
+	ub_mirror.checked = now;
+	ub_mirror.valid = 1;
+}
+
+/** a forward zone is added to unbound, or its servers are replaced */
+static void
+ub_mirror_forward_add(const char* zone, const char* servers, int insecure)
+{
+	char name[1024];
+	const char* s = servers, *e;
+	struct nm_connection* c;
+	if(!ub_mirror.valid)
+		return;
+	ub_zone_name(zone, name, sizeof(name));
+	(void)nm_connection_list_remove(&ub_mirror.forwards, name,
+		sizeof(name));
+	c = nm_connection_new(&ub_mirror.forwards);
+	string_list_push_back(&c->zones, name, sizeof(name));
+	c->security = insecure?NM_CON_INSECURE:NM_CON_SECURE;
+	while(*s) {
+		while(*s == ' ')
+			s++;
+		for(e = s; *e && *e != ' '; e++)
+			;
+		if(e > s)
+			string_list_push_back(&c->servers, s, (size_t)(e-s));
+		s = e;
+	}
+	nm_connection_list_push_back(&ub_mirror.forwards, c);
+}
+
+/** a forward zone is removed from unbound */
+static void
+ub_mirror_forward_remove(const char* zone)
+{
+	char name[1024];
+	if(!ub_mirror.valid)
+		return;
+	ub_zone_name(zone, name, sizeof(name));
+	(void)nm_connection_list_remove(&ub_mirror.forwards, name,
+		sizeof(name));
+}
+
+/** a local zone is added to unbound, or its type is changed */
+static void
+ub_mirror_local_add(const char* zone, const char* type)
+{
+	char name[1024];
+	if(!ub_mirror.valid)
+		return;
+	ub_zone_name(zone, name, sizeof(name));
+	if(!string_list_contains(&ub_mirror.locals, name, sizeof(name)))
+		string_list_push_back(&ub_mirror.locals, name, sizeof(name));
+	if(strcmp(type, "static") != 0)
+		string_list_remove(&ub_mirror.statics, name, sizeof(name));
+	else if(!string_list_contains(&ub_mirror.statics, name, sizeof(name)))
+		string_list_push_back(&ub_mirror.statics, name, sizeof(name));
+}
+
+/** a local zone is removed from unbound */
+static void
+ub_mirror_local_remove(const char* zone)
+{
+	char name[1024];
+	if(!ub_mirror.valid)
+		return;
+	ub_zone_name(zone, name, sizeof(name));
+	string_list_remove(&ub_mirror.locals, name, sizeof(name));
+	string_list_remove(&ub_mirror.statics, name, sizeof(name));
+}
+
+/** if the mirror has the local zone, with the type static if asked */
+static int
+ub_mirror_has_local(const char* zone, int statics)
+{
+	char name[1024];
+	ub_zone_name(zone, name, sizeof(name));
+	return string_list_contains(statics?&ub_mirror.statics:
+		&ub_mirror.locals, name, sizeof(name));
+}
+#endif /* FWD_ZONES_SUPPORT */
+
+/** an unbound-control command, performed by a hook worker */
+struct ub_job {
+	/** the command line, or NULL for a trace only */
+	char* command;
+	/** the unbound-control command, for the trace */
+	char cmd[32];
+	/** the arguments of the command */
+	char* args;
+	/** for get_option, the option and where the answer goes */
+	const char* option;
+	/** answer of get_option, if the option is supported */
+	int* supports;
+	/** exit status */
+	int status;
+	/** errno when the status is -1 */
+	int err;
+	/** msec it took */
+	int msec;
+};
+
+/** create the job for the unbound-control command, or NULL on failure */
+static struct ub_job*
+ub_job_create(const char* ctrl, const char* cmd, const char* args)
+{
+	char command[12000];
+	struct ub_job* j = (struct ub_job*)calloc(1, sizeof(*j));
+	if(!j) {
+		log_err("out of memory");
+		return NULL;
+	}
+	snprintf(command, sizeof(command), "%s %s %s", ctrl, cmd, args);
+	j->command = strdup(command);
+	j->args = strdup(args);
+	if(!j->command || !j->args) {
+		log_err("out of memory");
+		free(j->command);
+		free(j->args);
+		free(j);
+		return NULL;
+	}
+	snprintf(j->cmd, sizeof(j->cmd), "%s", cmd);
+	return j;
+}
+
+/** free the job */
+static void
+ub_job_delete(struct ub_job* j)
+{
+	if(!j) return;
+	free(j->command);
+	free(j->args);
+	free(j);
+}
+
+/** run the unbound-control command, in a hook worker */
+static void
+ub_job_run(void* arg)
+{
+	struct ub_job* j = (struct ub_job*)arg;
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	watchdog_hook_begin(j->command);
+#ifdef USE_WINSOCK
+	j->status = win_run_cmd(j->command);
+#else
+	j->status = system(j->command);
+	if(j->status == -1)
+		j->err = errno;
+#endif
+	watchdog_hook_end();
+	j->msec = elapsed_msec(&start);
+#ifdef FWD_ZONES_SUPPORT
+	/* the forwarders of the root are in the list of forward zones */
+	if(strcmp(j->cmd, "forward") == 0) {
+		if(j->status != 0)
+			ub_mirror_failed("forward");
+		else if(strcmp(j->args, "off") == 0)
+			ub_mirror_forward_remove(".");
+		else	ub_mirror_forward_add(".", j->args, 0);
+	}
+#endif
+}
+
+/** the unbound-control command is done, on the event loop */
+static void
+ub_ctrl_done(void* arg)
+{
+	struct ub_job* j = (struct ub_job*)arg;
+	trace_ubctrl(j->cmd, j->status, j->msec);
+#ifndef USE_WINSOCK
+	if(j->status == -1) {
+		log_err("system(%s) failed: %s", j->command,
+			strerror(j->err));
+	} else
+#endif
+	if(j->status != 0) {
+		log_warn("unbound-control exited with status %d, cmd: %s",
+			j->status, j->command);
+	}
+	ub_job_delete(j);
+}
+
+/** record the trace of an unbound-control command, on the event loop */
+static void
+ub_trace_done(void* arg)
+{
+	struct ub_job* j = (struct ub_job*)arg;
+	trace_ubctrl(j->cmd, j->status, j->msec);
+	ub_job_delete(j);
+}
+
+/** record the trace of an unbound-control command that is performed
+ * by a hook worker, the flight recorder is on the event loop */
+static void
+ub_trace(const char* cmd, int status, int msec)
+{
+	struct ub_job* j = (struct ub_job*)calloc(1, sizeof(*j));
+	if(!j) {
+		log_err("out of memory");
+		return;
+	}
+	snprintf(j->cmd, sizeof(j->cmd), "%s", cmd);
+	j->status = status;
+	j->msec = msec;
+	hookq_main(&ub_trace_done, j);
+}
+
 /**
- * Perform the unbound control command.
+ * Perform the unbound control command.  It is submitted to the hook
+ * workers, the commands are performed in order.
  * @param cfg: the config options with the command pathname.
  * @param cmd: the command.
  * @param args: arguments.
@@ -99,12 +498,11 @@ allowed_arg(const char* arg)
 static void
 ub_ctrl(struct cfg* cfg, const char* cmd, const char* args)
 {
-	char command[12000];
 	const char* ctrl = "unbound-control";
 #ifdef USE_WINSOCK
 	char* regctrl = NULL;
 #endif
-	int r;
+	struct ub_job* j;
 	if(cfg->noaction)
 		return;
 #ifdef USE_WINSOCK
@@ -115,21 +513,18 @@ ub_ctrl(struct cfg* cfg, const char* cmd, const char* args)
 	if(cfg->unbound_control)
 		ctrl = cfg->unbound_control;
 	verbose(VERB_ALGO, "system %s %s %s", ctrl, cmd, args);
-	if(!allowed_arg(args)) return;
-	snprintf(command, sizeof(command), "%s %s %s", ctrl, cmd, args);
+	if(!allowed_arg(args)) {
 #ifdef USE_WINSOCK
-	r = win_run_cmd(command);
-	free(regctrl);
-#else
-	r = system(command);
-	if(r == -1) {
-		log_err("system(%s) failed: %s", ctrl, strerror(errno));
-	} else
+		free(regctrl);
 #endif
-	if(r != 0) {
-		log_warn("unbound-control exited with status %d, cmd: %s",
-			r, command);
+		return;
 	}
+	j = ub_job_create(ctrl, cmd, args);
+#ifdef USE_WINSOCK
+	free(regctrl);
+#endif
+	if(!j) return;
+	hookq_submit(hookq_unbound, &ub_job_run, &ub_ctrl_done, j);
 }
 
 static void
@@ -209,41 +604,60 @@ void hook_unbound_dark(struct cfg* cfg)
 	ub_ctrl(cfg, "forward", UNBOUND_DARK_IP); 
 }
 
-static int hook_unbound_supports_option(struct cfg* cfg, const char* args)
+/** the get_option is done, on the event loop */
+static void
+ub_supports_done(void* arg)
+{
+	struct ub_job* j = (struct ub_job*)arg;
+	trace_ubctrl(j->cmd, j->status, j->msec);
+#ifndef USE_WINSOCK
+	if(j->status == -1) {
+		log_err("system(%s) failed: %s", j->command,
+			strerror(j->err));
+	} else
+#endif
+	if(j->status != 0) {
+		verbose(VERB_OPS, "unbound does not support option: %s",
+			j->option);
+	} else {
+		verbose(VERB_OPS, "unbound supports option: %s", j->option);
+	}
+	*j->supports = (j->status == 0);
+	ub_job_delete(j);
+}
+
+/** check if unbound supports the option, the answer is stored when done */
+static void
+ub_check_option(struct cfg* cfg, const char* option, int* supports)
 {
-	char command[12000];
 	const char* ctrl = "unbound-control";
 	const char* cmd = "get_option";
-	int r;
+	struct ub_job* j;
 	if(cfg->unbound_control)
 		ctrl = cfg->unbound_control;
-	verbose(VERB_ALGO, "system %s %s %s", ctrl, cmd, args);
-	if(!allowed_arg(args)) return 0;
-	snprintf(command, sizeof(command), "%s %s %s", ctrl, cmd, args);
-#ifdef USE_WINSOCK
-	r = win_run_cmd(command);
-#else
-	r = system(command);
-	if(r == -1) {
-		log_err("system(%s) failed: %s", ctrl, strerror(errno));
-	} else
-#endif
-	if(r != 0) {
-		verbose(VERB_OPS, "unbound does not support option: %s", args);
-		return 0;
-	}
-	verbose(VERB_OPS, "unbound supports option: %s", args);
-	return 1;
+	verbose(VERB_ALGO, "system %s %s %s", ctrl, cmd, option);
+	if(!allowed_arg(option)) return;
+	if(!(j = ub_job_create(ctrl, cmd, option)))
+		return;
+	j->option = option;
+	j->supports = supports;
+	hookq_submit(hookq_unbound, &ub_job_run, &ub_supports_done, j);
+}
+
+void hook_unbound_check_upstream(struct cfg* cfg)
+{
+	ub_check_option(cfg, "tcp-upstream", &ub_supports_tcp_upstream);
+	ub_check_option(cfg, "ssl-upstream", &ub_supports_ssl_upstream);
 }
 
-int hook_unbound_supports_tcp_upstream(struct cfg* cfg)
+int hook_unbound_supports_tcp_upstream(struct cfg* ATTR_UNUSED(cfg))
 {
-	return hook_unbound_supports_option(cfg, "tcp-upstream");
+	return ub_supports_tcp_upstream;
 }
 
-int hook_unbound_supports_ssl_upstream(struct cfg* cfg)
+int hook_unbound_supports_ssl_upstream(struct cfg* ATTR_UNUSED(cfg))
 {
-	return hook_unbound_supports_option(cfg, "ssl-upstream");
+	return ub_supports_ssl_upstream;
 }
 
 static void append_str_port(char* buf, char** now, size_t* left,
@@ -336,16 +750,32 @@ void hook_unbound_ssl_upstream(struct cfg* cfg, int ssl443_ip4, int ssl443_ip6)
 
 #ifdef FWD_ZONES_SUPPORT
 
-struct nm_connection_list hook_unbound_list_forwards(struct cfg* cfg) {
-	FILE *fp;
+struct nm_connection_list hook_unbound_list_forwards(struct cfg* ATTR_UNUSED(cfg),
+	struct region* region) {
+	struct string_buffer exe = string_builder("unbound-control");
+	return hook_unbound_list_forwards_mirror(exe, region);
+}
+
+struct nm_connection_list hook_unbound_list_forwards_mirror(
+	struct string_buffer exe, struct region* region) {
 	struct nm_connection_list ret;
-	fp = popen("unbound-control list_forwards", "r");
-	ret = hook_unbound_list_forwards_inner(cfg, fp);
-	pclose(fp);
+	struct nm_connection_node* n;
+	ub_mirror_sync(exe.string);
+	/* a copy, the caller changes and frees it */
+	nm_connection_list_init_region(&ret, region);
+	if(ub_mirror.valid) {
+		for(n = ub_mirror.forwards.first; n; n = n->next)
+			nm_connection_list_copy_and_push_back(&ret, n->self);
+	}
 	return ret;
 }
 
-struct nm_connection_list hook_unbound_list_forwards_inner(struct cfg* ATTR_UNUSED(cfg), FILE *fp) {
+void hook_unbound_mirror_clear(void) {
+	ub_mirror_clear();
+}
+
+struct nm_connection_list hook_unbound_list_forwards_inner(struct cfg* ATTR_UNUSED(cfg),
+	FILE *fp, struct region* region) {
 	// TODO: is there any other output??
 	// Format: <ZONE> IN forward [+i] <list of addresses>
 	
@@ -355,7 +785,7 @@ struct nm_connection_list hook_unbound_list_forwards_inner(struct cfg* ATTR_UNUS
 	size_t line_len = 1024;
 	ssize_t read_len = 0;
 	char *line = (char *)calloc_or_die(line_len);
-	nm_connection_list_init(&ret);
+	nm_connection_list_init_region(&ret, region);
 	memset(line, 0, line_len);
 	while ((read_len = getline(&line, &line_len, fp) != -1)){
 		// XXX: line len is always 1??
@@ -363,8 +793,8 @@ struct nm_connection_list hook_unbound_list_forwards_inner(struct cfg* ATTR_UNUS
 		int parser_state = 0;
 		size_t start = 0;
 		int run = 1;
-		new = (struct nm_connection *) calloc_or_die(sizeof(struct nm_connection));
-		nm_connection_init(new);
+		new = nm_connection_new(&ret);
+		new->security = NM_CON_SECURE;
 		while(run) {
 			switch (parser_state) {
 				case 0:
@@ -388,6 +818,7 @@ struct nm_connection_list hook_unbound_list_forwards_inner(struct cfg* ATTR_UNUS
 					if (line[i] == '+') {
 						i += 3;
 						// INSECURE
+						new->security = NM_CON_INSECURE;
 					} else {
 						start = i;
 						while (line[i] != ' ' && line[i] != '\n') {
@@ -440,12 +871,26 @@ struct string_list hook_unbound_list_local_zones_inner(struct cfg* ATTR_UNUSED(c
 static int run_unbound_control(char *cmd) {
 	FILE *fp;
 	int ret = -1;
-	
+	struct timeval start;
+	const char *name = strchr(cmd, ' ');
+	char buf[64];
+
+	gettimeofday(&start, NULL);
+	watchdog_hook_begin(cmd);
 	fp = popen(cmd, "r");
-	if (fscanf(fp, "ok\n") != -1) {
+	if (fp == NULL) {
+		log_err("popen(%s) failed: %s", cmd, strerror(errno));
+		watchdog_hook_end();
+		return -1;
+	}
+	/* the command succeeded if it says ok, the mirror of the zones
+	 * follows it */
+	if (fgets(buf, sizeof(buf), fp) != NULL && strcmp(buf, "ok\n") == 0) {
 		ret = 0;
 	}
 	pclose(fp);
+	watchdog_hook_end();
+	ub_trace(name?name+1:cmd, ret, elapsed_msec(&start));
 	return ret;
 }
 
@@ -474,7 +919,12 @@ int hook_unbound_add_forward_zone_inner(struct string_buffer exe, struct string_
 	if(!allowed_arg(zone.string)) return 0;
 	if(!allowed_arg(servers.string)) return 0;
 	snprintf(cmd, sizeof(cmd), "%s forward_add +i %s %s", exe.string, zone.string, servers.string);
-	return run_unbound_control(cmd);
+	if (run_unbound_control(cmd) != 0) {
+		ub_mirror_failed("forward_add");
+		return -1;
+	}
+	ub_mirror_forward_add(zone.string, servers.string, 1);
+	return 0;
 }
 
 int hook_unbound_remove_forward_zone(struct string_buffer zone) {
@@ -486,7 +936,12 @@ int hook_unbound_remove_forward_zone_inner(struct string_buffer exe, struct stri
 	char cmd[4000] = {'\0'};
 	if(!allowed_arg(zone.string)) return 0;
 	snprintf(cmd, sizeof(cmd), "%s forward_remove %s", exe.string, zone.string);
-	return run_unbound_control(cmd);
+	if (run_unbound_control(cmd) != 0) {
+		ub_mirror_failed("forward_remove");
+		return -1;
+	}
+	ub_mirror_forward_remove(zone.string);
+	return 0;
 }
 
 int hook_unbound_add_local_zone(struct string_buffer zone, struct string_buffer type) {
@@ -498,8 +953,18 @@ int hook_unbound_add_local_zone_inner(struct string_buffer exe, struct string_bu
 	char cmd[1000] = {'\0'};
 	if(!allowed_arg(zone.string)) return 0;
 	if(!allowed_arg(type.string)) return 0;
+	if (ub_mirror.valid && strcmp(type.string, "static") == 0 &&
+		ub_mirror_has_local(zone.string, 1)) {
+		verbose(VERB_ALGO, "local zone %s is already static", zone.string);
+		return 0;
+	}
 	snprintf(cmd, sizeof(cmd), "%s local_zone %s %s", exe.string, zone.string, type.string);
-	return run_unbound_control(cmd);
+	if (run_unbound_control(cmd) != 0) {
+		ub_mirror_failed("local_zone");
+		return -1;
+	}
+	ub_mirror_local_add(zone.string, type.string);
+	return 0;
 }
 
 int hook_unbound_remove_local_zone(struct string_buffer zone) {
@@ -510,8 +975,17 @@ int hook_unbound_remove_local_zone(struct string_buffer zone) {
 int hook_unbound_remove_local_zone_inner(struct string_buffer exe, struct string_buffer zone) {
 	char cmd[1000] = {'\0'};
 	if(!allowed_arg(zone.string)) return 0;
+	if (ub_mirror.valid && !ub_mirror_has_local(zone.string, 0)) {
+		verbose(VERB_ALGO, "local zone %s is not there to remove", zone.string);
+		return 0;
+	}
 	snprintf(cmd, sizeof(cmd), "%s local_zone_remove %s", exe.string, zone.string);
-	return run_unbound_control(cmd);
+	if (run_unbound_control(cmd) != 0) {
+		ub_mirror_failed("local_zone_remove");
+		return -1;
+	}
+	ub_mirror_local_remove(zone.string);
+	return 0;
 }
 
 #endif
@@ -82,15 +82,25 @@ void hook_unbound_dark(struct cfg* cfg);
  * donotquery 127.0.0.0/8 by default */
 #define UNBOUND_DARK_IP "127.0.0.127"
 
+/**
+ * Check if unbound supports the tcp-upstream and ssl-upstream options.
+ * The check is performed by the hook workers, and the answer is stored
+ * for hook_unbound_supports_tcp_upstream and _ssl_upstream.
+ * @param cfg: the config options.
+ */
+void hook_unbound_check_upstream(struct cfg* cfg);
+
 /**
  * Detect if unbound supports the tcp-upstream option (since 1.4.13).
  * @param cfg: the config options.
+ * @return the answer of the last check, true if not checked yet.
  */
 int hook_unbound_supports_tcp_upstream(struct cfg* cfg);
 
 /**
  * Detect if unbound supports the ssl-upstream option (since 1.4.14).
  * @param cfg: the config options.
+ * @return the answer of the last check, true if not checked yet.
  */
 int hook_unbound_supports_ssl_upstream(struct cfg* cfg);
 
@@ -116,14 +126,33 @@ void hook_unbound_ssl_upstream(struct cfg* cfg, int ssl443_ip4, int ssl443_ip6);
 #ifdef FWD_ZONES_SUPPORT
 
 /**
- * Run unbound list_forwards and parse output into the return structure
+ * List the forward zones of unbound.  They are copied from the mirror of
+ * the zones of unbound, that the commands we perform keep up to date; it is
+ * read with unbound-control list_forwards and list_local_zones at first,
+ * after a failed command and when a periodic check finds it has changed.
+ * Used by the unbound hook worker.
+ * The list is allocated from the region, or the heap if that is NULL.
+ */
+struct nm_connection_list hook_unbound_list_forwards(struct cfg* cfg,
+	struct region* region);
+
+/**
+ * For testing purposes only.  With the unbound-control executable.
+ */
+struct nm_connection_list hook_unbound_list_forwards_mirror(
+	struct string_buffer exe, struct region* region);
+
+/**
+ * Forget the mirror of the zones of unbound, it is read again when it is
+ * used next.  Frees it, at exit.
  */
-struct nm_connection_list hook_unbound_list_forwards(struct cfg* cfg);
+void hook_unbound_mirror_clear(void);
 
 /**
  * For testing purposes only.
  */
-struct nm_connection_list hook_unbound_list_forwards_inner(struct cfg* cfg, FILE *fp);
+struct nm_connection_list hook_unbound_list_forwards_inner(struct cfg* cfg,
+	FILE *fp, struct region* region);
 
 /**
  * Run unbound list_local_zones and parse output into the return structure
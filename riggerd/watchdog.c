@@ -0,0 +1,425 @@
+/*
+ * watchdog.c - dnssec-trigger stall detector of the event loop
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the watchdog of the event loop.
+ */
+#include "config.h"
+#include <sys/time.h>
+#include <time.h>
+#include "watchdog.h"
+#include "log.h"
+#include "fptr_wlist.h"
+#include "memstats.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+int watchdog_on = 0;
+
+#ifdef HAVE_PTHREAD
+/** length of the hook command that is kept */
+#define WATCHDOG_HOOK_LEN 64
+
+/** a stall, as it was seen */
+struct watchdog_stall {
+	/** the callback that ran */
+	void (*func)(void);
+	/** the number of the callback in the event loop */
+	unsigned id;
+	/** msec it ran when it was seen, the total when it is done */
+	int msec;
+	/** the DNS queries that were outstanding */
+	int outq;
+	/** the last hook command */
+	char hook[WATCHDOG_HOOK_LEN];
+	/** if the hook command was running */
+	int hook_busy;
+	/** when it was seen */
+	time_t when;
+};
+
+/**
+ * The watchdog.  The event loop marks the callbacks with atomic stores,
+ * busy, since and func, and takes no lock; the watchdog thread reads busy
+ * before and after since and func, so they belong to that callback.
+ * The lock protects the rest, the event loop takes it only at the end
+ * of a stall.
+ */
+static struct watchdog {
+	/** the watchdog thread */
+	pthread_t thr;
+	/** if the thread has to stop */
+	int stop;
+	/** msec that a callback can run */
+	int threshold;
+	/** number of the last callback, only used by the event loop */
+	unsigned id;
+	/** number of the callback that runs, 0 if none, atomic */
+	unsigned busy;
+	/** when the callback started, msec, atomic */
+	long long since;
+	/** the callback, atomic */
+	void (*func)(void);
+	/** number of the callback that is counted as a stall, atomic */
+	unsigned stalled;
+	/** the callback whose stall is over, and its total msec */
+	unsigned done;
+	/** the total msec of the done stall */
+	int done_msec;
+	/** the last hook command */
+	char hook[WATCHDOG_HOOK_LEN];
+	/** if the hook command runs */
+	int hook_busy;
+	/** number of stalls */
+	unsigned stalls;
+	/** the longest stall, msec */
+	int max_msec;
+	/** the last stall */
+	struct watchdog_stall last;
+	/** when a stall was last logged */
+	time_t last_log;
+	/** stalls since then that were not logged */
+	unsigned not_logged;
+} watchdog;
+
+/** lock for the watchdog, the hooks use it when it is not started */
+static pthread_mutex_t watchdog_lock = PTHREAD_MUTEX_INITIALIZER;
+/** the watchdog thread waits on this, it is set up when it starts */
+static pthread_cond_t watchdog_cond;
+
+/** msec on the monotonic clock, so that a change of the system time is
+ * not a stall; the wall clock if there is no monotonic clock */
+static long long
+watchdog_now(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec*1000 + tv.tv_usec/1000;
+#endif
+}
+
+/** if the condition waits on the monotonic clock */
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC) && defined(HAVE_PTHREAD_CONDATTR_SETCLOCK)
+#define WATCHDOG_COND_MONOTONIC 1
+#endif
+
+/** setup the condition, on the monotonic clock if possible */
+static void
+watchdog_cond_init(void)
+{
+#ifdef WATCHDOG_COND_MONOTONIC
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&watchdog_cond, &attr);
+	pthread_condattr_destroy(&attr);
+#else
+	pthread_cond_init(&watchdog_cond, NULL);
+#endif
+}
+
+/** the time msec from now, on the clock of the condition */
+static void
+watchdog_deadline(struct timespec* ts, int msec)
+{
+#ifdef WATCHDOG_COND_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, ts);
+#else
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	ts->tv_sec = now.tv_sec;
+	ts->tv_nsec = now.tv_usec*1000;
+#endif
+	ts->tv_sec += msec/1000;
+	ts->tv_nsec += (msec%1000)*1000000;
+	if(ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/** the name of the function, in buf if it is not in the whitelist */
+static const char*
+watchdog_name(void (*func)(void), char* buf, size_t len)
+{
+	const char* name = fptr_whitelist_name(func);
+	if(name)
+		return name;
+	snprintf(buf, len, "%p", (void*)(size_t)func);
+	return buf;
+}
+
+/** log the stall */
+static void
+watchdog_log(struct watchdog_stall* s, unsigned not_logged)
+{
+	char buf[32], more[64];
+	more[0] = 0;
+	if(not_logged)
+		snprintf(more, sizeof(more), ", and %u stalls not logged",
+			not_logged);
+	log_warn("event loop stall: %s runs for %d msec, %d DNS queries "
+		"outstanding, last hook: %s (%s)%s",
+		watchdog_name(s->func, buf, sizeof(buf)), s->msec, s->outq,
+		s->hook[0]?s->hook:"none", s->hook_busy?"running":"done",
+		more);
+}
+
+/** the watchdog thread, checks the callbacks until stopped */
+static void*
+watchdog_thread(void* ATTR_UNUSED(arg))
+{
+	struct watchdog_stall s;
+	struct timespec ts;
+	size_t bytes, num, max_bytes, max_num;
+	unsigned not_logged = 0, id;
+	void (*func)(void);
+	long long since;
+	time_t now;
+	int check, msec, log_it;
+	pthread_mutex_lock(&watchdog_lock);
+	while(!watchdog.stop) {
+		check = watchdog.threshold/4;
+		if(check < WATCHDOG_CHECK_MIN)
+			check = WATCHDOG_CHECK_MIN;
+		if(check > WATCHDOG_CHECK_MAX)
+			check = WATCHDOG_CHECK_MAX;
+		watchdog_deadline(&ts, check);
+		pthread_cond_timedwait(&watchdog_cond, &watchdog_lock, &ts);
+		if(watchdog.stop)
+			break;
+		id = __atomic_load_n(&watchdog.busy, __ATOMIC_ACQUIRE);
+		if(id == 0 || id == __atomic_load_n(&watchdog.stalled,
+			__ATOMIC_RELAXED))
+			continue;
+		since = __atomic_load_n(&watchdog.since, __ATOMIC_ACQUIRE);
+		func = __atomic_load_n(&watchdog.func, __ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&watchdog.busy, __ATOMIC_ACQUIRE) != id)
+			continue; /* it is done, since can be the next one */
+		msec = (int)(watchdog_now() - since);
+		if(msec < watchdog.threshold)
+			continue;
+		/* a stall, the callback runs too long */
+		__atomic_store_n(&watchdog.stalled, id, __ATOMIC_RELEASE);
+		watchdog.stalls++;
+		if(msec > watchdog.max_msec)
+			watchdog.max_msec = msec;
+		memset(&s, 0, sizeof(s));
+		s.func = func;
+		s.id = id;
+		s.msec = msec;
+		memmove(s.hook, watchdog.hook, sizeof(s.hook));
+		s.hook_busy = watchdog.hook_busy;
+		now = time(NULL);
+		s.when = now;
+		log_it = (now >= watchdog.last_log + WATCHDOG_LOG_SECS);
+		if(log_it) {
+			not_logged = watchdog.not_logged;
+			watchdog.not_logged = 0;
+			watchdog.last_log = now;
+		} else	watchdog.not_logged++;
+		pthread_mutex_unlock(&watchdog_lock);
+
+		/* the memstats lock is not taken with ours */
+		memstats_get(memstats_outq, &bytes, &num, &max_bytes,
+			&max_num);
+		s.outq = (int)num;
+		if(log_it)
+			watchdog_log(&s, not_logged);
+
+		pthread_mutex_lock(&watchdog_lock);
+		/* the callback can be done, it has set the total msec */
+		if(watchdog.done == id)
+			s.msec = watchdog.done_msec;
+		watchdog.last = s;
+	}
+	pthread_mutex_unlock(&watchdog_lock);
+	return NULL;
+}
+#endif /* HAVE_PTHREAD */
+
+int watchdog_start(int threshold)
+{
+#ifdef HAVE_PTHREAD
+	int r;
+	if(threshold <= 0) {
+		watchdog_stop();
+		return 1;
+	}
+	pthread_mutex_lock(&watchdog_lock);
+	watchdog.threshold = threshold;
+	if(watchdog_on) {
+		pthread_cond_signal(&watchdog_cond);
+		pthread_mutex_unlock(&watchdog_lock);
+		return 1;
+	}
+	watchdog.stop = 0;
+	watchdog.busy = 0;
+	watchdog.stalled = 0;
+	watchdog.done = 0;
+	pthread_mutex_unlock(&watchdog_lock);
+	watchdog_cond_init();
+	if((r=pthread_create(&watchdog.thr, NULL, watchdog_thread, NULL))
+		!= 0) {
+		log_err("could not start watchdog thread: %s", strerror(r));
+		pthread_cond_destroy(&watchdog_cond);
+		return 0;
+	}
+	watchdog_on = 1;
+	verbose(VERB_ALGO, "started watchdog, stall threshold %d msec",
+		threshold);
+	return 1;
+#else
+	if(threshold > 0)
+		verbose(VERB_OPS, "no threads, no watchdog for stalls");
+	return threshold <= 0;
+#endif /* HAVE_PTHREAD */
+}
+
+void watchdog_stop(void)
+{
+#ifdef HAVE_PTHREAD
+	if(!watchdog_on)
+		return;
+	pthread_mutex_lock(&watchdog_lock);
+	watchdog.stop = 1;
+	pthread_cond_signal(&watchdog_cond);
+	pthread_mutex_unlock(&watchdog_lock);
+	pthread_join(watchdog.thr, NULL);
+	pthread_cond_destroy(&watchdog_cond);
+	watchdog_on = 0;
+#endif /* HAVE_PTHREAD */
+}
+
+void watchdog_enter(void (*func)(void))
+{
+#ifdef HAVE_PTHREAD
+	if(!watchdog_on)
+		return;
+	if(++watchdog.id == 0)
+		watchdog.id = 1; /* 0 is for no callback */
+	__atomic_store_n(&watchdog.since, watchdog_now(), __ATOMIC_RELEASE);
+	__atomic_store_n(&watchdog.func, func, __ATOMIC_RELEASE);
+	__atomic_store_n(&watchdog.busy, watchdog.id, __ATOMIC_RELEASE);
+#else
+	(void)func;
+#endif /* HAVE_PTHREAD */
+}
+
+void watchdog_leave(void)
+{
+#ifdef HAVE_PTHREAD
+	char buf[32];
+	int msec;
+	if(!watchdog_on)
+		return;
+	__atomic_store_n(&watchdog.busy, 0, __ATOMIC_RELEASE);
+	/* if the stall is marked just now, it keeps the msec it was seen */
+	if(__atomic_load_n(&watchdog.stalled, __ATOMIC_ACQUIRE) !=
+		watchdog.id)
+		return;
+	/* the stall is over, record how long it was */
+	msec = (int)(watchdog_now() - watchdog.since);
+	pthread_mutex_lock(&watchdog_lock);
+	watchdog.done = watchdog.id;
+	watchdog.done_msec = msec;
+	if(watchdog.last.id == watchdog.id)
+		watchdog.last.msec = msec;
+	if(msec > watchdog.max_msec)
+		watchdog.max_msec = msec;
+	pthread_mutex_unlock(&watchdog_lock);
+	verbose(VERB_ALGO, "event loop stall over, %s ran %d msec",
+		watchdog_name(watchdog.func, buf, sizeof(buf)), msec);
+#endif /* HAVE_PTHREAD */
+}
+
+void watchdog_hook_begin(const char* cmd)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&watchdog_lock);
+	snprintf(watchdog.hook, sizeof(watchdog.hook), "%s", cmd);
+	watchdog.hook_busy = 1;
+	pthread_mutex_unlock(&watchdog_lock);
+#else
+	(void)cmd;
+#endif /* HAVE_PTHREAD */
+}
+
+void watchdog_hook_end(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&watchdog_lock);
+	watchdog.hook_busy = 0;
+	pthread_mutex_unlock(&watchdog_lock);
+#endif /* HAVE_PTHREAD */
+}
+
+int watchdog_print(ldns_buffer* buf)
+{
+#ifdef HAVE_PTHREAD
+	struct watchdog_stall s;
+	unsigned stalls;
+	int threshold, max_msec;
+	char name[32];
+	if(!watchdog_on)
+		return ldns_buffer_printf(buf, "watchdog off\n") != -1;
+	pthread_mutex_lock(&watchdog_lock);
+	s = watchdog.last;
+	stalls = watchdog.stalls;
+	threshold = watchdog.threshold;
+	max_msec = watchdog.max_msec;
+	pthread_mutex_unlock(&watchdog_lock);
+	if(ldns_buffer_printf(buf, "stalls: %u over %d msec, longest %d "
+		"msec\n", stalls, threshold, max_msec) == -1)
+		return 0;
+	if(!stalls)
+		return 1;
+	return ldns_buffer_printf(buf, "last stall: %s ran %d msec, %d DNS "
+		"queries outstanding, last hook: %s (%s), %d sec ago\n",
+		watchdog_name(s.func, name, sizeof(name)), s.msec, s.outq,
+		s.hook[0]?s.hook:"none", s.hook_busy?"running":"done",
+		(int)(time(NULL) - s.when)) != -1;
+#else
+	return ldns_buffer_printf(buf, "watchdog off\n") != -1;
+#endif /* HAVE_PTHREAD */
+}
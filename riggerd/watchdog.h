@@ -0,0 +1,99 @@
+/*
+ * watchdog.h - dnssec-trigger stall detector of the event loop
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the watchdog of the event loop.  The event loop marks
+ * the start and the end of every callback, with the time on the monotonic
+ * clock and the function, with atomic stores and without a lock.
+ * A thread checks on it, and when a callback runs longer than the
+ * threshold, it is a stall: the callback, the DNS queries that are
+ * outstanding and the last hook command are recorded, a warning is
+ * logged, at most once a minute, and the stall is counted.
+ *
+ * Without threads the watchdog is not there, watchdog_on stays false.
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+#include <ldns/buffer.h>
+
+/** the stall warning is logged at most once per this many seconds */
+#define WATCHDOG_LOG_SECS 60
+/** the watchdog checks at least this often, msec */
+#define WATCHDOG_CHECK_MAX 1000
+/** the watchdog checks at most this often, msec */
+#define WATCHDOG_CHECK_MIN 10
+
+/** if the watchdog is running, read by the event loop */
+extern int watchdog_on;
+
+/**
+ * Start the watchdog thread, or set the threshold if it runs.
+ * @param threshold: msec that a callback can run, 0 stops the watchdog.
+ * @return false on failure.
+ */
+int watchdog_start(int threshold);
+
+/** stop the watchdog thread */
+void watchdog_stop(void);
+
+/**
+ * The event loop starts a callback.  Call when watchdog_on.
+ * @param func: the callback, cast, for the name in the report.
+ */
+void watchdog_enter(void (*func)(void));
+
+/** The event loop is done with the callback. */
+void watchdog_leave(void);
+
+/**
+ * A hook command starts, in a hook worker or on the event loop.
+ * @param cmd: the command, copied.
+ */
+void watchdog_hook_begin(const char* cmd);
+
+/** The hook command is done. */
+void watchdog_hook_end(void);
+
+/**
+ * Print the stall counts and the last stall.
+ * @param buf: printed into, at the position.
+ * @return false if it did not fit.
+ */
+int watchdog_print(ldns_buffer* buf);
+
+#endif /* WATCHDOG_H */
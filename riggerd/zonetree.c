@@ -0,0 +1,285 @@
+/*
+ * zonetree.c - dnssec-trigger tree of zone names
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the tree of zone names.
+ */
+#include "config.h"
+#include <ctype.h>
+#include "zonetree.h"
+
+int zone_key_make(struct zone_key* key, const char* name, size_t len)
+{
+	size_t i, start;
+	int n = 0;
+	uint8_t off[ZONE_LABS_MAX], lablen[ZONE_LABS_MAX];
+	len = strnlen(name, len);
+	/* the trailing dot, and the root itself, have no label */
+	if(len > 0 && name[len-1] == '.')
+		len--;
+	if(len >= ZONE_NAME_MAX)
+		return 0;
+	for(i=0; i<len; i++)
+		key->name[i] = (char)tolower((unsigned char)name[i]);
+	key->name[len] = 0;
+	key->len = len;
+	key->labs = 0;
+	if(len == 0)
+		return 1;
+	/* the labels from the left, then stored from the root side */
+	start = 0;
+	for(i=0; i<=len; i++) {
+		if(i < len && key->name[i] != '.')
+			continue;
+		if(i == start || i - start > 63 || n >= ZONE_LABS_MAX)
+			return 0;
+		off[n] = (uint8_t)start;
+		lablen[n] = (uint8_t)(i - start);
+		n++;
+		start = i+1;
+	}
+	key->labs = n;
+	for(i=0; i<(size_t)n; i++) {
+		key->lab_off[i] = off[n-1-i];
+		key->lab_len[i] = lablen[n-1-i];
+	}
+	return 1;
+}
+
+/** compare a label with the label of a node */
+static int
+label_cmp(const char* lab, size_t len, struct zonetree_node* n)
+{
+	int c = memcmp(lab, n->label, len<n->len?len:n->len);
+	if(c != 0)
+		return c;
+	if(len == n->len)
+		return 0;
+	return len<n->len?-1:1;
+}
+
+/** find the child of a node with the label, or where it goes in kids */
+static struct zonetree_node*
+kid_find(struct zonetree_node* n, const char* lab, size_t len, size_t* pos)
+{
+	size_t lo = 0, hi = n->num_kids, mid;
+	int c;
+	while(lo < hi) {
+		mid = lo + (hi-lo)/2;
+		c = label_cmp(lab, len, n->kids[mid]);
+		if(c == 0) {
+			*pos = mid;
+			return n->kids[mid];
+		}
+		if(c < 0)
+			hi = mid;
+		else	lo = mid+1;
+	}
+	*pos = lo;
+	return NULL;
+}
+
+/** add a child to a node, at the position, or NULL if out of memory */
+static struct zonetree_node*
+kid_add(struct zonetree_node* n, const char* lab, size_t len, size_t pos)
+{
+	struct zonetree_node* k;
+	if(n->num_kids == n->max_kids) {
+		size_t max = n->max_kids?n->max_kids*2:4;
+		struct zonetree_node** kids = (struct zonetree_node**)realloc(
+			n->kids, max*sizeof(*kids));
+		if(!kids)
+			return NULL;
+		n->kids = kids;
+		n->max_kids = max;
+	}
+	k = (struct zonetree_node*)calloc(1, sizeof(*k));
+	if(!k)
+		return NULL;
+	k->label = (char*)malloc(len);
+	if(!k->label) {
+		free(k);
+		return NULL;
+	}
+	memmove(k->label, lab, len);
+	k->len = len;
+	k->parent = n;
+	memmove(n->kids+pos+1, n->kids+pos,
+		(n->num_kids-pos)*sizeof(*n->kids));
+	n->kids[pos] = k;
+	n->num_kids++;
+	return k;
+}
+
+/** free the nodes below a node */
+static void
+node_free_kids(struct zonetree_node* n)
+{
+	size_t i;
+	for(i=0; i<n->num_kids; i++) {
+		node_free_kids(n->kids[i]);
+		free(n->kids[i]->label);
+		free(n->kids[i]);
+	}
+	free(n->kids);
+	n->kids = NULL;
+	n->num_kids = 0;
+	n->max_kids = 0;
+}
+
+struct zonetree* zonetree_create(void)
+{
+	return (struct zonetree*)calloc(1, sizeof(struct zonetree));
+}
+
+void zonetree_delete(struct zonetree* tree)
+{
+	if(!tree)
+		return;
+	node_free_kids(&tree->root);
+	free(tree);
+}
+
+/** walk down to the node of the key; NULL if it is not there */
+static struct zonetree_node*
+node_walk(struct zonetree* tree, struct zone_key* key)
+{
+	struct zonetree_node* n = &tree->root;
+	size_t pos;
+	int i;
+	for(i=0; i<key->labs && n; i++)
+		n = kid_find(n, key->name+key->lab_off[i], key->lab_len[i],
+			&pos);
+	return n;
+}
+
+struct zonetree_node* zonetree_insert(struct zonetree* tree, const char* name,
+	size_t len, void* data)
+{
+	struct zone_key key;
+	struct zonetree_node* n, *k;
+	size_t pos;
+	int i;
+	if(!zone_key_make(&key, name, len))
+		return NULL;
+	n = &tree->root;
+	for(i=0; i<key.labs; i++) {
+		k = kid_find(n, key.name+key.lab_off[i], key.lab_len[i], &pos);
+		if(!k) {
+			k = kid_add(n, key.name+key.lab_off[i],
+				key.lab_len[i], pos);
+			if(!k)
+				return NULL;
+		}
+		n = k;
+	}
+	if(!n->is_zone)
+		tree->count++;
+	n->is_zone = 1;
+	n->data = data;
+	return n;
+}
+
+void* zonetree_remove(struct zonetree* tree, const char* name, size_t len)
+{
+	struct zone_key key;
+	struct zonetree_node* n, *p;
+	void* data;
+	size_t pos;
+	if(!zone_key_make(&key, name, len))
+		return NULL;
+	n = node_walk(tree, &key);
+	if(!n || !n->is_zone)
+		return NULL;
+	data = n->data;
+	n->is_zone = 0;
+	n->data = NULL;
+	tree->count--;
+	/* remove the nodes that are left without zones */
+	while(n->parent && !n->is_zone && n->num_kids == 0) {
+		p = n->parent;
+		(void)kid_find(p, n->label, n->len, &pos);
+		memmove(p->kids+pos, p->kids+pos+1,
+			(p->num_kids-pos-1)*sizeof(*p->kids));
+		p->num_kids--;
+		free(n->kids);
+		free(n->label);
+		free(n);
+		n = p;
+	}
+	return data;
+}
+
+struct zonetree_node* zonetree_lookup(struct zonetree* tree, const char* name,
+	size_t len)
+{
+	struct zone_key key;
+	struct zonetree_node* n;
+	if(!zone_key_make(&key, name, len))
+		return NULL;
+	n = node_walk(tree, &key);
+	if(!n || !n->is_zone)
+		return NULL;
+	return n;
+}
+
+struct zonetree_node* zonetree_cover(struct zonetree* tree, const char* name,
+	size_t len, int strict)
+{
+	struct zone_key key;
+	struct zonetree_node* n = &tree->root, *cover = NULL;
+	size_t pos;
+	int i, labs;
+	if(!zone_key_make(&key, name, len))
+		return NULL;
+	labs = key.labs;
+	if(strict) {
+		if(labs == 0)
+			return NULL;
+		labs--;
+	}
+	if(n->is_zone)
+		cover = n;
+	for(i=0; i<labs; i++) {
+		n = kid_find(n, key.name+key.lab_off[i], key.lab_len[i], &pos);
+		if(!n)
+			break;
+		if(n->is_zone)
+			cover = n;
+	}
+	return cover;
+}
@@ -0,0 +1,163 @@
+/*
+ * zonetree.h - dnssec-trigger tree of zone names
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the tree of zone names.  The names are made canonical,
+ * in lowercase and without the trailing dot, so that "Corp.Example." and
+ * "corp.example" are the same zone.  The tree has a node per label, from
+ * the root down, so a lookup takes a step per label of the name, and the
+ * closest enclosing zone of a name is found on the way down.
+ *
+ * The names are in presentation format, escapes are not interpreted.
+ */
+
+#ifndef ZONETREE_H
+#define ZONETREE_H
+
+/** length of the longest zone name, in presentation format */
+#define ZONE_NAME_MAX 256
+/** the most labels in a zone name */
+#define ZONE_LABS_MAX 128
+
+/**
+ * A canonical zone name.  The labels are indexed from the root side, the
+ * first label is the top level domain.
+ */
+struct zone_key {
+	/** the name in lowercase, without the trailing dot, "" for the root */
+	char name[ZONE_NAME_MAX];
+	/** length of the name */
+	size_t len;
+	/** number of labels, 0 for the root */
+	int labs;
+	/** offset of the labels in name, from the root side */
+	uint8_t lab_off[ZONE_LABS_MAX];
+	/** length of the labels */
+	uint8_t lab_len[ZONE_LABS_MAX];
+};
+
+/**
+ * A node in the tree, for a label.  It is a zone if it was inserted, or
+ * only the parent of zones below it.
+ */
+struct zonetree_node {
+	/** parent node, NULL for the root */
+	struct zonetree_node* parent;
+	/** the label, lowercase; not terminated */
+	char* label;
+	/** length of the label */
+	size_t len;
+	/** the child nodes, sorted by label */
+	struct zonetree_node** kids;
+	/** number of child nodes */
+	size_t num_kids;
+	/** allocated size of kids */
+	size_t max_kids;
+	/** if the node is a zone in the tree */
+	int is_zone;
+	/** the data of the zone, for the user of the tree */
+	void* data;
+};
+
+/**
+ * The tree of zones.
+ */
+struct zonetree {
+	/** the root node */
+	struct zonetree_node root;
+	/** number of zones in the tree */
+	size_t count;
+};
+
+/**
+ * Make the canonical key of a zone name.
+ * @param key: the key that is made.
+ * @param name: the zone name, with or without the trailing dot.
+ * @param len: the length of the name, it can be terminated before that.
+ * @return false if the name is too long or has an empty label.
+ */
+int zone_key_make(struct zone_key* key, const char* name, size_t len);
+
+/** create an empty tree, or NULL if out of memory */
+struct zonetree* zonetree_create(void);
+
+/** delete the tree, the data is not freed */
+void zonetree_delete(struct zonetree* tree);
+
+/**
+ * Insert a zone, or set the data of the zone if it is in the tree.
+ * @param tree: the tree.
+ * @param name: the zone name.
+ * @param len: the length of the name.
+ * @param data: the data for the zone.
+ * @return the node of the zone, or NULL if out of memory or a bad name.
+ */
+struct zonetree_node* zonetree_insert(struct zonetree* tree, const char* name,
+	size_t len, void* data);
+
+/**
+ * Remove a zone.
+ * @param tree: the tree.
+ * @param name: the zone name.
+ * @param len: the length of the name.
+ * @return the data of the zone, or NULL if it was not in the tree.
+ */
+void* zonetree_remove(struct zonetree* tree, const char* name, size_t len);
+
+/**
+ * Find a zone.
+ * @param tree: the tree.
+ * @param name: the zone name.
+ * @param len: the length of the name.
+ * @return the node of the zone, or NULL if it is not in the tree.
+ */
+struct zonetree_node* zonetree_lookup(struct zonetree* tree, const char* name,
+	size_t len);
+
+/**
+ * Find the closest enclosing zone of a name, the zone with the longest
+ * suffix of the name in the tree.
+ * @param tree: the tree.
+ * @param name: the name.
+ * @param len: the length of the name.
+ * @param strict: if true, the name itself is not a match, only its parents.
+ * @return the node of the zone, or NULL if no zone encloses the name.
+ */
+struct zonetree_node* zonetree_cover(struct zonetree* tree, const char* name,
+	size_t len, int strict);
+
+#endif /* ZONETREE_H */
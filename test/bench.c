@@ -0,0 +1,730 @@
+/*
+ * test/bench.c - dnssec-trigger probe convergence benchmark
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * The probe benchmark, run with make bench.  It runs in a network
+ * namespace of its own (test/bench.sh sets that up) where every address
+ * is local, so the root servers and the fallback resolvers in the config
+ * reach the scripted servers that this program runs.  For every scenario
+ * it starts dnssec-triggerd, submits the DHCP resolver and measures the
+ * time until the state: line of the results, and the CPU time and the
+ * max RSS of the daemon.  The fastopen benchmark measures the time of a
+ * query over a new TCP connection, with and without TCP Fast Open.
+ */
+#include "../config.h"
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef HAVE_OPENSSL_SSL_H
+#include <openssl/ssl.h>
+#endif
+#ifdef HAVE_OPENSSL_ERR_H
+#include <openssl/err.h>
+#endif
+#include "../riggerd/log.h"
+#include "../riggerd/cfg.h"
+#include "../riggerd/net_help.h"
+#include "simanswer.h"
+
+/** the DHCP provided resolver, that is submitted */
+#define BENCH_CACHE_IP "192.0.2.1"
+/** the ssl443 resolver of test/bench.sh, the others are plain dns */
+#define BENCH_SSL_IP "198.51.100.44"
+/** msec to wait for the daemon to listen on the control port */
+#define BENCH_START_WAIT 5000
+/** msec without results before the next run starts */
+#define BENCH_SETTLE 100
+/** port of the server of the fastopen benchmark */
+#define BENCH_FASTOPEN_PORT 5300
+/** number of queries that the fastopen benchmark times */
+#define BENCH_FASTOPEN_QUERIES 1000
+
+/**
+ * A scenario of the benchmark, the networks that the probes find.
+ */
+struct bench_scenario {
+	/** name of the scenario */
+	const char* name;
+	/** what the DHCP provided resolver does */
+	enum sim_behave cache;
+	/** what the other servers do, roots and tcp80, tcp443 */
+	enum sim_behave others;
+	/** if the ssl443 resolver works, or closes the connection */
+	int ssl;
+	/** the state line must start with this */
+	const char* expect;
+};
+
+/** the scenarios */
+static const struct bench_scenario bench_scenarios[] = {
+	{ "cache", sim_works, sim_works, 1, "state: cache" },
+	{ "broken-cache", sim_strip_rrsig, sim_works, 1, "state: auth" },
+	{ "tcp-only", sim_strip_rrsig, sim_tcp_only, 0, "state: tcp" },
+	{ "ssl", sim_strip_rrsig, sim_drop, 1, "state: ssl" },
+	{ "hotspot", sim_portal, sim_portal, 0, "state: nodnssec" },
+	{ NULL, sim_works, sim_works, 0, NULL }
+};
+
+/** the pid of the benchmark, the scripted servers and the daemon */
+static pid_t bench_pid = 0, bench_server = 0, bench_daemon = 0;
+
+/** stop the servers and the daemon if the benchmark exits on an error */
+static void bench_cleanup(void)
+{
+	if(getpid() != bench_pid)
+		return;
+	if(bench_daemon)
+		(void)kill(bench_daemon, SIGTERM);
+	if(bench_server)
+		(void)kill(-bench_server, SIGTERM);
+}
+
+/** the listening sockets of the scripted servers */
+struct bench_socks {
+	/** UDP port 53 */
+	int udp;
+	/** TCP port 53, 80 and 443 */
+	int tcp[3];
+};
+
+/** usage and exit */
+static void usage(void)
+{
+	printf("usage: probe-bench [-n runs] dnssec-triggerd config "
+		"[scenario ...]\n");
+	printf("Measures the time from submit to the probe result, run it "
+		"with test/bench.sh.\n");
+	exit(1);
+}
+
+/** true if the IP4 address is the text address */
+static int bench_addr_is(struct in_addr* a, const char* ip)
+{
+	struct in_addr b;
+	return inet_pton(AF_INET, ip, &b) == 1 && a->s_addr == b.s_addr;
+}
+
+/** what the server at the address does in the scenario */
+static enum sim_behave bench_behave(const struct bench_scenario* sc,
+	struct in_addr* a)
+{
+	if(bench_addr_is(a, BENCH_CACHE_IP))
+		return sc->cache;
+	return sc->others;
+}
+
+/** open a listening socket on all addresses */
+static int bench_listen(int type, int port)
+{
+	struct sockaddr_in sa;
+	int on = 1;
+	int s = socket(AF_INET, type, 0);
+	if(s == -1)
+		fatal_exit("socket: %s", strerror(errno));
+	(void)setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons((uint16_t)port);
+	sa.sin_addr.s_addr = htonl(INADDR_ANY);
+	if(bind(s, (struct sockaddr*)&sa, (socklen_t)sizeof(sa)) == -1)
+		fatal_exit("bind port %d: %s", port, strerror(errno));
+	if(type == SOCK_DGRAM) {
+		/* the destination tells which server is asked */
+		if(setsockopt(s, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on)) == -1)
+			fatal_exit("IP_PKTINFO: %s", strerror(errno));
+	} else {
+#ifdef TCP_FASTOPEN
+		/* for the tcp-fastopen option of the daemon */
+		int qlen = 16;
+		(void)setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN, &qlen,
+			sizeof(qlen));
+#endif
+		if(listen(s, 64) == -1)
+			fatal_exit("listen: %s", strerror(errno));
+	}
+	return s;
+}
+
+/** answer a UDP query, from the address it was sent to */
+static void bench_udp(const struct bench_scenario* sc, int s)
+{
+	uint8_t q[SIM_MAX_ANSWER], a[SIM_MAX_ANSWER];
+	union {
+		struct cmsghdr hdr;
+		char buf[256];
+	} control;
+	struct sockaddr_in from;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr* cmsg;
+	struct in_pktinfo pi;
+	ssize_t r;
+	size_t len;
+	memset(&msg, 0, sizeof(msg));
+	memset(&pi, 0, sizeof(pi));
+	iov.iov_base = q;
+	iov.iov_len = sizeof(q);
+	msg.msg_name = &from;
+	msg.msg_namelen = (socklen_t)sizeof(from);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	if((r = recvmsg(s, &msg, 0)) <= 0)
+		return;
+	for(cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if(cmsg->cmsg_level == IPPROTO_IP &&
+			cmsg->cmsg_type == IP_PKTINFO)
+			memmove(&pi, CMSG_DATA(cmsg), sizeof(pi));
+	}
+	len = sim_answer(q, (size_t)r, bench_behave(sc, &pi.ipi_addr), 0,
+		a, sizeof(a));
+	if(len == 0)
+		return;
+	/* reply from the address that was asked */
+	iov.iov_base = a;
+	iov.iov_len = len;
+	msg.msg_controllen = CMSG_SPACE(sizeof(pi));
+	memset(control.buf, 0, sizeof(control.buf));
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = IPPROTO_IP;
+	cmsg->cmsg_type = IP_PKTINFO;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(pi));
+	pi.ipi_ifindex = 0;
+	pi.ipi_spec_dst = pi.ipi_addr;
+	memmove(CMSG_DATA(cmsg), &pi, sizeof(pi));
+	if(sendmsg(s, &msg, 0) == -1)
+		log_err("sendmsg: %s", strerror(errno));
+}
+
+/** read all of len, over ssl if not NULL, false on eof or error */
+static int bench_read(int fd, SSL* ssl, uint8_t* buf, size_t len)
+{
+	size_t got = 0;
+	while(got < len) {
+		int r;
+		if(ssl)
+			r = SSL_read(ssl, buf+got, (int)(len-got));
+		else	r = (int)read(fd, buf+got, len-got);
+		if(r <= 0)
+			return 0;
+		got += (size_t)r;
+	}
+	return 1;
+}
+
+/** write all of len, over ssl if not NULL, false on error */
+static int bench_write(int fd, SSL* ssl, const void* buf, size_t len)
+{
+	size_t done = 0;
+	while(done < len) {
+		int r;
+		if(ssl)
+			r = SSL_write(ssl, (const uint8_t*)buf+done,
+				(int)(len-done));
+		else	r = (int)write(fd, (const uint8_t*)buf+done,
+				len-done);
+		if(r <= 0)
+			return 0;
+		done += (size_t)r;
+	}
+	return 1;
+}
+
+/** serve the web page, the real one or the login page of the portal */
+static void bench_http(int fd, int portal)
+{
+	const char* page = portal?
+		"<html><body>Please log in</body></html>\n":"OK\n";
+	char req[4096], hdr[256];
+	size_t got = 0;
+	ssize_t r;
+	/* read the request up to the empty line */
+	while(got < sizeof(req)-1) {
+		if((r = read(fd, req+got, sizeof(req)-1-got)) <= 0)
+			return;
+		got += (size_t)r;
+		req[got] = 0;
+		if(strstr(req, "\r\n\r\n"))
+			break;
+	}
+	snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/plain\r\n"
+		"Content-Length: %d\r\n"
+		"Connection: close\r\n\r\n", (int)strlen(page));
+	if(bench_write(fd, NULL, hdr, strlen(hdr)))
+		(void)bench_write(fd, NULL, page, strlen(page));
+}
+
+/** handle a TCP connection, DNS over TCP or SSL, or HTTP */
+static void bench_tcp(const struct bench_scenario* sc, int fd,
+	SSL_CTX* sctx)
+{
+	struct sockaddr_in sa;
+	socklen_t salen = (socklen_t)sizeof(sa);
+	enum sim_behave behave;
+	uint8_t q[SIM_MAX_ANSWER], a[SIM_MAX_ANSWER+2];
+	SSL* ssl = NULL;
+	size_t len;
+	if(getsockname(fd, (struct sockaddr*)&sa, &salen) == -1)
+		return;
+	if(ntohs(sa.sin_port) == 80 && (bench_addr_is(&sa.sin_addr,
+		SIM_WEB_IP) || bench_addr_is(&sa.sin_addr, SIM_PORTAL_IP))) {
+		bench_http(fd, bench_addr_is(&sa.sin_addr, SIM_PORTAL_IP));
+		return;
+	}
+	behave = bench_behave(sc, &sa.sin_addr);
+	if(ntohs(sa.sin_port) == 443 && bench_addr_is(&sa.sin_addr,
+		BENCH_SSL_IP)) {
+		if(!sc->ssl)
+			return;
+		if(!(ssl = SSL_new(sctx)) || !SSL_set_fd(ssl, fd) ||
+			SSL_accept(ssl) != 1) {
+			if(ssl) SSL_free(ssl);
+			return;
+		}
+		behave = sim_works;
+	}
+	while(bench_read(fd, ssl, q, 2)) {
+		len = (size_t)((q[0]<<8) | q[1]);
+		if(len > sizeof(q) || !bench_read(fd, ssl, q, len))
+			break;
+		len = sim_answer(q, len, behave, 1, a+2, sizeof(a)-2);
+		if(len == 0)
+			continue;
+		a[0] = (uint8_t)(len>>8);
+		a[1] = (uint8_t)len;
+		if(!bench_write(fd, ssl, a, len+2))
+			break;
+	}
+	if(ssl) {
+		SSL_shutdown(ssl);
+		SSL_free(ssl);
+	}
+}
+
+/** the scripted servers, runs until killed */
+static void bench_serve(const struct bench_scenario* sc,
+	struct bench_socks* bs, SSL_CTX* sctx)
+{
+	int i, maxfd = bs->udp;
+	/* the connections are handled in processes of their own */
+	(void)signal(SIGCHLD, SIG_IGN);
+	for(i=0; i<3; i++)
+		if(bs->tcp[i] > maxfd)
+			maxfd = bs->tcp[i];
+	while(1) {
+		fd_set rset;
+		FD_ZERO(&rset);
+		FD_SET(bs->udp, &rset);
+		for(i=0; i<3; i++)
+			FD_SET(bs->tcp[i], &rset);
+		if(select(maxfd+1, &rset, NULL, NULL, NULL) == -1) {
+			if(errno == EINTR)
+				continue;
+			fatal_exit("select: %s", strerror(errno));
+		}
+		if(FD_ISSET(bs->udp, &rset))
+			bench_udp(sc, bs->udp);
+		for(i=0; i<3; i++) {
+			int fd;
+			if(!FD_ISSET(bs->tcp[i], &rset))
+				continue;
+			if((fd = accept(bs->tcp[i], NULL, NULL)) == -1)
+				continue;
+			if(fork() == 0) {
+				bench_tcp(sc, fd, sctx);
+				close(fd);
+				_exit(0);
+			}
+			close(fd);
+		}
+	}
+}
+
+/** contact the control port of the daemon, wait for it if it starts */
+static SSL* bench_control(struct cfg* cfg, SSL_CTX* cctx, int wait)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	char err[512];
+	int fd, msec = 0;
+	SSL* ssl;
+	if(!ipstrtoaddr("127.0.0.1", cfg->control_port, &addr, &addrlen))
+		fatal_exit("cannot make control address");
+	while(1) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if(fd == -1)
+			fatal_exit("socket: %s", strerror(errno));
+		if(connect(fd, (struct sockaddr*)&addr, addrlen) == 0)
+			break;
+		close(fd);
+		if(!wait || msec >= BENCH_START_WAIT)
+			fatal_exit("cannot connect to the daemon: %s",
+				strerror(errno));
+		usleep(10000);
+		msec += 10;
+	}
+	if(!(ssl = setup_ssl_client(cctx, fd, err, sizeof(err))))
+		fatal_exit("%s", err);
+	return ssl;
+}
+
+/** close the control connection */
+static void bench_control_close(SSL* ssl)
+{
+	int fd = SSL_get_fd(ssl);
+	SSL_free(ssl);
+	close(fd);
+}
+
+/** send a command to the daemon */
+static void bench_cmd(SSL* ssl, const char* cmd)
+{
+	char buf[256];
+	snprintf(buf, sizeof(buf), "DNSTRIG%d %s\n", CONTROL_VERSION, cmd);
+	if(!bench_write(-1, ssl, buf, strlen(buf)))
+		fatal_exit("could not send %s", cmd);
+}
+
+/** read a line from the results, false on eof */
+static int bench_line(SSL* ssl, char* line, size_t max)
+{
+	size_t len = 0;
+	while(bench_read(-1, ssl, (uint8_t*)line+len, 1)) {
+		if(line[len] == '\n') {
+			line[len] = 0;
+			return 1;
+		}
+		if(len < max-1)
+			len++;
+	}
+	return 0;
+}
+
+/** read the results up to the empty line after the state line, and
+ * return the state line, false on eof */
+static int bench_state(SSL* ssl, char* state, size_t max)
+{
+	char line[256];
+	state[0] = 0;
+	while(bench_line(ssl, line, sizeof(line))) {
+		if(strncmp(line, "state:", 6) == 0)
+			(void)strlcpy(state, line, max);
+		else if(line[0] == 0 && state[0] != 0)
+			return 1;
+	}
+	return 0;
+}
+
+/** skip the results that follow right after, the daemon can report
+ * the end of the probe more than once, and they are not for the next run */
+static void bench_settle(SSL* ssl, char* line, size_t max)
+{
+	struct timeval tv;
+	fd_set rset;
+	int fd = SSL_get_fd(ssl);
+	while(1) {
+		if(SSL_pending(ssl) == 0) {
+			FD_ZERO(&rset);
+			FD_SET(fd, &rset);
+			tv.tv_sec = 0;
+			tv.tv_usec = BENCH_SETTLE*1000;
+			if(select(fd+1, &rset, NULL, NULL, &tv) <= 0)
+				return;
+		}
+		if(!bench_state(ssl, line, max))
+			return;
+	}
+}
+
+/** compare doubles for qsort */
+static int bench_cmp(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x < y)?-1:((x > y)?1:0);
+}
+
+/** run the scenario and print the result line */
+static void bench_run(const struct bench_scenario* sc, struct cfg* cfg,
+	const char* daemon, const char* cfgfile, int runs,
+	struct bench_socks* bs, SSL_CTX* cctx, SSL_CTX* sctx)
+{
+	char state[256], extra[256];
+	struct timeval start, end;
+	struct rusage ru;
+	double* msec = (double*)calloc((size_t)runs, sizeof(double));
+	SSL* results, *c;
+	int i, status;
+	if(!msec) fatal_exit("out of memory");
+
+	if((bench_server = fork()) == -1)
+		fatal_exit("fork: %s", strerror(errno));
+	if(bench_server == 0) {
+		(void)setpgid(0, 0);
+		bench_serve(sc, bs, sctx);
+		_exit(0);
+	}
+	/* so that the kill of the process group cannot miss it */
+	(void)setpgid(bench_server, bench_server);
+	if((bench_daemon = fork()) == -1)
+		fatal_exit("fork: %s", strerror(errno));
+	if(bench_daemon == 0) {
+		execl(daemon, daemon, "-d", "-c", cfgfile, (char*)NULL);
+		log_err("exec %s: %s", daemon, strerror(errno));
+		_exit(1);
+	}
+
+	results = bench_control(cfg, cctx, 1);
+	bench_cmd(results, "results");
+	if(!bench_state(results, state, sizeof(state)))
+		fatal_exit("%s: no results from the daemon", sc->name);
+	for(i=0; i<runs; i++) {
+		c = bench_control(cfg, cctx, 0);
+		gettimeofday(&start, NULL);
+		bench_cmd(c, "submit " BENCH_CACHE_IP);
+		if(!bench_state(results, state, sizeof(state)))
+			fatal_exit("%s: no results from the daemon", sc->name);
+		gettimeofday(&end, NULL);
+		bench_control_close(c);
+		bench_settle(results, extra, sizeof(extra));
+		msec[i] = (end.tv_sec - start.tv_sec)*1000. +
+			(end.tv_usec - start.tv_usec)/1000.;
+		if(strncmp(state, sc->expect, strlen(sc->expect)) != 0)
+			fatal_exit("%s: got '%s', expected '%s'", sc->name,
+				state, sc->expect);
+	}
+
+	c = bench_control(cfg, cctx, 0);
+	bench_cmd(c, "stop");
+	if(wait4(bench_daemon, &status, 0, &ru) == -1)
+		fatal_exit("wait4: %s", strerror(errno));
+	bench_daemon = 0;
+	bench_control_close(c);
+	bench_control_close(results);
+	(void)kill(-bench_server, SIGTERM);
+	(void)waitpid(bench_server, &status, 0);
+	bench_server = 0;
+
+	qsort(msec, (size_t)runs, sizeof(double), bench_cmp);
+	printf("%-13s %4d %9.1f %9.1f %9.1f %7d %7ld  %s\n", sc->name,
+		runs, msec[0], msec[runs/2], msec[runs-1],
+		(int)((ru.ru_utime.tv_sec+ru.ru_stime.tv_sec)*1000 +
+		(ru.ru_utime.tv_usec+ru.ru_stime.tv_usec)/1000),
+		(long)ru.ru_maxrss, state+7);
+	fflush(stdout);
+	free(msec);
+}
+
+/** the server of the fastopen benchmark, it answers one connection at a
+ * time, in the same process, so that the round trips are measured */
+static void bench_fastopen_serve(int s)
+{
+	uint8_t q[SIM_MAX_ANSWER], a[SIM_MAX_ANSWER+2];
+	size_t len;
+	int fd;
+	while((fd = accept(s, NULL, NULL)) != -1) {
+		if(bench_read(fd, NULL, q, 2)) {
+			len = (size_t)((q[0]<<8) | q[1]);
+			if(len <= sizeof(q) && bench_read(fd, NULL, q, len) &&
+				(len = sim_answer(q, len, sim_works, 1, a+2,
+				sizeof(a)-2)) != 0) {
+				a[0] = (uint8_t)(len>>8);
+				a[1] = (uint8_t)len;
+				(void)bench_write(fd, NULL, a, len+2);
+			}
+		}
+		close(fd);
+	}
+}
+
+/** send queries over new connections, with or without fastopen.
+ * @return usec per query, syndata is the number sent with the SYN. */
+static double bench_fastopen_queries(int tfo, int* syndata)
+{
+	/* the root DNSKEY query, with RD, after its length */
+	static const uint8_t query[] = { 0, 17, 0x12, 0x34, 0x01, 0x00,
+		0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 48, 0, 1 };
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	struct timeval start, end;
+	uint8_t a[SIM_MAX_ANSWER];
+	size_t len;
+	int i, fd;
+	*syndata = 0;
+	if(!ipstrtoaddr("127.0.0.1", BENCH_FASTOPEN_PORT, &addr, &addrlen))
+		fatal_exit("cannot make fastopen address");
+	gettimeofday(&start, NULL);
+	for(i=0; i<BENCH_FASTOPEN_QUERIES; i++) {
+		if((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+			fatal_exit("socket: %s", strerror(errno));
+		if(tfo)
+			(void)fd_set_tcp_fastopen(fd);
+		if(connect(fd, (struct sockaddr*)&addr, addrlen) == -1)
+			fatal_exit("connect: %s", strerror(errno));
+		if(!bench_write(fd, NULL, query, sizeof(query)) ||
+			!bench_read(fd, NULL, a, 2) ||
+			(len = (size_t)((a[0]<<8) | a[1])) > sizeof(a) ||
+			!bench_read(fd, NULL, a, len))
+			fatal_exit("fastopen: no answer");
+#ifdef TCPI_OPT_SYN_DATA
+		{
+			struct tcp_info ti;
+			socklen_t tilen = (socklen_t)sizeof(ti);
+			if(getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &tilen)
+				== 0 && (ti.tcpi_options & TCPI_OPT_SYN_DATA))
+				(*syndata)++;
+		}
+#endif
+		close(fd);
+	}
+	gettimeofday(&end, NULL);
+	return ((end.tv_sec - start.tv_sec)*1000000. +
+		(end.tv_usec - start.tv_usec)) / BENCH_FASTOPEN_QUERIES;
+}
+
+/** time queries over TCP with and without fastopen, and print it */
+static void bench_fastopen(void)
+{
+	int s, syndata;
+	double plain, tfo;
+	pid_t server;
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if(s == -1)
+		fatal_exit("socket: %s", strerror(errno));
+	if(!fd_set_tcp_fastopen(s)) {
+		printf("%-13s no tcp fastopen support\n", "fastopen");
+		close(s);
+		return;
+	}
+	close(s);
+	s = bench_listen(SOCK_STREAM, BENCH_FASTOPEN_PORT);
+	if((server = fork()) == -1)
+		fatal_exit("fork: %s", strerror(errno));
+	if(server == 0) {
+		bench_fastopen_serve(s);
+		_exit(0);
+	}
+	close(s);
+	/* the first connections get the cookie of the server */
+	(void)bench_fastopen_queries(1, &syndata);
+	plain = bench_fastopen_queries(0, &syndata);
+	tfo = bench_fastopen_queries(1, &syndata);
+	(void)kill(server, SIGTERM);
+	(void)waitpid(server, NULL, 0);
+	printf("%-13s %4d  connect %.1f usec/query, fastopen %.1f "
+		"usec/query, %d with the SYN\n", "fastopen",
+		BENCH_FASTOPEN_QUERIES, plain, tfo, syndata);
+	fflush(stdout);
+}
+
+/** the ssl context of the ssl443 resolver, with the daemon's key */
+static SSL_CTX* bench_server_ctx(struct cfg* cfg)
+{
+	SSL_CTX* ctx = SSL_CTX_new(SSLv23_server_method());
+	if(!ctx)
+		fatal_exit("could not SSL_CTX_new");
+	if(!SSL_CTX_use_certificate_chain_file(ctx, cfg->server_cert_file) ||
+		!SSL_CTX_use_PrivateKey_file(ctx, cfg->server_key_file,
+		SSL_FILETYPE_PEM))
+		fatal_exit("cannot read %s and %s", cfg->server_cert_file,
+			cfg->server_key_file);
+	return ctx;
+}
+
+int main(int argc, char* argv[])
+{
+	struct bench_socks bs;
+	struct cfg* cfg;
+	SSL_CTX* cctx, *sctx;
+	char err[512];
+	int i, runs = 5;
+	const struct bench_scenario* sc;
+
+	log_ident_set("probe-bench");
+	log_init(NULL, 0, NULL);
+	bench_pid = getpid();
+	(void)atexit(&bench_cleanup);
+	if(argc > 2 && strcmp(argv[1], "-n") == 0) {
+		runs = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+	if(argc < 3 || runs < 1)
+		usage();
+	(void)SSL_library_init();
+	SSL_load_error_strings();
+	(void)signal(SIGPIPE, SIG_IGN);
+	if(!(cfg = cfg_create(argv[2])))
+		fatal_exit("could not read %s", argv[2]);
+	if(!(cctx = cfg_setup_ctx_client(cfg, err, sizeof(err))))
+		fatal_exit("%s", err);
+	sctx = bench_server_ctx(cfg);
+	bs.udp = bench_listen(SOCK_DGRAM, 53);
+	bs.tcp[0] = bench_listen(SOCK_STREAM, 53);
+	bs.tcp[1] = bench_listen(SOCK_STREAM, 80);
+	bs.tcp[2] = bench_listen(SOCK_STREAM, 443);
+
+	printf("%-13s %4s %9s %9s %9s %7s %7s  %s\n", "scenario", "runs",
+		"min", "median", "max", "cpu", "maxrss", "state");
+	printf("%-13s %4s %9s %9s %9s %7s %7s\n", "", "", "msec", "msec",
+		"msec", "msec", "kb");
+	for(sc = bench_scenarios; sc->name; sc++) {
+		if(argc > 3) {
+			/* only the scenarios on the commandline */
+			for(i=3; i<argc; i++)
+				if(strcmp(argv[i], sc->name) == 0)
+					break;
+			if(i == argc)
+				continue;
+		}
+		bench_run(sc, cfg, argv[1], argv[2], runs, &bs, cctx, sctx);
+	}
+	for(i=3; i<argc; i++)
+		if(strcmp(argv[i], "fastopen") == 0)
+			break;
+	if(argc == 3 || i < argc)
+		bench_fastopen();
+	SSL_CTX_free(cctx);
+	SSL_CTX_free(sctx);
+	cfg_delete(cfg);
+	return 0;
+}
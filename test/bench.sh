@@ -0,0 +1,52 @@
+#!/bin/sh
+# probe convergence benchmark script, make bench
+# usage: test/bench.sh [-n runs] [scenario ...]
+#
+# Runs test/probe-bench in a network namespace of its own, where all
+# addresses are routed to the loopback, so that the root servers and the
+# fallback resolvers reach the scripted servers of test/bench.c.  Needs
+# unshare(1) with user namespaces, ip(8) and openssl for the keys.
+
+PRE="."
+if test -z "$BENCH_NETNS"; then
+	if test ! -x "`which unshare 2>&1`" -o ! -x "`which ip 2>&1`"; then
+		echo "No unshare or ip in path, skip benchmark"
+		exit 0
+	fi
+	BENCH_NETNS=yes exec unshare -rn /bin/sh $0 "$@"
+fi
+ip link set lo up || exit 1
+ip route add local 0.0.0.0/0 dev lo || exit 1
+# the scripted servers accept TCP Fast Open, if the kernel has it
+echo 3 > /proc/sys/net/ipv4/tcp_fastopen 2>/dev/null
+
+dir=`mktemp -d /tmp/dnssec-trigger-bench.XXXXXX` || exit 1
+trap "rm -rf $dir" 0
+$PRE/dnssec-trigger-control-setup -d $dir >$dir/setup.log 2>&1 || {
+	cat $dir/setup.log
+	exit 1
+}
+# the DHCP resolver is 192.0.2.1, see test/bench.c
+cat >$dir/bench.conf <<EOF
+verbosity: 1
+logfile: "$dir/dnssec-triggerd.log"
+noaction: yes
+check-updates: no
+unbound-control: "true"
+state-dir: ""
+pidfile: "$dir/dnssec-trigger.pid"
+resolvconf: "$dir/resolv.conf"
+port: 8955
+server-key-file: "$dir/dnssec_trigger_server.key"
+server-cert-file: "$dir/dnssec_trigger_server.pem"
+control-key-file: "$dir/dnssec_trigger_control.key"
+control-cert-file: "$dir/dnssec_trigger_control.pem"
+tcp80: 198.51.100.80
+tcp443: 198.51.100.43
+ssl443: 198.51.100.44
+url: "http://bench.example.net/hotspot.txt OK"
+EOF
+$PRE/test/probe-bench "$@" $PRE/dnssec-triggerd $dir/bench.conf || {
+	tail -20 $dir/dnssec-triggerd.log
+	exit 1
+}
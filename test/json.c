@@ -6,11 +6,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "../riggerd/fwd_zones.h"
 #include "../riggerd/connection_list.h"
 #include "../riggerd/string_list.h"
 #include "../riggerd/string_buffer.h"
+#include "../riggerd/region.h"
 #include "../vendor/ccan/json/json.h"
 
 char *json = 
@@ -93,6 +95,147 @@ static void filter_connection_list_and_test_length1(void) {
     nm_connection_list_clear(&l);
 }
 
+static void load_json_check_content(void) {
+    struct nm_connection_list l = yield_connections_from_json(json);
+    struct nm_connection *c;
+    assert_true(nm_connection_list_length(&l) == 3);
+    c = l.first->next->self;
+    assert_true(c->default_con == true);
+    assert_true(c->type == NM_CON_OTHER);
+    assert_true(string_list_length(&c->zones) == 5);
+    assert_true(string_list_contains(&c->zones, "lab2.prague.example.com", 24));
+    assert_true(string_list_length(&c->servers) == 2);
+    assert_true(string_list_contains(&c->servers, "10.67.5.56", 11));
+    assert_true(l.first->next->next->self->type == NM_CON_VPN);
+    nm_connection_list_clear(&l);
+}
+
+static void load_json_into_region(void) {
+    struct region *region = region_create();
+    struct nm_connection_list l = yield_connections_from_json_region(json, region);
+    struct nm_connection_list l2 = nm_connection_list_filter(&l, 1, &nm_connection_filter_default);
+    struct string_list servers = nm_connection_list_get_servers_list(&l2);
+    assert_true(nm_connection_list_length(&l) == 3);
+    assert_true(nm_connection_list_length(&l2) == 1);
+    assert_true(string_list_length(&servers) == 2);
+    assert_true(servers.region == region);
+    nm_connection_list_copy_and_push_back(&l, l2.first->self);
+    assert_true(nm_connection_list_length(&l) == 4);
+    assert_true(nm_connection_list_remove(&l, "prague.example.com", 19) == 0);
+    assert_true(nm_connection_list_length(&l) == 3);
+    assert_true(region->count > 0);
+    nm_connection_list_clear(&l2);
+    nm_connection_list_clear(&l);
+    region_destroy(region);
+}
+
+static void load_json_escapes_and_unknown_keys(void) {
+    char *in = "{\"version\": [1, 2.5e3, null, {\"a\": true}], \"connections\": "
+        "[{\"zones\": [\"\", \"a\\u0062c.\\/x\"], \"servers\": [\"\"], \"extra\": -0.5, "
+        "\"type\": \"wifi\", \"default\": \"yes\"}, {}]}";
+    struct nm_connection_list l = yield_connections_from_json(in);
+    assert_true(nm_connection_list_length(&l) == 2);
+    assert_true(string_list_length(&l.first->self->zones) == 1);
+    assert_true(string_list_length(&l.first->self->servers) == 0);
+    assert_true(string_list_contains(&l.first->self->zones, "abc./x", 7));
+    assert_true(l.first->self->type == NM_CON_WIFI);
+    assert_true(l.first->self->default_con == false);
+    nm_connection_list_clear(&l);
+}
+
+static void load_json_reject_malformed(void) {
+    char *bad[] = {
+        "",
+        "[]",
+        "{}",
+        "{\"connections\": [}",
+        "{\"connections\": [{\"zones\": [\"a\", 1]}]}",
+        "{\"connections\": [{\"zones\": [\"a\"]}]} x",
+        "{\"connections\": [{\"type\": \"wifi\",}]}",
+        "{\"connections\": [{\"zones\": [\"a\\q\"]}]}",
+        "{\"connections\": [{\"zones\": [\"a\\u0000\"]}]}",
+        "{\"connections\": [{\"default\": tru}]}",
+        "{\"connections\": [{\"x\": 01}]}",
+        "{\"connections\": [{\"zones\": [\"unterminated",
+        NULL
+    };
+    int i;
+    for (i = 0; bad[i]; i++) {
+        struct nm_connection_list l = yield_connections_from_json(bad[i]);
+        assert_true(nm_connection_list_length(&l) == 0);
+        nm_connection_list_clear(&l);
+    }
+}
+
+/** create update_all input with num_con connections of num_zones each */
+static char *bench_json_create(int num_con, int num_zones) {
+    size_t max = (size_t)num_con * ((size_t)num_zones * 48 + 256) + 64;
+    char *buf = calloc_or_die(max);
+    size_t len = 0;
+    int i, j;
+    len += snprintf(buf + len, max - len, "{\"connections\": [");
+    for (i = 0; i < num_con; i++) {
+        len += snprintf(buf + len, max - len, "%s{\"default\": %s, \"servers\": "
+            "[\"10.%d.%d.1\", \"2001:db8::%x\"], \"type\": \"%s\", \"zones\": [",
+            i ? ", " : "", i ? "false" : "true", (i >> 8) & 0xff, i & 0xff, i,
+            (i % 3 == 0) ? "vpn" : "wifi");
+        for (j = 0; j < num_zones; j++) {
+            len += snprintf(buf + len, max - len, "%s\"zone%d.con%d.example.com\"",
+                j ? ", " : "", j, i);
+        }
+        len += snprintf(buf + len, max - len, "]}");
+    }
+    len += snprintf(buf + len, max - len, "]}");
+    assert_true(len < max);
+    return buf;
+}
+
+static double bench_msec(clock_t start) {
+    return (double)(clock() - start) * 1000. / CLOCKS_PER_SEC;
+}
+
+/** time the decode of large inputs, and compare with the JsonNode tree
+ * (validate and decode) that the decoder used to build first */
+static void bench_json_decode(int num_con, int num_zones, int rounds) {
+    char *in = bench_json_create(num_con, num_zones);
+    clock_t start;
+    double stream, inregion, tree;
+    int i;
+
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        struct nm_connection_list l = yield_connections_from_json(in);
+        assert_true(nm_connection_list_length(&l) == (size_t)num_con);
+        nm_connection_list_clear(&l);
+    }
+    stream = bench_msec(start);
+
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        struct region *region = region_create();
+        struct nm_connection_list l = yield_connections_from_json_region(in, region);
+        assert_true(nm_connection_list_length(&l) == (size_t)num_con);
+        nm_connection_list_clear(&l);
+        region_destroy(region);
+    }
+    inregion = bench_msec(start);
+
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        JsonNode *head;
+        assert_true(json_validate(in));
+        head = json_decode(in);
+        assert_true(head != NULL);
+        json_delete(head);
+    }
+    tree = bench_msec(start);
+
+    printf("%d connections, %d zones: %.3f msec/decode (in region: %.3f msec, "
+        "tree only: %.3f msec) ", num_con, num_zones, stream / rounds,
+        inregion / rounds, tree / rounds);
+    free(in);
+}
+
 int main() {
     // printf("Test json parser:\n%s\n", json);
     // struct nm_connection_list l = yield_connections_from_json(json);
@@ -138,6 +281,30 @@ int main() {
     filter_connection_list_and_test_length1();
     printf("OK\n");
 
+    printf("load_json_check_content: ");
+    load_json_check_content();
+    printf("OK\n");
+
+    printf("load_json_into_region: ");
+    load_json_into_region();
+    printf("OK\n");
+
+    printf("load_json_escapes_and_unknown_keys: ");
+    load_json_escapes_and_unknown_keys();
+    printf("OK\n");
+
+    printf("load_json_reject_malformed: ");
+    load_json_reject_malformed();
+    printf("OK\n");
+
+    printf("bench_json_decode: ");
+    bench_json_decode(100, 10, 20);
+    printf("OK\n");
+
+    printf("bench_json_decode: ");
+    bench_json_decode(500, 50, 5);
+    printf("OK\n");
+
     printf("\n");
     printf("OK\n");
     return 0;
@@ -12,6 +12,32 @@
 #include "../riggerd/string_buffer.h"
 #include "../riggerd/string_list.h"
 #include "../riggerd/ubhook.h"
+#include "../riggerd/score.h"
+#include "../riggerd/region.h"
+#include "../riggerd/log.h"
+#include "../riggerd/trace.h"
+#include "../riggerd/memstats.h"
+#include "../riggerd/evprof.h"
+#include "../riggerd/watchdog.h"
+#include "../riggerd/snapshot.h"
+#include "../riggerd/ticket.h"
+#include "../riggerd/svr.h"
+#include "../riggerd/zonetree.h"
+#include "../riggerd/reshook.h"
+#include "../riggerd/hookq.h"
+#include "../riggerd/netevent.h"
+#include "../riggerd/http.h"
+#include "../riggerd/probe.h"
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #define assert_true(x) assert_true_fp((x), __FILE__, __LINE__)
 static void assert_true_fp(int x, const char* f, int l)
@@ -105,6 +131,34 @@ static void lock_file_check_file_permissions(void) {
     assert_true(access(name, X_OK) == -1);
 }
 
+static void lock_file_try_busy(void) {
+    const char *name = "/tmp/dnssec0003";
+    int held[2], done[2];
+    char c;
+    pid_t pid;
+    lock_override(name, 15);
+    assert_true(pipe(held) == 0 && pipe(done) == 0);
+    pid = fork();
+    assert_true(pid != -1);
+    if (pid == 0) {
+        /* the script: hold the lock until the parent is done */
+        lock_acquire();
+        if (write(held[1], "x", 1) != 1)
+            _exit(1);
+        (void)read(done[0], &c, 1);
+        lock_release();
+        _exit(0);
+    }
+    assert_true(read(held[0], &c, 1) == 1);
+    assert_true(lock_try_acquire() == 0);
+    assert_true(write(done[1], "x", 1) == 1);
+    assert_true(waitpid(pid, NULL, 0) == pid);
+    assert_true(lock_try_acquire() == 1);
+    lock_release();
+    close(held[0]); close(held[1]);
+    close(done[0]); close(done[1]);
+}
+
 static void store_macro_creation(void) {
     struct store s = STORE_INIT("test");
     assert_true(strcmp(s.dir, "/var/run/dnssec-trigger") == 0);
@@ -153,6 +207,42 @@ static void store_commit_cache(void) {
     }
 }
 
+static void store_flush_dirty(void) {
+    const char *dir_name = "test/tmp";
+    const char *file_name = "test/tmp/flush-dirty";
+    const char *tmp_file_name = "test/tmp/flush-dirty.tmp";
+    struct stat st;
+    struct store s;
+    unlink(file_name);
+    s = store_init(dir_name, file_name, tmp_file_name);
+    assert_true(!s.dirty);
+
+    // nothing changed, nothing is written
+    assert_true(store_flush(&s) == 0);
+    assert_true(stat(file_name, &st) == -1);
+
+    // changes are written together
+    store_add(&s, "1.2.3.4", 8);
+    store_add(&s, "5.6.7.8", 8);
+    store_remove(&s, "1.2.3.4", 8);
+    assert_true(s.dirty);
+    assert_true(store_flush(&s) == 0);
+    assert_true(!s.dirty);
+    assert_true(stat(file_name, &st) == 0 && st.st_size == 8);
+
+    // adding what is there, or removing what is not, is no change
+    store_add(&s, "5.6.7.8", 8);
+    store_remove(&s, "9.9.9.9", 8);
+    assert_true(!s.dirty);
+    store_destroy(&s);
+
+    s = store_init(dir_name, file_name, tmp_file_name);
+    assert_true(store_contains(&s, "5.6.7.8", 8));
+    assert_true(string_list_length(&s.cache) == 1);
+    store_destroy(&s);
+    unlink(file_name);
+}
+
 static void ubhook_list_forwards_test(void) {
     FILE *fp;
     struct nm_connection_list ret;
@@ -160,7 +250,7 @@ static void ubhook_list_forwards_test(void) {
     struct string_buffer zone2 = string_builder(".");
 
     fp = fopen("test/list_forwards_example", "r");
-    ret = hook_unbound_list_forwards_inner(NULL, fp);
+    ret = hook_unbound_list_forwards_inner(NULL, fp, NULL);
     //nm_connection_list_dbg_eprint(&ret);
     assert_true(nm_connection_list_contains_zone(&ret, zone.string, zone.length));
     assert_true(nm_connection_list_contains_zone(&ret, zone2.string, zone2.length));
@@ -202,6 +292,91 @@ static void ubhook_remove_local_zone(void) {
     assert_int_equal(ret, 0);
 }
 
+static void ubhook_zone_mirror(void) {
+    struct string_buffer exe = string_builder("./test/unbound-control-fake.sh");
+    struct string_buffer noop = string_builder("true");
+    struct string_buffer stat = string_builder("static");
+    struct string_buffer zone = string_builder("test");
+    struct string_buffer corp = string_builder("ny.mylovelycorporate.io.");
+    struct string_buffer servers = string_builder("192.0.2.1 192.0.2.2");
+    struct nm_connection_list ret;
+
+    // read from unbound at first
+    hook_unbound_mirror_clear();
+    ret = hook_unbound_list_forwards_mirror(exe, NULL);
+    assert_true(nm_connection_list_contains_zone(&ret, corp.string, corp.length));
+    assert_false(nm_connection_list_contains_zone(&ret, "test.", 6));
+    nm_connection_list_clear(&ret);
+
+    // then from the mirror, with the changes of our commands
+    assert_int_equal(hook_unbound_add_forward_zone_inner(exe, zone, servers), 0);
+    ret = hook_unbound_list_forwards_mirror(noop, NULL);
+    assert_true(nm_connection_list_contains_zone(&ret, corp.string, corp.length));
+    assert_true(nm_connection_list_contains_zone(&ret, "test.", 6));
+    nm_connection_list_clear(&ret);
+    assert_int_equal(hook_unbound_remove_forward_zone_inner(exe, zone), 0);
+    ret = hook_unbound_list_forwards_mirror(noop, NULL);
+    assert_false(nm_connection_list_contains_zone(&ret, "test.", 6));
+    nm_connection_list_clear(&ret);
+
+    // test. is a static local zone, it is not added again
+    assert_int_equal(hook_unbound_add_local_zone_inner(noop, zone, stat), 0);
+    assert_int_equal(hook_unbound_remove_local_zone_inner(exe, zone), 0);
+    assert_int_equal(hook_unbound_remove_local_zone_inner(noop, zone), 0);
+    assert_int_equal(hook_unbound_add_local_zone_inner(exe, zone, stat), 0);
+
+    // a failed command makes it read from unbound again
+    assert_int_equal(hook_unbound_remove_forward_zone_inner(exe, corp), -1);
+    ret = hook_unbound_list_forwards_mirror(noop, NULL);
+    assert_false(nm_connection_list_contains_zone(&ret, corp.string, corp.length));
+    nm_connection_list_clear(&ret);
+    hook_unbound_mirror_clear();
+}
+
+static void zonetree_lookup_and_cover(void) {
+    struct zonetree* t = zonetree_create();
+    struct zone_key key;
+    int a = 1, b = 2;
+    assert_true(t != NULL);
+
+    // canonical names
+    assert_true(zone_key_make(&key, "Corp.Example.", 14));
+    assert_true(strcmp(key.name, "corp.example") == 0);
+    assert_int_equal(key.labs, 2);
+    assert_true(strncmp(key.name+key.lab_off[0], "example", key.lab_len[0]) == 0);
+    assert_true(zone_key_make(&key, ".", 2));
+    assert_int_equal(key.labs, 0);
+    assert_false(zone_key_make(&key, "a..b", 5));
+
+    assert_true(zonetree_insert(t, "corp.example.", 14, &a) != NULL);
+    assert_true(zonetree_insert(t, "168.192.in-addr.arpa", 21, &b) != NULL);
+    assert_true(zonetree_insert(t, "CORP.example", 13, &b) != NULL);
+    assert_int_equal((int)t->count, 2);
+
+    // exact match, without regard to case and the trailing dot
+    assert_true(zonetree_lookup(t, "corp.example", 13)->data == &b);
+    assert_true(zonetree_lookup(t, "example", 8) == NULL);
+    assert_true(zonetree_lookup(t, "ny.corp.example", 16) == NULL);
+
+    // the closest enclosing zone
+    assert_true(zonetree_cover(t, "ny.Corp.Example.", 17, 0)->data == &b);
+    assert_true(zonetree_cover(t, "1.168.192.in-addr.arpa.", 24, 0) != NULL);
+    assert_true(zonetree_cover(t, "corp.example", 13, 0) != NULL);
+    assert_true(zonetree_cover(t, "corp.example", 13, 1) == NULL);
+    assert_true(zonetree_cover(t, "172.in-addr.arpa", 17, 0) == NULL);
+    assert_true(zonetree_insert(t, ".", 2, &a) != NULL);
+    assert_true(zonetree_cover(t, "corp.example", 13, 1)->data == &a);
+    assert_true(zonetree_cover(t, "other.test", 11, 0)->data == &a);
+
+    // removed zones, and the nodes without zones under them
+    assert_true(zonetree_remove(t, "corp.example", 13) == &b);
+    assert_true(zonetree_remove(t, "corp.example", 13) == NULL);
+    assert_true(zonetree_cover(t, "ny.corp.example", 16, 0)->data == &a);
+    assert_int_equal((int)t->root.num_kids, 1);
+    assert_int_equal((int)t->count, 2);
+    zonetree_delete(t);
+}
+
 static void nm_list_remove(void) {
     FILE *fp;
     struct nm_connection_list ret;
@@ -209,7 +384,7 @@ static void nm_list_remove(void) {
     struct string_buffer zone2 = string_builder(".");
 
     fp = fopen("test/list_forwards_example", "r");
-    ret = hook_unbound_list_forwards_inner(NULL, fp);
+    ret = hook_unbound_list_forwards_inner(NULL, fp, NULL);
     //nm_connection_list_dbg_eprint(&ret);
 
     assert_true(nm_connection_list_contains_zone(&ret, zone.string, zone.length));
@@ -241,6 +416,781 @@ static void string_list_extension(void) {
     string_list_clear(&new);
 }
 
+static void region_alloc_and_free(void) {
+    struct region *region = region_create();
+    struct string_list list;
+    char *big;
+    int i;
+    string_list_init_region(&list, region);
+    for (i = 0; i < 1000; i++) {
+        char zone[64];
+        snprintf(zone, sizeof(zone), "zone%d.example.com", i);
+        string_list_push_back(&list, zone, sizeof(zone));
+    }
+    assert_int_equal((int) string_list_length(&list), 1000);
+    assert_true(string_list_contains(&list, "zone999.example.com", 20));
+    string_list_remove(&list, "zone0.example.com", 18);
+    assert_false(string_list_contains(&list, "zone0.example.com", 18));
+    // every allocation is aligned, and zeroed
+    big = region_alloc(region, REGION_CHUNK_SIZE * 2);
+    assert_true(((size_t)big % sizeof(void*)) == 0);
+    assert_true(big[0] == 0 && big[REGION_CHUNK_SIZE * 2 - 1] == 0);
+    // a handful of chunks instead of two mallocs per string
+    assert_true(region->total < 20 * REGION_CHUNK_SIZE);
+    assert_int_equal((int) region->count, 2001);
+    string_list_clear(&list);
+    region_free_all(region);
+    assert_int_equal((int) region->total, 0);
+    string_list_push_back(&list, "reuse", 5);
+    assert_true(string_list_contains(&list, "reuse", 5));
+    region_destroy(region);
+}
+
+static void memstats_counts_and_peaks(void) {
+    struct region *region;
+    size_t a = 0, b = 0, bytes, num, max_bytes, max_num;
+    memstats_init();
+    memstats_set(memstats_probes, &a, 100);
+    memstats_set(memstats_probes, &b, 50);
+    memstats_set(memstats_probes, &a, 300);
+    memstats_get(memstats_probes, &bytes, &num, &max_bytes, &max_num);
+    assert_int_equal((int) bytes, 350);
+    assert_int_equal((int) num, 2);
+    memstats_set(memstats_probes, &a, 0);
+    memstats_set(memstats_probes, &b, 0);
+    memstats_get(memstats_probes, &bytes, &num, &max_bytes, &max_num);
+    assert_int_equal((int) bytes, 0);
+    assert_int_equal((int) num, 0);
+    assert_int_equal((int) max_bytes, 350);
+    assert_int_equal((int) max_num, 2);
+    assert_int_equal((int) a, 0);
+
+    // the regions of the update are accounted by their chunks
+    region = region_create();
+    region_alloc(region, 10);
+    region_alloc(region, REGION_CHUNK_SIZE);
+    memstats_get(memstats_update, &bytes, &num, &max_bytes, &max_num);
+    assert_int_equal((int) bytes, (int) (sizeof(*region) + region->total));
+    assert_int_equal((int) num, 1);
+    region_destroy(region);
+    memstats_get(memstats_update, &bytes, &num, &max_bytes, &max_num);
+    assert_int_equal((int) bytes, 0);
+    assert_int_equal((int) num, 0);
+    assert_true(max_bytes > 2 * REGION_CHUNK_SIZE);
+}
+
+static void evprof_counts_and_histogram(void) {
+    struct timeval start;
+    ldns_buffer *buf = ldns_buffer_new(4096);
+    char *out;
+    int i;
+    assert_true(buf != NULL);
+    evprof_set(0);
+    assert_false(evprof_begin(&start));
+    assert_true(evprof_print(buf));
+    ldns_buffer_write_u8(buf, 0);
+    assert_true(strcmp((char *) ldns_buffer_begin(buf), "profile off\n") == 0);
+
+    evprof_set(1);
+    for(i = 0; i < 3; i++) {
+        assert_true(evprof_begin(&start));
+        // started 3 msec ago
+        start.tv_usec -= 3000;
+        if(start.tv_usec < 0) {
+            start.tv_usec += 1000000;
+            start.tv_sec--;
+        }
+        evprof_end(&start, evprof_callback,
+            (evprof_func_type *) hookq_wake_cb);
+        evprof_loop(&start);
+    }
+    evprof_end(&start, evprof_event, (evprof_func_type *) memstats_counts_and_peaks);
+    ldns_buffer_clear(buf);
+    assert_true(evprof_print(buf));
+    ldns_buffer_write_u8(buf, 0);
+    out = (char *) ldns_buffer_begin(buf);
+    // the most time first, the unknown function by its address
+    assert_true(strstr(out, "callback          3") != NULL);
+    assert_true(strstr(out, "hookq_wake_cb") < strstr(out, "event "));
+    assert_true(strstr(out, "0x") != NULL);
+    assert_true(strstr(out, "loop iterations: 3\n") != NULL);
+    // at least 3 msec, the buckets are powers of two
+    assert_true(strstr(out, "loop < 2048 usec: ") == NULL);
+    assert_true(strstr(out, "usec: 3\n") != NULL);
+
+    evprof_reset();
+    ldns_buffer_clear(buf);
+    assert_true(evprof_print(buf));
+    ldns_buffer_write_u8(buf, 0);
+    assert_true(strstr((char *) ldns_buffer_begin(buf), "hookq_wake_cb") == NULL);
+    evprof_set(0);
+    ldns_buffer_free(buf);
+}
+
+static void score_select_prefers_working(void) {
+    const char *names[] = { "192.0.2.1", "192.0.2.2", "192.0.2.3" };
+    struct score_tab *tab = score_tab_create();
+    int i, count[3] = {0, 0, 0};
+    assert_true(tab != NULL);
+    for (i = 0; i < 10; i++) {
+        score_note(tab, names[0], 80, 0, 0, 0);
+        score_note(tab, names[1], 80, 0, 1, 800);
+        score_note(tab, names[2], 80, 0, 1, 20);
+    }
+    // other port or ssl does not share the score
+    assert_true(score_lookup(tab, names[2], 443, 0, 0) == NULL);
+    assert_true(score_lookup(tab, names[2], 80, 1, 0) == NULL);
+    for (i = 0; i < 1000; i++) {
+        count[score_select(tab, names, 3, 80, 0)]++;
+    }
+    // fast and working is preferred, but failed ones are still explored
+    assert_true(count[2] > count[1]);
+    assert_true(count[1] > count[0]);
+    assert_true(count[0] > 0);
+    score_tab_delete(tab);
+}
+
+static void score_table_commit(void) {
+    const char *file_name = "test/tmp/probe-scores";
+    struct score_tab *tab = score_tab_create();
+    struct score_entry *e;
+    score_note(tab, "2001:db8::1", 443, 1, 1, 100);
+    score_note(tab, "2001:db8::1", 443, 1, 0, 0);
+    assert_true(tab->dirty);
+    assert_true(score_tab_write(tab, file_name));
+    assert_false(tab->dirty);
+    score_tab_delete(tab);
+
+    tab = score_tab_create();
+    assert_true(score_tab_read(tab, file_name));
+    e = score_lookup(tab, "2001:db8::1", 443, 1, 0);
+    assert_true(e != NULL);
+    assert_int_equal(e->tries, 2);
+    assert_int_equal(e->success, 1);
+    assert_int_equal(e->rtt, 100);
+    score_tab_delete(tab);
+    unlink(file_name);
+}
+
+static void snapshot_write_and_read(void) {
+    const char *file_name = "test/tmp/warm-start";
+    struct snapshot *s = snapshot_create(), *r = snapshot_create();
+    char fp1[SNAPSHOT_FP_LEN], fp2[SNAPSHOT_FP_LEN];
+    FILE *f;
+    assert_true(s && r);
+    s->res_state = res_tcp;
+    snprintf(s->fingerprint, sizeof(s->fingerprint), "2-0123456789abcdef");
+    s->dhcp = strdup("192.0.2.1 2001:db8::1");
+    s->tcp80_ip4 = 1;
+    s->tcp443_ip6 = 1;
+    assert_true(snapshot_write(s, file_name));
+    assert_true(snapshot_read(r, file_name));
+    assert_true(snapshot_equal(s, r));
+    assert_int_equal(r->res_state, res_tcp);
+    assert_true(strcmp(r->dhcp, "192.0.2.1 2001:db8::1") == 0);
+    assert_false(r->tcp80_ip6 || r->ssl443_ip4);
+
+    // a cache state without resolvers to forward to is not used
+    s->res_state = res_cache;
+    assert_true(snapshot_write(s, file_name));
+    assert_false(snapshot_read(r, file_name));
+    // the resolvers go to unbound-control, only IP addresses are used
+    s->forward = strdup("192.0.2.53  2001:db8::53");
+    assert_true(snapshot_write(s, file_name));
+    assert_true(snapshot_read(r, file_name));
+    free(s->forward);
+    s->forward = strdup("192.0.2.53;touch${IFS}x");
+    assert_true(snapshot_write(s, file_name));
+    assert_false(snapshot_read(r, file_name));
+    free(s->forward);
+    s->forward = strdup("192.0.2.53");
+    free(s->dhcp);
+    s->dhcp = strdup("192.0.2.1 $(reboot)");
+    assert_true(snapshot_write(s, file_name));
+    assert_false(snapshot_read(r, file_name));
+    // and the states that are not secure are not kept
+    s->res_state = res_dark;
+    assert_false(snapshot_write(s, file_name));
+    f = fopen(file_name, "w");
+    assert_true(f != NULL);
+    fprintf(f, "fingerprint 1-00\nstate dark\n");
+    fclose(f);
+    assert_false(snapshot_read(r, file_name));
+    unlink(file_name);
+    assert_false(snapshot_read(r, file_name));
+    snapshot_delete(s);
+    snapshot_delete(r);
+
+    // the same interfaces give the same fingerprint
+    if (snapshot_fingerprint(fp1, sizeof(fp1))) {
+        assert_true(snapshot_fingerprint(fp2, sizeof(fp2)));
+        assert_true(strcmp(fp1, fp2) == 0);
+    }
+}
+
+static void ticket_keys_store_and_rotate(void) {
+    const char *file_name = "test/tmp/ticket-keys";
+    struct ticket_key keys[2], r[2], old;
+    unsigned char unknown[16];
+    char bad[8 + 2 * 84];
+    time_t now = 1000000;
+    struct stat st;
+    int renew = 0;
+    FILE *f;
+    memset(keys, 0, sizeof(keys));
+    // the first key is made, there is no previous key
+    assert_int_equal(ticket_keys_rotate(keys, now), 1);
+    assert_true(keys[0].created == now);
+    assert_true(keys[1].created == 0);
+    assert_int_equal(ticket_keys_rotate(keys, now + 10), 0);
+
+    // written, only readable by us, and read back
+    unlink(file_name);
+    assert_true(ticket_keys_write(keys, file_name));
+    assert_true(stat(file_name, &st) == 0);
+    assert_int_equal((int)(st.st_mode & 0777), 0600);
+    memset(r, 0, sizeof(r));
+    assert_true(ticket_keys_read(r, file_name));
+    assert_true(memcmp(r[0].name, keys[0].name, sizeof(r[0].name)) == 0);
+    assert_true(memcmp(r[0].aes, keys[0].aes, sizeof(r[0].aes)) == 0);
+    assert_true(memcmp(r[0].hmac, keys[0].hmac, sizeof(r[0].hmac)) == 0);
+    assert_true(r[0].created == now);
+    assert_true(r[1].created == 0);
+    old = keys[0];
+
+    // the new key encrypts, the old key still decrypts and renews
+    assert_int_equal(ticket_keys_rotate(keys, now + TICKET_KEY_ROTATE), 1);
+    assert_true(memcmp(keys[1].name, old.name, sizeof(old.name)) == 0);
+    assert_true(memcmp(keys[0].name, old.name, sizeof(old.name)) != 0);
+    assert_true(ticket_key_find(keys, keys[0].name, now + TICKET_KEY_ROTATE,
+        &renew) == &keys[0]);
+    assert_false(renew);
+    assert_true(ticket_key_find(keys, old.name, now + TICKET_KEY_ROTATE,
+        &renew) == &keys[1]);
+    assert_true(renew);
+    // the old key expires, and an unknown key is a full handshake
+    assert_true(ticket_key_find(keys, old.name, now + 2 * TICKET_KEY_ROTATE,
+        &renew) == NULL);
+    memset(unknown, 0xff, sizeof(unknown));
+    assert_true(ticket_key_find(keys, unknown, now, &renew) == NULL);
+
+    // a short file, a bad format or no file is ignored, the keys are kept
+    f = fopen(file_name, "wb");
+    assert_true(f != NULL);
+    fwrite("DNSTKEY1", 1, 8, f);
+    fclose(f);
+    assert_false(ticket_keys_read(r, file_name));
+    assert_true(memcmp(r[0].name, old.name, sizeof(old.name)) == 0);
+    memset(bad, 'x', sizeof(bad));
+    f = fopen(file_name, "wb");
+    assert_true(f != NULL);
+    fwrite(bad, 1, sizeof(bad), f);
+    fclose(f);
+    assert_false(ticket_keys_read(r, file_name));
+    assert_true(memcmp(r[0].name, old.name, sizeof(old.name)) == 0);
+    unlink(file_name);
+    assert_false(ticket_keys_read(r, file_name));
+}
+
+/** check the body against the expected content, it arrives in three
+ * reads, cut at a and b.  @return the result of the last check, or of
+ * the failed one */
+static int http_check_reads(struct http_get *hg, const char *body,
+    size_t a, size_t b) {
+    size_t cut[3], i, prev = 0;
+    int r = 1;
+    cut[0] = a;
+    cut[1] = b;
+    cut[2] = strlen(body);
+    hg->expect_pos = 0;
+    hg->expect_seen = 0;
+    hg->datalen = strlen(body);
+    ldns_buffer_clear(hg->buf);
+    for (i = 0; i < 3 && r == 1; i++) {
+        ldns_buffer_write(hg->buf, body + prev, cut[i] - prev);
+        prev = cut[i];
+        r = http_get_check_data(hg);
+    }
+    return r;
+}
+
+/** the body matches, it is all there, at every cut of the reads */
+static void http_check_whole(struct http_get *hg, const char *body) {
+    size_t a, b, n = strlen(body);
+    for (a = 0; a <= n; a++) {
+        for (b = a; b <= n; b++) {
+            assert_int_equal(http_check_reads(hg, body, a, b), 1);
+            assert_true(hg->expect_pos == strlen(hg->expect));
+            assert_true(hg->expect_seen == n);
+            assert_true(hg->datalen == 0);
+            assert_true(ldns_buffer_position(hg->buf) == 0);
+        }
+    }
+}
+
+/** the body differs, at every cut of the reads */
+static void http_check_differs(struct http_get *hg, const char *body) {
+    size_t a, b, n = strlen(body);
+    for (a = 0; a <= n; a++)
+        for (b = a; b <= n; b++)
+            assert_int_equal(http_check_reads(hg, body, a, b), 0);
+}
+
+static void http_check_page_content(void) {
+    struct http_get hg;
+    memset(&hg, 0, sizeof(hg));
+    hg.buf = ldns_buffer_new(1024);
+    assert_true(hg.buf != NULL);
+    hg.expect = "hello world";
+
+    // leading and trailing whitespace
+    http_check_whole(&hg, "hello world");
+    http_check_whole(&hg, "\r\n \thello world\n");
+    http_check_whole(&hg, "  hello world \r\n\r\n  ");
+    // whitespace inside is content
+    http_check_differs(&hg, "hello  world");
+    // a mismatch in the middle of a read, the rest is not checked
+    assert_int_equal(http_check_reads(&hg, "hello there world", 17, 17), 0);
+    assert_true(hg.expect_seen == 0);
+    http_check_differs(&hg, "hello there world");
+    http_check_differs(&hg, "jello world");
+    // extra content after the full match
+    http_check_differs(&hg, "hello world!");
+    http_check_differs(&hg, "hello world\nhello world");
+    // a part of the page matches, but it is not all there
+    assert_int_equal(http_check_reads(&hg, "  hello wor", 3, 7), 1);
+    assert_true(hg.expect_pos == 9);
+
+    // the data after the data length, such as the end of a chunk, stays
+    hg.expect_pos = 0;
+    hg.expect_seen = 0;
+    hg.datalen = 11;
+    ldns_buffer_clear(hg.buf);
+    ldns_buffer_write(hg.buf, "hello world\r\n", 13);
+    assert_int_equal(http_get_check_data(&hg), 1);
+    assert_true(hg.expect_pos == 11 && hg.datalen == 0);
+    assert_true(ldns_buffer_position(hg.buf) == 2);
+    assert_true(memcmp(ldns_buffer_begin(hg.buf), "\r\n", 2) == 0);
+
+    // a page larger than the data limit
+    hg.data_limit = 8;
+    assert_int_equal(http_check_reads(&hg, "hello world", 4, 8), -1);
+    assert_true(hg.expect_seen == 8);
+    ldns_buffer_free(hg.buf);
+}
+
+/** two address records, with these TTLs */
+static ldns_rr_list *http_addr_list(uint32_t ttl1, uint32_t ttl2) {
+    ldns_rr_list *list = ldns_rr_list_new();
+    ldns_rr *rr;
+    assert_true(list != NULL);
+    rr = ldns_rr_new_frm_type(LDNS_RR_TYPE_A);
+    assert_true(rr != NULL);
+    ldns_rr_set_ttl(rr, ttl1);
+    assert_true(ldns_rr_list_push_rr(list, rr));
+    rr = ldns_rr_new_frm_type(LDNS_RR_TYPE_A);
+    assert_true(rr != NULL);
+    ldns_rr_set_ttl(rr, ttl2);
+    assert_true(ldns_rr_list_push_rr(list, rr));
+    return list;
+}
+
+/** see if the hostname has addresses in the cache */
+static int http_addr_cached(struct http_addr_cache *c, const char *name,
+    int ip6, uint32_t now) {
+    ldns_rr_list *r = http_addr_cache_lookup(c, name, ip6, now);
+    int n = r ? (int)ldns_rr_list_rr_count(r) : 0;
+    ldns_rr_list_deep_free(r);
+    return n;
+}
+
+static void http_addr_cache_expire_and_network(void) {
+    struct http_addr_cache *c = http_addr_cache_create();
+    struct probe_ip p[3];
+    ldns_rr_list *addr;
+    uint32_t now = 1000000;
+    assert_true(c != NULL);
+    // two cache resolvers and a probe that is not a cache
+    memset(p, 0, sizeof(p));
+    p[0].name = "192.0.2.2";
+    p[0].next = &p[1];
+    p[1].name = "192.0.2.1";
+    p[1].next = &p[2];
+    p[2].name = "198.51.100.1";
+    p[2].to_auth = 1;
+    http_addr_cache_network(c, &p[0]);
+    assert_true(strcmp(c->network, "192.0.2.1 192.0.2.2") == 0);
+
+    // kept until the smallest TTL, for A and AAAA apart
+    addr = http_addr_list(300, 60);
+    http_addr_cache_store(c, "www.example.net", 0, addr, now);
+    ldns_rr_list_deep_free(addr);
+    assert_int_equal(http_addr_cached(c, "www.example.net", 0, now), 2);
+    assert_int_equal(http_addr_cached(c, "www.example.net", 1, now), 0);
+    assert_int_equal(http_addr_cached(c, "example.net", 0, now), 0);
+    assert_int_equal(http_addr_cached(c, "www.example.net", 0, now + 59),
+        2);
+    assert_int_equal(http_addr_cached(c, "www.example.net", 0, now + 60),
+        0);
+    assert_int_equal(c->num, 0);
+    // TTL zero is not kept
+    addr = http_addr_list(0, 300);
+    http_addr_cache_store(c, "www.example.net", 0, addr, now);
+    ldns_rr_list_deep_free(addr);
+    assert_int_equal(c->num, 0);
+    // a new lookup replaces the old addresses
+    addr = http_addr_list(300, 300);
+    http_addr_cache_store(c, "www.example.net", 0, addr, now);
+    http_addr_cache_store(c, "www.example.net", 1, addr, now);
+    http_addr_cache_store(c, "www.example.net", 0, addr, now + 100);
+    ldns_rr_list_deep_free(addr);
+    assert_int_equal(c->num, 2);
+    assert_int_equal(http_addr_cached(c, "www.example.net", 0, now + 300),
+        2);
+    assert_int_equal(http_addr_cached(c, "www.example.net", 1, now + 300),
+        0);
+    assert_int_equal(c->num, 1);
+
+    // the same resolvers in another order are the same network
+    p[1].next = &p[0];
+    p[0].next = &p[2];
+    http_addr_cache_network(c, &p[1]);
+    assert_true(strcmp(c->network, "192.0.2.1 192.0.2.2") == 0);
+    assert_int_equal(http_addr_cached(c, "www.example.net", 0, now), 2);
+    // another probe that is not a cache does not change it
+    p[2].to_auth = 0;
+    p[2].to_http = 1;
+    http_addr_cache_network(c, &p[1]);
+    assert_int_equal(http_addr_cached(c, "www.example.net", 0, now), 2);
+    // another cache resolver is another network, the addresses go
+    p[0].name = "192.0.2.3";
+    http_addr_cache_network(c, &p[1]);
+    assert_true(strcmp(c->network, "192.0.2.1 192.0.2.3") == 0);
+    assert_int_equal(c->num, 0);
+    assert_int_equal(http_addr_cached(c, "www.example.net", 0, now), 0);
+    // and no cache resolvers at all
+    addr = http_addr_list(300, 300);
+    http_addr_cache_store(c, "www.example.net", 0, addr, now);
+    ldns_rr_list_deep_free(addr);
+    http_addr_cache_network(c, NULL);
+    assert_true(strcmp(c->network, "") == 0);
+    assert_int_equal(c->num, 0);
+    http_addr_cache_delete(c);
+}
+
+static void log_ring_keeps_order(void) {
+    FILE *f = tmpfile();
+    char line[4096], big[3001];
+    int i, next = 0, dropped = 0, num, big_seen = 0;
+    const int total = 2000;
+    assert_true(f != NULL);
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = 0;
+    log_file(f);
+    log_async_start();
+    for (i = 0; i < total; i++) {
+        log_info("message %d", i);
+    }
+    // longer than a slot of the ring, and not cut short
+    log_info("big %s", big);
+    log_async_stop();
+    log_file(NULL);
+    // every message is written in order, or counted as dropped
+    rewind(f);
+    while (fgets(line, (int)sizeof(line), f)) {
+        char *p;
+        if ((p = strstr(line, "info: big ")) != NULL) {
+            assert_true(strncmp(p + strlen("info: big "), big,
+                sizeof(big) - 1) == 0);
+            assert_true(p[strlen("info: big ") + sizeof(big) - 1] == '\n');
+            big_seen = 1;
+        } else if ((p = strstr(line, "info: message ")) != NULL) {
+            num = atoi(p + strlen("info: message "));
+            assert_true(num >= next);
+            dropped += num - next;
+            next = num + 1;
+        } else if ((p = strstr(line, "log ring full, ")) != NULL) {
+            dropped -= atoi(p + strlen("log ring full, "));
+        }
+    }
+    dropped += total - next;
+    assert_int_equal(dropped, 0);
+    assert_true(big_seen);
+    fclose(f);
+}
+
+#ifdef HAVE_PTHREAD
+static void *log_reopen_thread(void *arg) {
+    int i;
+    for (i = 0; i < *(int *)arg; i++) {
+        log_info("message %d", i);
+        if (i % 64 == 0)
+            usleep(100);
+    }
+    return NULL;
+}
+
+/** the messages in the file, and the dropped ones are subtracted */
+static int log_reopen_count(const char *file_name) {
+    FILE *f = fopen(file_name, "r");
+    char line[1024], *p;
+    int num = 0;
+    assert_true(f != NULL);
+    while (fgets(line, (int)sizeof(line), f)) {
+        if (strstr(line, "info: message ") != NULL)
+            num++;
+        else if ((p = strstr(line, "log ring full, ")) != NULL)
+            num += atoi(p + strlen("log ring full, "));
+    }
+    fclose(f);
+    return num;
+}
+
+static void log_reopen_while_logging(void) {
+    const char *file1 = "test/tmp/log1", *file2 = "test/tmp/log2";
+    pthread_t thr;
+    int total = 2000;
+    unlink(file1);
+    unlink(file2);
+    log_init(file1, 0, NULL);
+    log_async_start();
+    assert_true(pthread_create(&thr, NULL, log_reopen_thread, &total) == 0);
+    // the file is swapped while the log thread and the other thread log
+    usleep(5000);
+    log_init(file2, 0, NULL);
+    pthread_join(thr, NULL);
+    log_async_stop();
+    log_init(NULL, 0, NULL);
+    assert_int_equal(log_reopen_count(file1) + log_reopen_count(file2),
+        total);
+    unlink(file1);
+    unlink(file2);
+}
+#endif /* HAVE_PTHREAD */
+
+static void trace_addr(struct sockaddr_storage *ss, const char *ip, int port) {
+    struct sockaddr_in *sa = (struct sockaddr_in *)ss;
+    memset(ss, 0, sizeof(*ss));
+    sa->sin_family = AF_INET;
+    sa->sin_port = htons(port);
+    assert_int_equal(inet_pton(AF_INET, ip, &sa->sin_addr), 1);
+}
+
+static void trace_record_and_dump(void) {
+    static uint8_t buf[TRACE_DUMP_MAX];
+    struct sockaddr_storage addr;
+    struct trace_event e, first;
+    struct timeval now = {1000, 0};
+    uint32_t num, total;
+    char line[256];
+    size_t len;
+    int i;
+    trace_clear();
+    trace_set_time(&now);
+    trace_addr(&addr, "192.0.2.1", 53);
+    trace_outq(trace_outq_send, &addr, TRACE_RECURSE, 48, 100);
+    now.tv_usec = 250000;
+    trace_state(1, 0, TRACE_INSECURE);
+    trace_ubctrl("forward off", 1, 12);
+    len = trace_dump(buf);
+    assert_int_equal((int)len, TRACE_HEADER_LEN + 3*TRACE_EVENT_LEN);
+    assert_true(trace_parse_header(buf, len, &num, &total));
+    assert_int_equal(num, 3);
+    assert_int_equal(total, 3);
+
+    trace_parse_event(buf + TRACE_HEADER_LEN, &first);
+    trace_event_str(&first, &first, line, sizeof(line));
+    assert_true(strstr(line, "send") != NULL);
+    assert_true(strstr(line, "udp 192.0.2.1 recursive port 53 DNSKEY, 100 msec") != NULL);
+    trace_parse_event(buf + TRACE_HEADER_LEN + TRACE_EVENT_LEN, &e);
+    trace_event_str(&e, &first, line, sizeof(line));
+    assert_true(strstr(line, "0.250 state cache -> auth insecure_mode") != NULL);
+    trace_parse_event(buf + TRACE_HEADER_LEN + 2*TRACE_EVENT_LEN, &e);
+    trace_event_str(&e, &first, line, sizeof(line));
+    assert_true(strstr(line, "unbound-control forward: status 1, 12 msec") != NULL);
+
+    // the ring keeps the last TRACE_SIZE events
+    for (i = 0; i < TRACE_SIZE + 10; i++) {
+        trace_outq(trace_outq_recv, &addr, TRACE_TCP, 1, i);
+    }
+    len = trace_dump(buf);
+    assert_int_equal((int)len, TRACE_DUMP_MAX);
+    assert_true(trace_parse_header(buf, len, &num, &total));
+    assert_int_equal(num, TRACE_SIZE);
+    assert_int_equal(total, TRACE_SIZE + 13);
+    trace_parse_event(buf + TRACE_HEADER_LEN, &e);
+    assert_int_equal(e.type, trace_outq_recv);
+    assert_int_equal(e.val, 13 - 3);
+    assert_false(trace_parse_header((uint8_t *)"DNSTRIG1 status", 15, &num, &total));
+    trace_set_time(NULL);
+    trace_clear();
+}
+
+static void bench_trace_event(void) {
+    struct sockaddr_storage addr;
+    struct timeval now = {1000, 0};
+    const int rounds = 10000000;
+    clock_t start;
+    double base, gtod;
+    int i;
+    trace_addr(&addr, "192.0.2.1", 53);
+    trace_set_time(&now);
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        trace_outq(trace_outq_send, &addr, 0, 1, i);
+    }
+    base = (double)(clock() - start) * 1000000000. / CLOCKS_PER_SEC;
+    trace_set_time(NULL);
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        trace_outq(trace_outq_send, &addr, 0, 1, i);
+    }
+    gtod = (double)(clock() - start) * 1000000000. / CLOCKS_PER_SEC;
+    trace_clear();
+    printf("%.1f nsec/event (with gettimeofday: %.1f nsec) ", base / rounds,
+        gtod / rounds);
+}
+
+static void resolv_write_skips_identical(void) {
+    const char *file_name = "test/tmp/resolv.conf";
+    const char *content = "# Generated by test\nnameserver 127.0.0.1\n";
+    struct stat first, st;
+    unlink(file_name);
+    assert_true(hook_resolv_write(file_name, content, 0));
+    assert_int_equal(stat(file_name, &first), 0);
+    assert_int_equal((int)first.st_size, (int)strlen(content));
+    assert_int_equal((int)(first.st_mode & 0777), 0444);
+    // same content is not written again
+    assert_true(hook_resolv_write(file_name, content, 0));
+    assert_int_equal(stat(file_name, &st), 0);
+    assert_true(st.st_ino == first.st_ino);
+    // other content replaces the file, by rename
+    assert_true(hook_resolv_write(file_name, "nameserver 192.0.2.1\n", 0));
+    assert_int_equal(stat(file_name, &st), 0);
+    assert_true(st.st_ino != first.st_ino);
+    assert_int_equal((int)st.st_size, (int)strlen("nameserver 192.0.2.1\n"));
+    assert_int_equal(stat("test/tmp/resolv.conf.dnssec-trigger", &st), -1);
+    unlink(file_name);
+}
+
+#ifdef HAVE_PTHREAD
+#define HOOKQ_TEST_JOBS 16
+/* the order the hook jobs ran in, per target */
+static int hookq_order[HOOKQ_TARGETS][HOOKQ_TEST_JOBS];
+static int hookq_num[HOOKQ_TARGETS];
+static int hookq_done_num, hookq_off_main, hookq_main_calls;
+static pthread_t hookq_test_thr;
+static struct comm_base *hookq_test_base;
+
+struct hookq_test_job {
+    enum hookq_target target;
+    int num;
+};
+
+static void hookq_test_main_call(void *ATTR_UNUSED(arg)) {
+    if (!pthread_equal(pthread_self(), hookq_test_thr))
+        hookq_off_main++;
+    hookq_main_calls++;
+}
+
+static void hookq_test_run(void *arg) {
+    struct hookq_test_job *j = (struct hookq_test_job *)arg;
+    // like a slow unbound-control
+    usleep(10000);
+    // one job of a target runs at a time
+    hookq_order[j->target][hookq_num[j->target]++] = j->num;
+    hookq_main(&hookq_test_main_call, NULL);
+}
+
+static void hookq_test_done(void *arg) {
+    if (!pthread_equal(pthread_self(), hookq_test_thr))
+        hookq_off_main++;
+    hookq_done_num++;
+    free(arg);
+    if (hookq_pending() == 0)
+        comm_base_exit(hookq_test_base);
+}
+
+static void hookq_test_submit(enum hookq_target target, int num) {
+    struct hookq_test_job *j = (struct hookq_test_job *)calloc(1, sizeof(*j));
+    assert_true(j != NULL);
+    j->target = target;
+    j->num = num;
+    hookq_submit(target, &hookq_test_run, &hookq_test_done, j);
+}
+
+static void hookq_ordered_and_async(void) {
+    struct timeval start, end;
+    int i, t;
+    hookq_test_thr = pthread_self();
+    hookq_test_base = comm_base_create(0);
+    assert_true(hookq_test_base != NULL);
+    assert_true(hookq_start(hookq_test_base));
+    gettimeofday(&start, NULL);
+    for (i = 0; i < HOOKQ_TEST_JOBS; i++) {
+        for (t = 0; t < HOOKQ_TARGETS; t++)
+            hookq_test_submit((enum hookq_target)t, i);
+    }
+    gettimeofday(&end, NULL);
+    // submitting does not wait for the jobs
+    assert_true((end.tv_sec - start.tv_sec)*1000000 +
+        (end.tv_usec - start.tv_usec) < 10000);
+    assert_int_equal(hookq_pending(), HOOKQ_TEST_JOBS*HOOKQ_TARGETS);
+    comm_base_dispatch(hookq_test_base);
+    assert_int_equal(hookq_done_num, HOOKQ_TEST_JOBS*HOOKQ_TARGETS);
+    assert_int_equal(hookq_main_calls, HOOKQ_TEST_JOBS*HOOKQ_TARGETS);
+    assert_int_equal(hookq_off_main, 0);
+    for (t = 0; t < HOOKQ_TARGETS; t++) {
+        assert_int_equal(hookq_num[t], HOOKQ_TEST_JOBS);
+        for (i = 0; i < HOOKQ_TEST_JOBS; i++)
+            assert_int_equal(hookq_order[t][i], i);
+        hookq_num[t] = 0;
+    }
+    // the stop performs the submitted jobs
+    for (i = 0; i < 4; i++)
+        hookq_test_submit(hookq_unbound, i);
+    hookq_stop();
+    assert_int_equal(hookq_done_num, HOOKQ_TEST_JOBS*HOOKQ_TARGETS + 4);
+    assert_int_equal(hookq_num[hookq_unbound], 4);
+    // without workers, the job is performed when submitted
+    hookq_test_submit(hookq_resolv, 0);
+    assert_int_equal(hookq_num[hookq_resolv], 1);
+    assert_int_equal(hookq_off_main, 0);
+    comm_base_delete(hookq_test_base);
+}
+
+static void watchdog_reports_stall(void) {
+    ldns_buffer *buf = ldns_buffer_new(4096);
+    char *out, *p;
+    assert_true(buf != NULL);
+    assert_true(watchdog_start(20));
+    watchdog_hook_begin("unbound-control forward_add corp.example");
+    watchdog_hook_end();
+    // a quick callback is not a stall
+    watchdog_enter((void (*)(void)) hookq_wake_cb);
+    watchdog_leave();
+    watchdog_enter((void (*)(void)) hookq_wake_cb);
+    usleep(150000);
+    watchdog_leave();
+    assert_true(watchdog_print(buf));
+    ldns_buffer_write_u8(buf, 0);
+    out = (char *) ldns_buffer_begin(buf);
+    assert_true(strstr(out, "stalls: 1 over 20 msec") != NULL);
+    p = strstr(out, "last stall: hookq_wake_cb ran ");
+    assert_true(p != NULL);
+    // the total time of the callback, after it is done
+    assert_true(atoi(p + strlen("last stall: hookq_wake_cb ran ")) >= 150);
+    assert_true(strstr(out, "last hook: unbound-control forward_add "
+        "corp.example (done)") != NULL);
+    watchdog_stop();
+    ldns_buffer_clear(buf);
+    assert_true(watchdog_print(buf));
+    ldns_buffer_write_u8(buf, 0);
+    assert_true(strcmp((char *) ldns_buffer_begin(buf), "watchdog off\n") == 0);
+    ldns_buffer_free(buf);
+}
+#endif /* HAVE_PTHREAD */
+
 int main() {
     printf("string_list_test_remove_at_the_beginning: ");
     string_list_test_remove_at_the_beginning();
@@ -266,6 +1216,10 @@ int main() {
     lock_file_check_file_permissions();
     printf("OK\n");
 
+    printf("lock_file_try_busy: ");
+    lock_file_try_busy();
+    printf("OK\n");
+
     printf("store_macro_creation: ");
     store_macro_creation();
     printf("OK\n");
@@ -278,6 +1232,10 @@ int main() {
     store_commit_cache();
     printf("OK\n");
 
+    printf("store_flush_dirty: ");
+    store_flush_dirty();
+    printf("OK\n");
+
     printf("ubhook_list_forwards_test: ");
     ubhook_list_forwards_test();
     printf("OK\n");
@@ -294,6 +1252,14 @@ int main() {
     ubhook_remove_local_zone();
     printf("OK\n");
 
+    printf("ubhook_zone_mirror: ");
+    ubhook_zone_mirror();
+    printf("OK\n");
+
+    printf("zonetree_lookup_and_cover: ");
+    zonetree_lookup_and_cover();
+    printf("OK\n");
+
     printf("nm_list_remove: ");
     nm_list_remove();
     printf("OK\n");
@@ -302,6 +1268,72 @@ int main() {
     string_list_extension();
     printf("OK\n");
 
+    printf("region_alloc_and_free: ");
+    region_alloc_and_free();
+    printf("OK\n");
+
+    printf("memstats_counts_and_peaks: ");
+    memstats_counts_and_peaks();
+    printf("OK\n");
+
+    printf("evprof_counts_and_histogram: ");
+    evprof_counts_and_histogram();
+    printf("OK\n");
+
+    printf("score_select_prefers_working: ");
+    score_select_prefers_working();
+    printf("OK\n");
+
+    printf("score_table_commit: ");
+    score_table_commit();
+    printf("OK\n");
+
+    printf("snapshot_write_and_read: ");
+    snapshot_write_and_read();
+    printf("OK\n");
+
+    printf("ticket_keys_store_and_rotate: ");
+    ticket_keys_store_and_rotate();
+    printf("OK\n");
+
+    printf("http_check_page_content: ");
+    http_check_page_content();
+    printf("OK\n");
+
+    printf("http_addr_cache_expire_and_network: ");
+    http_addr_cache_expire_and_network();
+    printf("OK\n");
+
+    printf("log_ring_keeps_order: ");
+    log_ring_keeps_order();
+    printf("OK\n");
+
+    printf("trace_record_and_dump: ");
+    trace_record_and_dump();
+    printf("OK\n");
+
+    printf("bench_trace_event: ");
+    bench_trace_event();
+    printf("OK\n");
+
+    printf("resolv_write_skips_identical: ");
+    resolv_write_skips_identical();
+    printf("OK\n");
+
+#ifdef HAVE_PTHREAD
+    printf("hookq_ordered_and_async: ");
+    hookq_ordered_and_async();
+    printf("OK\n");
+
+    printf("log_reopen_while_logging: ");
+    log_reopen_while_logging();
+    printf("OK\n");
+
+    printf("watchdog_reports_stall: ");
+    watchdog_reports_stall();
+    printf("OK\n");
+#endif
+
     printf("\n");
     printf("OK\n");
     return 0;
@@ -0,0 +1,604 @@
+#include "../config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#ifndef USE_WINSOCK
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "../riggerd/cfg.h"
+#include "../riggerd/svr.h"
+#include "../riggerd/probe.h"
+#include "../riggerd/netevent.h"
+#include "../riggerd/score.h"
+#include "../riggerd/sched.h"
+#include "../riggerd/http.h"
+#include "../riggerd/update.h"
+#include "simnet.h"
+#include <ldns/ldns.h>
+
+/*
+ * Probe scenarios on the simulated network of test/simnet.c.  The DHCP
+ * provided resolver is CACHE_IP, every other address (root servers and
+ * the tcp80 and tcp443 servers of test/sim.conf) is the default server.
+ */
+
+/** the DHCP provided resolver */
+#define CACHE_IP "192.0.2.1"
+/** virtual msec per step when waiting for the probe result */
+#define SIM_STEP 10
+
+#define assert_true(x) assert_true_fp((x), __FILE__, __LINE__)
+static void assert_true_fp(int x, const char* f, int l)
+{
+	if(!x) {
+		printf("%s:%d: assert_true failed\n", f, l);
+		exit(1);
+	}
+}
+
+#define assert_int_equal(x, y) assert_int_equal_fp((x), (y), __FILE__, __LINE__)
+static void assert_int_equal_fp(int x, int y, const char* f, int l)
+{
+	if(x != y) {
+		printf("%s:%d: assert_int_equal(%d, %d) failed\n", f, l, x, y);
+		exit(1);
+	}
+}
+
+/** create the svr, like svr_create but without listening and SSL */
+static struct svr* sim_svr_create(struct cfg* cfg)
+{
+	struct svr* svr = (struct svr*)calloc(1, sizeof(*svr));
+	assert_true(svr != NULL);
+	global_svr = svr;
+	svr->max_active = 32;
+	svr->cfg = cfg;
+	svr->base = comm_base_create(0);
+	svr->udp_buffer = ldns_buffer_new(65553);
+	svr->retry_timer = comm_timer_create(svr->base, &svr_retry_callback,
+		svr);
+	svr->tcp_timer = comm_timer_create(svr->base, &svr_tcp_callback, svr);
+	svr->scores = score_tab_create();
+	svr->sched = sched_create(svr->base);
+	assert_true(svr->base && svr->udp_buffer && svr->retry_timer &&
+		svr->tcp_timer && svr->scores && svr->sched);
+	sched_set_limits(svr->sched, cfg->probe_inflight, cfg->probe_rate);
+	return svr;
+}
+
+/** setup the network: the DHCP resolver and all the other servers */
+static void sim_network(enum sim_behave cache, enum sim_behave others)
+{
+	sim_server_clear();
+	sim_server(CACHE_IP, cache, 10);
+	sim_server(NULL, others, 40);
+}
+
+/** msec of virtual time since start */
+static int sim_msec(struct svr* svr, struct timeval* start)
+{
+	uint32_t* secs;
+	struct timeval* now;
+	comm_base_timept(svr->base, &secs, &now);
+	return (int)((now->tv_sec - start->tv_sec)*1000 +
+		(now->tv_usec - start->tv_usec)/1000);
+}
+
+/** start the probe for the DHCP resolver and wait until it is done.
+ * @return virtual msec it took, or -1 if not done within max msec. */
+static int sim_probe(struct svr* svr, int max)
+{
+	char ips[64];
+	uint32_t* secs;
+	struct timeval* now, start;
+	comm_base_timept(svr->base, &secs, &now);
+	start = *now;
+	snprintf(ips, sizeof(ips), "%s", CACHE_IP);
+	svr->probetime = 0;
+	probe_start(ips);
+	while(svr->probetime == 0) {
+		if(sim_msec(svr, &start) >= max)
+			return -1;
+		sim_run(svr->base, SIM_STEP);
+	}
+	return sim_msec(svr, &start);
+}
+
+static void sim_cache_works(struct svr* svr)
+{
+	int t;
+	sim_network(sim_works, sim_works);
+	t = sim_probe(svr, 60000);
+	assert_true(t >= 0 && t <= 100);
+	assert_int_equal(svr->res_state, res_cache);
+	/* DNSKEY, DS and NSEC3 to the cache, no fallbacks */
+	assert_int_equal(sim_stats.udp_queries, 3);
+	assert_int_equal(sim_stats.tcp_queries, 0);
+}
+
+static void sim_cache_strips_rrsig(struct svr* svr)
+{
+	int t;
+	sim_network(sim_strip_rrsig, sim_works);
+	t = sim_probe(svr, 60000);
+	assert_true(t >= 0 && t <= 1000);
+	assert_int_equal(svr->res_state, res_auth);
+}
+
+static void sim_cache_truncates(struct svr* svr)
+{
+	int t;
+	sim_network(sim_truncate, sim_works);
+	t = sim_probe(svr, 60000);
+	assert_true(t >= 0 && t <= 1000);
+	assert_int_equal(svr->res_state, res_cache);
+	assert_int_equal(sim_stats.tcp_queries, 3);
+}
+
+static void sim_udp_blocked(struct svr* svr)
+{
+	int t;
+	/* the cache does no DNSSEC, the authorities cannot be reached
+	 * over UDP, and the open resolvers on tcp80 and tcp443 work */
+	sim_network(sim_strip_rrsig, sim_tcp_only);
+	t = sim_probe(svr, 60000);
+	assert_true(t >= QUERY_END_TIMEOUT);
+	assert_int_equal(svr->res_state, res_tcp);
+	assert_true(sim_stats.tcp_queries >= 2);
+}
+
+static void sim_captive_portal(struct svr* svr)
+{
+	int t;
+	sim_network(sim_portal, sim_portal);
+	t = sim_probe(svr, 60000);
+	assert_true(t >= 0);
+	assert_int_equal(svr->res_state, res_dark);
+}
+
+static void sim_offline(struct svr* svr)
+{
+	int t;
+	sim_network(sim_drop, sim_drop);
+	t = sim_probe(svr, 60000);
+	/* UDP to the cache, UDP to the authorities, then TCP, time out */
+	assert_true(t >= 2*QUERY_END_TIMEOUT + QUERY_TCP_TIMEOUT);
+	assert_int_equal(svr->res_state, res_disconn);
+	assert_int_equal(sim_stats.answers, 0);
+}
+
+static void sim_retry_recovers(struct svr* svr)
+{
+	sim_network(sim_drop, sim_drop);
+	assert_true(sim_probe(svr, 60000) >= 0);
+	assert_int_equal(svr->res_state, res_disconn);
+	assert_true(svr->retry_timer_enabled);
+	/* the network comes back without a notification, the retry
+	 * timer probes again */
+	sim_network(sim_works, sim_works);
+	sim_run(svr->base, (svr->retry_timer_timeout+1)*1000);
+	assert_int_equal(svr->res_state, res_cache);
+	assert_true(!svr->retry_timer_enabled);
+}
+
+static void sim_many_resolvers(struct svr* svr)
+{
+	char ips[1024];
+	uint32_t* secs;
+	struct timeval* now, start;
+	int i, t, max = 0;
+	/* DHCP gives 40 resolvers, their 120 queries are paced */
+	sim_network(sim_works, sim_works);
+	ips[0] = 0;
+	for(i=1; i<=40; i++)
+		snprintf(ips+strlen(ips), sizeof(ips)-strlen(ips),
+			"192.0.2.%d ", i);
+	sched_set_limits(svr->sched, 8, 100);
+	comm_base_timept(svr->base, &secs, &now);
+	start = *now;
+	svr->probetime = 0;
+	probe_start(ips);
+	while(svr->probetime == 0) {
+		assert_true(sim_msec(svr, &start) < 60000);
+		if(svr->sched->inflight > max)
+			max = svr->sched->inflight;
+		sim_run(svr->base, SIM_STEP);
+	}
+	t = sim_msec(svr, &start);
+	assert_int_equal(svr->res_state, res_cache);
+	assert_int_equal(sim_stats.udp_queries, 120);
+	assert_true(max <= 8);
+	/* a burst of 8, then 100 per second */
+	assert_true(t >= 1000 && t <= 2000);
+	assert_int_equal(svr->sched->inflight, 0);
+	assert_int_equal(svr->sched->num_queued, 0);
+	sched_set_limits(svr->sched, global_svr->cfg->probe_inflight,
+		global_svr->cfg->probe_rate);
+}
+
+/** a network for the churn test, and the state it should end up in */
+struct sim_phase {
+	/** the DHCP resolver */
+	enum sim_behave cache;
+	/** all other servers */
+	enum sim_behave others;
+	/** the resulting state */
+	int res_state;
+};
+
+static void sim_churn(struct svr* svr)
+{
+	const struct sim_phase phases[] = {
+		{ sim_works, sim_works, res_cache },
+		{ sim_strip_rrsig, sim_works, res_auth },
+		{ sim_portal, sim_portal, res_dark },
+		{ sim_truncate, sim_works, res_cache },
+		{ sim_drop, sim_drop, res_disconn },
+		{ sim_strip_rrsig, sim_tcp_only, res_tcp },
+		{ sim_strip_rrsig, sim_strip_rrsig, res_dark }
+	};
+	int num = (int)(sizeof(phases)/sizeof(phases[0]));
+	int hours = 24, period = 600; /* seconds per network change */
+	int i, t;
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	for(i=0; i<hours*3600/period; i++) {
+		const struct sim_phase* p = &phases[(i*3)%num];
+		/* network changes, like NetworkManager tells us */
+		sim_network(p->cache, p->others);
+		t = sim_probe(svr, period*1000);
+		assert_true(t >= 0);
+		assert_int_equal(svr->res_state, p->res_state);
+		/* retries and tcp reprobes until the next change, they
+		 * end up in the same state */
+		sim_run(svr->base, period*1000 - t);
+		assert_int_equal(svr->res_state, p->res_state);
+	}
+	gettimeofday(&end, NULL);
+	printf("%d hours, %d network changes in %d msec ", hours, i,
+		(int)((end.tv_sec-start.tv_sec)*1000 +
+		(end.tv_usec-start.tv_usec)/1000));
+}
+
+#ifndef USE_WINSOCK
+/** the commands of the session test, in turn */
+static const char* sim_session_cmd(int i)
+{
+	const char* cmds[] = { "status", "foo", "memstats" };
+	return cmds[i%3];
+}
+
+/** send commands first to last-1 of the session test to the server */
+static void sim_session_send(int fd, int first, int last)
+{
+	char line[64];
+	int i;
+	for(i=first; i<last; i++) {
+		snprintf(line, sizeof(line), "%s\n", sim_session_cmd(i));
+		assert_true(send(fd, line, strlen(line), 0) ==
+			(ssize_t)strlen(line));
+	}
+}
+
+/** read what the server has written so far, it is zero terminated.
+ * @return the length, or -1 if the server has closed the connection */
+static int sim_session_read(int fd, char* buf, size_t len)
+{
+	size_t n = 0;
+	ssize_t r;
+	while(n+1 < len) {
+		r = recv(fd, buf+n, len-n-1, MSG_DONTWAIT);
+		if(r == 0 && n == 0)
+			return -1;
+		if(r <= 0)
+			break;
+		n += (size_t)r;
+	}
+	buf[n] = 0;
+	return (int)n;
+}
+
+/** check the replies that are read, they are for the commands from
+ * number *num onwards, in order.  @return the number of replies */
+static int sim_session_replies(char* buf, int* num)
+{
+	int count = 0;
+	unsigned len;
+	char* p = buf, *payload;
+	const char* cmd;
+	while(*p) {
+		assert_true(sscanf(p, "reply %u\n", &len) == 1);
+		payload = strchr(p, '\n') + 1;
+		assert_true(strlen(payload) >= len);
+		cmd = sim_session_cmd(*num);
+		if(strcmp(cmd, "status") == 0) {
+			assert_true(strstr(payload, "state: ") != NULL &&
+				strstr(payload, "state: ") < payload+len);
+		} else if(strcmp(cmd, "foo") == 0) {
+			assert_true(len == strlen("error unknown command\n") &&
+				strncmp(payload, "error unknown command\n", len)
+				== 0);
+		} else {
+			assert_true(strstr(payload, "total: bytes") != NULL &&
+				strstr(payload, "total: bytes") < payload+len);
+		}
+		p = payload + len;
+		(*num)++;
+		count++;
+	}
+	return count;
+}
+
+static void sim_control_session(struct svr* svr)
+{
+	char buf[65536], hdr[64];
+	struct sslconn* sc;
+	int fd, num = 0, total = 2*SESSION_QUEUE_MAX + SESSION_QUEUE_MAX/2;
+	fd = sim_connect();
+	assert_true(fd != -1);
+	/* the commands are there when the server reads the first line */
+	snprintf(hdr, sizeof(hdr), "DNSTRIG%d session\n", CONTROL_VERSION);
+	assert_true(send(fd, hdr, strlen(hdr), 0) == (ssize_t)strlen(hdr));
+	sim_session_send(fd, 0, total);
+	(void)handle_unix_accept(NULL, NULL, NETEVENT_NOERROR, NULL);
+	sc = svr->busy_list;
+	assert_true(sc != NULL && sc->line_state == session_cmds);
+
+	/* a window of commands is read and queued, the replies are
+	 * written at the next event, then the next window is read */
+	snprintf(hdr, sizeof(hdr), "ok session %d\n", SESSION_QUEUE_MAX);
+	assert_true(sim_session_read(fd, buf, sizeof(buf)) > 0);
+	assert_true(strcmp(buf, hdr) == 0);
+	assert_true(sim_raw_event(sc->c));
+	assert_true(sim_session_read(fd, buf, sizeof(buf)) > 0);
+	assert_int_equal(sim_session_replies(buf, &num), SESSION_QUEUE_MAX);
+	assert_true(sim_raw_event(sc->c));
+	assert_true(sim_session_read(fd, buf, sizeof(buf)) > 0);
+	assert_int_equal(sim_session_replies(buf, &num), SESSION_QUEUE_MAX);
+	assert_true(sim_raw_event(sc->c));
+	assert_true(sim_session_read(fd, buf, sizeof(buf)) > 0);
+	assert_int_equal(sim_session_replies(buf, &num), SESSION_QUEUE_MAX/2);
+	assert_int_equal(num, total);
+	/* all done, the server waits for commands */
+	assert_true(!sim_raw_event(sc->c));
+	assert_int_equal(sim_session_read(fd, buf, sizeof(buf)), 0);
+	assert_true(svr->busy_list == sc);
+
+	/* more commands later, and an EOF in the middle of a line; the
+	 * replies to the whole lines are written, then it is closed */
+	sim_session_send(fd, total, total+5);
+	assert_true(send(fd, "stat", 4, 0) == 4);
+	assert_true(shutdown(fd, SHUT_WR) == 0);
+	assert_true(sim_raw_event(sc->c));
+	assert_true(svr->busy_list == sc && sc->close_me);
+	assert_true(sim_raw_event(sc->c));
+	assert_true(svr->busy_list == NULL);
+	assert_int_equal(svr->active, 0);
+	assert_true(sim_session_read(fd, buf, sizeof(buf)) > 0);
+	assert_int_equal(sim_session_replies(buf, &num), 5);
+	assert_int_equal(sim_session_read(fd, buf, sizeof(buf)), -1);
+	close(fd);
+}
+
+/* the addresses of the http race test, on the loopback */
+/** accepts the connection */
+#define RACE_LIVE "127.0.0.1"
+/** the connect gets no answer, the accept queue is full */
+#define RACE_DEAD "127.0.0.2"
+/** the connect is refused, nothing listens */
+#define RACE_REFUSED "127.0.0.3"
+/** also refused */
+#define RACE_REFUSED2 "127.0.0.4"
+
+/** listen on ip and port, or a free port if 0.  @return the socket */
+static int sim_listen(const char* ip, int* port, int backlog)
+{
+	struct sockaddr_in sa;
+	socklen_t len = (socklen_t)sizeof(sa);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert_true(fd != -1);
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons((uint16_t)*port);
+	assert_true(inet_pton(AF_INET, ip, &sa.sin_addr) == 1);
+	assert_true(bind(fd, (struct sockaddr*)&sa, len) == 0);
+	assert_true(listen(fd, backlog) == 0);
+	assert_true(getsockname(fd, (struct sockaddr*)&sa, &len) == 0);
+	*port = (int)ntohs(sa.sin_port);
+	return fd;
+}
+
+/** wait (in real time) until the connect on the comm point is done */
+static void sim_connect_wait(struct comm_point* c)
+{
+	struct pollfd p;
+	memset(&p, 0, sizeof(p));
+	p.fd = c->fd;
+	p.events = POLLOUT;
+	assert_true(poll(&p, 1, 1000) == 1);
+}
+
+/** start the http get of the race, to the addresses in turn; it is the
+ * download of the selfupdate, that gets the result */
+static struct http_get* sim_race_start(struct svr* svr, const char* a,
+	const char* b, int port)
+{
+	char* err = NULL;
+	struct http_get* hg = http_get_create(
+		"http://race.example.net/page.txt", svr->base, NULL);
+	assert_true(hg != NULL);
+	assert_true(http_get_add_dest(hg, b));
+	svr->update->download_http4 = hg;
+	assert_true(http_get_fetch(hg, a, port, &err));
+	assert_int_equal(hg->race_num, 2);
+	/* the first address is tried, and the timer for the next is set */
+	assert_true(hg->race_cp[0] != NULL && hg->race_cp[1] == NULL);
+	assert_true(comm_timer_is_set(hg->race_timer));
+	return hg;
+}
+
+/** check that the race is won by the live address; the others are
+ * closed, and the request is sent to the winner */
+static void sim_race_won(struct svr* svr, struct http_get* hg, int live)
+{
+	char buf[1024];
+	ssize_t r;
+	int fd;
+	assert_true(hg->cp != NULL);
+	assert_true(hg->race_cp[0] == NULL && hg->race_cp[1] == NULL);
+	assert_true(!comm_timer_is_set(hg->race_timer));
+	assert_true(strcmp(hg->dest, RACE_LIVE) == 0);
+	fd = accept(live, NULL, NULL);
+	assert_true(fd != -1);
+	r = recv(fd, buf, sizeof(buf)-1, 0);
+	assert_true(r > 0);
+	buf[r] = 0;
+	assert_true(strncmp(buf, "GET /page.txt HTTP/1.1\r\n", 24) == 0);
+	close(fd);
+	svr->update->download_http4 = NULL;
+	http_get_delete(hg);
+}
+
+static void sim_http_race(struct svr* svr)
+{
+	struct http_get* hg;
+	struct sockaddr_in sa;
+	int port = 0, live, dead, fill, timers;
+	svr->update = selfupdate_create(svr, svr->cfg);
+	assert_true(svr->update != NULL);
+	/* no downloads other than the ones of the test */
+	svr->update_desired = 0;
+	live = sim_listen(RACE_LIVE, &port, 5);
+	dead = sim_listen(RACE_DEAD, &port, 0);
+	/* fill the accept queue, the next connects get no answer */
+	fill = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons((uint16_t)port);
+	assert_true(inet_pton(AF_INET, RACE_DEAD, &sa.sin_addr) == 1);
+	assert_true(connect(fill, (struct sockaddr*)&sa, sizeof(sa)) == 0);
+
+	/* the dead address is first, the live one is tried after the
+	 * delay, and wins; the connect to the dead one is cancelled */
+	hg = sim_race_start(svr, RACE_DEAD, RACE_LIVE, port);
+	assert_true(!sim_raw_event(hg->race_cp[0]));
+	sim_run(svr->base, HTTP_RACE_DELAY-1);
+	assert_true(hg->race_cp[1] == NULL);
+	sim_run(svr->base, 1);
+	assert_true(hg->race_cp[0] != NULL && hg->race_cp[1] != NULL);
+	sim_connect_wait(hg->race_cp[1]);
+	assert_true(sim_raw_event(hg->race_cp[1]));
+	sim_race_won(svr, hg, live);
+
+	/* the first connect fails, the next is started right away, it
+	 * does not wait for the delay */
+	hg = sim_race_start(svr, RACE_REFUSED, RACE_LIVE, port);
+	sim_connect_wait(hg->race_cp[0]);
+	assert_true(sim_raw_event(hg->race_cp[0]));
+	assert_true(hg->race_cp[0] == NULL && hg->race_cp[1] != NULL);
+	assert_true(hg->cp == NULL);
+	sim_connect_wait(hg->race_cp[1]);
+	assert_true(sim_raw_event(hg->race_cp[1]));
+	sim_race_won(svr, hg, live);
+
+	/* all connects fail: the get is done, with its timers, and the
+	 * selfupdate sets its retry timer */
+	timers = sim_timers(svr->base);
+	hg = sim_race_start(svr, RACE_REFUSED, RACE_REFUSED2, port);
+	assert_int_equal(sim_timers(svr->base), timers+2);
+	sim_connect_wait(hg->race_cp[0]);
+	assert_true(sim_raw_event(hg->race_cp[0]));
+	assert_true(svr->update->download_http4 == hg);
+	assert_true(hg->race_cp[1] != NULL);
+	sim_connect_wait(hg->race_cp[1]);
+	assert_true(sim_raw_event(hg->race_cp[1]));
+	assert_true(svr->update->download_http4 == NULL);
+	assert_true(comm_timer_is_set(svr->update->timer));
+	assert_int_equal(sim_timers(svr->base), timers+1);
+	comm_timer_disable(svr->update->timer);
+	assert_int_equal(sim_timers(svr->base), timers);
+
+	/* the dead address and a refused one: the race waits for the dead
+	 * connect until the timeout of the get */
+	hg = sim_race_start(svr, RACE_DEAD, RACE_REFUSED, port);
+	sim_run(svr->base, HTTP_RACE_DELAY);
+	assert_true(hg->race_cp[1] != NULL);
+	sim_connect_wait(hg->race_cp[1]);
+	assert_true(sim_raw_event(hg->race_cp[1]));
+	assert_true(hg->race_cp[0] != NULL && hg->race_cp[1] == NULL);
+	assert_true(!comm_timer_is_set(hg->race_timer));
+	sim_run(svr->base, HTTP_TIMEOUT);
+	assert_true(svr->update->download_http4 == NULL);
+	comm_timer_disable(svr->update->timer);
+
+	close(fill);
+	close(dead);
+	close(live);
+	selfupdate_delete(svr->update);
+	svr->update = NULL;
+}
+#endif /* USE_WINSOCK */
+
+int main(void) {
+	struct cfg* cfg = cfg_create("test/sim.conf");
+	struct svr* svr;
+	assert_true(cfg != NULL);
+	svr = sim_svr_create(cfg);
+
+	printf("sim_cache_works: ");
+	sim_cache_works(svr);
+	printf("OK\n");
+
+	printf("sim_cache_strips_rrsig: ");
+	sim_cache_strips_rrsig(svr);
+	printf("OK\n");
+
+	printf("sim_cache_truncates: ");
+	sim_cache_truncates(svr);
+	printf("OK\n");
+
+	printf("sim_udp_blocked: ");
+	sim_udp_blocked(svr);
+	printf("OK\n");
+
+	printf("sim_captive_portal: ");
+	sim_captive_portal(svr);
+	printf("OK\n");
+
+	printf("sim_offline: ");
+	sim_offline(svr);
+	printf("OK\n");
+
+	printf("sim_retry_recovers: ");
+	sim_retry_recovers(svr);
+	printf("OK\n");
+
+	printf("sim_many_resolvers: ");
+	sim_many_resolvers(svr);
+	printf("OK\n");
+
+	printf("sim_churn: ");
+	sim_churn(svr);
+	printf("OK\n");
+
+#ifndef USE_WINSOCK
+	printf("sim_control_session: ");
+	sim_control_session(svr);
+	printf("OK\n");
+
+	printf("sim_http_race: ");
+	sim_http_race(svr);
+	printf("OK\n");
+#endif
+
+	svr_delete(svr);
+	cfg_delete(cfg);
+	sim_server_clear();
+	return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * test/simanswer.c - dnssec-trigger scripted DNS answers for tests
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the answers of the scripted DNS servers, in wire
+ * format, built from the query without ldns.
+ */
+#include "../config.h"
+#include "simanswer.h"
+#include <ldns/ldns.h>
+
+/** append data to the answer, false if it does not fit */
+static int sim_put(uint8_t* buf, size_t* pos, size_t max, const void* d,
+	size_t len)
+{
+	if(*pos + len > max)
+		return 0;
+	memmove(buf + *pos, d, len);
+	*pos += len;
+	return 1;
+}
+
+/** append a resource record, owned by the qname, to the answer */
+static int sim_rr(uint8_t* buf, size_t* pos, size_t max, int type,
+	const uint8_t* rdata, size_t rdlen)
+{
+	uint8_t hdr[12];
+	hdr[0] = 0xc0; /* compression pointer to the qname */
+	hdr[1] = LDNS_HEADER_SIZE;
+	hdr[2] = (uint8_t)(type>>8);
+	hdr[3] = (uint8_t)type;
+	hdr[4] = 0; /* class IN */
+	hdr[5] = LDNS_RR_CLASS_IN;
+	hdr[6] = 0; /* TTL 3600 */
+	hdr[7] = 0;
+	hdr[8] = 0x0e;
+	hdr[9] = 0x10;
+	hdr[10] = (uint8_t)(rdlen>>8);
+	hdr[11] = (uint8_t)rdlen;
+	return sim_put(buf, pos, max, hdr, sizeof(hdr)) &&
+		sim_put(buf, pos, max, rdata, rdlen);
+}
+
+/** append the RR and an RRSIG for it, unless the sigs are stripped */
+static int sim_rrset(uint8_t* buf, size_t* pos, size_t max, int type,
+	const uint8_t* rdata, size_t rdlen, int labels, int sigs, int* count)
+{
+	uint8_t sig[18+1+32];
+	if(!sim_rr(buf, pos, max, type, rdata, rdlen))
+		return 0;
+	(*count)++;
+	if(!sigs)
+		return 1;
+	/* the content does not verify, the probe only looks at types */
+	memset(sig, 0x5a, sizeof(sig));
+	sig[0] = (uint8_t)(type>>8);
+	sig[1] = (uint8_t)type;
+	sig[2] = 8; /* algorithm */
+	sig[3] = (uint8_t)labels;
+	sig[4] = 0; /* original TTL */
+	sig[5] = 0;
+	sig[6] = 0x0e;
+	sig[7] = 0x10;
+	sig[16] = 0x12; /* key tag */
+	sig[17] = 0x34;
+	sig[18] = 0; /* signer is the root */
+	if(!sim_rr(buf, pos, max, LDNS_RR_TYPE_RRSIG, sig, sizeof(sig)))
+		return 0;
+	(*count)++;
+	return 1;
+}
+
+/** create the answer, see simanswer.h */
+size_t sim_answer(const uint8_t* q, size_t qlen,
+	enum sim_behave behave, int tcp, uint8_t* buf, size_t max)
+{
+	size_t pos = LDNS_HEADER_SIZE;
+	int qtype, rd, labels = 0, an = 0, ns = 0, ar = 0, ok = 1;
+	int sigs = (behave != sim_strip_rrsig);
+	uint8_t rdata[64];
+	if(behave == sim_drop || (behave == sim_tcp_only && !tcp))
+		return 0;
+	if(qlen < LDNS_HEADER_SIZE || (q[2]&0x80))
+		return 0; /* not a query */
+	/* the probes send the qname uncompressed */
+	while(pos < qlen && q[pos] != 0) {
+		if(q[pos] > 63)
+			return 0;
+		labels++;
+		pos += q[pos]+1;
+	}
+	pos += 5; /* root label, qtype, qclass */
+	if(pos > qlen || pos > max)
+		return 0;
+	qtype = (q[pos-4]<<8) | q[pos-3];
+	rd = (q[2]&0x01);
+	memmove(buf, q, pos);
+	buf[2] = 0x80 | rd; /* QR, opcode QUERY */
+	buf[3] = (q[3]&0x10); /* CD */
+	if(rd || behave == sim_portal)
+		buf[3] |= 0x80; /* RA */
+	if(!rd && behave != sim_portal)
+		buf[2] |= 0x04; /* AA */
+
+	memset(rdata, 0xa5, sizeof(rdata));
+	if(behave == sim_truncate && !tcp) {
+		buf[2] |= 0x02; /* TC */
+	} else if(behave == sim_portal) {
+		/* everything resolves to the login page */
+		rdata[0] = 10; rdata[1] = 0; rdata[2] = 0; rdata[3] = 1;
+		ok = sim_rr(buf, &pos, max, LDNS_RR_TYPE_A, rdata, 4);
+		an++;
+	} else if(qtype == LDNS_RR_TYPE_DNSKEY) {
+		rdata[0] = 1; /* flags 257, KSK */
+		rdata[1] = 1;
+		rdata[2] = 3; /* protocol */
+		rdata[3] = 8; /* algorithm */
+		ok = sim_rrset(buf, &pos, max, qtype, rdata, 4+32, labels,
+			sigs, &an);
+	} else if(qtype == LDNS_RR_TYPE_DS) {
+		rdata[0] = 0x12; /* key tag */
+		rdata[1] = 0x34;
+		rdata[2] = 8; /* algorithm */
+		rdata[3] = 2; /* digest type, SHA256 */
+		ok = sim_rrset(buf, &pos, max, qtype, rdata, 4+32, labels,
+			sigs, &an);
+	} else if(qtype == LDNS_RR_TYPE_A) {
+		rdata[0] = 192; rdata[1] = 0; rdata[2] = 2; rdata[3] = 80;
+		ok = sim_rrset(buf, &pos, max, qtype, rdata, 4, labels,
+			sigs, &an);
+	} else {
+		/* nodata, with the NSEC3 that the probe asks for */
+		rdata[0] = 1; /* hash algorithm */
+		rdata[1] = 0; /* flags */
+		rdata[2] = 0; /* iterations */
+		rdata[3] = 0;
+		rdata[4] = 0; /* salt length */
+		rdata[5] = 20; /* hash length, then hash */
+		rdata[26] = 0; /* type bitmap window 0, with A */
+		rdata[27] = 1;
+		rdata[28] = 0x40;
+		ok = sim_rrset(buf, &pos, max, LDNS_RR_TYPE_NSEC3, rdata, 29,
+			labels, sigs, &ns);
+	}
+	if(ok && (q[10] || q[11])) {
+		/* OPT record with DO flag, the query had EDNS */
+		const uint8_t opt[11] = {0, 0, 41, 0x10, 0, 0, 0, 0x80, 0,
+			0, 0};
+		ok = sim_put(buf, &pos, max, opt, sizeof(opt));
+		ar++;
+	}
+	if(!ok)
+		return 0;
+	buf[6] = (uint8_t)(an>>8);
+	buf[7] = (uint8_t)an;
+	buf[8] = (uint8_t)(ns>>8);
+	buf[9] = (uint8_t)ns;
+	buf[10] = (uint8_t)(ar>>8);
+	buf[11] = (uint8_t)ar;
+	return pos;
+}
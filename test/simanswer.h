@@ -0,0 +1,86 @@
+/*
+ * test/simanswer.h - dnssec-trigger scripted DNS answers for tests
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * The answers of the scripted DNS servers, for the simulated network of
+ * test/simnet.c and the loopback servers of the benchmark, test/bench.c.
+ * They have the DNSKEY, DS and NSEC3 records (and RRSIGs) that the probes
+ * look for, the content of the records is not real.
+ */
+
+#ifndef SIMANSWER_H
+#define SIMANSWER_H
+
+/** max size of a scripted answer */
+#define SIM_MAX_ANSWER 1024
+/** the address in the A records of the servers that work */
+#define SIM_WEB_IP "192.0.2.80"
+/** the address in the A records of the captive portal */
+#define SIM_PORTAL_IP "10.0.0.1"
+
+/**
+ * What a simulated server does with the queries that it gets.
+ */
+enum sim_behave {
+	/** answer with DNSSEC data, recursive if RD, else authoritative */
+	sim_works = 0,
+	/** never answer, queries time out */
+	sim_drop,
+	/** answer, but strip the RRSIGs from it */
+	sim_strip_rrsig,
+	/** answer UDP with the TC flag, and works over TCP */
+	sim_truncate,
+	/** drop UDP, and works over TCP */
+	sim_tcp_only,
+	/** captive portal: every query gets the A record of the portal */
+	sim_portal
+};
+
+/**
+ * Create the answer of a server to a query.
+ * @param q: the query.
+ * @param qlen: length of the query.
+ * @param behave: what the server does.
+ * @param tcp: if the query came over TCP.
+ * @param buf: the answer is returned here.
+ * @param max: size of buf.
+ * @return length of the answer, or 0 if no answer is sent.
+ */
+size_t sim_answer(const uint8_t* q, size_t qlen, enum sim_behave behave,
+	int tcp, uint8_t* buf, size_t max);
+
+#endif /* SIMANSWER_H */
@@ -0,0 +1,805 @@
+/*
+ * test/simnet.c - dnssec-trigger simulated network for tests
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * This file contains the simulation build of the comm_base, it implements
+ * the functions of riggerd/netevent.h on a virtual clock, with a list of
+ * pending events (timers and answers) sorted by time.  Sockets are still
+ * opened by the caller, but nothing is sent on them: UDP queries and TCP
+ * connections go to the scripted servers of the simulated network.
+ * The control connections are real sockets, a socketpair with the test,
+ * and their events are performed by sim_raw_event.
+ */
+#include "../config.h"
+#include "../riggerd/netevent.h"
+#include "../riggerd/log.h"
+#include "../riggerd/net_help.h"
+#include "../riggerd/fptr_wlist.h"
+#include "simnet.h"
+#include "simanswer.h"
+#include <ldns/ldns.h>
+#include <openssl/ssl.h>
+#ifndef USE_WINSOCK
+#include <poll.h>
+#endif
+
+struct sim_stats sim_stats;
+
+/** the server end of the connection made by sim_connect, or -1 */
+static int sim_accept_fd = -1;
+
+/**
+ * A server in the simulated network.
+ */
+struct sim_server {
+	/** next in list */
+	struct sim_server* next;
+	/** address of the server, NULL for the default server */
+	char* ip;
+	/** what it does */
+	enum sim_behave behave;
+	/** round trip time in msec */
+	int delay;
+};
+
+/** the servers of the simulated network */
+static struct sim_server* sim_servers = NULL;
+
+/**
+ * A pending event, a timer that fires or an answer that arrives.
+ */
+struct sim_event {
+	/** next in the list, sorted by time */
+	struct sim_event* next;
+	/** when the event happens */
+	struct timeval when;
+	/** the timer that fires, or NULL */
+	struct comm_timer* timer;
+	/** the comm point for the answer, or NULL */
+	struct comm_point* c;
+	/** error for the callback, NETEVENT_NOERROR if data is an answer */
+	int error;
+	/** the answer, malloced */
+	uint8_t* data;
+	/** length of the answer */
+	size_t len;
+	/** where the answer comes from */
+	struct sockaddr_storage addr;
+	/** length of addr */
+	socklen_t addrlen;
+};
+
+/**
+ * The simulated base, with the virtual clock.
+ */
+struct internal_base {
+	/** seconds time pointer points here */
+	uint32_t secs;
+	/** timeval with current (virtual) time */
+	struct timeval now;
+	/** the pending events, sorted by time */
+	struct sim_event* events;
+	/** if the dispatch has to stop */
+	int exit;
+};
+
+/**
+ * Event info of a comm point.
+ */
+struct internal_event {
+	/** the comm base */
+	struct comm_base* base;
+	/** raw comm points: listen for read, and for write */
+	int rd, wr;
+};
+
+/**
+ * Event info of a timer.
+ */
+struct internal_timer {
+	/** the comm base */
+	struct comm_base* base;
+	/** is timer enabled */
+	uint8_t enabled;
+};
+
+/**
+ * Signals are not simulated.
+ */
+struct internal_signal {
+	/** the signal number */
+	int sig;
+};
+
+/* ------ the simulated servers ------ */
+
+void sim_server(const char* ip, enum sim_behave behave, int delay)
+{
+	struct sim_server* s;
+	for(s = sim_servers; s; s = s->next) {
+		if((!ip && !s->ip) || (ip && s->ip && strcmp(ip, s->ip) == 0))
+			break;
+	}
+	if(!s) {
+		s = (struct sim_server*)calloc(1, sizeof(*s));
+		if(!s) fatal_exit("out of memory");
+		if(ip && !(s->ip = strdup(ip)))
+			fatal_exit("out of memory");
+		s->next = sim_servers;
+		sim_servers = s;
+	}
+	s->behave = behave;
+	s->delay = delay;
+}
+
+void sim_server_clear(void)
+{
+	struct sim_server* s = sim_servers, *n;
+	while(s) {
+		n = s->next;
+		free(s->ip);
+		free(s);
+		s = n;
+	}
+	sim_servers = NULL;
+	memset(&sim_stats, 0, sizeof(sim_stats));
+}
+
+/** find the server for an address, the default one if not listed */
+static struct sim_server* sim_lookup(struct sockaddr_storage* addr,
+	socklen_t addrlen)
+{
+	struct sim_server* s, *def = NULL;
+	struct sockaddr_storage a;
+	socklen_t alen;
+	for(s = sim_servers; s; s = s->next) {
+		if(!s->ip) {
+			def = s;
+			continue;
+		}
+		if(ipstrtoaddr(s->ip, 0, &a, &alen) &&
+			sockaddr_cmp_addr(&a, alen, addr, addrlen) == 0)
+			return s;
+	}
+	return def;
+}
+
+/* ------ the events ------ */
+
+/** a is earlier than b */
+static int tv_smaller(struct timeval* a, struct timeval* b)
+{
+	return a->tv_sec < b->tv_sec ||
+		(a->tv_sec == b->tv_sec && a->tv_usec < b->tv_usec);
+}
+
+/** set tv to now + msec */
+static void tv_later(struct timeval* tv, struct timeval* now, long msec)
+{
+	tv->tv_sec = now->tv_sec + msec/1000;
+	tv->tv_usec = now->tv_usec + (msec%1000)*1000;
+	if(tv->tv_usec >= 1000000) {
+		tv->tv_sec++;
+		tv->tv_usec -= 1000000;
+	}
+}
+
+/** add event to the list, after the events at the same time */
+static void sim_event_insert(struct internal_base* eb, struct sim_event* ev)
+{
+	struct sim_event** pp = &eb->events;
+	while(*pp && !tv_smaller(&ev->when, &(*pp)->when))
+		pp = &(*pp)->next;
+	ev->next = *pp;
+	*pp = ev;
+}
+
+/** remove the events for the comm point or the timer */
+static void sim_event_remove(struct internal_base* eb, struct comm_point* c,
+	struct comm_timer* tm)
+{
+	struct sim_event** pp = &eb->events, *ev;
+	while(*pp) {
+		ev = *pp;
+		if((c && ev->c == c) || (tm && ev->timer == tm)) {
+			*pp = ev->next;
+			free(ev->data);
+			free(ev);
+		} else	pp = &ev->next;
+	}
+}
+
+/** schedule an answer, or an error, for a comm point */
+static void sim_deliver(struct comm_point* c, int delay, int error,
+	uint8_t* data, size_t len, struct sockaddr_storage* addr,
+	socklen_t addrlen)
+{
+	struct internal_base* eb = c->ev->base->eb;
+	struct sim_event* ev = (struct sim_event*)calloc(1, sizeof(*ev));
+	if(!ev) fatal_exit("out of memory");
+	tv_later(&ev->when, &eb->now, delay);
+	ev->c = c;
+	ev->error = error;
+	if(data && !(ev->data = memdup(data, len)))
+		fatal_exit("out of memory");
+	ev->len = len;
+	memmove(&ev->addr, addr, addrlen);
+	ev->addrlen = addrlen;
+	sim_event_insert(eb, ev);
+}
+
+/** a tcp_out comm point has connected and writes its query */
+static void sim_tcp_query(struct comm_point* c)
+{
+	uint8_t buf[SIM_MAX_ANSWER];
+	size_t len;
+	struct sim_server* s = sim_lookup(&c->repinfo.addr,
+		c->repinfo.addrlen);
+	sim_stats.tcp_queries++;
+	if(!s)
+		return;
+	if(c->ssl) {
+		/* SSL is not simulated, the connection fails */
+		sim_deliver(c, s->delay, NETEVENT_CLOSED, NULL, 0,
+			&c->repinfo.addr, c->repinfo.addrlen);
+		return;
+	}
+	len = sim_answer(ldns_buffer_begin(c->buffer),
+		ldns_buffer_limit(c->buffer), s->behave, 1, buf, sizeof(buf));
+	if(len)
+		sim_deliver(c, s->delay, NETEVENT_NOERROR, buf, len,
+			&c->repinfo.addr, c->repinfo.addrlen);
+}
+
+/** perform the first event, it is taken off the list */
+static void sim_event_perform(struct internal_base* eb)
+{
+	struct sim_event* ev = eb->events;
+	struct comm_point* c = ev->c;
+	struct comm_reply rep;
+	eb->events = ev->next;
+	eb->now = ev->when;
+	eb->secs = (uint32_t)eb->now.tv_sec;
+	if(ev->timer) {
+		struct comm_timer* tm = ev->timer;
+		free(ev);
+		tm->ev_timer->enabled = 0;
+		sim_stats.timeouts++;
+		fptr_ok(fptr_whitelist_comm_timer(tm->callback));
+		(*tm->callback)(tm->cb_arg);
+		return;
+	}
+	fptr_ok(fptr_whitelist_comm_point(c->callback));
+	if(ev->error != NETEVENT_NOERROR) {
+		int error = ev->error;
+		free(ev);
+		(void)(*c->callback)(c, c->cb_arg, error, NULL);
+		return;
+	}
+	ldns_buffer_clear(c->buffer);
+	ldns_buffer_write(c->buffer, ev->data, ev->len);
+	ldns_buffer_flip(c->buffer);
+	memset(&rep, 0, sizeof(rep));
+	rep.c = c;
+	memmove(&rep.addr, &ev->addr, ev->addrlen);
+	rep.addrlen = ev->addrlen;
+	free(ev->data);
+	free(ev);
+	sim_stats.answers++;
+	/* the callback can delete the comm point */
+	(void)(*c->callback)(c, c->cb_arg, NETEVENT_NOERROR, &rep);
+}
+
+void sim_run(struct comm_base* base, int msec)
+{
+	struct internal_base* eb = base->eb;
+	struct timeval end;
+	tv_later(&end, &eb->now, msec);
+	eb->exit = 0;
+	while(eb->events && !tv_smaller(&end, &eb->events->when) &&
+		!eb->exit)
+		sim_event_perform(eb);
+	eb->now = end;
+	eb->secs = (uint32_t)eb->now.tv_sec;
+}
+
+int sim_timers(struct comm_base* base)
+{
+	struct sim_event* ev;
+	int n = 0;
+	for(ev = base->eb->events; ev; ev = ev->next)
+		if(ev->timer)
+			n++;
+	return n;
+}
+
+/* ------ the comm base ------ */
+
+struct comm_base*
+comm_base_create(int ATTR_UNUSED(sigs))
+{
+	struct comm_base* b = (struct comm_base*)calloc(1,
+		sizeof(struct comm_base));
+	if(!b)
+		return NULL;
+	b->eb = (struct internal_base*)calloc(1, sizeof(struct internal_base));
+	if(!b->eb) {
+		free(b);
+		return NULL;
+	}
+	b->eb->now.tv_sec = SIM_START_TIME;
+	b->eb->secs = SIM_START_TIME;
+	return b;
+}
+
+void
+comm_base_delete(struct comm_base* b)
+{
+	struct sim_event* ev, *n;
+	if(!b)
+		return;
+	for(ev = b->eb->events; ev; ev = n) {
+		n = ev->next;
+		free(ev->data);
+		free(ev);
+	}
+	free(b->eb);
+	free(b);
+}
+
+void
+comm_base_timept(struct comm_base* b, uint32_t** tt, struct timeval** tv)
+{
+	*tt = &b->eb->secs;
+	*tv = &b->eb->now;
+}
+
+void
+comm_base_dispatch(struct comm_base* b)
+{
+	b->eb->exit = 0;
+	while(b->eb->events && !b->eb->exit)
+		sim_event_perform(b->eb);
+}
+
+void comm_base_exit(struct comm_base* b)
+{
+	b->eb->exit = 1;
+}
+
+struct event_base* comm_base_internal(struct comm_base* ATTR_UNUSED(b))
+{
+	return NULL;
+}
+
+/* ------ the comm points ------ */
+
+/** create a comm point of a type */
+static struct comm_point* sim_point_create(struct comm_base* base, int fd,
+	enum comm_point_type type, comm_point_callback_t* callback,
+	void* callback_arg)
+{
+	struct comm_point* c = (struct comm_point*)calloc(1,
+		sizeof(struct comm_point));
+	if(!c)
+		return NULL;
+	c->ev = (struct internal_event*)calloc(1,
+		sizeof(struct internal_event));
+	if(!c->ev) {
+		free(c);
+		return NULL;
+	}
+	c->ev->base = base;
+	c->fd = fd;
+	c->type = type;
+	c->repinfo.c = c;
+	c->callback = callback;
+	c->cb_arg = callback_arg;
+	return c;
+}
+
+struct comm_point*
+comm_point_create_udp(struct comm_base *base, int fd, ldns_buffer* buffer,
+	comm_point_callback_t* callback, void* callback_arg)
+{
+	struct comm_point* c = sim_point_create(base, fd, comm_udp,
+		callback, callback_arg);
+	if(c)
+		c->buffer = buffer;
+	return c;
+}
+
+struct comm_point*
+comm_point_create_udp_ancil(struct comm_base *base, int fd,
+	ldns_buffer* buffer,
+	comm_point_callback_t* callback, void* callback_arg)
+{
+	return comm_point_create_udp(base, fd, buffer, callback,
+		callback_arg);
+}
+
+struct comm_point*
+comm_point_create_tcp(struct comm_base *base, int fd, int ATTR_UNUSED(num),
+	size_t ATTR_UNUSED(bufsize), comm_point_callback_t* callback,
+	void* callback_arg)
+{
+	/* there are no clients in the simulation, no handlers needed */
+	return sim_point_create(base, fd, comm_tcp_accept, callback,
+		callback_arg);
+}
+
+struct comm_point*
+comm_point_create_tcp_out(struct comm_base *base, size_t bufsize,
+	comm_point_callback_t* callback, void* callback_arg)
+{
+	struct comm_point* c = sim_point_create(base, -1, comm_tcp,
+		callback, callback_arg);
+	if(!c)
+		return NULL;
+	c->buffer = ldns_buffer_new(bufsize);
+	if(!c->buffer) {
+		free(c->ev);
+		free(c);
+		return NULL;
+	}
+	c->tcp_do_toggle_rw = 1;
+	c->tcp_check_nb_connect = 1;
+	return c;
+}
+
+struct comm_point*
+comm_point_create_local(struct comm_base *base, int fd, size_t bufsize,
+	comm_point_callback_t* callback, void* callback_arg)
+{
+	struct comm_point* c = sim_point_create(base, fd, comm_local,
+		callback, callback_arg);
+	if(!c)
+		return NULL;
+	c->buffer = ldns_buffer_new(bufsize);
+	if(!c->buffer) {
+		free(c->ev);
+		free(c);
+		return NULL;
+	}
+	return c;
+}
+
+struct comm_point*
+comm_point_create_raw(struct comm_base* base, int fd, int writing,
+	comm_point_callback_t* callback, void* callback_arg)
+{
+	struct comm_point* c = sim_point_create(base, fd, comm_raw,
+		callback, callback_arg);
+	if(c) {
+		c->ev->rd = !writing;
+		c->ev->wr = writing;
+	}
+	return c;
+}
+
+void
+comm_point_close(struct comm_point* c)
+{
+	if(!c)
+		return;
+	sim_event_remove(c->ev->base->eb, c, NULL);
+	if(c->fd != -1 && !c->do_not_close)
+		close(c->fd);
+	c->fd = -1;
+}
+
+void
+comm_point_delete(struct comm_point* c)
+{
+	if(!c)
+		return;
+	if(c->type == comm_tcp && c->ssl)
+		SSL_free(c->ssl);
+	comm_point_close(c);
+	free(c->timeout);
+	if(c->type == comm_tcp || c->type == comm_local)
+		ldns_buffer_free(c->buffer);
+	free(c->ev);
+	free(c);
+}
+
+void
+comm_point_send_reply(struct comm_reply* ATTR_UNUSED(repinfo))
+{
+	/* there are no clients in the simulation */
+}
+
+void
+comm_point_drop_reply(struct comm_reply* ATTR_UNUSED(repinfo))
+{
+}
+
+int
+comm_point_send_udp_msg(struct comm_point *c, ldns_buffer* packet,
+	struct sockaddr* addr, socklen_t addrlen)
+{
+	uint8_t buf[SIM_MAX_ANSWER];
+	size_t len;
+	struct sim_server* s = sim_lookup((struct sockaddr_storage*)addr,
+		addrlen);
+	sim_stats.udp_queries++;
+	if(!s)
+		return 1; /* nobody there, the packet is lost */
+	len = sim_answer(ldns_buffer_current(packet),
+		ldns_buffer_remaining(packet), s->behave, 0, buf, sizeof(buf));
+	if(len)
+		sim_deliver(c, s->delay, NETEVENT_NOERROR, buf, len,
+			(struct sockaddr_storage*)addr, addrlen);
+	return 1;
+}
+
+int
+comm_point_connect_tcp_out(int ATTR_UNUSED(fd),
+	struct sockaddr* ATTR_UNUSED(addr), socklen_t ATTR_UNUSED(addrlen))
+{
+	/* the connection is made when the comm point starts listening */
+	errno = EINPROGRESS;
+	return -1;
+}
+
+void
+comm_point_stop_listening(struct comm_point* c)
+{
+	sim_event_remove(c->ev->base->eb, c, NULL);
+}
+
+void
+comm_point_start_listening(struct comm_point* c, int newfd,
+	int ATTR_UNUSED(sec))
+{
+	if(newfd != -1) {
+		if(c->fd != -1 && !c->do_not_close)
+			close(c->fd);
+		c->fd = newfd;
+	}
+	if(c->type == comm_tcp && c->tcp_check_nb_connect &&
+		!c->tcp_is_reading)
+		sim_tcp_query(c);
+}
+
+void
+comm_point_listen_for_rw(struct comm_point* c, int rd, int wr)
+{
+	c->ev->rd = rd;
+	c->ev->wr = wr;
+}
+
+int
+comm_point_perform_accept(struct comm_point* ATTR_UNUSED(c),
+	struct sockaddr_storage* addr, socklen_t* addrlen)
+{
+	int s = sim_accept_fd;
+	sim_accept_fd = -1;
+	if(s != -1) {
+		memset(addr, 0, sizeof(*addr));
+		addr->ss_family = AF_UNIX;
+		*addrlen = (socklen_t)sizeof(sa_family_t);
+	}
+	return s;
+}
+
+#ifndef USE_WINSOCK
+int sim_connect(void)
+{
+	int sv[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		log_err("socketpair: %s", strerror(errno));
+		return -1;
+	}
+	if(sim_accept_fd != -1)
+		close(sim_accept_fd);
+	fd_set_nonblock(sv[0]);
+	sim_accept_fd = sv[0];
+	return sv[1];
+}
+
+int sim_raw_event(struct comm_point* c)
+{
+	struct pollfd p;
+	memset(&p, 0, sizeof(p));
+	p.fd = c->fd;
+	p.events = (c->ev->rd?POLLIN:0) | (c->ev->wr?POLLOUT:0);
+	if(p.events == 0 || poll(&p, 1, 0) <= 0 || p.revents == 0)
+		return 0;
+	fptr_ok(fptr_whitelist_comm_point_raw(c->callback));
+	/* the callback can delete the comm point */
+	(void)(*c->callback)(c, c->cb_arg, NETEVENT_NOERROR, NULL);
+	return 1;
+}
+#endif /* USE_WINSOCK */
+
+size_t
+comm_point_get_mem(struct comm_point* c)
+{
+	if(!c)
+		return 0;
+	return sizeof(*c) + sizeof(*c->ev);
+}
+
+/* the event callbacks are on the function pointer whitelist, but in the
+ * simulation the events are performed by sim_run */
+
+void
+comm_point_udp_callback(int ATTR_UNUSED(fd), short ATTR_UNUSED(event),
+	void* ATTR_UNUSED(arg))
+{
+}
+
+void
+comm_point_udp_ancil_callback(int ATTR_UNUSED(fd), short ATTR_UNUSED(event),
+	void* ATTR_UNUSED(arg))
+{
+}
+
+void
+comm_point_tcp_accept_callback(int ATTR_UNUSED(fd), short ATTR_UNUSED(event),
+	void* ATTR_UNUSED(arg))
+{
+}
+
+void
+comm_point_tcp_handle_callback(int ATTR_UNUSED(fd), short ATTR_UNUSED(event),
+	void* ATTR_UNUSED(arg))
+{
+}
+
+void
+comm_point_local_handle_callback(int ATTR_UNUSED(fd),
+	short ATTR_UNUSED(event), void* ATTR_UNUSED(arg))
+{
+}
+
+void
+comm_point_raw_handle_callback(int ATTR_UNUSED(fd), short ATTR_UNUSED(event),
+	void* ATTR_UNUSED(arg))
+{
+}
+
+/* ------ the timers ------ */
+
+struct comm_timer*
+comm_timer_create(struct comm_base* base, void (*cb)(void*), void* cb_arg)
+{
+	struct comm_timer *tm = (struct comm_timer*)calloc(1,
+		sizeof(struct comm_timer));
+	if(!tm)
+		return NULL;
+	tm->ev_timer = (struct internal_timer*)calloc(1,
+		sizeof(struct internal_timer));
+	if(!tm->ev_timer) {
+		log_err("malloc failed");
+		free(tm);
+		return NULL;
+	}
+	tm->ev_timer->base = base;
+	tm->callback = cb;
+	tm->cb_arg = cb_arg;
+	return tm;
+}
+
+void
+comm_timer_disable(struct comm_timer* timer)
+{
+	if(!timer)
+		return;
+	sim_event_remove(timer->ev_timer->base->eb, NULL, timer);
+	timer->ev_timer->enabled = 0;
+}
+
+void
+comm_timer_set(struct comm_timer* timer, struct timeval* tv)
+{
+	struct internal_base* eb = timer->ev_timer->base->eb;
+	struct sim_event* ev;
+	log_assert(tv);
+	comm_timer_disable(timer);
+	ev = (struct sim_event*)calloc(1, sizeof(*ev));
+	if(!ev) fatal_exit("out of memory");
+	tv_later(&ev->when, &eb->now, (long)tv->tv_sec*1000 +
+		(long)tv->tv_usec/1000);
+	ev->timer = timer;
+	sim_event_insert(eb, ev);
+	timer->ev_timer->enabled = 1;
+}
+
+void
+comm_timer_delete(struct comm_timer* timer)
+{
+	if(!timer)
+		return;
+	comm_timer_disable(timer);
+	free(timer->ev_timer);
+	free(timer);
+}
+
+void
+comm_timer_callback(int ATTR_UNUSED(fd), short ATTR_UNUSED(event),
+	void* ATTR_UNUSED(arg))
+{
+}
+
+int
+comm_timer_is_set(struct comm_timer* timer)
+{
+	return (int)timer->ev_timer->enabled;
+}
+
+size_t
+comm_timer_get_mem(struct comm_timer* ATTR_UNUSED(timer))
+{
+	return sizeof(struct comm_timer) + sizeof(struct internal_timer);
+}
+
+/* ------ the signals, not simulated ------ */
+
+struct comm_signal*
+comm_signal_create(struct comm_base* base,
+	void (*callback)(int, void*), void* cb_arg)
+{
+	struct comm_signal* s = (struct comm_signal*)calloc(1,
+		sizeof(struct comm_signal));
+	if(!s)
+		return NULL;
+	s->base = base;
+	s->callback = callback;
+	s->cb_arg = cb_arg;
+	return s;
+}
+
+int
+comm_signal_bind(struct comm_signal* ATTR_UNUSED(comsig),
+	int ATTR_UNUSED(sig))
+{
+	return 1;
+}
+
+void
+comm_signal_delete(struct comm_signal* comsig)
+{
+	free(comsig);
+}
+
+void
+comm_signal_callback(int ATTR_UNUSED(sig), short ATTR_UNUSED(event),
+	void* ATTR_UNUSED(arg))
+{
+}
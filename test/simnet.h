@@ -0,0 +1,117 @@
+/*
+ * test/simnet.h - dnssec-trigger simulated network for tests
+ *
+ * Copyright (c) 2011, NLnet Labs. All rights reserved.
+ *
+ * This software is open source.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * Neither the name of the NLNET LABS nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *
+ * The simulation build of the comm_base (test/simnet.c replaces
+ * riggerd/netevent.c).  Time is virtual, it only moves when the next
+ * event is due, and the queries that the probes send go to scripted
+ * servers in memory, not to the network.  So hours of probing take
+ * milliseconds, and the results are the same every run.
+ */
+
+#ifndef SIMNET_H
+#define SIMNET_H
+#include "simanswer.h"
+struct comm_base;
+struct comm_point;
+
+/** the virtual clock starts at this time, in seconds since 1970 */
+#define SIM_START_TIME 1000000000
+
+/**
+ * Counters of the simulated network, for the tests to check.
+ */
+struct sim_stats {
+	/** number of UDP queries sent */
+	int udp_queries;
+	/** number of TCP queries sent */
+	int tcp_queries;
+	/** number of answers delivered */
+	int answers;
+	/** number of timer callbacks */
+	int timeouts;
+};
+
+/** the counters, zeroed by sim_server_clear */
+extern struct sim_stats sim_stats;
+
+/**
+ * Add a server to the simulated network, or change the behaviour of
+ * a server that is already there.
+ * @param ip: IP address of the server, on all ports.  NULL for all other
+ *	addresses, such as the root servers.
+ * @param behave: what the server does.
+ * @param delay: round trip time in msec.
+ */
+void sim_server(const char* ip, enum sim_behave behave, int delay);
+
+/** remove all servers from the simulated network, and zero the stats */
+void sim_server_clear(void);
+
+/**
+ * Run the events of the comm base, for the given amount of virtual time.
+ * The clock is at now+msec afterwards.
+ * @param base: the (simulated) comm base.
+ * @param msec: virtual time to run.
+ */
+void sim_run(struct comm_base* base, int msec);
+
+/**
+ * Count the timers that are set.
+ * @param base: the (simulated) comm base.
+ * @return the number of timers that are set on the comm base.
+ */
+int sim_timers(struct comm_base* base);
+
+#ifndef USE_WINSOCK
+/**
+ * Connect to the control socket.  The next accept returns the server
+ * end of the connection, it is nonblocking.
+ * @return the client end of the connection, or -1 on failure.
+ */
+int sim_connect(void);
+
+/**
+ * Perform an event on a raw comm point, such as a control connection,
+ * if its socket is ready for the read or write that it listens for.
+ * @param c: the comm point.  It can be deleted by the callback.
+ * @return true if the callback was called.
+ */
+int sim_raw_event(struct comm_point* c);
+#endif
+
+#endif /* SIMNET_H */
@@ -13,10 +13,26 @@ then
 	if [ $1 = "local_zone_remove" ] && [ $2 = "test" ]
 	then
 		echo ok
+	elif [ $1 = "forward_remove" ] && [ $2 = "test" ]
+	then
+		echo ok
+	else
+		echo fail
+	fi
+elif [ $# -eq 1 ]
+then
+	if [ $1 = "list_forwards" ]
+	then
+		cat test/list_forwards_example
+	elif [ $1 = "list_local_zones" ]
+	then
+		cat test/list_local_zones_example
 	else
 		echo fail
 	fi
+elif [ $# -ge 4 ] && [ $1 = "forward_add" ] && [ $2 = "+i" ]
+then
+	echo ok
 else
 	echo fail
 fi
-